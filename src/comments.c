@@ -0,0 +1,235 @@
+#include "comments.h"
+#include "memory.h"
+#include <glib.h>
+#include <jansson.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static const char* const REDDIT_URL = "https://www.reddit.com";
+static const size_t INITIAL_COMMENTS_CAPACITY = 64;
+
+static struct comment_thread* new_comment_thread(void) {
+    struct comment_thread* thread = LOG_ERR_MALLOC(struct comment_thread, 1);
+    thread->items = NULL;
+    thread->count = 0;
+    thread->capacity = 0;
+    thread->arena = new_arena();
+    return thread;
+}
+
+static void reserve_comments(struct comment_thread* thread, size_t count) {
+    if (count <= thread->capacity)
+        return;
+    size_t capacity = thread->capacity ? thread->capacity : INITIAL_COMMENTS_CAPACITY;
+    while (capacity < count) {
+        capacity *= 2;
+    }
+    thread->items = g_renew(struct comment, thread->items, capacity);
+    thread->capacity = capacity;
+}
+
+static const char* arena_strdup_or_null(struct arena* arena, const char* str) {
+    return str ? arena_strdup(arena, str) : NULL;
+}
+
+// "t1_kx3f9a2" to "kx3f9a2".
+static const char* strip_kind(const char* fullname) {
+    const char* underscore = fullname ? strchr(fullname, '_') : NULL;
+    return underscore ? underscore + 1 : fullname;
+}
+
+// Appends the comment or row of hidden comments thing stands for. Returns false for anything else, e.g. deleted
+// things without data.
+static bool append_thing(struct comment_thread* thread, json_t* thing, const char* article, uint32_t depth) {
+    const char* kind = json_string_value(json_object_get(thing, "kind"));
+    json_t* data = json_object_get(thing, "data");
+    if (!kind || !json_is_object(data))
+        return false;
+    bool is_more = strcmp(kind, "more") == 0;
+    if (!is_more && strcmp(kind, "t1") != 0)
+        return false;
+    json_t* depth_json = json_object_get(data, "depth");
+    struct comment row = {
+        .id = NULL,
+        .depth = json_is_integer(depth_json) ? (uint32_t)json_integer_value(depth_json) : depth,
+        .author = NULL,
+        .body = NULL,
+        .score = 0,
+        .url = NULL,
+        .is_more = is_more,
+        .more_ids = NULL,
+        .more_count = 0,
+    };
+    struct arena* arena = thread->arena;
+    if (is_more) {
+        json_t* children = json_object_get(data, "children");
+        row.more_count = json_array_size(children);
+        row.more_ids = arena_alloc(arena, sizeof(const char*) * (row.more_count ? row.more_count : 1));
+        size_t i = 0;
+        json_t* child = NULL;
+        json_array_foreach(children, i, child) {
+            row.more_ids[i] = arena_strdup(arena, json_string_value(child) ? json_string_value(child) : "");
+        }
+        // "continue this thread" links lead to the parent's page, where the branch starts over at depth 0
+        const char* parent = strip_kind(json_string_value(json_object_get(data, "parent_id")));
+        if (row.more_count == 0 && parent)
+            row.url = arena_printf(arena, "%s/comments/%s/_/%s/", REDDIT_URL, article, parent);
+    } else {
+        row.id = arena_strdup_or_null(arena, json_string_value(json_object_get(data, "id")));
+        row.author = arena_strdup_or_null(arena, json_string_value(json_object_get(data, "author")));
+        row.body = arena_strdup_or_null(arena, json_string_value(json_object_get(data, "body")));
+        row.score = (int32_t)json_integer_value(json_object_get(data, "score"));
+        const char* permalink = json_string_value(json_object_get(data, "permalink"));
+        row.url = permalink ? arena_printf(arena, "%s%s", REDDIT_URL, permalink) : NULL;
+        if (!row.body) {
+            fprintf(stderr, "No body found for comment.\n");
+            return false;
+        }
+    }
+    reserve_comments(thread, thread->count + 1);
+    thread->items[thread->count++] = row;
+    return true;
+}
+
+// Appends the things of a listing, each followed by its replies.
+static void flatten_listing(struct comment_thread* thread, json_t* listing, const char* article, uint32_t depth) {
+    json_t* children = json_object_get(json_object_get(listing, "data"), "children");
+    size_t i = 0;
+    json_t* child = NULL;
+    json_array_foreach(children, i, child) {
+        if (!append_thing(thread, child, article, depth))
+            continue;
+        // a listing of their own, or "" for comments without replies
+        json_t* replies = json_object_get(json_object_get(child, "data"), "replies");
+        if (json_is_object(replies))
+            flatten_listing(thread, replies, article, thread->items[thread->count - 1].depth + 1);
+    }
+}
+
+static json_t* load_json(const struct response_buffer* resp) {
+    json_error_t error;
+    json_t* root = json_loadb(resp->buffer, resp->size, 0, &error);
+    if (!root)
+        fprintf(stderr, "Error deserializing comments: %s\n", error.text);
+    return root;
+}
+
+struct comment_thread* deserialize_comment_thread(const struct response_buffer* resp, const char* article) {
+    json_t* root = load_json(resp);
+    if (!root)
+        return NULL;
+    // the thread's own listing comes first, then the comments
+    json_t* comments = json_array_get(root, 1);
+    if (!json_is_object(comments)) {
+        fprintf(stderr, "Comments response of thread %s holds no comments.\n", article);
+        json_decref(root);
+        return NULL;
+    }
+    struct comment_thread* thread = new_comment_thread();
+    flatten_listing(thread, comments, article, 0);
+    json_decref(root);
+    return thread;
+}
+
+// Appends thing and, recursively, the things whose parent it is. children and next hold the first child and the next
+// sibling of every thing by position, -1 for none. placed marks the things already visited, so that none is visited
+// twice and the recursion ends even if parent_ids were to loop.
+static void append_in_order(struct comment_thread* thread, json_t* things, gssize index, const gssize* children,
+                            const gssize* next, bool* placed, const char* article, uint32_t depth) {
+    for (gssize i = index; i >= 0 && !placed[i]; i = next[i]) {
+        placed[i] = true;
+        bool appended = append_thing(thread, json_array_get(things, (size_t)i), article, depth);
+        uint32_t child_depth = appended ? thread->items[thread->count - 1].depth + 1 : depth;
+        if (children[i] >= 0)
+            append_in_order(thread, things, children[i], children, next, placed, article, child_depth);
+    }
+}
+
+struct comment_thread* deserialize_more_comments(const struct response_buffer* resp, const char* article,
+                                                 uint32_t depth) {
+    json_t* root = load_json(resp);
+    if (!root)
+        return NULL;
+    json_t* things = json_object_get(json_object_get(json_object_get(root, "json"), "data"), "things");
+    if (!json_is_array(things)) {
+        fprintf(stderr, "More comments response of thread %s holds no comments.\n", article);
+        json_decref(root);
+        return NULL;
+    }
+    size_t count = json_array_size(things);
+    gssize* children = g_new(gssize, count);
+    gssize* next = g_new(gssize, count);
+    gssize* last_child = g_new(gssize, count);
+    GHashTable* positions = g_hash_table_new(g_str_hash, g_str_equal);
+    for (size_t i = 0; i < count; i++) {
+        children[i] = next[i] = last_child[i] = -1;
+        json_t* data = json_object_get(json_array_get(things, i), "data");
+        const char* name = json_string_value(json_object_get(data, "name"));
+        if (name)
+            g_hash_table_insert(positions, (gpointer)name, GSIZE_TO_POINTER(i + 1));
+    }
+    // things whose parent isn't among them reply to the comment the row of hidden comments belonged to
+    gssize first_root = -1;
+    gssize last_root = -1;
+    for (size_t i = 0; i < count; i++) {
+        json_t* data = json_object_get(json_array_get(things, i), "data");
+        const char* parent_id = json_string_value(json_object_get(data, "parent_id"));
+        gsize parent = parent_id ? GPOINTER_TO_SIZE(g_hash_table_lookup(positions, parent_id)) : 0;
+        gssize* first = parent ? &children[parent - 1] : &first_root;
+        gssize* last = parent ? &last_child[parent - 1] : &last_root;
+        if (*last >= 0) {
+            next[*last] = (gssize)i;
+        } else {
+            *first = (gssize)i;
+        }
+        *last = (gssize)i;
+    }
+    struct comment_thread* thread = new_comment_thread();
+    bool* placed = g_new0(bool, count);
+    if (first_root >= 0)
+        append_in_order(thread, things, first_root, children, next, placed, article, depth);
+    // things whose parent_ids lead in a circle never hang below the row they replace, there is nowhere to show them
+    size_t dropped = 0;
+    for (size_t i = 0; i < count; i++) {
+        dropped += placed[i] ? 0 : 1;
+    }
+    if (dropped > 0)
+        fprintf(stderr, "Dropped %zu comments of thread %s replying to each other in a circle.\n", dropped, article);
+    g_free(placed);
+    g_hash_table_destroy(positions);
+    g_free(children);
+    g_free(next);
+    g_free(last_child);
+    json_decref(root);
+    return thread;
+}
+
+void replace_more_comments(struct comment_thread* thread, size_t index, struct comment_thread* loaded,
+                           size_t requested) {
+    struct comment more = thread->items[index];
+    size_t remaining = more.more_count > requested ? more.more_count - requested : 0;
+    size_t added = loaded->count + (remaining > 0 ? 1 : 0);
+    reserve_comments(thread, thread->count - 1 + added);
+    memmove(&thread->items[index + added], &thread->items[index + 1],
+            sizeof(struct comment) * (thread->count - index - 1));
+    if (loaded->count > 0)
+        memcpy(&thread->items[index], loaded->items, sizeof(struct comment) * loaded->count);
+    if (remaining > 0) {
+        more.more_ids += requested;
+        more.more_count = remaining;
+        thread->items[index + loaded->count] = more;
+    }
+    thread->count = thread->count - 1 + added;
+    arena_adopt(thread->arena, loaded->arena);
+    g_free(loaded->items);
+    free(loaded);
+}
+
+void free_comment_thread(struct comment_thread* thread) {
+    if (!thread)
+        return;
+    free_arena(thread->arena);
+    g_free(thread->items);
+    free(thread);
+}
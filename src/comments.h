@@ -0,0 +1,53 @@
+#ifndef COMMENTS_H
+#define COMMENTS_H
+
+#include "curl_wrappers.h"
+#include "memory.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// One row of a comment tree flattened in reading order: every comment is followed by its replies.
+struct comment {
+    // e.g. "kx3f9a2", NULL for rows of hidden comments
+    const char* id;
+    // 0 for replies to the thread itself
+    uint32_t depth;
+    const char* author;
+    const char* body;
+    int32_t score;
+    // the comment's page, or for a branch nested too deep to load here, its parent's page
+    const char* url;
+    // stands for comments Reddit left out, which are loaded by replacing this row through replace_more_comments
+    bool is_more;
+    // ids of the hidden comments, empty for branches nested too deep, which Reddit only shows on a page of their own
+    const char** more_ids;
+    size_t more_count;
+};
+
+// The loaded part of a thread's comments. Hidden comments only take up a row each until they are loaded, so memory
+// grows with what has been expanded rather than with the size of the thread.
+struct comment_thread {
+    struct comment* items;
+    size_t count;
+    size_t capacity;
+    // owns the strings of every item
+    struct arena* arena;
+};
+
+// Parses the response of /comments/<article>. NULL if it isn't shaped like one.
+struct comment_thread* deserialize_comment_thread(const struct response_buffer* resp, const char* article);
+
+// Parses the response of /api/morechildren. Reddit lists those comments flat, so they are put back in reading order,
+// with depth as the depth of the row they replace for the ones that don't say. NULL if it isn't shaped like one.
+struct comment_thread* deserialize_more_comments(const struct response_buffer* resp, const char* article,
+                                                 uint32_t depth);
+
+// Replaces the row of hidden comments at index with the first requested of them, loaded, taking ownership of loaded.
+// The row stays, standing for the rest, if there are more than requested.
+void replace_more_comments(struct comment_thread* thread, size_t index, struct comment_thread* loaded,
+                           size_t requested);
+
+void free_comment_thread(struct comment_thread* thread);
+
+#endif
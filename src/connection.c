@@ -0,0 +1,87 @@
+#include "connection.h"
+#include "memory.h"
+#include <curl/curl.h>
+#include <glib.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+static const long TCP_KEEPIDLE_SECONDS = 60L;
+static const long TCP_KEEPINTVL_SECONDS = 30L;
+
+struct connection_pool {
+    CURLSH* share;
+    GMutex locks[CURL_LOCK_DATA_LAST];
+};
+
+static void lock_shared_data(CURL* client, curl_lock_data data, curl_lock_access access, void* user_data) {
+    struct connection_pool* pool = (struct connection_pool*)user_data;
+    g_mutex_lock(&pool->locks[data]);
+}
+
+static void unlock_shared_data(CURL* client, curl_lock_data data, void* user_data) {
+    struct connection_pool* pool = (struct connection_pool*)user_data;
+    g_mutex_unlock(&pool->locks[data]);
+}
+
+struct connection_pool* new_connection_pool(bool share_connections) {
+    struct connection_pool* pool = LOG_ERR_MALLOC(struct connection_pool, 1);
+    pool->share = curl_share_init();
+    if (!pool->share) {
+        fprintf(stderr, "Failed to initialize CURL share. Connections won't be reused.\n");
+        free(pool);
+        return NULL;
+    }
+    for (int i = 0; i < CURL_LOCK_DATA_LAST; i++) {
+        g_mutex_init(&pool->locks[i]);
+    }
+    curl_share_setopt(pool->share, CURLSHOPT_LOCKFUNC, lock_shared_data);
+    curl_share_setopt(pool->share, CURLSHOPT_UNLOCKFUNC, unlock_shared_data);
+    curl_share_setopt(pool->share, CURLSHOPT_USERDATA, pool);
+    curl_share_setopt(pool->share, CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS);
+    curl_share_setopt(pool->share, CURLSHOPT_SHARE, CURL_LOCK_DATA_SSL_SESSION);
+    if (share_connections)
+        curl_share_setopt(pool->share, CURLSHOPT_SHARE, CURL_LOCK_DATA_CONNECT);
+    return pool;
+}
+
+void use_connection_pool(CURL* client, struct connection_pool* pool) {
+    if (pool)
+        curl_easy_setopt(client, CURLOPT_SHARE, pool->share);
+    // falls back to HTTP/1.1 when libcurl was built without nghttp2
+    curl_easy_setopt(client, CURLOPT_HTTP_VERSION, CURL_HTTP_VERSION_2TLS);
+    // wait for an in-progress connection to the host to multiplex over it rather than opening a parallel one
+    curl_easy_setopt(client, CURLOPT_PIPEWAIT, 1L);
+    curl_easy_setopt(client, CURLOPT_TCP_KEEPALIVE, 1L);
+    curl_easy_setopt(client, CURLOPT_TCP_KEEPIDLE, TCP_KEEPIDLE_SECONDS);
+    curl_easy_setopt(client, CURLOPT_TCP_KEEPINTVL, TCP_KEEPINTVL_SECONDS);
+    // required for DNS timeouts to work when transfers run outside the main thread
+    curl_easy_setopt(client, CURLOPT_NOSIGNAL, 1L);
+}
+
+void log_connection_reuse(CURL* client, const char* request_name) {
+    long new_connections = 0;
+    curl_off_t tls_done_us = 0;
+    curl_off_t connect_done_us = 0;
+    curl_easy_getinfo(client, CURLINFO_NUM_CONNECTS, &new_connections);
+    curl_easy_getinfo(client, CURLINFO_CONNECT_TIME_T, &connect_done_us);
+    curl_easy_getinfo(client, CURLINFO_APPCONNECT_TIME_T, &tls_done_us);
+    if (new_connections == 0) {
+        fprintf(stdout, "%s reused an open connection.\n", request_name);
+    } else {
+        fprintf(stdout,
+                "%s opened %ld connection(s): connect %" CURL_FORMAT_CURL_OFF_T " us, TLS handshake %" CURL_FORMAT_CURL_OFF_T
+                " us.\n",
+                request_name, new_connections, connect_done_us, tls_done_us - connect_done_us);
+    }
+}
+
+void free_connection_pool(struct connection_pool* pool) {
+    if (!pool)
+        return;
+    curl_share_cleanup(pool->share);
+    for (int i = 0; i < CURL_LOCK_DATA_LAST; i++) {
+        g_mutex_clear(&pool->locks[i]);
+    }
+    free(pool);
+}
@@ -0,0 +1,23 @@
+#ifndef CONNECTION_H
+#define CONNECTION_H
+
+#include <curl/curl.h>
+#include <stdbool.h>
+
+// DNS cache, TLS sessions and live connections shared by every CURL handle of the app, so that requests after the
+// first one (to either Reddit host) skip resolving and handshaking.
+struct connection_pool;
+
+// libcurl doesn't support sharing live connections between transfers running at the same time on several threads, so
+// share_connections is only for handles that take turns; the others still share DNS and TLS sessions.
+struct connection_pool* new_connection_pool(bool share_connections);
+
+// Applies sharing, HTTP/2 and keepalive options. Needs to be called again after curl_easy_reset.
+void use_connection_pool(CURL* client, struct connection_pool* pool);
+
+// Prints how many connections the last transfer had to open and how long its TLS handshake took.
+void log_connection_reuse(CURL* client, const char* request_name);
+
+void free_connection_pool(struct connection_pool* pool);
+
+#endif
@@ -1,14 +1,24 @@
 #include "curl_wrappers.h"
 #include "memory.h"
 #include <curl/curl.h>
+#include <glib.h>
+#include <stdbool.h>
 #include <stdlib.h>
+#include <string.h>
 
-static const int INITIAL_RESPONSE_BUFFER_SIZE = (256 * 1024);
+// Error bodies and access tokens fit, listings are streamed into the parser and never buffered.
+static const size_t INITIAL_RESPONSE_BUFFER_CAPACITY = 4096;
+// a few concurrent fetches' worth
+static const size_t MAX_POOLED_RESPONSE_BUFFERS = 8;
+// larger buffers are freed on release rather than holding on to their memory
+static const size_t MAX_POOLED_RESPONSE_BUFFER_CAPACITY = 1024 * 1024;
 
 struct response_buffer* new_response_buffer() {
     struct response_buffer* resp = (struct response_buffer*)LOG_ERR_MALLOC(struct response_buffer, 1);
-    resp->buffer = LOG_ERR_MALLOC(char, INITIAL_RESPONSE_BUFFER_SIZE);
+    resp->buffer = LOG_ERR_MALLOC(char, INITIAL_RESPONSE_BUFFER_CAPACITY);
+    resp->buffer[0] = '\0';
     resp->size = 0;
+    resp->capacity = INITIAL_RESPONSE_BUFFER_CAPACITY;
     return resp;
 }
 
@@ -17,16 +27,115 @@ void free_response_buffer(struct response_buffer* resp) {
     free(resp);
 }
 
+size_t write_to_response_buffer(char* buffer, size_t chunks, size_t chunk_size, void* stream) {
+    struct response_buffer* resp = (struct response_buffer*)stream;
+    size_t realsize = chunks * chunk_size;
+    size_t needed = resp->size + realsize + 1;
+    if (needed > resp->capacity) {
+        size_t capacity = resp->capacity > 0 ? resp->capacity : INITIAL_RESPONSE_BUFFER_CAPACITY;
+        while (capacity < needed) {
+            capacity *= 2;
+        }
+        char* ptr = realloc(resp->buffer, capacity);
+        // tells curl to abort the transfer
+        if (!ptr)
+            return 0;
+        resp->buffer = ptr;
+        resp->capacity = capacity;
+    }
+    memcpy(&(resp->buffer[resp->size]), buffer, realsize);
+    resp->size += realsize;
+    resp->buffer[resp->size] = 0;
+    return realsize;
+}
+
+struct response_buffer_pool {
+    GMutex lock;
+    GPtrArray* idle;
+    struct response_buffer_pool_stats stats;
+};
+
+struct response_buffer_pool* new_response_buffer_pool() {
+    struct response_buffer_pool* pool = LOG_ERR_MALLOC(struct response_buffer_pool, 1);
+    g_mutex_init(&pool->lock);
+    pool->idle = g_ptr_array_sized_new(MAX_POOLED_RESPONSE_BUFFERS);
+    pool->stats = (struct response_buffer_pool_stats){0};
+    return pool;
+}
+
+struct response_buffer* acquire_response_buffer(struct response_buffer_pool* pool) {
+    if (!pool)
+        return new_response_buffer();
+    g_mutex_lock(&pool->lock);
+    struct response_buffer* resp = NULL;
+    if (pool->idle->len > 0)
+        resp = g_ptr_array_remove_index(pool->idle, pool->idle->len - 1);
+    pool->stats.acquired++;
+    if (resp)
+        pool->stats.reused++;
+    g_mutex_unlock(&pool->lock);
+    if (!resp)
+        return new_response_buffer();
+    resp->size = 0;
+    resp->buffer[0] = '\0';
+    return resp;
+}
+
+void release_response_buffer(struct response_buffer_pool* pool, struct response_buffer* resp) {
+    if (!resp)
+        return;
+    if (!pool) {
+        free_response_buffer(resp);
+        return;
+    }
+    g_mutex_lock(&pool->lock);
+    if (resp->capacity > pool->stats.high_water_mark)
+        pool->stats.high_water_mark = resp->capacity;
+    bool keep = pool->idle->len < MAX_POOLED_RESPONSE_BUFFERS && resp->capacity <= MAX_POOLED_RESPONSE_BUFFER_CAPACITY;
+    if (keep)
+        g_ptr_array_add(pool->idle, resp);
+    g_mutex_unlock(&pool->lock);
+    if (!keep)
+        free_response_buffer(resp);
+}
+
+struct response_buffer_pool_stats response_buffer_pool_stats(struct response_buffer_pool* pool) {
+    g_mutex_lock(&pool->lock);
+    struct response_buffer_pool_stats stats = pool->stats;
+    g_mutex_unlock(&pool->lock);
+    return stats;
+}
+
+void free_response_buffer_pool(struct response_buffer_pool* pool) {
+    if (!pool)
+        return;
+    for (guint i = 0; i < pool->idle->len; i++) {
+        free_response_buffer(g_ptr_array_index(pool->idle, i));
+    }
+    g_ptr_array_free(pool->idle, TRUE);
+    g_mutex_clear(&pool->lock);
+    free(pool);
+}
+
 long* get_response_status(CURL* client) {
     long* http_code = (long*)malloc(sizeof(long));
     curl_easy_getinfo(client, CURLINFO_RESPONSE_CODE, http_code);
     return http_code;
 }
 
+char* get_response_header(CURL* client, const char* name) {
+    struct curl_header* header = NULL;
+    if (curl_easy_header(client, name, 0, CURLH_HEADER, -1, &header) != CURLHE_OK)
+        return NULL;
+    return strdup(header->value);
+}
+
 enum http_status_code http_status_code_from(long code) {
     switch (code) {
     case 200L:
         return HTTP_OK;
+    case 304L:
+        return HTTP_NOT_MODIFIED;
     case 400L:
         return HTTP_BAD_REQUEST;
     case 401L:
@@ -35,6 +144,8 @@ enum http_status_code http_status_code_from(long code) {
         return HTTP_FORBIDDEN;
     case 404L:
         return HTTP_NOT_FOUND;
+    case 429L:
+        return HTTP_TOO_MANY_REQUESTS;
     default:
         return (enum http_status_code)code;
     }
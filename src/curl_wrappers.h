@@ -7,20 +7,54 @@
 struct response_buffer {
   char *buffer;
   size_t size;
+  // bytes allocated for buffer, which always holds a terminating NUL after size bytes
+  size_t capacity;
 };
 
 struct response_buffer *new_response_buffer();
 
 void free_response_buffer(struct response_buffer *resp);
 
+// CURLOPT_WRITEFUNCTION appending the body to the response_buffer passed as CURLOPT_WRITEDATA. Capacity doubles
+// whenever it runs out, so a body arriving in many chunks is only copied a few times.
+size_t write_to_response_buffer(char *buffer, size_t chunks, size_t chunk_size, void *stream);
+
+// Buffers given back after a request, kept with their capacity for the next ones. Safe to use from several threads.
+struct response_buffer_pool;
+
+struct response_buffer_pool_stats {
+  size_t acquired;
+  // acquisitions served from the pool rather than allocated
+  size_t reused;
+  // largest capacity any released buffer had grown to
+  size_t high_water_mark;
+};
+
+struct response_buffer_pool *new_response_buffer_pool();
+
+// An empty buffer. With a NULL pool, a new one.
+struct response_buffer *acquire_response_buffer(struct response_buffer_pool *pool);
+
+// Hands resp back for reuse. Freed instead when the pool is NULL or full, or when resp grew too large to keep around.
+void release_response_buffer(struct response_buffer_pool *pool, struct response_buffer *resp);
+
+struct response_buffer_pool_stats response_buffer_pool_stats(struct response_buffer_pool *pool);
+
+void free_response_buffer_pool(struct response_buffer_pool *pool);
+
 long *get_response_status(CURL *client);
 
+// Value of the named response header of the last transfer, or NULL when absent. Caller frees.
+char *get_response_header(CURL *client, const char *name);
+
 enum http_status_code {
   HTTP_OK = 200,
+  HTTP_NOT_MODIFIED = 304,
   HTTP_BAD_REQUEST = 400,
   HTTP_UNAUTHORIZED = 401,
   HTTP_FORBIDDEN = 403,
-  HTTP_NOT_FOUND = 404
+  HTTP_NOT_FOUND = 404,
+  HTTP_TOO_MANY_REQUESTS = 429
 };
 
 enum http_status_code http_status_code_from(long code);
@@ -0,0 +1,372 @@
+#include "fetch_daemon.h"
+#include "fetch_worker.h"
+#include "listings_cache.h"
+#include "memory.h"
+#include "reddit.h"
+#include <errno.h>
+#include <glib-unix.h>
+#include <glib.h>
+#include <jansson.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+// Bumped whenever requests, results or enum subreddit_access change, as the daemon may be older than the plugin.
+static const json_int_t FETCH_DAEMON_PROTOCOL_VERSION = 1;
+static const char* const FETCH_DAEMON_EXECUTABLE = "rofi-reddit-daemon";
+// the daemon may wait for Reddit for a while itself, e.g. connect_timeout_ms on a bad network
+static const time_t FETCH_DAEMON_RESPONSE_TIMEOUT_SECONDS = 30;
+// requests are a query and a sort, anything longer is not one of ours
+static const size_t MAX_FETCH_DAEMON_REQUEST_SIZE = 4096;
+
+struct fetch_daemon {
+    char* socket_path;
+    int listener;
+    guint listener_source;
+    struct fetch_worker* worker;
+    int64_t idle_timeout_seconds;
+    guint idle_source;
+    fetch_daemon_idle_callback on_idle;
+    void* user_data;
+    // connected clients, waiting for their request to come in or its listings to be fetched
+    GPtrArray* clients;
+};
+
+struct fetch_daemon_client {
+    struct fetch_daemon* daemon;
+    int socket;
+    // main loop watch of the socket while the request comes in and again while the answer goes out, 0 in between
+    guint source;
+    GString* received;
+    // the line answering the request, NULL until its listings are fetched
+    GString* answer;
+    size_t answered;
+};
+
+static bool send_all(int socket, const char* data, size_t size) {
+    while (size > 0) {
+        ssize_t sent = send(socket, data, size, MSG_NOSIGNAL);
+        if (sent < 0 && errno == EINTR)
+            continue;
+        if (sent <= 0)
+            return false;
+        data += sent;
+        size -= (size_t)sent;
+    }
+    return true;
+}
+
+// Compact JSON never holds a line break, so that every message is a single line.
+static char* serialize_fetch_result(const struct fetch_result* result) {
+    json_t* root = result->listings ? listings_to_json(result->listings) : json_object();
+    json_object_set_new(root, "version", json_integer(FETCH_DAEMON_PROTOCOL_VERSION));
+    json_object_set_new(root, "access", json_integer(result->access));
+    json_object_set_new(root, "offline_cached_at", json_integer((json_int_t)result->offline_cached_at));
+    json_object_set_new(root, "rate_limited", json_boolean(result->rate_limited));
+    json_t* statuses = json_array();
+    for (size_t i = 0; i < result->status_count; i++) {
+        json_t* status = json_object();
+        json_object_set_new(status, "subreddit", json_string(result->statuses[i].subreddit));
+        json_object_set_new(status, "access", json_integer(result->statuses[i].access));
+        json_array_append_new(statuses, status);
+    }
+    json_object_set_new(root, "statuses", statuses);
+    char* line = json_dumps(root, JSON_COMPACT);
+    json_decref(root);
+    return line;
+}
+
+// The listings of the query answered by the daemon. NULL if the answer is garbled or from another version.
+static struct fetch_result* deserialize_fetch_result(const char* line, size_t size, const char* query,
+                                                     const char* sort) {
+    json_error_t error;
+    json_t* root = json_loadb(line, size, 0, &error);
+    if (!root || json_integer_value(json_object_get(root, "version")) != FETCH_DAEMON_PROTOCOL_VERSION) {
+        fprintf(stderr, "Ignoring answer of rofi-reddit-daemon: %s\n", root ? "unknown version" : error.text);
+        json_decref(root);
+        return NULL;
+    }
+    json_t* statuses = json_object_get(root, "statuses");
+    struct fetch_result* result = LOG_ERR_MALLOC(struct fetch_result, 1);
+    result->subreddit = strdup(query);
+    result->sort = strdup(sort);
+    result->generation = 0;
+    result->access = (enum subreddit_access)json_integer_value(json_object_get(root, "access"));
+    result->listings = listings_from_json(root);
+    result->offline_cached_at = (time_t)json_integer_value(json_object_get(root, "offline_cached_at"));
+    result->rate_limited = json_is_true(json_object_get(root, "rate_limited"));
+    result->status_count = json_array_size(statuses);
+    result->statuses = LOG_ERR_MALLOC(struct subreddit_status, result->status_count ? result->status_count : 1);
+    for (size_t i = 0; i < result->status_count; i++) {
+        json_t* status = json_array_get(statuses, i);
+        const char* subreddit = json_string_value(json_object_get(status, "subreddit"));
+        result->statuses[i].subreddit = strdup(subreddit ? subreddit : "");
+        result->statuses[i].access = (enum subreddit_access)json_integer_value(json_object_get(status, "access"));
+    }
+    json_decref(root);
+    return result;
+}
+
+static void free_fetch_daemon_client(struct fetch_daemon_client* client) {
+    if (client->source)
+        g_source_remove(client->source);
+    close(client->socket);
+    g_string_free(client->received, TRUE);
+    if (client->answer)
+        g_string_free(client->answer, TRUE);
+    free(client);
+}
+
+static void close_fetch_daemon_client(struct fetch_daemon_client* client) {
+    g_ptr_array_remove_fast(client->daemon->clients, client);
+    free_fetch_daemon_client(client);
+}
+
+static gboolean on_idle_timeout(gpointer data) {
+    struct fetch_daemon* daemon = (struct fetch_daemon*)data;
+    if (daemon->clients->len > 0)
+        return G_SOURCE_CONTINUE;
+    daemon->idle_source = 0;
+    daemon->on_idle(daemon->user_data);
+    return G_SOURCE_REMOVE;
+}
+
+static void restart_idle_timer(struct fetch_daemon* daemon) {
+    if (daemon->idle_source)
+        g_source_remove(daemon->idle_source);
+    guint timeout = (guint)(daemon->idle_timeout_seconds < G_MAXUINT ? daemon->idle_timeout_seconds : G_MAXUINT);
+    daemon->idle_source = g_timeout_add_seconds(timeout, on_idle_timeout, daemon);
+}
+
+// Sends as much of the answer as the socket takes without blocking, and closes the connection once all of it is out.
+static gboolean on_client_writable(gint socket, GIOCondition condition, gpointer data) {
+    struct fetch_daemon_client* client = (struct fetch_daemon_client*)data;
+    while (client->answered < client->answer->len) {
+        ssize_t sent =
+            send(socket, client->answer->str + client->answered, client->answer->len - client->answered, MSG_NOSIGNAL);
+        if (sent < 0 && errno == EINTR)
+            continue;
+        if (sent < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+            return G_SOURCE_CONTINUE;
+        if (sent <= 0) {
+            fprintf(stderr, "Failed to answer a request: %s\n", sent < 0 ? strerror(errno) : "nothing sent");
+            break;
+        }
+        client->answered += (size_t)sent;
+    }
+    client->source = 0;
+    close_fetch_daemon_client(client);
+    return G_SOURCE_REMOVE;
+}
+
+static void on_listings_fetched(struct fetch_result* result, void* user_data) {
+    struct fetch_daemon_client* client = (struct fetch_daemon_client*)user_data;
+    char* line = serialize_fetch_result(result);
+    restart_idle_timer(client->daemon);
+    if (!line) {
+        fprintf(stderr, "Failed to answer request for subreddit=%s.\n", result->subreddit);
+        free_fetch_result(result);
+        close_fetch_daemon_client(client);
+        return;
+    }
+    client->answer = g_string_new(line);
+    g_string_append_c(client->answer, '\n');
+    free(line);
+    free_fetch_result(result);
+    // written whenever the socket takes more, so that a client slow to read holds up nobody but itself
+    client->source = g_unix_fd_add(client->socket, G_IO_OUT | G_IO_HUP | G_IO_ERR, on_client_writable, client);
+}
+
+// Submits the request once its line has come in. Returns false for requests that aren't one.
+static bool submit_request(struct fetch_daemon_client* client) {
+    json_error_t error;
+    json_t* root = json_loadb(client->received->str, client->received->len, 0, &error);
+    const char* query = json_string_value(json_object_get(root, "query"));
+    char* sort = normalize_listings_sort(json_string_value(json_object_get(root, "sort")));
+    bool valid = query && sort &&
+                 json_integer_value(json_object_get(root, "version")) == FETCH_DAEMON_PROTOCOL_VERSION;
+    if (valid) {
+        fprintf(stdout, "Request for subreddit=%s sort=%s.\n", query, sort);
+        fetch_worker_submit(client->daemon->worker, query, sort, on_listings_fetched, client);
+    }
+    g_free(sort);
+    json_decref(root);
+    return valid;
+}
+
+static gboolean on_client_readable(gint socket, GIOCondition condition, gpointer data) {
+    struct fetch_daemon_client* client = (struct fetch_daemon_client*)data;
+    char chunk[1024];
+    ssize_t size = recv(socket, chunk, sizeof(chunk), 0);
+    if (size < 0 && (errno == EINTR || errno == EAGAIN || errno == EWOULDBLOCK))
+        return G_SOURCE_CONTINUE;
+    if (size > 0)
+        g_string_append_len(client->received, chunk, size);
+    char* line_end = size > 0 ? memchr(client->received->str, '\n', client->received->len) : NULL;
+    if (!line_end && size > 0 && client->received->len < MAX_FETCH_DAEMON_REQUEST_SIZE)
+        return G_SOURCE_CONTINUE;
+    // returning G_SOURCE_REMOVE removes the watch
+    client->source = 0;
+    if (line_end)
+        g_string_truncate(client->received, (gsize)(line_end - client->received->str));
+    // clients checking whether the daemon runs close the connection without a request
+    if (!line_end || !submit_request(client))
+        close_fetch_daemon_client(client);
+    return G_SOURCE_REMOVE;
+}
+
+static gboolean on_client_connected(gint listener, GIOCondition condition, gpointer data) {
+    struct fetch_daemon* daemon = (struct fetch_daemon*)data;
+    int socket = accept(listener, NULL, NULL);
+    if (socket < 0)
+        return G_SOURCE_CONTINUE;
+    // the main loop serves every client, none may block it
+    if (!g_unix_set_fd_nonblocking(socket, TRUE, NULL)) {
+        close(socket);
+        return G_SOURCE_CONTINUE;
+    }
+    struct fetch_daemon_client* client = LOG_ERR_MALLOC(struct fetch_daemon_client, 1);
+    client->daemon = daemon;
+    client->socket = socket;
+    client->received = g_string_new(NULL);
+    client->answer = NULL;
+    client->answered = 0;
+    client->source = g_unix_fd_add(socket, G_IO_IN | G_IO_HUP | G_IO_ERR, on_client_readable, client);
+    g_ptr_array_add(daemon->clients, client);
+    return G_SOURCE_CONTINUE;
+}
+
+// A connected socket to the daemon at socket_path, -1 if none listens there.
+static int connect_to_fetch_daemon(const char* socket_path) {
+    struct sockaddr_un address = {.sun_family = AF_UNIX};
+    if (strlen(socket_path) >= sizeof(address.sun_path))
+        return -1;
+    g_strlcpy(address.sun_path, socket_path, sizeof(address.sun_path));
+    int socket_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (socket_fd < 0)
+        return -1;
+    if (connect(socket_fd, (struct sockaddr*)&address, sizeof(address)) != 0) {
+        close(socket_fd);
+        return -1;
+    }
+    return socket_fd;
+}
+
+bool is_fetch_daemon_running(const char* socket_path) {
+    int socket_fd = connect_to_fetch_daemon(socket_path);
+    if (socket_fd < 0)
+        return false;
+    close(socket_fd);
+    return true;
+}
+
+struct fetch_daemon* new_fetch_daemon(const char* socket_path, struct fetch_worker* worker,
+                                      int64_t idle_timeout_seconds, fetch_daemon_idle_callback on_idle,
+                                      void* user_data) {
+    struct sockaddr_un address = {.sun_family = AF_UNIX};
+    if (strlen(socket_path) >= sizeof(address.sun_path)) {
+        fprintf(stderr, "Socket path %s is too long.\n", socket_path);
+        return NULL;
+    }
+    if (is_fetch_daemon_running(socket_path)) {
+        fprintf(stderr, "Another rofi-reddit-daemon already listens at %s.\n", socket_path);
+        return NULL;
+    }
+    // left behind by a daemon that was killed
+    unlink(socket_path);
+    g_strlcpy(address.sun_path, socket_path, sizeof(address.sun_path));
+    int listener = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    // only the user may connect, even where the runtime directory is shared
+    mode_t mask = umask(0177);
+    bool listening = listener >= 0 && bind(listener, (struct sockaddr*)&address, sizeof(address)) == 0 &&
+                     listen(listener, 16) == 0;
+    umask(mask);
+    if (!listening) {
+        fprintf(stderr, "Failed to listen at %s: %s\n", socket_path, strerror(errno));
+        if (listener >= 0)
+            close(listener);
+        return NULL;
+    }
+    struct fetch_daemon* daemon = LOG_ERR_MALLOC(struct fetch_daemon, 1);
+    daemon->socket_path = strdup(socket_path);
+    daemon->listener = listener;
+    daemon->worker = worker;
+    daemon->idle_timeout_seconds = idle_timeout_seconds;
+    daemon->idle_source = 0;
+    daemon->on_idle = on_idle;
+    daemon->user_data = user_data;
+    daemon->clients = g_ptr_array_new();
+    daemon->listener_source = g_unix_fd_add(listener, G_IO_IN, on_client_connected, daemon);
+    restart_idle_timer(daemon);
+    return daemon;
+}
+
+void free_fetch_daemon(struct fetch_daemon* daemon) {
+    if (!daemon)
+        return;
+    g_source_remove(daemon->listener_source);
+    if (daemon->idle_source)
+        g_source_remove(daemon->idle_source);
+    close(daemon->listener);
+    unlink(daemon->socket_path);
+    for (guint i = 0; i < daemon->clients->len; i++) {
+        free_fetch_daemon_client(g_ptr_array_index(daemon->clients, i));
+    }
+    g_ptr_array_free(daemon->clients, TRUE);
+    free(daemon->socket_path);
+    free(daemon);
+}
+
+struct fetch_result* fetch_through_daemon(const char* socket_path, const char* query, const char* sort) {
+    int socket_fd = connect_to_fetch_daemon(socket_path);
+    if (socket_fd < 0)
+        return NULL;
+    struct timeval timeout = {.tv_sec = FETCH_DAEMON_RESPONSE_TIMEOUT_SECONDS, .tv_usec = 0};
+    setsockopt(socket_fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    json_t* request = json_object();
+    json_object_set_new(request, "version", json_integer(FETCH_DAEMON_PROTOCOL_VERSION));
+    json_object_set_new(request, "query", json_string(query));
+    json_object_set_new(request, "sort", json_string(sort));
+    char* line = json_dumps(request, JSON_COMPACT);
+    json_decref(request);
+    bool sent = line && send_all(socket_fd, line, strlen(line)) && send_all(socket_fd, "\n", 1);
+    free(line);
+    GString* received = g_string_new(NULL);
+    char chunk[16384];
+    ssize_t size = 0;
+    while (sent && (size = recv(socket_fd, chunk, sizeof(chunk), 0)) != 0) {
+        if (size < 0 && errno == EINTR)
+            continue;
+        if (size < 0)
+            break;
+        g_string_append_len(received, chunk, size);
+    }
+    close(socket_fd);
+    // the daemon closes the connection once the whole line is out
+    struct fetch_result* result = NULL;
+    if (sent && size == 0 && received->len > 0 && received->str[received->len - 1] == '\n')
+        result = deserialize_fetch_result(received->str, received->len - 1, query, sort);
+    if (!result)
+        fprintf(stderr, "rofi-reddit-daemon at %s didn't answer.\n", socket_path);
+    g_string_free(received, TRUE);
+    return result;
+}
+
+bool spawn_fetch_daemon(void) {
+    char* argv[] = {(char*)FETCH_DAEMON_EXECUTABLE, NULL};
+    GError* error = NULL;
+    // without G_SPAWN_DO_NOT_REAP_CHILD GLib forks twice, so the daemon is never left a zombie of rofi
+    bool spawned = g_spawn_async(NULL, argv, NULL,
+                                 G_SPAWN_SEARCH_PATH | G_SPAWN_STDOUT_TO_DEV_NULL | G_SPAWN_STDERR_TO_DEV_NULL, NULL,
+                                 NULL, NULL, &error);
+    if (!spawned) {
+        fprintf(stderr, "Failed to start %s: %s\n", FETCH_DAEMON_EXECUTABLE, error->message);
+        g_error_free(error);
+    }
+    return spawned;
+}
@@ -0,0 +1,36 @@
+#ifndef FETCH_DAEMON_H
+#define FETCH_DAEMON_H
+
+#include "fetch_worker.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+// rofi-reddit-daemon stays running between launches with a fetch worker whose token, connections and rate limit are
+// ready, and serves listings over a Unix socket. Every request is a line of JSON like
+// {"version": 1, "query": "linux,cpp", "sort": "hot"}, answered by a line holding the fetch_result.
+struct fetch_daemon;
+
+// Invoked on the GLib main loop once the daemon has gone without requests for its idle timeout.
+typedef void (*fetch_daemon_idle_callback)(void* user_data);
+
+// Listens at socket_path and fetches through worker, which stays owned by the caller. NULL if another daemon already
+// listens there or the socket can't be set up.
+struct fetch_daemon* new_fetch_daemon(const char* socket_path, struct fetch_worker* worker,
+                                      int64_t idle_timeout_seconds, fetch_daemon_idle_callback on_idle,
+                                      void* user_data);
+
+// Stops listening and removes the socket. Requests in flight are dropped, free the worker first so that none of them
+// is delivered afterwards.
+void free_fetch_daemon(struct fetch_daemon* daemon);
+
+// Asks the daemon at socket_path for the listings of the query, blocking until they arrive. NULL when no daemon
+// answers, in which case the caller fetches them itself.
+struct fetch_result* fetch_through_daemon(const char* socket_path, const char* query, const char* sort);
+
+// Whether a daemon listens at socket_path.
+bool is_fetch_daemon_running(const char* socket_path);
+
+// Starts rofi-reddit-daemon from the PATH in the background, detached from the calling process.
+bool spawn_fetch_daemon(void);
+
+#endif
@@ -0,0 +1,694 @@
+#include "fetch_worker.h"
+#include "curl_wrappers.h"
+#include "fetch_daemon.h"
+#include "listings_cache.h"
+#include "memory.h"
+#include "rate_limiter.h"
+#include "reddit.h"
+#include "search_index.h"
+#include <glib.h>
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// RedditApp owns a single CURL easy handle, which must not be used from two threads at once.
+static const int MAX_FETCH_THREADS = 1;
+// how long to wait before trying again when a token couldn't be refreshed
+static const int64_t TOKEN_REFRESH_RETRY_SECONDS = 60;
+// requests the user waits for are held back until Reddit's request limit renews if it does within this long, and
+// answered from the cache otherwise
+static const int64_t MAX_RATE_LIMIT_WAIT_SECONDS = 5;
+
+struct fetch_worker {
+    config_loader load_config;
+    // set up by the first job, NULL until then and if that failed
+    RedditApp* app;
+    // why the app couldn't be set up
+    const char* startup_error;
+    // only touched by the worker thread once the worker is running
+    RedditAccessToken* token;
+    // rofi-reddit-daemon was already running when the app was set up, only touched by the worker thread
+    bool daemon_running;
+    struct rate_limiter* limiter;
+    // how many jobs had been submitted when the first page of a subreddit was last fetched, keyed by sort and
+    // subreddit. Only touched by the worker thread.
+    GHashTable* fetched_first_pages;
+    GThreadPool* pool;
+    // runs searches of the index, which never wait for a fetch
+    GThreadPool* search_pool;
+    // main loop timer of the next proactive token refresh, only touched by the main thread
+    guint token_refresh_source;
+    // jobs submitted so far, bumped by the main thread
+    gint submitted;
+    // bumped by every query, prefetches submitted before it are dropped
+    gint prefetch_generation;
+    // bumped by every search, searches submitted before it are dropped
+    gint search_generation;
+    gint refcount;
+    gint shutting_down;
+};
+
+enum fetch_job_kind {
+    // sets up the app, always the first job
+    FETCH_JOB_START,
+    // obtains the first token and connects to Reddit, always the second job
+    FETCH_JOB_WARM_UP,
+    FETCH_JOB_LISTINGS,
+    FETCH_JOB_NEXT_PAGE,
+    // fills the cache with another sort of the query, only once nothing else is waiting
+    FETCH_JOB_PREFETCH,
+    FETCH_JOB_COMMENTS,
+    FETCH_JOB_MORE_COMMENTS,
+    FETCH_JOB_REFRESH_TOKEN,
+    // looks up threads in the search index, on a thread of its own
+    FETCH_JOB_SEARCH
+};
+
+struct fetch_job {
+    enum fetch_job_kind kind;
+    struct fetch_worker* worker;
+    // jobs of the same priority run in the order they were submitted
+    guint sequence;
+    // the worker's prefetch generation when a prefetch job was submitted, its search generation for searches
+    gint prefetch_generation;
+    // set for listings, next page, prefetch and search jobs only
+    struct fetch_result* result;
+    // set for comments jobs only
+    struct comments_result* comments;
+    comments_done_callback comments_callback;
+    // set for more comments jobs only, the ids requested and the depth of the row they replace
+    char** more_ids;
+    uint32_t more_depth;
+    // seconds until the refreshed token is due again, set by token refreshes and the warm up
+    int64_t token_refresh_in;
+    // set for next page jobs only, one entry per subreddit that has more threads
+    char** page_subreddits;
+    char** page_afters;
+    fetch_done_callback callback;
+    // set for the start job only
+    fetch_worker_ready_callback ready;
+    void* user_data;
+};
+
+static struct fetch_worker* ref_fetch_worker(struct fetch_worker* worker) {
+    g_atomic_int_inc(&worker->refcount);
+    return worker;
+}
+
+static void unref_fetch_worker(struct fetch_worker* worker) {
+    if (!g_atomic_int_dec_and_test(&worker->refcount))
+        return;
+    free_reddit_access_token(worker->token);
+    free_rate_limiter(worker->limiter);
+    g_hash_table_destroy(worker->fetched_first_pages);
+    free_reddit_app(worker->app);
+    free(worker);
+}
+
+void free_fetch_result(struct fetch_result* result) {
+    if (!result)
+        return;
+    free(result->subreddit);
+    free(result->sort);
+    free_listings(result->listings);
+    for (size_t i = 0; i < result->status_count; i++) {
+        free(result->statuses[i].subreddit);
+    }
+    free(result->statuses);
+    free(result);
+}
+
+void free_comments_result(struct comments_result* result) {
+    if (!result)
+        return;
+    free(result->article);
+    free_comment_thread(result->comments);
+    free(result);
+}
+
+// paths is NULL for responses that must not be cached, like pages past the first one.
+static enum subreddit_access use_listings_response(const RedditApp* app, const struct rofi_reddit_paths* paths,
+                                                   const char* subreddit, const char* sort,
+                                                   struct cached_listings* cached,
+                                                   const struct reddit_api_response* response,
+                                                   struct listings** listings) {
+    enum subreddit_access access = subreddit_access_from_response(response);
+    if (response->status_code == HTTP_NOT_MODIFIED && cached) {
+        fprintf(stdout, "Cached listings for subreddit=%s sort=%s are still current.\n", subreddit, sort);
+        *listings = cached->listings;
+        cached->listings = NULL;
+        write_listings_cache(paths, subreddit, sort, *listings, cached->etag);
+    } else if (access == SUBREDDIT_ACCESS_OK) {
+        *listings = response->listings;
+        if (*listings && paths)
+            write_listings_cache(paths, subreddit, sort, *listings, response->etag);
+        // unchanged listings were indexed when they were first fetched
+        if (*listings && app->search)
+            search_index_add(app->search, (*listings)->items, (*listings)->count);
+    }
+    release_response_buffer(app->buffers, (struct response_buffer*)response->response_buffer);
+    free_reddit_api_response(response);
+    return access;
+}
+
+static void refresh_token(struct fetch_worker* worker) {
+    fprintf(stdout, "Refreshing access token.\n");
+    free_reddit_access_token(worker->token);
+    worker->token = fetch_and_cache_token(worker->app);
+}
+
+// Catches tokens the timer didn't get to, e.g. because the machine was suspended while it was pending.
+static void refresh_token_if_due(struct fetch_worker* worker) {
+    if (!worker->token) {
+        // usually the one cached by the last session
+        worker->token = new_reddit_access_token(worker->app);
+    } else if (access_token_refresh_in(worker->token) <= 0) {
+        refresh_token(worker);
+    }
+}
+
+static void start_app(struct fetch_worker* worker) {
+    gint64 started = g_get_monotonic_time();
+    struct rofi_reddit_cfg* config = worker->load_config();
+    if (!config) {
+        worker->startup_error = "Rofi Reddit is not configured. Check the config file and the log.";
+        return;
+    }
+    worker->app = new_reddit_app(config);
+    if (!worker->app) {
+        worker->startup_error = "Rofi Reddit failed to initialize CURL.";
+        return;
+    }
+    fprintf(stdout, "Set up app in %" PRId64 " us.\n", g_get_monotonic_time() - started);
+    if (!config->daemon.enabled)
+        return;
+    worker->daemon_running = is_fetch_daemon_running(config->paths->daemon_socket_path);
+    // answers the queries of this launch too once it listens, until then they are fetched here
+    if (!worker->daemon_running)
+        spawn_fetch_daemon();
+}
+
+static void warm_up(struct fetch_worker* worker) {
+    gint64 started = g_get_monotonic_time();
+    refresh_token_if_due(worker);
+    // the daemon's connections are warm already, the first query must not wait for these
+    if (worker->token && !worker->daemon_running)
+        warm_up_listings_connection(worker->app);
+    fprintf(stdout, "Obtained access token and connected in %" PRId64 " us.\n", g_get_monotonic_time() - started);
+}
+
+// Whether rofi-reddit-daemon answered the listings job. Falls back to fetching in this process when it isn't running.
+static bool fetch_through_running_daemon(struct fetch_worker* worker, struct fetch_job* job) {
+    const struct rofi_reddit_cfg* config = worker->app->config;
+    if (!config->daemon.enabled)
+        return false;
+    struct fetch_result* answer =
+        fetch_through_daemon(config->paths->daemon_socket_path, job->result->subreddit, job->result->sort);
+    if (!answer)
+        return false;
+    answer->generation = job->result->generation;
+    free_fetch_result(job->result);
+    job->result = answer;
+    return true;
+}
+
+static enum request_priority fetch_job_priority(const struct fetch_job* job) {
+    return job->kind == FETCH_JOB_PREFETCH ? REQUEST_PRIORITY_BACKGROUND : REQUEST_PRIORITY_USER;
+}
+
+// Whether Reddit's request limit leaves room for count more requests. The ones the user waits for are held back for a
+// few seconds if that is all it takes.
+static bool acquire_requests(struct fetch_worker* worker, enum request_priority priority, size_t count) {
+    int64_t wait = rate_limiter_acquire(worker->limiter, priority, count, time(NULL));
+    if (wait > 0 && priority == REQUEST_PRIORITY_USER && wait <= MAX_RATE_LIMIT_WAIT_SECONDS) {
+        fprintf(stdout, "Waiting %" PRId64 " s for Reddit's request limit to renew.\n", wait);
+        g_usleep((gulong)wait * G_USEC_PER_SEC);
+        wait = rate_limiter_acquire(worker->limiter, priority, count, time(NULL));
+    }
+    if (wait > 0)
+        fprintf(stdout, "Holding back %zu request(s), Reddit's request limit renews in %" PRId64 " s.\n", count, wait);
+    return wait == 0;
+}
+
+static void note_rate_limit(struct fetch_worker* worker, const struct reddit_api_response* response) {
+    rate_limiter_update(worker->limiter, response->ratelimit_used, response->ratelimit_remaining,
+                        response->ratelimit_reset, response->status_code == HTTP_TOO_MANY_REQUESTS, time(NULL));
+}
+
+static char* first_page_key(const char* subreddit, const char* sort) {
+    char* name = g_ascii_strdown(subreddit, -1);
+    char* key = g_strdup_printf("%s/%s", sort, name);
+    g_free(name);
+    return key;
+}
+
+// Whether the last fetch of the first page started after the job was submitted. Its response then answers the job as
+// well, however short the cache's ttl, so that a query submitted again while in flight isn't fetched twice.
+static bool is_answered_by_last_fetch(struct fetch_worker* worker, const char* subreddit, const char* sort,
+                                      guint sequence) {
+    char* key = first_page_key(subreddit, sort);
+    guint submitted = GPOINTER_TO_UINT(g_hash_table_lookup(worker->fetched_first_pages, key));
+    g_free(key);
+    return sequence <= submitted;
+}
+
+// Fetches one page of each subreddit. afters holds the page cursors, or is NULL for the first page, which goes
+// through the cache.
+static void fetch_subreddits(struct fetch_worker* worker, const struct fetch_job* job, char** subreddits,
+                             char** afters) {
+    struct fetch_result* result = job->result;
+    const struct rofi_reddit_paths* paths = afters ? NULL : worker->app->config->paths;
+    size_t count = g_strv_length(subreddits);
+    struct listings** parts = g_new0(struct listings*, count);
+    struct cached_listings** cached = g_new0(struct cached_listings*, count);
+    struct subreddit_fetch* fetches = g_new0(struct subreddit_fetch, count);
+    size_t* fetch_to_subreddit = g_new0(size_t, count);
+    result->statuses = LOG_ERR_MALLOC(struct subreddit_status, count);
+    result->status_count = count;
+
+    size_t pending = 0;
+    for (size_t i = 0; i < count; i++) {
+        result->statuses[i].subreddit = strdup(subreddits[i]);
+        result->statuses[i].access = SUBREDDIT_ACCESS_EXPIRED_TOKEN;
+        cached[i] = paths ? read_listings_cache(paths, subreddits[i], result->sort) : NULL;
+        bool answered = cached[i] && is_answered_by_last_fetch(worker, subreddits[i], result->sort, job->sequence);
+        if (answered)
+            fprintf(stdout, "Subreddit=%s sort=%s was fetched since it was asked for.\n", subreddits[i], result->sort);
+        if (answered || is_listings_cache_fresh(cached[i], worker->app->config->cache.ttl_seconds)) {
+            parts[i] = cached[i]->listings;
+            cached[i]->listings = NULL;
+            result->statuses[i].access = SUBREDDIT_ACCESS_OK;
+            continue;
+        }
+        fetches[pending] = (struct subreddit_fetch){.subreddit = subreddits[i],
+                                                    .sort = result->sort,
+                                                    .etag = cached[i] ? cached[i]->etag : NULL,
+                                                    .after = afters ? afters[i] : NULL};
+        fetch_to_subreddit[pending++] = i;
+    }
+    if (pending > 0)
+        refresh_token_if_due(worker);
+    for (size_t f = 0; f < pending && !worker->token && worker->app->auth_unreachable; f++) {
+        result->statuses[fetch_to_subreddit[f]].access = SUBREDDIT_ACCESS_UNREACHABLE;
+    }
+    // Reddit may still revoke a token early. One retry is enough: a token that was just issued can't be expired
+    for (int attempt = 0; attempt < 2 && pending > 0 && worker->token; attempt++) {
+        if (!acquire_requests(worker, fetch_job_priority(job), pending)) {
+            for (size_t f = 0; f < pending; f++) {
+                result->statuses[fetch_to_subreddit[f]].access = SUBREDDIT_ACCESS_RATE_LIMITED;
+            }
+            break;
+        }
+        // every job submitted up to now is answered by these responses
+        guint submitted = (guint)g_atomic_int_get(&worker->submitted);
+        if (pending == 1) {
+            fetches[0].response = fetch_listings(worker->app, worker->token, fetches[0].subreddit, fetches[0].sort,
+                                                 fetches[0].etag, fetches[0].after);
+        } else {
+            fetch_listings_concurrently(worker->app, worker->token, fetches, pending);
+        }
+        size_t expired = 0;
+        for (size_t f = 0; f < pending; f++) {
+            size_t i = fetch_to_subreddit[f];
+            note_rate_limit(worker, fetches[f].response);
+            enum subreddit_access access = use_listings_response(worker->app, paths, subreddits[i], result->sort,
+                                                                 cached[i], fetches[f].response, &parts[i]);
+            result->statuses[i].access = access;
+            if (access == SUBREDDIT_ACCESS_OK && paths)
+                g_hash_table_insert(worker->fetched_first_pages, first_page_key(subreddits[i], result->sort),
+                                    GUINT_TO_POINTER(submitted));
+            if (access == SUBREDDIT_ACCESS_EXPIRED_TOKEN) {
+                fetches[expired] = fetches[f];
+                fetch_to_subreddit[expired++] = i;
+            }
+        }
+        pending = expired;
+        if (pending > 0) {
+            fprintf(stdout, "Access token was rejected.\n");
+            refresh_token(worker);
+        }
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        enum subreddit_access access = result->statuses[i].access;
+        if ((access != SUBREDDIT_ACCESS_UNREACHABLE && access != SUBREDDIT_ACCESS_RATE_LIMITED) || !cached[i] ||
+            !cached[i]->listings)
+            continue;
+        fprintf(stdout, "Reddit %s, serving cached listings for subreddit=%s.\n",
+                access == SUBREDDIT_ACCESS_RATE_LIMITED ? "is rate limiting" : "can't be reached", subreddits[i]);
+        result->rate_limited = result->rate_limited || access == SUBREDDIT_ACCESS_RATE_LIMITED;
+        parts[i] = cached[i]->listings;
+        cached[i]->listings = NULL;
+        result->statuses[i].access = SUBREDDIT_ACCESS_OK;
+        if (!result->offline_cached_at || cached[i]->fetched_at < result->offline_cached_at)
+            result->offline_cached_at = cached[i]->fetched_at;
+    }
+
+    // the query as a whole succeeds if any of its subreddits could be fetched
+    result->access = count > 0 ? result->statuses[0].access : SUBREDDIT_ACCESS_UNKNOWN;
+    for (size_t i = 0; i < count; i++) {
+        if (result->statuses[i].access == SUBREDDIT_ACCESS_OK)
+            result->access = SUBREDDIT_ACCESS_OK;
+        free_cached_listings(cached[i]);
+    }
+    if (count > 0)
+        result->listings = merge_listings(parts, count, worker->app->config->listings.merge_order);
+    if (result->access != SUBREDDIT_ACCESS_OK) {
+        free_listings(result->listings);
+        result->listings = NULL;
+    }
+    g_free(parts);
+    g_free(cached);
+    g_free(fetches);
+    g_free(fetch_to_subreddit);
+}
+
+static void fetch_comments_of(struct fetch_worker* worker, struct fetch_job* job) {
+    struct comments_result* result = job->comments;
+    refresh_token_if_due(worker);
+    if (!worker->token)
+        result->access = worker->app->auth_unreachable ? SUBREDDIT_ACCESS_UNREACHABLE : SUBREDDIT_ACCESS_EXPIRED_TOKEN;
+    for (int attempt = 0; attempt < 2 && worker->token; attempt++) {
+        if (!acquire_requests(worker, REQUEST_PRIORITY_USER, 1)) {
+            result->access = SUBREDDIT_ACCESS_RATE_LIMITED;
+            break;
+        }
+        const struct reddit_api_response* response =
+            job->kind == FETCH_JOB_COMMENTS
+                ? fetch_comments(worker->app, worker->token, result->article)
+                : fetch_more_comments(worker->app, worker->token, result->article, (const char* const*)job->more_ids,
+                                      result->requested);
+        note_rate_limit(worker, response);
+        result->access = subreddit_access_from_response(response);
+        if (result->access == SUBREDDIT_ACCESS_OK) {
+            result->comments =
+                job->kind == FETCH_JOB_COMMENTS
+                    ? deserialize_comment_thread(response->response_buffer, result->article)
+                    : deserialize_more_comments(response->response_buffer, result->article, job->more_depth);
+            if (!result->comments)
+                result->access = SUBREDDIT_ACCESS_UNKNOWN;
+        }
+        release_response_buffer(worker->app->buffers, (struct response_buffer*)response->response_buffer);
+        free_reddit_api_response(response);
+        if (result->access != SUBREDDIT_ACCESS_EXPIRED_TOKEN)
+            break;
+        fprintf(stdout, "Access token was rejected.\n");
+        refresh_token(worker);
+    }
+}
+
+static void schedule_token_refresh(struct fetch_worker* worker, int64_t refresh_in);
+
+static gboolean deliver_fetch_result(gpointer data) {
+    struct fetch_job* job = (struct fetch_job*)data;
+    if (g_atomic_int_get(&job->worker->shutting_down)) {
+        free_fetch_result(job->result);
+        free_comments_result(job->comments);
+    } else if (job->kind == FETCH_JOB_COMMENTS || job->kind == FETCH_JOB_MORE_COMMENTS) {
+        job->comments_callback(job->comments, job->user_data);
+    } else if (job->kind == FETCH_JOB_START) {
+        job->ready(job->worker->app, job->worker->startup_error, job->user_data);
+    } else if (job->kind == FETCH_JOB_REFRESH_TOKEN || job->kind == FETCH_JOB_WARM_UP) {
+        if (job->worker->app)
+            schedule_token_refresh(job->worker, job->token_refresh_in);
+    } else if (job->callback) {
+        job->callback(job->result, job->user_data);
+    } else {
+        free_fetch_result(job->result);
+    }
+    unref_fetch_worker(job->worker);
+    g_strfreev(job->page_subreddits);
+    g_strfreev(job->page_afters);
+    g_strfreev(job->more_ids);
+    free(job);
+    return G_SOURCE_REMOVE;
+}
+
+static void run_fetch_job(gpointer data, gpointer user_data) {
+    struct fetch_job* job = (struct fetch_job*)data;
+    struct fetch_worker* worker = (struct fetch_worker*)user_data;
+    if (g_atomic_int_get(&worker->shutting_down)) {
+        g_idle_add(deliver_fetch_result, job);
+        return;
+    }
+    if (!worker->app && job->kind != FETCH_JOB_START) {
+        // nothing can be fetched without config, the UI already shows why
+        if (job->result)
+            job->result->access = SUBREDDIT_ACCESS_UNKNOWN;
+        if (job->comments)
+            job->comments->access = SUBREDDIT_ACCESS_UNKNOWN;
+        g_idle_add(deliver_fetch_result, job);
+        return;
+    }
+    switch (job->kind) {
+    case FETCH_JOB_START:
+        start_app(worker);
+        break;
+    case FETCH_JOB_WARM_UP:
+        warm_up(worker);
+        job->token_refresh_in = worker->token ? access_token_refresh_in(worker->token) : 0;
+        break;
+    case FETCH_JOB_PREFETCH:
+        if (job->prefetch_generation != g_atomic_int_get(&worker->prefetch_generation))
+            break;
+        // fall through
+    case FETCH_JOB_LISTINGS: {
+        fprintf(stdout, "%s subreddit=%s sort=%s listings.\n",
+                job->kind == FETCH_JOB_PREFETCH ? "Prefetching" : "Fetching", job->result->subreddit,
+                job->result->sort);
+        if (job->kind == FETCH_JOB_LISTINGS && fetch_through_running_daemon(worker, job))
+            break;
+        size_t count = 0;
+        char** subreddits = split_subreddit_query(job->result->subreddit, &count);
+        fetch_subreddits(worker, job, subreddits, NULL);
+        g_strfreev(subreddits);
+        break;
+    }
+    case FETCH_JOB_NEXT_PAGE:
+        fprintf(stdout, "Fetching next page of subreddit=%s sort=%s listings.\n", job->result->subreddit,
+                job->result->sort);
+        fetch_subreddits(worker, job, job->page_subreddits, job->page_afters);
+        break;
+    case FETCH_JOB_COMMENTS:
+    case FETCH_JOB_MORE_COMMENTS:
+        fprintf(stdout, "Fetching %scomments of thread=%s.\n", job->kind == FETCH_JOB_MORE_COMMENTS ? "more " : "",
+                job->comments->article);
+        fetch_comments_of(worker, job);
+        break;
+    case FETCH_JOB_REFRESH_TOKEN:
+        // a fetch may have replaced the token since the timer was set
+        refresh_token_if_due(worker);
+        job->token_refresh_in = worker->token ? access_token_refresh_in(worker->token) : 0;
+        break;
+    case FETCH_JOB_SEARCH:
+        // submitted to the search pool only
+        break;
+    }
+    g_idle_add(deliver_fetch_result, job);
+}
+
+// Only the latest search is worth running, typing submits one per keystroke.
+static void run_search_job(gpointer data, gpointer user_data) {
+    struct fetch_job* job = (struct fetch_job*)data;
+    struct fetch_worker* worker = (struct fetch_worker*)user_data;
+    if (!g_atomic_int_get(&worker->shutting_down) && worker->app && worker->app->search &&
+        job->prefetch_generation == g_atomic_int_get(&worker->search_generation)) {
+        job->result->listings = search_index_query(worker->app->search, job->result->subreddit,
+                                                   (size_t)worker->app->config->search.max_results);
+        job->result->access = SUBREDDIT_ACCESS_OK;
+    }
+    g_idle_add(deliver_fetch_result, job);
+}
+
+static struct fetch_job* new_fetch_job(struct fetch_worker* worker, enum fetch_job_kind kind, const char* subreddit,
+                                       unsigned int generation, fetch_done_callback callback, void* user_data) {
+    struct fetch_job* job = LOG_ERR_MALLOC(struct fetch_job, 1);
+    job->kind = kind;
+    job->worker = ref_fetch_worker(worker);
+    job->sequence = (guint)g_atomic_int_add(&worker->submitted, 1) + 1;
+    job->prefetch_generation = 0;
+    job->callback = callback;
+    job->ready = NULL;
+    job->user_data = user_data;
+    job->token_refresh_in = 0;
+    job->page_subreddits = NULL;
+    job->page_afters = NULL;
+    job->result = NULL;
+    job->comments = NULL;
+    job->comments_callback = NULL;
+    job->more_ids = NULL;
+    job->more_depth = 0;
+    if (kind == FETCH_JOB_START || kind == FETCH_JOB_WARM_UP || kind == FETCH_JOB_REFRESH_TOKEN)
+        return job;
+    if (kind == FETCH_JOB_COMMENTS || kind == FETCH_JOB_MORE_COMMENTS) {
+        job->comments = LOG_ERR_MALLOC(struct comments_result, 1);
+        job->comments->article = strdup(subreddit);
+        job->comments->generation = generation;
+        job->comments->index = 0;
+        job->comments->requested = 0;
+        job->comments->access = SUBREDDIT_ACCESS_UNINITIALIZED;
+        job->comments->comments = NULL;
+        return job;
+    }
+    job->result = LOG_ERR_MALLOC(struct fetch_result, 1);
+    job->result->subreddit = strdup(subreddit);
+    job->result->sort = NULL;
+    job->result->generation = generation;
+    job->result->access = SUBREDDIT_ACCESS_UNINITIALIZED;
+    job->result->listings = NULL;
+    job->result->offline_cached_at = 0;
+    job->result->rate_limited = false;
+    job->result->statuses = NULL;
+    job->result->status_count = 0;
+    return job;
+}
+
+// Background jobs, i.e. prefetches, wait for every other job, which otherwise run in the order they were submitted.
+static gint compare_prefetches_last(gconstpointer a, gconstpointer b, gpointer user_data) {
+    const struct fetch_job* x = (const struct fetch_job*)a;
+    const struct fetch_job* y = (const struct fetch_job*)b;
+    enum request_priority x_priority = fetch_job_priority(x);
+    enum request_priority y_priority = fetch_job_priority(y);
+    if (x_priority != y_priority)
+        return x_priority == REQUEST_PRIORITY_BACKGROUND ? 1 : -1;
+    return (x->sequence > y->sequence) - (x->sequence < y->sequence);
+}
+
+static gboolean on_token_refresh_due(gpointer data) {
+    struct fetch_worker* worker = (struct fetch_worker*)data;
+    worker->token_refresh_source = 0;
+    // runs on the worker thread like any fetch, so the token is never swapped under a request using it
+    g_thread_pool_push(worker->pool, new_fetch_job(worker, FETCH_JOB_REFRESH_TOKEN, NULL, 0, NULL, NULL), NULL);
+    return G_SOURCE_REMOVE;
+}
+
+static void schedule_token_refresh(struct fetch_worker* worker, int64_t refresh_in) {
+    if (worker->token_refresh_source)
+        g_source_remove(worker->token_refresh_source);
+    int64_t delay = refresh_in > 0 ? refresh_in : TOKEN_REFRESH_RETRY_SECONDS;
+    worker->token_refresh_source =
+        g_timeout_add_seconds((guint)(delay < G_MAXUINT ? delay : G_MAXUINT), on_token_refresh_due, worker);
+}
+
+struct fetch_worker* new_fetch_worker(config_loader load_config, fetch_worker_ready_callback ready, void* user_data) {
+    struct fetch_worker* worker = LOG_ERR_MALLOC(struct fetch_worker, 1);
+    worker->load_config = load_config;
+    worker->app = NULL;
+    worker->startup_error = NULL;
+    worker->token = NULL;
+    worker->daemon_running = false;
+    worker->limiter = new_rate_limiter();
+    worker->fetched_first_pages = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+    worker->token_refresh_source = 0;
+    worker->submitted = 0;
+    worker->prefetch_generation = 0;
+    worker->search_generation = 0;
+    worker->search_pool = NULL;
+    worker->refcount = 1;
+    worker->shutting_down = false;
+    GError* error = NULL;
+    worker->pool = g_thread_pool_new(run_fetch_job, worker, MAX_FETCH_THREADS, FALSE, &error);
+    if (!worker->pool) {
+        fprintf(stderr, "Failed to start fetch worker: %s\n", error->message);
+        g_error_free(error);
+        unref_fetch_worker(worker);
+        return NULL;
+    }
+    g_thread_pool_set_sort_function(worker->pool, compare_prefetches_last, NULL);
+    worker->search_pool = g_thread_pool_new(run_search_job, worker, 1, FALSE, &error);
+    if (!worker->search_pool) {
+        // searching stays possible, just without results
+        fprintf(stderr, "Failed to start searching in the background: %s\n", error->message);
+        g_error_free(error);
+    }
+    struct fetch_job* start = new_fetch_job(worker, FETCH_JOB_START, NULL, 0, NULL, user_data);
+    start->ready = ready;
+    // the pool runs one job at a time, so every fetch submitted from now on waits for these two
+    g_thread_pool_push(worker->pool, start, NULL);
+    g_thread_pool_push(worker->pool, new_fetch_job(worker, FETCH_JOB_WARM_UP, NULL, 0, NULL, NULL), NULL);
+    return worker;
+}
+
+void fetch_worker_submit(struct fetch_worker* worker, const char* subreddit, const char* sort,
+                         fetch_done_callback callback, void* user_data) {
+    g_atomic_int_inc(&worker->prefetch_generation);
+    struct fetch_job* job = new_fetch_job(worker, FETCH_JOB_LISTINGS, subreddit, 0, callback, user_data);
+    job->result->sort = strdup(sort);
+    g_thread_pool_push(worker->pool, job, NULL);
+}
+
+void fetch_worker_submit_prefetch(struct fetch_worker* worker, const char* subreddit, const char* const* sorts,
+                                  size_t count, fetch_done_callback callback, void* user_data) {
+    gint generation = g_atomic_int_add(&worker->prefetch_generation, 1) + 1;
+    for (size_t i = 0; i < count; i++) {
+        struct fetch_job* job = new_fetch_job(worker, FETCH_JOB_PREFETCH, subreddit, 0, callback, user_data);
+        job->result->sort = strdup(sorts[i]);
+        job->prefetch_generation = generation;
+        g_thread_pool_push(worker->pool, job, NULL);
+    }
+}
+
+void fetch_worker_submit_next_page(struct fetch_worker* worker, const char* subreddit, const char* sort,
+                                   const struct listings* listings, unsigned int generation,
+                                   fetch_done_callback callback, void* user_data) {
+    struct fetch_job* job = new_fetch_job(worker, FETCH_JOB_NEXT_PAGE, subreddit, generation, callback, user_data);
+    job->result->sort = strdup(sort);
+    job->page_subreddits = g_new0(char*, listings->cursor_count + 1);
+    job->page_afters = g_new0(char*, listings->cursor_count + 1);
+    for (size_t i = 0; i < listings->cursor_count; i++) {
+        job->page_subreddits[i] = g_strdup(listings->cursors[i].subreddit);
+        job->page_afters[i] = g_strdup(listings->cursors[i].after);
+    }
+    g_thread_pool_push(worker->pool, job, NULL);
+}
+
+void fetch_worker_submit_search(struct fetch_worker* worker, const char* query, fetch_done_callback callback,
+                                void* user_data) {
+    struct fetch_job* job = new_fetch_job(worker, FETCH_JOB_SEARCH, query, 0, callback, user_data);
+    job->prefetch_generation = g_atomic_int_add(&worker->search_generation, 1) + 1;
+    if (worker->search_pool) {
+        g_thread_pool_push(worker->search_pool, job, NULL);
+    } else {
+        g_idle_add(deliver_fetch_result, job);
+    }
+}
+
+void fetch_worker_submit_comments(struct fetch_worker* worker, const char* article, unsigned int generation,
+                                  comments_done_callback callback, void* user_data) {
+    struct fetch_job* job = new_fetch_job(worker, FETCH_JOB_COMMENTS, article, generation, NULL, user_data);
+    job->comments_callback = callback;
+    g_thread_pool_push(worker->pool, job, NULL);
+}
+
+void fetch_worker_submit_more_comments(struct fetch_worker* worker, const char* article, const struct comment* more,
+                                       size_t index, unsigned int generation, comments_done_callback callback,
+                                       void* user_data) {
+    struct fetch_job* job = new_fetch_job(worker, FETCH_JOB_MORE_COMMENTS, article, generation, NULL, user_data);
+    job->comments_callback = callback;
+    size_t requested = more->more_count;
+    if ((int64_t)requested > worker->app->config->comments.limit)
+        requested = (size_t)worker->app->config->comments.limit;
+    job->more_ids = g_new0(char*, requested + 1);
+    for (size_t i = 0; i < requested; i++) {
+        job->more_ids[i] = g_strdup(more->more_ids[i]);
+    }
+    job->more_depth = more->depth;
+    job->comments->index = index;
+    job->comments->requested = requested;
+    g_thread_pool_push(worker->pool, job, NULL);
+}
+
+void free_fetch_worker(struct fetch_worker* worker) {
+    if (!worker)
+        return;
+    g_atomic_int_set(&worker->shutting_down, true);
+    if (worker->token_refresh_source)
+        g_source_remove(worker->token_refresh_source);
+    // queued jobs still run (as no-ops) so that their idle callbacks release what they hold
+    if (worker->search_pool)
+        g_thread_pool_free(worker->search_pool, FALSE, TRUE);
+    g_thread_pool_free(worker->pool, FALSE, TRUE);
+    unref_fetch_worker(worker);
+}
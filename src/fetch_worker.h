@@ -0,0 +1,109 @@
+#ifndef FETCH_WORKER_H
+#define FETCH_WORKER_H
+
+#include "comments.h"
+#include "reddit.h"
+
+struct subreddit_status {
+    char* subreddit;
+    enum subreddit_access access;
+};
+
+struct fetch_result {
+    // the query as submitted, one or more comma separated subreddits
+    char* subreddit;
+    // normalized, e.g. "top:week"
+    char* sort;
+    // handed back as submitted, so that a page can be matched with the listings it continues
+    unsigned int generation;
+    // SUBREDDIT_ACCESS_OK as soon as one of the subreddits could be fetched, SUBREDDIT_ACCESS_UNINITIALIZED for
+    // prefetches dropped because another query came in first
+    enum subreddit_access access;
+    // threads of every accessible subreddit, merged
+    struct listings* listings;
+    // when the oldest of the listings served from the cache because Reddit couldn't be reached, or was rate limiting,
+    // was fetched, 0 if none were
+    time_t offline_cached_at;
+    // some of those were served because Reddit's request limit was used up
+    bool rate_limited;
+    struct subreddit_status* statuses;
+    size_t status_count;
+};
+
+void free_fetch_result(struct fetch_result* result);
+
+// Invoked on the GLib main loop (rofi's UI thread) once a fetch has finished. Ownership of the result is handed over.
+typedef void (*fetch_done_callback)(struct fetch_result* result, void* user_data);
+
+struct comments_result {
+    // id of the thread
+    char* article;
+    // handed back as submitted, so that loaded comments are never spliced into a thread they don't belong to
+    unsigned int generation;
+    // for hidden comments, the row they replace and how many of its ids were requested
+    size_t index;
+    size_t requested;
+    // of the thread, SUBREDDIT_ACCESS_DOESNT_EXIST once it has been deleted
+    enum subreddit_access access;
+    // the thread's comments, or the hidden ones in reading order. NULL unless access is SUBREDDIT_ACCESS_OK.
+    struct comment_thread* comments;
+};
+
+void free_comments_result(struct comments_result* result);
+
+// Invoked on the GLib main loop once comments have been fetched. Ownership of the result is handed over.
+typedef void (*comments_done_callback)(struct comments_result* result, void* user_data);
+
+// Invoked on the GLib main loop once the worker has set up the app. app is NULL if that failed, with error saying why.
+typedef void (*fetch_worker_ready_callback)(RedditApp* app, const char* error, void* user_data);
+
+// Reads the config on the worker thread. NULL if it is missing or incomplete.
+typedef struct rofi_reddit_cfg* (*config_loader)(void);
+
+struct fetch_worker;
+
+// Returns right away, everything slow happens on the worker thread: loading the config and setting up the app, then
+// obtaining an access token and connecting to Reddit. Fetches submitted in the meantime wait for all of it. The worker
+// owns the app and the token, which it refreshes shortly before it expires.
+struct fetch_worker* new_fetch_worker(config_loader load_config, fetch_worker_ready_callback ready, void* user_data);
+
+// Fetches the listings of a single subreddit or of several comma separated ones, concurrently, in a normalized sort.
+// Subreddits whose cached listings are still fresh are served from the cache, and so are stale ones while Reddit can't
+// be reached or its request limit is used up. So are subreddits fetched by an earlier job that was still waiting or in
+// flight when this one was submitted. Prefetches that haven't started yet are dropped. With daemon.enabled, the
+// listings come from rofi-reddit-daemon while it runs.
+void fetch_worker_submit(struct fetch_worker* worker, const char* subreddit, const char* sort,
+                         fetch_done_callback callback, void* user_data);
+
+// Fetches the listings of the query in each of the sorts into the cache, like fetch_worker_submit would, but only while
+// nothing else is waiting to be fetched and only while part of Reddit's request limit is left for fetches the user
+// waits for. Replaces the prefetches submitted before. callback may be NULL, it is invoked once per sort otherwise.
+void fetch_worker_submit_prefetch(struct fetch_worker* worker, const char* subreddit, const char* const* sorts,
+                                  size_t count, fetch_done_callback callback, void* user_data);
+
+// Fetches the page after the given listings for every subreddit that has more threads, bypassing the cache. The
+// cursors are copied, the listings may be freed while the page is in flight.
+void fetch_worker_submit_next_page(struct fetch_worker* worker, const char* subreddit, const char* sort,
+                                   const struct listings* listings, unsigned int generation,
+                                   fetch_done_callback callback, void* user_data);
+
+// Looks up the threads of the search index matching query off the main thread, so that typing never waits for the
+// index while a fetch is adding to it. The result's subreddit is the query and its listings the matching threads.
+// A search still waiting when the next one is submitted is dropped, with access SUBREDDIT_ACCESS_UNINITIALIZED.
+void fetch_worker_submit_search(struct fetch_worker* worker, const char* query, fetch_done_callback callback,
+                                void* user_data);
+
+// Fetches the first comments of a thread, comments.limit of them and comments.depth levels deep at most.
+void fetch_worker_submit_comments(struct fetch_worker* worker, const char* article, unsigned int generation,
+                                  comments_done_callback callback, void* user_data);
+
+// Fetches the first comments.limit comments a row of hidden comments stands for, the one at index. The ids are copied,
+// the thread may be freed while they are in flight.
+void fetch_worker_submit_more_comments(struct fetch_worker* worker, const char* article, const struct comment* more,
+                                       size_t index, unsigned int generation, comments_done_callback callback,
+                                       void* user_data);
+
+// Waits for the in-flight fetch to finish, then frees the app. Results that have not been delivered yet are dropped.
+void free_fetch_worker(struct fetch_worker* worker);
+
+#endif
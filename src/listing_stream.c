@@ -0,0 +1,285 @@
+#include "listing_stream.h"
+#include "memory.h"
+#include "reddit.h"
+#include <glib.h>
+#include <jansson.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Only the path down to the fields of each child matters: root{ data{ children[ child{ data{...} } ] } }, plus the
+// data.after cursor next to the children
+#define TRACKED_DEPTH 5
+#define MAX_KEY_SIZE 16
+#define CHILDREN_DEPTH 3
+#define DATA_DEPTH 2
+#define CHILD_DATA_DEPTH 5
+// fullnames like "t3_1abcdef" are far shorter, anything longer is not a cursor
+#define MAX_CURSOR_SIZE 64
+
+static const size_t INITIAL_ITEMS_CAPACITY = 32;
+
+// Fields of a child's data that deserialize_listing reads. Reddit sends about a hundred, some of them, like
+// selftext_html and preview, far larger than everything shown; the others are replaced with null before parsing.
+static const char* const PROJECTED_FIELDS[] = {"id", "title", "subreddit", "ups", "permalink", "url", "thumbnail"};
+// kept JSON escaped next to the listing instead of being parsed, see listing_selftext
+static const char* const SELFTEXT_FIELD = "selftext";
+
+struct stream_level {
+    bool is_object;
+    bool expects_key;
+    char key[MAX_KEY_SIZE];
+};
+
+struct listing_stream {
+    struct stream_level levels[TRACKED_DEPTH];
+    size_t depth;
+    bool started;
+    bool in_string;
+    bool escaped;
+    bool capturing_key;
+    char key[MAX_KEY_SIZE];
+    size_t key_size;
+    bool capturing_after;
+    char after[MAX_CURSOR_SIZE];
+    size_t after_size;
+    bool has_after;
+    bool malformed;
+    // bytes of the child object currently being received, without the values of fields that aren't projected
+    GString* child;
+    bool in_child;
+    // the value of a field that isn't projected is being received
+    bool skipping_field;
+    bool skipping_selftext;
+    // the selftext of the child currently being received, still escaped and without its quotes
+    GString* selftext;
+    bool in_selftext;
+    bool has_selftext;
+    struct listing* items;
+    size_t count;
+    size_t capacity;
+    struct arena* arena;
+};
+
+struct listing_stream* new_listing_stream(void) {
+    struct listing_stream* stream = g_malloc0(sizeof(*stream));
+    stream->child = g_string_new(NULL);
+    stream->selftext = g_string_new(NULL);
+    stream->arena = new_arena();
+    return stream;
+}
+
+static bool at_children_array(const struct listing_stream* stream) {
+    return stream->depth == CHILDREN_DEPTH && !stream->levels[2].is_object &&
+           strcmp(stream->levels[0].key, "data") == 0 && strcmp(stream->levels[1].key, "children") == 0;
+}
+
+static bool at_after_value(const struct listing_stream* stream) {
+    const struct stream_level* data = &stream->levels[DATA_DEPTH - 1];
+    return stream->depth == DATA_DEPTH && data->is_object && !data->expects_key &&
+           strcmp(stream->levels[0].key, "data") == 0 && strcmp(data->key, "after") == 0;
+}
+
+static bool at_child_field_value(const struct listing_stream* stream) {
+    return stream->in_child && stream->depth == CHILD_DATA_DEPTH && stream->levels[CHILD_DATA_DEPTH - 1].is_object &&
+           strcmp(stream->levels[CHILD_DATA_DEPTH - 2].key, "data") == 0;
+}
+
+static bool is_projected_field(const char* key) {
+    for (size_t i = 0; i < G_N_ELEMENTS(PROJECTED_FIELDS); i++) {
+        if (strcmp(key, PROJECTED_FIELDS[i]) == 0)
+            return true;
+    }
+    return false;
+}
+
+static void emit_child(struct listing_stream* stream) {
+    json_error_t error;
+    json_t* child_json = json_loadb(stream->child->str, stream->child->len, 0, &error);
+    g_string_truncate(stream->child, 0);
+    if (!child_json) {
+        fprintf(stderr, "Error deserializing listing: %s\n", error.text);
+        return;
+    }
+    if (stream->count == stream->capacity) {
+        stream->capacity = stream->capacity ? stream->capacity * 2 : INITIAL_ITEMS_CAPACITY;
+        stream->items = g_renew(struct listing, stream->items, stream->capacity);
+    }
+    struct listing* item = &stream->items[stream->count];
+    memset(item, 0, sizeof(*item));
+    deserialize_listing(child_json, stream->items, stream->count, stream->arena);
+    json_decref(child_json);
+    if (item->title && stream->has_selftext) {
+        item->escaped_selftext = arena_strndup(stream->arena, stream->selftext->str, stream->selftext->len);
+        item->escaped_selftext_size = stream->selftext->len;
+    }
+    // children that are missing mandatory fields are skipped rather than shown as blank rows
+    if (item->title)
+        stream->count++;
+}
+
+static void open_container(struct listing_stream* stream, bool is_object) {
+    if (stream->depth < TRACKED_DEPTH) {
+        struct stream_level* level = &stream->levels[stream->depth];
+        level->is_object = is_object;
+        level->expects_key = is_object;
+        level->key[0] = '\0';
+    }
+    stream->depth++;
+    stream->started = true;
+}
+
+bool listing_stream_feed(struct listing_stream* stream, const char* chunk, size_t size) {
+    if (stream->malformed)
+        return false;
+    size_t child_start = 0;
+    size_t selftext_start = 0;
+    for (size_t i = 0; i < size; i++) {
+        const char c = chunk[i];
+        if (stream->in_string) {
+            if (stream->escaped) {
+                stream->escaped = false;
+            } else if (c == '\\') {
+                stream->escaped = true;
+            } else if (c == '"') {
+                stream->in_string = false;
+                if (stream->in_selftext) {
+                    g_string_append_len(stream->selftext, chunk + selftext_start, (gssize)(i - selftext_start));
+                    stream->in_selftext = false;
+                    stream->has_selftext = true;
+                }
+                if (stream->capturing_key) {
+                    memcpy(stream->levels[stream->depth - 1].key, stream->key, stream->key_size);
+                    stream->levels[stream->depth - 1].key[stream->key_size] = '\0';
+                }
+                if (stream->capturing_after) {
+                    stream->has_after = stream->after_size > 0;
+                    stream->capturing_after = false;
+                }
+            } else if (stream->capturing_key && stream->key_size < MAX_KEY_SIZE - 1) {
+                stream->key[stream->key_size++] = c;
+            } else if (stream->capturing_after) {
+                if (stream->after_size < MAX_CURSOR_SIZE - 1) {
+                    stream->after[stream->after_size++] = c;
+                } else {
+                    stream->capturing_after = false;
+                    stream->has_after = false;
+                }
+            }
+            continue;
+        }
+        switch (c) {
+        case '"':
+            stream->in_string = true;
+            if (stream->skipping_selftext && stream->depth == CHILD_DATA_DEPTH) {
+                stream->in_selftext = true;
+                selftext_start = i + 1;
+            }
+            stream->capturing_key = stream->depth > 0 && stream->depth <= TRACKED_DEPTH &&
+                                    stream->levels[stream->depth - 1].is_object &&
+                                    stream->levels[stream->depth - 1].expects_key;
+            stream->key_size = 0;
+            stream->capturing_after = !stream->capturing_key && at_after_value(stream);
+            if (stream->capturing_after)
+                stream->after_size = 0;
+            break;
+        case '{':
+        case '[':
+            if (stream->depth == 0 && stream->started) {
+                stream->malformed = true;
+                return false;
+            }
+            if (c == '{' && at_children_array(stream)) {
+                stream->in_child = true;
+                child_start = i;
+                g_string_truncate(stream->selftext, 0);
+                stream->has_selftext = false;
+            }
+            open_container(stream, c == '{');
+            break;
+        case '}':
+        case ']':
+            if (stream->depth == 0) {
+                stream->malformed = true;
+                return false;
+            }
+            if (stream->skipping_field && at_child_field_value(stream)) {
+                // the last field of the child's data was skipped
+                stream->skipping_field = false;
+                stream->skipping_selftext = false;
+                child_start = i;
+            }
+            stream->depth--;
+            if (stream->in_child && at_children_array(stream)) {
+                g_string_append_len(stream->child, chunk + child_start, (gssize)(i + 1 - child_start));
+                stream->in_child = false;
+                emit_child(stream);
+            }
+            break;
+        case ':':
+            if (stream->depth > 0 && stream->depth <= TRACKED_DEPTH)
+                stream->levels[stream->depth - 1].expects_key = false;
+            if (at_child_field_value(stream) && !is_projected_field(stream->levels[CHILD_DATA_DEPTH - 1].key)) {
+                g_string_append_len(stream->child, chunk + child_start, (gssize)(i + 1 - child_start));
+                g_string_append(stream->child, "null");
+                stream->skipping_field = true;
+                stream->skipping_selftext = strcmp(stream->levels[CHILD_DATA_DEPTH - 1].key, SELFTEXT_FIELD) == 0;
+            }
+            break;
+        case ',':
+            if (stream->skipping_field && at_child_field_value(stream)) {
+                stream->skipping_field = false;
+                stream->skipping_selftext = false;
+                child_start = i;
+            }
+            if (stream->depth > 0 && stream->depth <= TRACKED_DEPTH)
+                stream->levels[stream->depth - 1].expects_key = stream->levels[stream->depth - 1].is_object;
+            break;
+        default:
+            break;
+        }
+    }
+    if (stream->in_child && !stream->skipping_field)
+        g_string_append_len(stream->child, chunk + child_start, (gssize)(size - child_start));
+    if (stream->in_selftext)
+        g_string_append_len(stream->selftext, chunk + selftext_start, (gssize)(size - selftext_start));
+    return true;
+}
+
+struct listings* listing_stream_finish(struct listing_stream* stream) {
+    if (stream->malformed || !stream->started || stream->depth != 0) {
+        fprintf(stderr, "Listing response was malformed or truncated.\n");
+        return NULL;
+    }
+    struct listings* listings = LOG_ERR_MALLOC(struct listings, 1);
+    listings->items = stream->items;
+    listings->count = stream->count;
+    listings->arena = stream->arena;
+    listings->cursors = NULL;
+    listings->cursor_count = 0;
+    // "after" is null on the last page
+    if (stream->has_after) {
+        struct listings_cursor* cursor = arena_alloc(stream->arena, sizeof(*cursor));
+        cursor->subreddit = NULL;
+        cursor->after = arena_strndup(stream->arena, stream->after, stream->after_size);
+        listings->cursors = cursor;
+        listings->cursor_count = 1;
+    }
+    stream->items = NULL;
+    stream->count = 0;
+    stream->capacity = 0;
+    stream->arena = NULL;
+    return listings;
+}
+
+void free_listing_stream(struct listing_stream* stream) {
+    if (!stream)
+        return;
+    free_arena(stream->arena);
+    g_free(stream->items);
+    g_string_free(stream->child, TRUE);
+    g_string_free(stream->selftext, TRUE);
+    g_free(stream);
+}
@@ -0,0 +1,23 @@
+#ifndef LISTING_STREAM_H
+#define LISTING_STREAM_H
+
+#include "reddit.h"
+#include <stdbool.h>
+#include <stddef.h>
+
+// Incremental deserializer for listing responses. The body can be fed in arbitrary chunks, as they come off the
+// network; every child of data.children is deserialized as soon as its closing brace arrives, and only the bytes of
+// the child currently being received are buffered.
+struct listing_stream;
+
+struct listing_stream* new_listing_stream(void);
+
+// Returns false once the input is known to be malformed. Further chunks are ignored from then on.
+bool listing_stream_feed(struct listing_stream* stream, const char* chunk, size_t size);
+
+// Hands over the listings deserialized so far, or NULL if the body was malformed or incomplete.
+struct listings* listing_stream_finish(struct listing_stream* stream);
+
+void free_listing_stream(struct listing_stream* stream);
+
+#endif
@@ -0,0 +1,169 @@
+#include "listings_cache.h"
+#include "listings_snapshot.h"
+#include "memory.h"
+#include "reddit.h"
+#include <glib.h>
+#include <jansson.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+static char* listings_cache_path(const struct rofi_reddit_paths* paths, const char* subreddit, const char* sort) {
+    // subreddit names are case insensitive, r/Linux and r/linux share an entry
+    char* subreddit_lower = g_ascii_strdown(subreddit, -1);
+    // whatever the user typed must not be able to escape the cache directory
+    for (char* p = subreddit_lower; *p; ++p) {
+        if (!g_ascii_isalnum(*p) && *p != '_')
+            *p = '_';
+    }
+    char* file_name = g_strdup_printf("%s.%s.snapshot", subreddit_lower, sort);
+    char* path = g_build_filename(paths->listings_cache_dir, file_name, NULL);
+    g_free(subreddit_lower);
+    g_free(file_name);
+    return path;
+}
+
+static char* strdup_or_null(const char* value) {
+    return value ? strdup(value) : NULL;
+}
+
+static char* arena_strdup_or_null(struct arena* arena, const char* value) {
+    return value ? arena_strdup(arena, value) : NULL;
+}
+
+static void cursors_from_json(json_t* cursors_json, struct listings* listings) {
+    size_t count = json_array_size(cursors_json);
+    struct listings_cursor* cursors = count > 0 ? arena_alloc(listings->arena, sizeof(*cursors) * count) : NULL;
+    listings->cursors = cursors;
+    listings->cursor_count = 0;
+    for (size_t i = 0; i < count; i++) {
+        json_t* cursor_json = json_array_get(cursors_json, i);
+        const char* subreddit = json_string_value(json_object_get(cursor_json, "subreddit"));
+        const char* after = json_string_value(json_object_get(cursor_json, "after"));
+        if (!subreddit || !after)
+            continue;
+        struct listings_cursor* cursor = &cursors[listings->cursor_count++];
+        cursor->subreddit = arena_strdup(listings->arena, subreddit);
+        cursor->after = arena_strdup(listings->arena, after);
+    }
+}
+
+static json_t* cursors_to_json(const struct listings* listings) {
+    json_t* cursors_json = json_array();
+    for (size_t i = 0; i < listings->cursor_count; i++) {
+        json_t* cursor_json = json_object();
+        json_object_set_new(cursor_json, "subreddit", json_string(listings->cursors[i].subreddit));
+        json_object_set_new(cursor_json, "after", json_string(listings->cursors[i].after));
+        json_array_append_new(cursors_json, cursor_json);
+    }
+    return cursors_json;
+}
+
+static struct listings* items_from_json(json_t* items_json) {
+    size_t count = json_array_size(items_json);
+    struct listings* listings = LOG_ERR_MALLOC(struct listings, 1);
+    struct listing* items = LOG_ERR_MALLOC(struct listing, count);
+    struct arena* arena = new_arena();
+    for (size_t i = 0; i < count; i++) {
+        json_t* item_json = json_array_get(items_json, i);
+        items[i].id = arena_strdup_or_null(arena, json_string_value(json_object_get(item_json, "id")));
+        items[i].subreddit = arena_strdup_or_null(arena, json_string_value(json_object_get(item_json, "subreddit")));
+        items[i].title = arena_strdup_or_null(arena, json_string_value(json_object_get(item_json, "title")));
+        items[i].selftext = arena_strdup_or_null(arena, json_string_value(json_object_get(item_json, "selftext")));
+        items[i].escaped_selftext = NULL;
+        items[i].escaped_selftext_size = 0;
+        items[i].url = arena_strdup_or_null(arena, json_string_value(json_object_get(item_json, "url")));
+        items[i].thumbnail_url =
+            arena_strdup_or_null(arena, json_string_value(json_object_get(item_json, "thumbnail_url")));
+        items[i].ups = (uint32_t)json_integer_value(json_object_get(item_json, "ups"));
+    }
+    listings->items = items;
+    listings->count = count;
+    listings->arena = arena;
+    return listings;
+}
+
+static json_t* items_to_json(const struct listings* listings) {
+    json_t* items_json = json_array();
+    for (size_t i = 0; i < listings->count; i++) {
+        const struct listing* item = &listings->items[i];
+        json_t* item_json = json_object();
+        json_object_set_new(item_json, "id", item->id ? json_string(item->id) : json_null());
+        json_object_set_new(item_json, "subreddit", item->subreddit ? json_string(item->subreddit) : json_null());
+        json_object_set_new(item_json, "title", item->title ? json_string(item->title) : json_null());
+        char* selftext = listing_selftext(item);
+        json_object_set_new(item_json, "selftext", selftext ? json_string(selftext) : json_null());
+        g_free(selftext);
+        json_object_set_new(item_json, "url", item->url ? json_string(item->url) : json_null());
+        json_object_set_new(item_json, "thumbnail_url",
+                            item->thumbnail_url ? json_string(item->thumbnail_url) : json_null());
+        json_object_set_new(item_json, "ups", json_integer(item->ups));
+        json_array_append_new(items_json, item_json);
+    }
+    return items_json;
+}
+
+json_t* listings_to_json(const struct listings* listings) {
+    json_t* json = json_object();
+    json_object_set_new(json, "items", items_to_json(listings));
+    json_object_set_new(json, "cursors", cursors_to_json(listings));
+    return json;
+}
+
+struct listings* listings_from_json(json_t* json) {
+    json_t* items_json = json_object_get(json, "items");
+    if (!json_is_array(items_json))
+        return NULL;
+    struct listings* listings = items_from_json(items_json);
+    // listings without cursors simply end after their first page
+    cursors_from_json(json_object_get(json, "cursors"), listings);
+    return listings;
+}
+
+struct cached_listings* read_listings_cache(const struct rofi_reddit_paths* paths, const char* subreddit,
+                                            const char* sort) {
+    char* path = listings_cache_path(paths, subreddit, sort);
+    struct listings_snapshot_info info;
+    struct listings* listings = map_listings_snapshot(path, &info);
+    g_free(path);
+    if (!listings)
+        return NULL;
+    struct cached_listings* cached = LOG_ERR_MALLOC(struct cached_listings, 1);
+    cached->listings = listings;
+    cached->fetched_at = info.fetched_at;
+    cached->etag = strdup_or_null(info.etag);
+    return cached;
+}
+
+bool write_listings_cache(const struct rofi_reddit_paths* paths, const char* subreddit, const char* sort,
+                          const struct listings* listings, const char* etag) {
+    size_t size = 0;
+    char* snapshot = new_listings_snapshot(listings, time(NULL), etag, &size);
+    char* path = listings_cache_path(paths, subreddit, sort);
+    GError* error = NULL;
+    // written to a temporary file and renamed, so readers never observe a half written entry and mappings of the old
+    // one stay intact
+    bool written = g_file_set_contents(path, snapshot, (gssize)size, &error);
+    if (!written) {
+        fprintf(stderr, "Failed to write listings cache at %s: %s\n", path, error->message);
+        g_error_free(error);
+    }
+    g_free(path);
+    g_free(snapshot);
+    return written;
+}
+
+bool is_listings_cache_fresh(const struct cached_listings* cached, int64_t ttl_seconds) {
+    return cached && (int64_t)(time(NULL) - cached->fetched_at) < ttl_seconds;
+}
+
+void free_cached_listings(struct cached_listings* cached) {
+    if (!cached)
+        return;
+    free_listings(cached->listings);
+    free(cached->etag);
+    free(cached);
+}
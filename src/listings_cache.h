@@ -0,0 +1,33 @@
+#ifndef LISTINGS_CACHE_H
+#define LISTINGS_CACHE_H
+
+#include "reddit.h"
+#include <stdbool.h>
+#include <stdint.h>
+#include <time.h>
+
+struct cached_listings {
+    struct listings* listings;
+    time_t fetched_at;
+    // validator of the response the listings came from, NULL if Reddit didn't send one
+    char* etag;
+};
+
+// Listings are cached per subreddit and sort under the listings cache dir, as snapshots that are mapped rather than
+// parsed. Returns NULL on a miss, and for entries that are damaged or of an older version.
+struct cached_listings* read_listings_cache(const struct rofi_reddit_paths* paths, const char* subreddit,
+                                            const char* sort);
+
+bool write_listings_cache(const struct rofi_reddit_paths* paths, const char* subreddit, const char* sort,
+                          const struct listings* listings, const char* etag);
+
+// The threads and page cursors of listings as JSON, {"items": [...], "cursors": [...]}, e.g. in the daemon's answers.
+json_t* listings_to_json(const struct listings* listings);
+// NULL unless json holds an array of items.
+struct listings* listings_from_json(json_t* json);
+
+bool is_listings_cache_fresh(const struct cached_listings* cached, int64_t ttl_seconds);
+
+void free_cached_listings(struct cached_listings* cached);
+
+#endif
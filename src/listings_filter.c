@@ -0,0 +1,139 @@
+// memmem
+#define _GNU_SOURCE
+#include "listings_filter.h"
+#include "memory.h"
+#include "reddit.h"
+#include <glib.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+struct listings_filter {
+    bool include_selftext;
+    GString* text;
+    // thread i spans [starts[i], starts[i + 1]) of text, its title and selftext are separated by a NUL
+    GArray* starts;
+};
+
+struct listings_filter* new_listings_filter(bool include_selftext) {
+    struct listings_filter* filter = LOG_ERR_MALLOC(struct listings_filter, 1);
+    filter->include_selftext = include_selftext;
+    filter->text = g_string_new(NULL);
+    filter->starts = g_array_new(FALSE, FALSE, sizeof(size_t));
+    size_t start = 0;
+    g_array_append_val(filter->starts, start);
+    return filter;
+}
+
+static void append_folded(GString* text, const char* value) {
+    char* folded = g_utf8_casefold(value, -1);
+    g_string_append(text, folded);
+    g_free(folded);
+}
+
+void listings_filter_add(struct listings_filter* filter, const struct listing* items, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        if (items[i].title)
+            append_folded(filter->text, items[i].title);
+        // only decoded when opted in, selftext is otherwise left escaped until a thread is previewed
+        char* selftext = filter->include_selftext ? listing_selftext(&items[i]) : NULL;
+        if (selftext) {
+            // neither the text nor tokens contain a NUL, so no match can straddle title and selftext
+            g_string_append_c(filter->text, '\0');
+            append_folded(filter->text, selftext);
+            g_free(selftext);
+        }
+        size_t end = filter->text->len;
+        g_array_append_val(filter->starts, end);
+    }
+}
+
+size_t listings_filter_count(const struct listings_filter* filter) {
+    return filter ? filter->starts->len - 1 : 0;
+}
+
+void free_listings_filter(struct listings_filter* filter) {
+    if (!filter)
+        return;
+    g_string_free(filter->text, TRUE);
+    g_array_free(filter->starts, TRUE);
+    free(filter);
+}
+
+struct filter_query* new_filter_query(const char* input, bool fuzzy) {
+    char** words = g_strsplit(input, " ", -1);
+    struct filter_query* query = LOG_ERR_MALLOC(struct filter_query, 1);
+    query->tokens = LOG_ERR_MALLOC(struct filter_token, g_strv_length(words) + 1);
+    query->count = 0;
+    query->fuzzy = fuzzy;
+    for (size_t i = 0; words[i]; i++) {
+        const char* word = words[i];
+        bool invert = word[0] == '-' && word[1] != '\0';
+        if (invert)
+            word++;
+        if (word[0] == '\0')
+            continue;
+        struct filter_token* token = &query->tokens[query->count++];
+        token->text = g_utf8_casefold(word, -1);
+        token->size = strlen(token->text);
+        token->invert = invert;
+    }
+    g_strfreev(words);
+    return query;
+}
+
+void free_filter_query(struct filter_query* query) {
+    if (!query)
+        return;
+    for (size_t i = 0; i < query->count; i++) {
+        g_free(query->tokens[i].text);
+    }
+    free(query->tokens);
+    free(query);
+}
+
+// Whether the bytes of needle appear in haystack in order. memchr skips ahead a vector at a time.
+static bool contains_subsequence(const char* haystack, size_t haystack_size, const char* needle, size_t needle_size) {
+    const char* end = haystack + haystack_size;
+    for (size_t i = 0; i < needle_size; i++) {
+        const char* found = memchr(haystack, needle[i], (size_t)(end - haystack));
+        if (!found)
+            return false;
+        haystack = found + 1;
+    }
+    return true;
+}
+
+static bool token_matches(const char* haystack, size_t haystack_size, const struct filter_token* token, bool fuzzy) {
+    if (memmem(haystack, haystack_size, token->text, token->size))
+        return true;
+    if (!fuzzy)
+        return false;
+    // the letters of a fuzzy match all come from the title, or all from the selftext
+    const char* end = haystack + haystack_size;
+    for (const char* field = haystack;;) {
+        const char* field_end = memchr(field, '\0', (size_t)(end - field));
+        if (!field_end)
+            field_end = end;
+        if (contains_subsequence(field, (size_t)(field_end - field), token->text, token->size))
+            return true;
+        if (field_end == end)
+            return false;
+        field = field_end + 1;
+    }
+}
+
+bool listings_filter_match(const struct listings_filter* filter, size_t position, const struct filter_query* query) {
+    if (position >= listings_filter_count(filter))
+        return false;
+    size_t start = g_array_index(filter->starts, size_t, position);
+    size_t end = g_array_index(filter->starts, size_t, position + 1);
+    const char* haystack = filter->text->str + start;
+    for (size_t i = 0; i < query->count; i++) {
+        const struct filter_token* token = &query->tokens[i];
+        if (token_matches(haystack, end - start, token, query->fuzzy && !token->invert) == token->invert)
+            return false;
+    }
+    return true;
+}
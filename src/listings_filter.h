@@ -0,0 +1,41 @@
+#ifndef LISTINGS_FILTER_H
+#define LISTINGS_FILTER_H
+
+#include "reddit.h"
+#include <stdbool.h>
+#include <stddef.h>
+
+// Case folded text of every thread, packed back to back into one buffer when the threads arrive, so that matching a
+// keystroke against thousands of them is a scan over contiguous memory rather than a fold and allocation per row.
+struct listings_filter;
+
+struct listings_filter* new_listings_filter(bool include_selftext);
+
+// Packs the text of more threads behind the ones already in the filter. Positions follow the order of addition.
+void listings_filter_add(struct listings_filter* filter, const struct listing* items, size_t count);
+
+size_t listings_filter_count(const struct listings_filter* filter);
+
+void free_listings_filter(struct listings_filter* filter);
+
+struct filter_token {
+    char* text;
+    size_t size;
+    // like in rofi, a leading '-' only keeps threads that don't match
+    bool invert;
+};
+
+// The input split on spaces into case folded tokens, every one of which has to match. With fuzzy set, a token also
+// matches when its characters appear in order with gaps, e.g. "rstlng" in "rust language".
+struct filter_query {
+    struct filter_token* tokens;
+    size_t count;
+    bool fuzzy;
+};
+
+struct filter_query* new_filter_query(const char* input, bool fuzzy);
+void free_filter_query(struct filter_query* query);
+
+bool listings_filter_match(const struct listings_filter* filter, size_t position, const struct filter_query* query);
+
+#endif
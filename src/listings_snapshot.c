@@ -0,0 +1,203 @@
+#include "listings_snapshot.h"
+#include "memory.h"
+#include "reddit.h"
+#include <glib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// File layout: header, item records, cursor records, then the heap of NUL terminated strings they point into.
+static const char LISTINGS_SNAPSHOT_MAGIC[4] = {'R', 'R', 'L', 'S'};
+// a snapshot from a machine of the other byte order reads as another version
+static const uint32_t LISTINGS_SNAPSHOT_VERSION = 1;
+// offset of strings a listing doesn't have, e.g. the thumbnail of a self post
+static const uint32_t NO_STRING = UINT32_MAX;
+
+struct listings_snapshot_header {
+    char magic[4];
+    uint32_t version;
+    uint32_t item_count;
+    uint32_t cursor_count;
+    uint32_t heap_size;
+    uint32_t etag;
+    int64_t fetched_at;
+};
+
+struct listings_snapshot_item {
+    uint32_t id;
+    uint32_t subreddit;
+    uint32_t title;
+    uint32_t selftext;
+    uint32_t url;
+    uint32_t thumbnail_url;
+    uint32_t ups;
+};
+
+struct listings_snapshot_cursor {
+    uint32_t subreddit;
+    uint32_t after;
+};
+
+struct snapshot_heap {
+    GByteArray* bytes;
+    // offset of every string added so far
+    GHashTable* offsets;
+};
+
+static uint32_t add_string(struct snapshot_heap* heap, const char* value) {
+    if (!value)
+        return NO_STRING;
+    gpointer known = NULL;
+    if (g_hash_table_lookup_extended(heap->offsets, value, NULL, &known))
+        return GPOINTER_TO_UINT(known);
+    uint32_t offset = heap->bytes->len;
+    g_byte_array_append(heap->bytes, (const guint8*)value, strlen(value) + 1);
+    g_hash_table_insert(heap->offsets, (gpointer)value, GUINT_TO_POINTER(offset));
+    return offset;
+}
+
+char* new_listings_snapshot(const struct listings* listings, time_t fetched_at, const char* etag, size_t* size) {
+    struct snapshot_heap heap = {.bytes = g_byte_array_new(), .offsets = g_hash_table_new(g_str_hash, g_str_equal)};
+    struct listings_snapshot_item* items = g_new0(struct listings_snapshot_item, listings->count);
+    // fetched selftext is decoded first, the heap refers to the copies until they are written out
+    char** selftexts = g_new0(char*, listings->count);
+    for (size_t i = 0; i < listings->count; i++) {
+        const struct listing* item = &listings->items[i];
+        selftexts[i] = listing_selftext(item);
+        items[i] = (struct listings_snapshot_item){.id = add_string(&heap, item->id),
+                                                   .subreddit = add_string(&heap, item->subreddit),
+                                                   .title = add_string(&heap, item->title),
+                                                   .selftext = add_string(&heap, selftexts[i]),
+                                                   .url = add_string(&heap, item->url),
+                                                   .thumbnail_url = add_string(&heap, item->thumbnail_url),
+                                                   .ups = item->ups};
+    }
+    struct listings_snapshot_cursor* cursors = g_new0(struct listings_snapshot_cursor, listings->cursor_count);
+    for (size_t i = 0; i < listings->cursor_count; i++) {
+        cursors[i] = (struct listings_snapshot_cursor){.subreddit = add_string(&heap, listings->cursors[i].subreddit),
+                                                       .after = add_string(&heap, listings->cursors[i].after)};
+    }
+    struct listings_snapshot_header header = {.version = LISTINGS_SNAPSHOT_VERSION,
+                                              .item_count = (uint32_t)listings->count,
+                                              .cursor_count = (uint32_t)listings->cursor_count,
+                                              .etag = add_string(&heap, etag),
+                                              .fetched_at = (int64_t)fetched_at};
+    memcpy(header.magic, LISTINGS_SNAPSHOT_MAGIC, sizeof(header.magic));
+    header.heap_size = heap.bytes->len;
+
+    size_t items_size = sizeof(*items) * listings->count;
+    size_t cursors_size = sizeof(*cursors) * listings->cursor_count;
+    *size = sizeof(header) + items_size + cursors_size + heap.bytes->len;
+    char* snapshot = g_malloc(*size);
+    char* at = snapshot;
+    memcpy(at, &header, sizeof(header));
+    at += sizeof(header);
+    memcpy(at, items, items_size);
+    at += items_size;
+    memcpy(at, cursors, cursors_size);
+    at += cursors_size;
+    memcpy(at, heap.bytes->data, heap.bytes->len);
+
+    for (size_t i = 0; i < listings->count; i++) {
+        g_free(selftexts[i]);
+    }
+    g_free(selftexts);
+    g_free(items);
+    g_free(cursors);
+    g_hash_table_destroy(heap.offsets);
+    g_byte_array_free(heap.bytes, TRUE);
+    return snapshot;
+}
+
+// Every string ends inside the heap, which the heap's trailing NUL guarantees once its offset is in bounds.
+static bool is_valid_string(uint32_t offset, uint32_t heap_size) {
+    return offset == NO_STRING || offset < heap_size;
+}
+
+static const char* snapshot_string(const char* heap, uint32_t offset) {
+    return offset == NO_STRING ? NULL : heap + offset;
+}
+
+struct listings* view_listings_snapshot(const char* data, size_t size, struct listings_snapshot_info* info) {
+    struct listings_snapshot_header header;
+    if (size < sizeof(header))
+        return NULL;
+    memcpy(&header, data, sizeof(header));
+    if (memcmp(header.magic, LISTINGS_SNAPSHOT_MAGIC, sizeof(header.magic)) != 0 ||
+        header.version != LISTINGS_SNAPSHOT_VERSION)
+        return NULL;
+    // the counts are 32 bits wide, none of this can overflow
+    uint64_t items_size = (uint64_t)header.item_count * sizeof(struct listings_snapshot_item);
+    uint64_t cursors_size = (uint64_t)header.cursor_count * sizeof(struct listings_snapshot_cursor);
+    if ((uint64_t)size != sizeof(header) + items_size + cursors_size + header.heap_size)
+        return NULL;
+    const char* records = data + sizeof(header);
+    const char* heap = records + items_size + cursors_size;
+    if ((header.heap_size > 0 && heap[header.heap_size - 1] != '\0') ||
+        !is_valid_string(header.etag, header.heap_size))
+        return NULL;
+
+    struct listings* listings = LOG_ERR_MALLOC(struct listings, 1);
+    struct listing* items = LOG_ERR_MALLOC(struct listing, header.item_count > 0 ? header.item_count : 1);
+    listings->arena = new_arena();
+    struct listings_cursor* cursors =
+        header.cursor_count > 0 ? arena_alloc(listings->arena, sizeof(*cursors) * header.cursor_count) : NULL;
+    listings->items = items;
+    listings->count = header.item_count;
+    listings->cursors = cursors;
+    listings->cursor_count = header.cursor_count;
+    bool valid = true;
+    for (size_t i = 0; valid && i < header.item_count; i++) {
+        // records may be unaligned when data is
+        struct listings_snapshot_item item;
+        memcpy(&item, records + i * sizeof(item), sizeof(item));
+        valid = is_valid_string(item.id, header.heap_size) && is_valid_string(item.subreddit, header.heap_size) &&
+                is_valid_string(item.title, header.heap_size) && is_valid_string(item.selftext, header.heap_size) &&
+                is_valid_string(item.url, header.heap_size) && is_valid_string(item.thumbnail_url, header.heap_size);
+        items[i] = (struct listing){.id = (char*)snapshot_string(heap, item.id),
+                                    .subreddit = (char*)snapshot_string(heap, item.subreddit),
+                                    .title = (char*)snapshot_string(heap, item.title),
+                                    .selftext = (char*)snapshot_string(heap, item.selftext),
+                                    .escaped_selftext = NULL,
+                                    .escaped_selftext_size = 0,
+                                    .url = (char*)snapshot_string(heap, item.url),
+                                    .thumbnail_url = (char*)snapshot_string(heap, item.thumbnail_url),
+                                    .ups = item.ups};
+    }
+    for (size_t i = 0; valid && i < header.cursor_count; i++) {
+        struct listings_snapshot_cursor cursor;
+        memcpy(&cursor, records + items_size + i * sizeof(cursor), sizeof(cursor));
+        // a cursor without either can't be followed
+        valid = cursor.subreddit < header.heap_size && cursor.after < header.heap_size;
+        cursors[i] = (struct listings_cursor){.subreddit = snapshot_string(heap, cursor.subreddit),
+                                              .after = snapshot_string(heap, cursor.after)};
+    }
+    if (!valid) {
+        free_listings(listings);
+        return NULL;
+    }
+    info->fetched_at = (time_t)header.fetched_at;
+    info->etag = snapshot_string(heap, header.etag);
+    return listings;
+}
+
+static void unref_mapped_file(void* file) {
+    g_mapped_file_unref((GMappedFile*)file);
+}
+
+struct listings* map_listings_snapshot(const char* path, struct listings_snapshot_info* info) {
+    GMappedFile* file = g_mapped_file_new(path, FALSE, NULL);
+    if (!file)
+        return NULL;
+    struct listings* listings =
+        view_listings_snapshot(g_mapped_file_get_contents(file), g_mapped_file_get_length(file), info);
+    if (!listings) {
+        fprintf(stderr, "Ignoring damaged listings snapshot at %s.\n", path);
+        g_mapped_file_unref(file);
+        return NULL;
+    }
+    arena_release_with(listings->arena, unref_mapped_file, file);
+    return listings;
+}
@@ -0,0 +1,30 @@
+#ifndef LISTINGS_SNAPSHOT_H
+#define LISTINGS_SNAPSHOT_H
+
+#include "reddit.h"
+#include <stddef.h>
+#include <time.h>
+
+// Binary form of listings that is read in place, without parsing: a fixed header, a table of fixed size item and cursor
+// records, and one heap of NUL terminated strings the records refer to by offset. Written and read on the same machine,
+// in its byte order.
+struct listings_snapshot_info {
+    time_t fetched_at;
+    // NULL if the listings came without one. Points into the snapshot.
+    const char* etag;
+};
+
+// The snapshot of the listings, *size bytes. Strings repeated across threads, like subreddit names, are stored once.
+// Free with g_free.
+char* new_listings_snapshot(const struct listings* listings, time_t fetched_at, const char* etag, size_t* size);
+
+// Listings whose strings point into data, which has to outlive them. Only the item and cursor tables are allocated.
+// NULL if data is not a whole snapshot of the current version, whatever it holds instead.
+struct listings* view_listings_snapshot(const char* data, size_t size, struct listings_snapshot_info* info);
+
+// Maps the snapshot at path and views it. The listings own the mapping, free_listings unmaps it. NULL if the file is
+// missing or not a valid snapshot. The file must only ever be replaced by renaming another over it, never rewritten in
+// place.
+struct listings* map_listings_snapshot(const char* path, struct listings_snapshot_info* info);
+
+#endif
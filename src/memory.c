@@ -1,6 +1,36 @@
 #include "memory.h"
+#include <stdalign.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stddef.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+
+// Big enough for a default page of listings, blocks double from there up to the max.
+static const size_t ARENA_FIRST_BLOCK_SIZE = 4 * 1024;
+static const size_t ARENA_MAX_BLOCK_SIZE = 256 * 1024;
+
+struct arena_block {
+    struct arena_block* next;
+    size_t size;
+    size_t used;
+    alignas(max_align_t) char data[];
+};
+
+// Allocated from the arena it belongs to.
+struct arena_release {
+    struct arena_release* next;
+    void (*release)(void*);
+    void* data;
+};
+
+struct arena {
+    struct arena_block* head;
+    struct arena_release* releases;
+    size_t next_block_size;
+    struct arena_stats stats;
+};
 
 void* log_err_malloc(size_t size) {
     void* ptr = malloc(size);
@@ -10,3 +40,124 @@ void* log_err_malloc(size_t size) {
     }
     return ptr;
 }
+
+struct arena* new_arena(void) {
+    struct arena* arena = LOG_ERR_MALLOC(struct arena, 1);
+    arena->head = NULL;
+    arena->releases = NULL;
+    arena->next_block_size = ARENA_FIRST_BLOCK_SIZE;
+    arena->stats = (struct arena_stats){0};
+    return arena;
+}
+
+// Requests larger than the next block get a block of their own, linked behind the head so that later allocations keep
+// bumping into the head's free tail, and without growing the blocks that follow.
+static struct arena_block* new_arena_block(struct arena* arena, size_t min_size) {
+    bool oversized = min_size > arena->next_block_size;
+    size_t size = oversized ? min_size : arena->next_block_size;
+    if (!oversized && arena->next_block_size < ARENA_MAX_BLOCK_SIZE)
+        arena->next_block_size *= 2;
+    struct arena_block* block = log_err_malloc(sizeof(struct arena_block) + size);
+    block->size = size;
+    block->used = 0;
+    struct arena_block** insert_at = oversized && arena->head ? &arena->head->next : &arena->head;
+    block->next = *insert_at;
+    *insert_at = block;
+    arena->stats.allocations++;
+    arena->stats.bytes_allocated += size;
+    return block;
+}
+
+static void* arena_alloc_aligned(struct arena* arena, size_t size, size_t alignment) {
+    struct arena_block* block = arena->head;
+    size_t offset = block ? (block->used + alignment - 1) & ~(alignment - 1) : 0;
+    if (!block || offset + size > block->size) {
+        block = new_arena_block(arena, size);
+        offset = 0;
+    }
+    block->used = offset + size;
+    arena->stats.bytes_used += size;
+    return block->data + offset;
+}
+
+void* arena_alloc(struct arena* arena, size_t size) {
+    return arena_alloc_aligned(arena, size, alignof(max_align_t));
+}
+
+char* arena_strndup(struct arena* arena, const char* str, size_t size) {
+    char* copy = arena_alloc_aligned(arena, size + 1, 1);
+    memcpy(copy, str, size);
+    copy[size] = '\0';
+    return copy;
+}
+
+char* arena_strdup(struct arena* arena, const char* str) {
+    return arena_strndup(arena, str, strlen(str));
+}
+
+char* arena_printf(struct arena* arena, const char* format, ...) {
+    va_list args;
+    va_start(args, format);
+    int size = vsnprintf(NULL, 0, format, args);
+    va_end(args);
+    char* str = arena_alloc_aligned(arena, (size_t)size + 1, 1);
+    va_start(args, format);
+    vsnprintf(str, (size_t)size + 1, format, args);
+    va_end(args);
+    return str;
+}
+
+struct arena_stats arena_stats(const struct arena* arena) {
+    return arena->stats;
+}
+
+void arena_release_with(struct arena* arena, void (*release)(void*), void* data) {
+    struct arena_release* entry = arena_alloc(arena, sizeof(*entry));
+    entry->release = release;
+    entry->data = data;
+    entry->next = arena->releases;
+    arena->releases = entry;
+}
+
+void arena_adopt(struct arena* destination, struct arena* source) {
+    if (!source)
+        return;
+    struct arena_block* last = source->head;
+    while (last && last->next) {
+        last = last->next;
+    }
+    if (last) {
+        // keep bumping into destination's current block, source's blocks go behind it
+        struct arena_block** insert_at = destination->head ? &destination->head->next : &destination->head;
+        last->next = *insert_at;
+        *insert_at = source->head;
+    }
+    struct arena_release* last_release = source->releases;
+    while (last_release && last_release->next) {
+        last_release = last_release->next;
+    }
+    if (last_release) {
+        last_release->next = destination->releases;
+        destination->releases = source->releases;
+    }
+    destination->stats.allocations += source->stats.allocations;
+    destination->stats.bytes_allocated += source->stats.bytes_allocated;
+    destination->stats.bytes_used += source->stats.bytes_used;
+    free(source);
+}
+
+void free_arena(struct arena* arena) {
+    if (!arena)
+        return;
+    // the entries live in the blocks, which go next
+    for (struct arena_release* entry = arena->releases; entry; entry = entry->next) {
+        entry->release(entry->data);
+    }
+    struct arena_block* block = arena->head;
+    while (block) {
+        struct arena_block* next = block->next;
+        free(block);
+        block = next;
+    }
+    free(arena);
+}
@@ -7,4 +7,28 @@
 
 void* log_err_malloc(size_t size);
 
+// Bump allocator for data that shares a lifetime, e.g. every string of one listings fetch. Allocations are never freed
+// individually; free_arena releases all of them at once.
+struct arena;
+
+struct arena_stats {
+    // number of blocks requested from malloc
+    size_t allocations;
+    size_t bytes_allocated;
+    size_t bytes_used;
+};
+
+struct arena* new_arena(void);
+void* arena_alloc(struct arena* arena, size_t size);
+char* arena_strdup(struct arena* arena, const char* str);
+char* arena_strndup(struct arena* arena, const char* str, size_t size);
+char* arena_printf(struct arena* arena, const char* format, ...) __attribute__((format(printf, 2, 3)));
+struct arena_stats arena_stats(const struct arena* arena);
+// Calls release(data) when the arena is freed, e.g. to unmap a file its allocations point into. Moves along with
+// arena_adopt.
+void arena_release_with(struct arena* arena, void (*release)(void*), void* data);
+// Moves every block of source into destination, which then owns all allocations made from either. Frees source.
+void arena_adopt(struct arena* destination, struct arena* source);
+void free_arena(struct arena* arena);
+
 #endif
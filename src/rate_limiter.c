@@ -0,0 +1,68 @@
+#include "rate_limiter.h"
+#include "memory.h"
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+// of every window, only the user's requests may use it
+static const double BACKGROUND_RESERVE_SHARE = 0.2;
+// how long a 429 without X-Ratelimit-Reset holds off every request
+static const int64_t DEFAULT_BACKOFF_SECONDS = 60;
+
+struct rate_limiter {
+    // whether a window announced by Reddit is running
+    bool known;
+    // left in the window, minus the requests sent since Reddit last said
+    double remaining;
+    // requests the window started with, 0 if Reddit didn't say
+    double size;
+    time_t reset_at;
+};
+
+struct rate_limiter* new_rate_limiter(void) {
+    struct rate_limiter* limiter = LOG_ERR_MALLOC(struct rate_limiter, 1);
+    limiter->known = false;
+    limiter->remaining = 0;
+    limiter->size = 0;
+    limiter->reset_at = 0;
+    return limiter;
+}
+
+void rate_limiter_update(struct rate_limiter* limiter, double used, double remaining, int64_t reset_in,
+                         bool too_many_requests, time_t now) {
+    if (too_many_requests) {
+        remaining = 0;
+        if (reset_in < 0)
+            reset_in = DEFAULT_BACKOFF_SECONDS;
+        fprintf(stderr, "Reddit's request limit is used up for the next %" PRId64 " seconds.\n", reset_in);
+    }
+    if (remaining < 0 || reset_in < 0)
+        return;
+    bool same_window = limiter->known && now < limiter->reset_at;
+    // responses of concurrent requests come in any order, the lowest count is the latest
+    limiter->remaining = same_window && limiter->remaining < remaining ? limiter->remaining : remaining;
+    if (used >= 0 && (!same_window || used + remaining > limiter->size))
+        limiter->size = used + remaining;
+    limiter->reset_at = now + reset_in;
+    limiter->known = true;
+}
+
+int64_t rate_limiter_acquire(struct rate_limiter* limiter, enum request_priority priority, size_t count, time_t now) {
+    if (limiter->known && now >= limiter->reset_at)
+        limiter->known = false;
+    if (!limiter->known)
+        return 0;
+    double reserve = priority == REQUEST_PRIORITY_BACKGROUND ? limiter->size * BACKGROUND_RESERVE_SHARE : 0;
+    if (limiter->remaining - (double)count < reserve) {
+        int64_t reset_in = (int64_t)(limiter->reset_at - now);
+        return reset_in > 0 ? reset_in : 1;
+    }
+    limiter->remaining -= (double)count;
+    return 0;
+}
+
+void free_rate_limiter(struct rate_limiter* limiter) {
+    if (!limiter)
+        return;
+    free(limiter);
+}
@@ -0,0 +1,35 @@
+#ifndef RATE_LIMITER_H
+#define RATE_LIMITER_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+
+enum request_priority {
+    // the user is waiting for the answer
+    REQUEST_PRIORITY_USER,
+    // prefetches, nobody has asked for them yet
+    REQUEST_PRIORITY_BACKGROUND
+};
+
+// Reddit's budget of requests, as its X-Ratelimit headers announce it: so many per window, all given back when the
+// window ends. Requests are deducted as they are sent, so that the budget stays right between responses. Background
+// requests leave a share of the window to the user's, so that prefetching alone never runs into a 429. Not thread
+// safe.
+struct rate_limiter;
+
+struct rate_limiter* new_rate_limiter(void);
+
+// Takes in the headers of a response received at now, -1 for those it came without. too_many_requests for 429s, which
+// use up the window even when they say nothing about it.
+void rate_limiter_update(struct rate_limiter* limiter, double used, double remaining, int64_t reset_in,
+                         bool too_many_requests, time_t now);
+
+// Deducts count requests of priority from the budget and returns 0 if it allows them, or the seconds until the window
+// ends otherwise. Unknown budgets, e.g. before the first response, allow everything.
+int64_t rate_limiter_acquire(struct rate_limiter* limiter, enum request_priority priority, size_t count, time_t now);
+
+void free_rate_limiter(struct rate_limiter* limiter);
+
+#endif
@@ -1,12 +1,15 @@
 #include "reddit.h"
 #include "curl_wrappers.h"
+#include "listing_stream.h"
 #include "memory.h"
 #include <curl/curl.h>
 #include <curl/easy.h>
 #include <curl/urlapi.h>
 #include <glib.h>
+#include <inttypes.h>
 #include <jansson.h>
 #include <pwd.h>
+#include <stdarg.h>
 #include <stdbool.h>
 #include <stddef.h>
 #include <stdint.h>
@@ -14,14 +17,42 @@
 #include <stdlib.h>
 #include <string.h>
 #include <sys/stat.h>
+#include <time.h>
 #include <tomlc17.h>
 #include <unistd.h>
 
 static const char* const HTTPS_SCHEME = "https://";
 static const char* const REDDIT_HOST = "www.reddit.com";
-static const char* const REDDIT_API_HOST = "oauth.reddit.com";
+static const char* const DEFAULT_AUTH_URL = "https://www.reddit.com";
+static const char* const DEFAULT_LISTINGS_URL = "https://oauth.reddit.com";
 
-static const uint16_t* const ACCESS_TOKEN_MAX_SIZE = &(const uint16_t){1024};
+const char* const HOT_LISTINGS_SORT = "hot";
+static const char* const LISTINGS_SORTS[] = {"hot", "new", "rising", "top", "controversial"};
+static const char* const LISTINGS_TIME_RANGES[] = {"hour", "day", "week", "month", "year", "all"};
+// what Reddit ranks top and controversial threads over when no time range is asked for
+static const char* const DEFAULT_TIME_RANGE = "day";
+static const char* const DEFAULT_LISTINGS_SORTS[] = {"hot", "new", "top:week", "rising"};
+
+// Reddit documents a lifetime of one day, used when a token response doesn't say
+static const int64_t DEFAULT_ACCESS_TOKEN_LIFETIME_SECONDS = 86400;
+static const int64_t ACCESS_TOKEN_REFRESH_MARGIN_SECONDS = 300;
+
+static const int64_t DEFAULT_CACHE_TTL_SECONDS = 300;
+static const int64_t DEFAULT_PAGE_SIZE = 25;
+static const int64_t MAX_PAGE_SIZE = 100;
+static const int64_t DEFAULT_PREFETCH_ROWS = 10;
+// libcurl waits up to five minutes by default, which is how long a fetch would hang on a network that drops packets
+static const int64_t DEFAULT_CONNECT_TIMEOUT_MS = 3000;
+static const int64_t DEFAULT_THUMBNAILS_CACHE_SIZE_MB = 32;
+static const int64_t DEFAULT_CONCURRENT_THUMBNAIL_DOWNLOADS = 4;
+static const int64_t MAX_CONCURRENT_THUMBNAIL_DOWNLOADS = 16;
+static const int64_t DEFAULT_COMMENTS_LIMIT = 50;
+// morechildren takes at most 100 comment ids per request
+static const int64_t MAX_COMMENTS_LIMIT = 100;
+static const int64_t DEFAULT_COMMENTS_DEPTH = 4;
+static const int64_t MAX_COMMENTS_DEPTH = 10;
+static const int64_t DEFAULT_DAEMON_IDLE_TIMEOUT_MINUTES = 30;
+static const int64_t DEFAULT_SEARCH_MAX_RESULTS = 100;
 
 static bool is_auth_filled(const struct app_auth* auth) {
     if (!auth || !auth->client_id || !auth->client_secret)
@@ -38,6 +69,198 @@ static struct app_auth* new_app_auth(toml_result_t toml) {
     return auth;
 }
 
+static int64_t toml_int_or_default(toml_result_t toml, const char* key, int64_t default_value) {
+    toml_datum_t datum = toml_seek(toml.toptab, key);
+    return datum.type == TOML_INT64 ? datum.u.int64 : default_value;
+}
+
+static bool toml_bool_or_default(toml_result_t toml, const char* key, bool default_value) {
+    toml_datum_t datum = toml_seek(toml.toptab, key);
+    return datum.type == TOML_BOOLEAN ? datum.u.boolean : default_value;
+}
+
+static struct filter_cfg new_filter_cfg(toml_result_t toml) {
+    return (struct filter_cfg){.match_selftext = toml_bool_or_default(toml, "filter.match_selftext", false),
+                               .fuzzy = toml_bool_or_default(toml, "filter.fuzzy", true)};
+}
+
+static struct timing_cfg new_timing_cfg(toml_result_t toml) {
+    return (struct timing_cfg){.log = toml_bool_or_default(toml, "timing.log", true),
+                               .show_summary = toml_bool_or_default(toml, "timing.show_summary", false)};
+}
+
+static struct thumbnails_cfg new_thumbnails_cfg(toml_result_t toml) {
+    struct thumbnails_cfg thumbnails = {
+        .show = toml_bool_or_default(toml, "thumbnails.show", true),
+        .cache_size_mb = toml_int_or_default(toml, "thumbnails.cache_size_mb", DEFAULT_THUMBNAILS_CACHE_SIZE_MB),
+        .concurrent_downloads =
+            toml_int_or_default(toml, "thumbnails.concurrent_downloads", DEFAULT_CONCURRENT_THUMBNAIL_DOWNLOADS),
+    };
+    if (thumbnails.cache_size_mb < 1)
+        thumbnails.cache_size_mb = 1;
+    if (thumbnails.concurrent_downloads < 1 || thumbnails.concurrent_downloads > MAX_CONCURRENT_THUMBNAIL_DOWNLOADS) {
+        fprintf(stderr, "thumbnails.concurrent_downloads must be between 1 and %" PRId64 ", falling back to %" PRId64
+                        ".\n",
+                MAX_CONCURRENT_THUMBNAIL_DOWNLOADS, DEFAULT_CONCURRENT_THUMBNAIL_DOWNLOADS);
+        thumbnails.concurrent_downloads = DEFAULT_CONCURRENT_THUMBNAIL_DOWNLOADS;
+    }
+    return thumbnails;
+}
+
+static struct comments_cfg new_comments_cfg(toml_result_t toml) {
+    struct comments_cfg comments = {
+        .limit = toml_int_or_default(toml, "comments.limit", DEFAULT_COMMENTS_LIMIT),
+        .depth = toml_int_or_default(toml, "comments.depth", DEFAULT_COMMENTS_DEPTH),
+    };
+    if (comments.limit < 1 || comments.limit > MAX_COMMENTS_LIMIT) {
+        fprintf(stderr, "comments.limit must be between 1 and %" PRId64 ", falling back to %" PRId64 ".\n",
+                MAX_COMMENTS_LIMIT, DEFAULT_COMMENTS_LIMIT);
+        comments.limit = DEFAULT_COMMENTS_LIMIT;
+    }
+    if (comments.depth < 1 || comments.depth > MAX_COMMENTS_DEPTH) {
+        fprintf(stderr, "comments.depth must be between 1 and %" PRId64 ", falling back to %" PRId64 ".\n",
+                MAX_COMMENTS_DEPTH, DEFAULT_COMMENTS_DEPTH);
+        comments.depth = DEFAULT_COMMENTS_DEPTH;
+    }
+    return comments;
+}
+
+static struct daemon_cfg new_daemon_cfg(toml_result_t toml) {
+    struct daemon_cfg daemon = {
+        .enabled = toml_bool_or_default(toml, "daemon.enabled", false),
+        .idle_timeout_minutes =
+            toml_int_or_default(toml, "daemon.idle_timeout_minutes", DEFAULT_DAEMON_IDLE_TIMEOUT_MINUTES),
+    };
+    if (daemon.idle_timeout_minutes < 1) {
+        fprintf(stderr, "daemon.idle_timeout_minutes must be at least 1, falling back to %" PRId64 ".\n",
+                DEFAULT_DAEMON_IDLE_TIMEOUT_MINUTES);
+        daemon.idle_timeout_minutes = DEFAULT_DAEMON_IDLE_TIMEOUT_MINUTES;
+    }
+    return daemon;
+}
+
+static struct search_cfg new_search_cfg(toml_result_t toml) {
+    struct search_cfg search = {
+        .enabled = toml_bool_or_default(toml, "search.enabled", true),
+        .max_results = toml_int_or_default(toml, "search.max_results", DEFAULT_SEARCH_MAX_RESULTS),
+    };
+    if (search.max_results < 1) {
+        fprintf(stderr, "search.max_results must be at least 1, falling back to %" PRId64 ".\n",
+                DEFAULT_SEARCH_MAX_RESULTS);
+        search.max_results = DEFAULT_SEARCH_MAX_RESULTS;
+    }
+    return search;
+}
+
+static bool is_any_of(const char* value, const char* const* values, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        if (strcmp(value, values[i]) == 0)
+            return true;
+    }
+    return false;
+}
+
+char* normalize_listings_sort(const char* sort) {
+    if (!sort)
+        return NULL;
+    char* name = g_strstrip(g_ascii_strdown(sort, -1));
+    char* range = strchr(name, ':');
+    if (range)
+        *range++ = '\0';
+    bool ranked = strcmp(name, "top") == 0 || strcmp(name, "controversial") == 0;
+    char* normalized = NULL;
+    if (ranked && (!range || is_any_of(range, LISTINGS_TIME_RANGES, G_N_ELEMENTS(LISTINGS_TIME_RANGES)))) {
+        normalized = g_strdup_printf("%s:%s", name, range ? range : DEFAULT_TIME_RANGE);
+    } else if (!ranked && !range && is_any_of(name, LISTINGS_SORTS, G_N_ELEMENTS(LISTINGS_SORTS))) {
+        normalized = g_strdup(name);
+    }
+    g_free(name);
+    return normalized;
+}
+
+// Unknown and repeated sorts are dropped, the defaults are used when none are left.
+static char** new_listings_sorts(toml_result_t toml, size_t* count) {
+    toml_datum_t configured = toml_seek(toml.toptab, "listings.sorts");
+    GPtrArray* sorts = g_ptr_array_new();
+    for (int32_t i = 0; configured.type == TOML_ARRAY && i < configured.u.arr.size; i++) {
+        toml_datum_t entry = configured.u.arr.elem[i];
+        char* sort = entry.type == TOML_STRING ? normalize_listings_sort(entry.u.s) : NULL;
+        if (!sort) {
+            fprintf(stderr, "Unknown sort in listings.sorts, skipping it.\n");
+        } else if (g_ptr_array_find_with_equal_func(sorts, sort, g_str_equal, NULL)) {
+            g_free(sort);
+        } else {
+            g_ptr_array_add(sorts, sort);
+        }
+    }
+    for (size_t i = 0; sorts->len == 0 && i < G_N_ELEMENTS(DEFAULT_LISTINGS_SORTS); i++) {
+        g_ptr_array_add(sorts, g_strdup(DEFAULT_LISTINGS_SORTS[i]));
+    }
+    *count = sorts->len;
+    g_ptr_array_add(sorts, NULL);
+    return (char**)g_ptr_array_free(sorts, FALSE);
+}
+
+static struct listings_cfg new_listings_cfg(toml_result_t toml) {
+    struct listings_cfg listings = {
+        .merge_order = LISTINGS_MERGE_HOT,
+        .page_size = toml_int_or_default(toml, "listings.page_size", DEFAULT_PAGE_SIZE),
+        .prefetch_rows = toml_int_or_default(toml, "listings.prefetch_rows", DEFAULT_PREFETCH_ROWS),
+        .sorts = NULL,
+        .sort_count = 0,
+        .prefetch_sorts = toml_bool_or_default(toml, "listings.prefetch_sorts", true),
+    };
+    listings.sorts = new_listings_sorts(toml, &listings.sort_count);
+    if (listings.page_size < 1 || listings.page_size > MAX_PAGE_SIZE) {
+        fprintf(stderr, "listings.page_size must be between 1 and %" PRId64 ", falling back to %" PRId64 ".\n",
+                MAX_PAGE_SIZE, DEFAULT_PAGE_SIZE);
+        listings.page_size = DEFAULT_PAGE_SIZE;
+    }
+    if (listings.prefetch_rows < 0)
+        listings.prefetch_rows = 0;
+    toml_datum_t merge_order = toml_seek(toml.toptab, "listings.merge_order");
+    if (merge_order.type == TOML_STRING && strcmp(merge_order.u.s, "ups") == 0) {
+        listings.merge_order = LISTINGS_MERGE_UPS;
+    } else if (merge_order.type == TOML_STRING && strcmp(merge_order.u.s, "hot") != 0) {
+        fprintf(stderr, "Unknown listings.merge_order '%s', falling back to 'hot'.\n", merge_order.u.s);
+    }
+    return listings;
+}
+
+static struct completion_cfg new_completion_cfg(toml_result_t toml) {
+    struct completion_cfg completion = {.import_path = NULL};
+    toml_datum_t import_path = toml_seek(toml.toptab, "completion.import_path");
+    if (import_path.type != TOML_STRING || import_path.u.s[0] == '\0')
+        return completion;
+    completion.import_path = g_str_has_prefix(import_path.u.s, "~/")
+                                 ? g_build_filename(g_get_home_dir(), import_path.u.s + 2, NULL)
+                                 : g_strdup(import_path.u.s);
+    return completion;
+}
+
+static char* toml_string_or_default(toml_result_t toml, const char* key, const char* default_value) {
+    toml_datum_t datum = toml_seek(toml.toptab, key);
+    return g_strdup(datum.type == TOML_STRING && datum.u.s[0] != '\0' ? datum.u.s : default_value);
+}
+
+static struct api_cfg new_api_cfg(toml_result_t toml) {
+    struct api_cfg api = {
+        .auth_url = toml_string_or_default(toml, "api.auth_url", DEFAULT_AUTH_URL),
+        .listings_url = toml_string_or_default(toml, "api.listings_url", DEFAULT_LISTINGS_URL),
+        .connect_timeout_ms = toml_int_or_default(toml, "api.connect_timeout_ms", DEFAULT_CONNECT_TIMEOUT_MS),
+    };
+    if (api.connect_timeout_ms < 0)
+        api.connect_timeout_ms = DEFAULT_CONNECT_TIMEOUT_MS;
+    return api;
+}
+
+static struct cache_cfg new_cache_cfg(toml_result_t toml) {
+    struct cache_cfg cache = {.ttl_seconds = toml_int_or_default(toml, "cache.ttl_seconds", DEFAULT_CACHE_TTL_SECONDS)};
+    if (cache.ttl_seconds < 0)
+        cache.ttl_seconds = 0;
+    return cache;
+}
+
 static void free_app_auth(struct app_auth* auth) {
     if (!auth)
         return;
@@ -64,44 +287,64 @@ struct rofi_reddit_paths* new_rofi_reddit_paths() {
     struct stat cfg_dir_stat;
     if (stat(plugin_cfg_dir, &cfg_dir_stat) != 0 || !S_ISDIR(cfg_dir_stat.st_mode)) {
         fprintf(stderr, "Rofi Reddit config directory does not exist. This is a symptom of the installing process "
-                        "having gone wrong. Try reinstalling. Aborting.\n");
+                        "having gone wrong. Try reinstalling.\n");
         free(plugin_cfg_dir);
-        exit(EXIT_FAILURE);
+        return NULL;
     }
     char* config_file_path = g_build_filename(plugin_cfg_dir, "config.toml", NULL);
     free(plugin_cfg_dir);
     if (access(config_file_path, F_OK) != 0 || access(config_file_path, R_OK) != 0) {
         fprintf(
             stderr,
-            "Rofi Reddit config file does not exist or lacks read permissions at %s. Check permissions. Aborting.\n",
+            "Rofi Reddit config file does not exist or lacks read permissions at %s. Check permissions.\n",
             config_file_path);
         free(config_file_path);
-        exit(EXIT_FAILURE);
+        return NULL;
     }
     struct rofi_reddit_paths* paths = LOG_ERR_MALLOC(struct rofi_reddit_paths, 1);
     paths->config_path = config_file_path;
-    char* xdg_cache = getenv("XDG_CACHE_HOME");
-    char* user_cache_dir =
-        xdg_cache && xdg_cache[0] != '\0' ? xdg_cache : g_build_filename(getenv("HOME"), ".cache", NULL);
+    paths->access_token_cache_path = NULL;
+    paths->cache_dir = NULL;
+    paths->listings_cache_dir = NULL;
+    paths->subreddit_index_path = NULL;
+    paths->subreddit_history_path = NULL;
+    paths->search_index_dir = NULL;
+    paths->timing_log_path = NULL;
+    paths->timing_histogram_path = NULL;
+    paths->thumbnails_cache_dir = NULL;
+    paths->daemon_socket_path = NULL;
+    const char* xdg_cache = getenv("XDG_CACHE_HOME");
+    char* user_cache_dir = xdg_cache && xdg_cache[0] != '\0' ? g_strdup(xdg_cache)
+                                                             : g_build_filename(getenv("HOME"), ".cache", NULL);
     char* plugin_cache_dir = g_build_filename(user_cache_dir, "rofi-reddit", NULL);
     free(user_cache_dir);
-    if (create_dir_if_not_exists(plugin_cache_dir) != 0) {
+    char* listings_cache_dir = g_build_filename(plugin_cache_dir, "listings", NULL);
+    if (create_dir_if_not_exists(plugin_cache_dir) != 0 || create_dir_if_not_exists(listings_cache_dir) != 0) {
         fprintf(stderr,
                 "Failed to create or access cache directory at %s. Check permissions. This will lead to more Reddit "
                 "API calls than necessary.\n",
                 plugin_cache_dir);
         free(plugin_cache_dir);
+        free(listings_cache_dir);
         free_rofi_reddit_paths(paths);
-        exit(EXIT_FAILURE);
+        return NULL;
     }
     paths->access_token_cache_path = g_build_filename(plugin_cache_dir, "access_token", NULL);
     struct stat access_token_cache_stat;
     // access token exists, process has read permissions and file is nonempty
     paths->access_token_cache_exists = stat(paths->access_token_cache_path, &access_token_cache_stat) == 0 &&
-                                       access(paths->access_token_cache_path, R_OK) == 0 && cfg_dir_stat.st_size > 0;
+                                       access(paths->access_token_cache_path, R_OK) == 0 &&
+                                       access_token_cache_stat.st_size > 0;
 
-    free(plugin_cache_dir);
-    free(xdg_cache);
+    paths->cache_dir = plugin_cache_dir;
+    paths->listings_cache_dir = listings_cache_dir;
+    paths->subreddit_index_path = g_build_filename(plugin_cache_dir, "subreddits.idx", NULL);
+    paths->subreddit_history_path = g_build_filename(plugin_cache_dir, "history", NULL);
+    paths->search_index_dir = g_build_filename(plugin_cache_dir, "search", NULL);
+    paths->timing_log_path = g_build_filename(plugin_cache_dir, "timings.jsonl", NULL);
+    paths->timing_histogram_path = g_build_filename(plugin_cache_dir, "timings.json", NULL);
+    paths->thumbnails_cache_dir = g_build_filename(plugin_cache_dir, "thumbnails", NULL);
+    paths->daemon_socket_path = g_build_filename(g_get_user_runtime_dir(), "rofi-reddit.sock", NULL);
     return paths;
 }
 
@@ -110,10 +353,21 @@ void free_rofi_reddit_paths(const struct rofi_reddit_paths* paths) {
         return;
     free((void*)paths->config_path);
     free((void*)paths->access_token_cache_path);
+    free((void*)paths->cache_dir);
+    free((void*)paths->listings_cache_dir);
+    free((void*)paths->subreddit_index_path);
+    free((void*)paths->subreddit_history_path);
+    free((void*)paths->search_index_dir);
+    free((void*)paths->timing_log_path);
+    free((void*)paths->timing_histogram_path);
+    free((void*)paths->thumbnails_cache_dir);
+    free((void*)paths->daemon_socket_path);
     free((void*)paths);
 }
 
 struct rofi_reddit_cfg* new_rofi_reddit_cfg(struct rofi_reddit_paths* paths) {
+    if (!paths)
+        return NULL;
     if (access(paths->config_path, F_OK) != 0 || access(paths->config_path, R_OK) != 0) {
         fprintf(
             stderr,
@@ -122,6 +376,7 @@ struct rofi_reddit_cfg* new_rofi_reddit_cfg(struct rofi_reddit_paths* paths) {
         return NULL;
     }
     struct rofi_reddit_cfg* cfg = (struct rofi_reddit_cfg*)LOG_ERR_MALLOC(struct rofi_reddit_cfg, 1);
+    *cfg = (struct rofi_reddit_cfg){0};
     toml_result_t parsed_toml = toml_parse_file_ex(paths->config_path);
     if (!parsed_toml.ok) {
         fprintf(stderr, "Failed to parse config file: %s\n", parsed_toml.errmsg);
@@ -139,6 +394,16 @@ struct rofi_reddit_cfg* new_rofi_reddit_cfg(struct rofi_reddit_paths* paths) {
         toml_free(parsed_toml);
         return NULL;
     }
+    cfg->api = new_api_cfg(parsed_toml);
+    cfg->cache = new_cache_cfg(parsed_toml);
+    cfg->listings = new_listings_cfg(parsed_toml);
+    cfg->completion = new_completion_cfg(parsed_toml);
+    cfg->filter = new_filter_cfg(parsed_toml);
+    cfg->timing = new_timing_cfg(parsed_toml);
+    cfg->thumbnails = new_thumbnails_cfg(parsed_toml);
+    cfg->comments = new_comments_cfg(parsed_toml);
+    cfg->daemon = new_daemon_cfg(parsed_toml);
+    cfg->search = new_search_cfg(parsed_toml);
     toml_free(parsed_toml);
     cfg->auth = auth;
     cfg->paths = paths;
@@ -148,16 +413,38 @@ struct rofi_reddit_cfg* new_rofi_reddit_cfg(struct rofi_reddit_paths* paths) {
 void free_rofi_reddit_cfg(const struct rofi_reddit_cfg* cfg) {
     if (!cfg)
         return;
-    if (!cfg->paths)
-        free_rofi_reddit_paths(cfg->paths);
-    if (!cfg->auth)
-        free_app_auth(cfg->auth);
+    free_rofi_reddit_paths(cfg->paths);
+    free_app_auth(cfg->auth);
+    g_free(cfg->api.auth_url);
+    g_free(cfg->api.listings_url);
+    g_free(cfg->completion.import_path);
+    g_strfreev(cfg->listings.sorts);
     free((void*)cfg);
 }
 
+struct rofi_reddit_cfg* load_rofi_reddit_cfg(void) {
+    struct rofi_reddit_paths* paths = new_rofi_reddit_paths();
+    struct rofi_reddit_cfg* cfg = new_rofi_reddit_cfg(paths);
+    if (!cfg)
+        free_rofi_reddit_paths(paths);
+    return cfg;
+}
+
 RedditApp* new_reddit_app(struct rofi_reddit_cfg* config) {
     RedditApp* app = (RedditApp*)LOG_ERR_MALLOC(RedditApp, 1);
     app->config = config;
+    // every request of the app is made from the fetch worker's one thread
+    app->connections = new_connection_pool(true);
+    app->buffers = new_response_buffer_pool();
+    app->timings = NULL;
+    app->search = NULL;
+    app->auth_unreachable = false;
+    // the histograms behind the summary are kept either way, the log only when asked for
+    if (config->paths && (config->timing.log || config->timing.show_summary))
+        app->timings = new_timing_log(config->timing.log ? config->paths->timing_log_path : NULL,
+                                      config->paths->timing_histogram_path);
+    if (config->paths && config->search.enabled)
+        app->search = new_search_index(config->paths->search_index_dir);
     app->http_client = curl_easy_init();
     if (!app->http_client) {
         fprintf(stderr, "Failed to initialize CURL.\n");
@@ -170,30 +457,45 @@ void free_reddit_app(RedditApp* app) {
     if (!app)
         return;
     curl_easy_cleanup(app->http_client);
+    free_connection_pool(app->connections);
+    struct response_buffer_pool_stats buffer_stats = response_buffer_pool_stats(app->buffers);
+    fprintf(stdout, "Response buffers: %zu of %zu reused, largest %zu KiB.\n", buffer_stats.reused,
+            buffer_stats.acquired, buffer_stats.high_water_mark / 1024);
+    free_response_buffer_pool(app->buffers);
+    free_timing_log(app->timings);
+    free_search_index(app->search);
     free_rofi_reddit_cfg(app->config);
     free(app);
 }
 
-static size_t write_callback(char* buffer, size_t chunks, size_t chunk_size, void* stream) {
-    struct response_buffer* resp = (struct response_buffer*)stream;
+// Successful listing responses are deserialized while they download; anything else is buffered whole so the caller
+// can inspect the error payload.
+struct listings_sink {
+    CURL* client;
+    struct response_buffer* raw;
+    struct listing_stream* stream;
+    bool status_known;
+    int64_t deserialize_us;
+};
+
+static size_t listings_write_callback(char* buffer, size_t chunks, size_t chunk_size, void* stream) {
+    struct listings_sink* sink = (struct listings_sink*)stream;
+    if (!sink->status_known) {
+        long status = 0;
+        curl_easy_getinfo(sink->client, CURLINFO_RESPONSE_CODE, &status);
+        if (http_status_code_from(status) == HTTP_OK)
+            sink->stream = new_listing_stream();
+        sink->status_known = true;
+    }
+    if (!sink->stream)
+        return write_to_response_buffer(buffer, chunks, chunk_size, sink->raw);
     size_t realsize = chunks * chunk_size;
-    char* ptr = realloc(resp->buffer, resp->size + realsize + 1);
-    resp->buffer = ptr;
-    memcpy(&(resp->buffer[resp->size]), buffer, realsize);
-    resp->size += realsize;
-    resp->buffer[resp->size] = 0;
+    gint64 started = g_get_monotonic_time();
+    listing_stream_feed(sink->stream, buffer, realsize);
+    sink->deserialize_us += g_get_monotonic_time() - started;
     return realsize;
 }
 
-static struct curl_slist* user_agent_header(const RedditApp* const app) {
-    const char* ua_header_key = "User-Agent";
-    size_t header_size = strlen(ua_header_key) + strlen(app->config->auth->client_name) + 1;
-    char* ua_header = (char*)LOG_ERR_MALLOC(char, header_size);
-    snprintf(ua_header, header_size, "%s: %s", ua_header_key, app->config->auth->client_name);
-    struct curl_slist* headers = curl_slist_append(NULL, ua_header);
-    return headers;
-}
-
 static json_t* deserialize_json_response(const struct response_buffer* resp) {
     json_error_t error;
     json_t* root = json_loads(resp->buffer, 0, &error);
@@ -206,26 +508,79 @@ static json_t* deserialize_json_response(const struct response_buffer* resp) {
 
 static RedditAccessToken* deserialize_access_token(const struct response_buffer* resp) {
     json_t* payload = deserialize_json_response(resp);
-    if (payload) {
-        RedditAccessToken* token = (RedditAccessToken*)LOG_ERR_MALLOC(RedditAccessToken, 1);
-        token->token = strdup(json_string_value(json_object_get(payload, "access_token")));
+    if (!payload)
+        return NULL;
+    const char* access_token = json_string_value(json_object_get(payload, "access_token"));
+    if (!access_token || access_token[0] == '\0') {
+        fprintf(stderr, "Access token response carries no token.\n");
         json_decref(payload);
-        return token;
+        return NULL;
     }
-    return NULL;
+    json_t* expires_in = json_object_get(payload, "expires_in");
+    RedditAccessToken* token = (RedditAccessToken*)LOG_ERR_MALLOC(RedditAccessToken, 1);
+    token->token = strdup(access_token);
+    token->expires_at = time(NULL) + (json_is_integer(expires_in) ? (time_t)json_integer_value(expires_in)
+                                                                   : (time_t)DEFAULT_ACCESS_TOKEN_LIFETIME_SECONDS);
+    json_decref(payload);
+    return token;
+}
+
+int64_t access_token_refresh_in(const RedditAccessToken* token) {
+    return (int64_t)(token->expires_at - time(NULL)) - ACCESS_TOKEN_REFRESH_MARGIN_SECONDS;
+}
+
+RedditAccessToken* read_access_token_cache(const char* path) {
+    json_error_t error;
+    json_t* root = json_load_file(path, 0, &error);
+    if (!root)
+        return NULL;
+    const char* access_token = json_string_value(json_object_get(root, "access_token"));
+    json_t* expires_at = json_object_get(root, "expires_at");
+    RedditAccessToken* token = NULL;
+    // caches written before expiries were tracked hold the bare token, which is treated as a miss
+    if (access_token && access_token[0] != '\0' && json_is_integer(expires_at)) {
+        token = LOG_ERR_MALLOC(RedditAccessToken, 1);
+        token->token = strdup(access_token);
+        token->expires_at = (time_t)json_integer_value(expires_at);
+    }
+    json_decref(root);
+    return token;
+}
+
+bool write_access_token_cache(const char* path, const RedditAccessToken* token) {
+    json_t* root = json_object();
+    json_object_set_new(root, "access_token", json_string(token->token));
+    json_object_set_new(root, "expires_at", json_integer((json_int_t)token->expires_at));
+    char* serialized = json_dumps(root, JSON_COMPACT);
+    json_decref(root);
+    if (!serialized)
+        return false;
+    GError* error = NULL;
+    // the token grants API access on behalf of the app, so only the user gets to read it
+    bool written = g_file_set_contents_full(path, serialized, -1, G_FILE_SET_CONTENTS_CONSISTENT, 0600, &error);
+    if (!written) {
+        fprintf(stderr, "Failed to write access token cache at %s: %s\n", path, error->message);
+        g_error_free(error);
+    }
+    free(serialized);
+    return written;
 }
 
-void deserialize_listing(json_t* listing_json, struct listing* deserialize_to, size_t index) {
+void deserialize_listing(json_t* listing_json, struct listing* deserialize_to, size_t index, struct arena* arena) {
     json_t* data = json_object_get(listing_json, "data");
     if (!data || !json_is_object(data) || !json_string_value(json_object_get(data, "title"))) {
         fprintf(stderr, "No data found for listing.\n");
         return;
     }
     struct listing* item = deserialize_to + index;
-    item->title = strdup(json_string_value(json_object_get(data, "title")));
-
-    const char* selftext_val = json_string_value(json_object_get(data, "selftext"));
-    item->selftext = selftext_val ? strdup(selftext_val) : NULL;
+    const char* id_val = json_string_value(json_object_get(data, "id"));
+    item->id = id_val ? arena_strdup(arena, id_val) : NULL;
+    const char* subreddit_val = json_string_value(json_object_get(data, "subreddit"));
+    item->subreddit = subreddit_val ? arena_strdup(arena, subreddit_val) : NULL;
+    item->title = arena_strdup(arena, json_string_value(json_object_get(data, "title")));
+    item->selftext = NULL;
+    item->escaped_selftext = NULL;
+    item->escaped_selftext_size = 0;
 
     json_t* ups_json = json_object_get(data, "ups");
     item->ups = (ups_json && json_is_integer(ups_json)) ? (uint32_t)json_integer_value(ups_json) : 0;
@@ -235,60 +590,208 @@ void deserialize_listing(json_t* listing_json, struct listing* deserialize_to, s
 
     item->url = NULL;
     if (path_val) {
-        size_t len = strlen(HTTPS_SCHEME) + strlen(REDDIT_HOST) + strlen(path_val) + 1;
-        char* parsed_url = LOG_ERR_MALLOC(char, len);
-        snprintf(parsed_url, len, "%s%s%s", HTTPS_SCHEME, REDDIT_HOST, path_val);
-        item->url = parsed_url;
+        item->url = arena_printf(arena, "%s%s%s", HTTPS_SCHEME, REDDIT_HOST, path_val);
     } else {
         fprintf(stderr, "No URL or permalink found for listing.\n");
     }
+    // "self", "default", "nsfw" and the like stand for Reddit's placeholder images, which aren't worth a download
+    const char* thumbnail_val = json_string_value(json_object_get(data, "thumbnail"));
+    item->thumbnail_url =
+        thumbnail_val && g_str_has_prefix(thumbnail_val, HTTPS_SCHEME) ? arena_strdup(arena, thumbnail_val) : NULL;
+}
+
+char* listing_selftext(const struct listing* listing) {
+    if (listing->selftext)
+        return listing->selftext[0] != '\0' ? g_strdup(listing->selftext) : NULL;
+    if (!listing->escaped_selftext || listing->escaped_selftext_size == 0)
+        return NULL;
+    // jansson does the unescaping once the quotes are back around it
+    GString* quoted = g_string_sized_new(listing->escaped_selftext_size + 2);
+    g_string_append_c(quoted, '"');
+    g_string_append_len(quoted, listing->escaped_selftext, (gssize)listing->escaped_selftext_size);
+    g_string_append_c(quoted, '"');
+    json_error_t error;
+    json_t* selftext_json = json_loadb(quoted->str, quoted->len, JSON_DECODE_ANY, &error);
+    g_string_free(quoted, TRUE);
+    if (!selftext_json) {
+        fprintf(stderr, "Error decoding selftext: %s\n", error.text);
+        return NULL;
+    }
+    char* selftext = g_strdup(json_string_value(selftext_json));
+    json_decref(selftext_json);
+    return selftext;
 }
 
 struct listings* deserialize_listings(const struct response_buffer* resp) {
-    json_t* payload = deserialize_json_response(resp);
-    if (payload) {
-        json_t* listing_payloads = json_object_get(json_object_get(payload, "data"), "children");
-        size_t count = json_array_size(listing_payloads);
-        struct listings* reddit_listings = (struct listings*)LOG_ERR_MALLOC(struct listings, 1);
-        struct listing* items = (struct listing*)LOG_ERR_MALLOC(struct listing, count);
+    struct listing_stream* stream = new_listing_stream();
+    listing_stream_feed(stream, resp->buffer, resp->size);
+    struct listings* reddit_listings = listing_stream_finish(stream);
+    free_listing_stream(stream);
+    return reddit_listings;
+}
+
+void free_listings(const struct listings* listings) {
+    if (!listings)
+        return;
+    free_arena(listings->arena);
+    free((void*)listings->items);
+    free((void*)listings);
+}
+
+static int compare_listing_ups_descending(const void* a, const void* b) {
+    uint32_t ups_a = ((const struct listing*)a)->ups;
+    uint32_t ups_b = ((const struct listing*)b)->ups;
+    return (ups_a < ups_b) - (ups_a > ups_b);
+}
+
+struct listings* merge_listings(struct listings** parts, size_t count, enum listings_merge_order order) {
+    if (count == 1)
+        return parts[0];
+    size_t total = 0;
+    size_t longest = 0;
+    size_t cursor_count = 0;
+    for (size_t i = 0; i < count; i++) {
+        if (!parts[i])
+            continue;
+        total += parts[i]->count;
+        longest = parts[i]->count > longest ? parts[i]->count : longest;
+        cursor_count += parts[i]->cursor_count;
+    }
+    struct listings* merged = LOG_ERR_MALLOC(struct listings, 1);
+    struct listing* items = LOG_ERR_MALLOC(struct listing, total > 0 ? total : 1);
+    merged->arena = new_arena();
+    struct listings_cursor* cursors = cursor_count > 0 ? arena_alloc(merged->arena, sizeof(*cursors) * cursor_count)
+                                                       : NULL;
+    merged->cursors = cursors;
+    merged->cursor_count = 0;
+    for (size_t i = 0; i < count; i++) {
+        for (size_t c = 0; parts[i] && c < parts[i]->cursor_count; c++) {
+            cursors[merged->cursor_count++] = parts[i]->cursors[c];
+        }
+    }
+    size_t merged_count = 0;
+    for (size_t rank = 0; rank < longest; rank++) {
         for (size_t i = 0; i < count; i++) {
-            json_t* listing_json = json_array_get(listing_payloads, i);
-            deserialize_listing(listing_json, items, i);
+            if (parts[i] && rank < parts[i]->count)
+                items[merged_count++] = parts[i]->items[rank];
         }
-        reddit_listings->count = count;
-        reddit_listings->items = items;
-        json_decref(payload);
-        return reddit_listings;
+    }
+    if (order == LISTINGS_MERGE_UPS)
+        qsort(items, merged_count, sizeof(struct listing), compare_listing_ups_descending);
+    for (size_t i = 0; i < count; i++) {
+        if (!parts[i])
+            continue;
+        // the merged items point into the parts' strings, which now belong to the merged arena
+        arena_adopt(merged->arena, parts[i]->arena);
+        free((void*)parts[i]->items);
+        free(parts[i]);
+    }
+    merged->items = items;
+    merged->count = merged_count;
+    return merged;
+}
+
+static const struct listings_cursor* find_cursor(const struct listings* listings, const char* subreddit) {
+    for (size_t i = 0; i < listings->cursor_count; i++) {
+        if (g_ascii_strcasecmp(listings->cursors[i].subreddit, subreddit) == 0)
+            return &listings->cursors[i];
     }
     return NULL;
 }
 
-void free_listing(const struct listing* listing) {
-    if (!listing)
-        return;
-    free(listing->title);
-    free(listing->selftext);
-    free(listing->url);
+static bool is_fetched(const char* const* fetched, const char* subreddit) {
+    for (size_t i = 0; fetched[i]; i++) {
+        if (g_ascii_strcasecmp(fetched[i], subreddit) == 0)
+            return true;
+    }
+    return false;
 }
 
-void free_listings(const struct listings* listings) {
-    if (!listings)
-        return;
-    for (size_t i = 0; i < listings->count; i++) {
-        free_listing(&listings->items[i]);
+// The current cursors in their order, each replaced by the page's one for its subreddit, or dropped if its page came
+// back without one.
+static void merge_cursors(struct listings* listings, const struct listings* page, const char* const* fetched) {
+    size_t most = listings->cursor_count + page->cursor_count;
+    struct listings_cursor* cursors = most > 0 ? arena_alloc(listings->arena, sizeof(*cursors) * most) : NULL;
+    size_t count = 0;
+    for (size_t i = 0; i < listings->cursor_count; i++) {
+        const struct listings_cursor* next = find_cursor(page, listings->cursors[i].subreddit);
+        if (next) {
+            cursors[count++] = *next;
+        } else if (!is_fetched(fetched, listings->cursors[i].subreddit)) {
+            cursors[count++] = listings->cursors[i];
+        }
     }
+    for (size_t i = 0; i < page->cursor_count; i++) {
+        if (!find_cursor(listings, page->cursors[i].subreddit))
+            cursors[count++] = page->cursors[i];
+    }
+    listings->cursors = cursors;
+    listings->cursor_count = count;
+}
+
+void append_listings(struct listings* listings, struct listings* page, const char* const* fetched) {
+    if (!page)
+        return;
+    struct listing* items = LOG_ERR_MALLOC(struct listing, listings->count + page->count + 1);
+    memcpy(items, listings->items, sizeof(struct listing) * listings->count);
+    memcpy(items + listings->count, page->items, sizeof(struct listing) * page->count);
     free((void*)listings->items);
-    free((void*)listings);
+    listings->items = items;
+    listings->count += page->count;
+    merge_cursors(listings, page, fetched);
+    // the page's strings and cursors stay where they are, they just change owner
+    arena_adopt(listings->arena, page->arena);
+    free((void*)page->items);
+    free(page);
+}
+
+bool has_more_listings(const struct listings* listings) {
+    return listings && listings->cursor_count > 0;
+}
+
+char** split_subreddit_query(const char* query, size_t* count) {
+    char** names = g_strsplit(query, ",", -1);
+    size_t kept = 0;
+    for (size_t i = 0; names[i]; i++) {
+        bool repeated = false;
+        for (size_t j = 0; j < kept && !repeated; j++) {
+            repeated = g_ascii_strcasecmp(names[j], names[i]) == 0;
+        }
+        if (names[i][0] == '\0' || repeated) {
+            g_free(names[i]);
+        } else {
+            names[kept++] = names[i];
+        }
+    }
+    names[kept] = NULL;
+    *count = kept;
+    return names;
+}
+
+// Failures of the network rather than of Reddit or of the plugin itself.
+static bool is_unreachable(CURLcode result) {
+    switch (result) {
+    case CURLE_COULDNT_RESOLVE_PROXY:
+    case CURLE_COULDNT_RESOLVE_HOST:
+    case CURLE_COULDNT_CONNECT:
+    case CURLE_OPERATION_TIMEDOUT:
+    case CURLE_SSL_CONNECT_ERROR:
+    case CURLE_GOT_NOTHING:
+    case CURLE_SEND_ERROR:
+    case CURLE_RECV_ERROR:
+        return true;
+    default:
+        return false;
+    }
 }
 
 const struct reddit_api_response* fetch_reddit_access_token_from_api(const RedditApp* app) {
     curl_easy_reset(app->http_client);
-    struct response_buffer* buffer = new_response_buffer();
-    struct curl_slist* ua_header = user_agent_header(app);
+    use_connection_pool(app->http_client, app->connections);
+    struct response_buffer* buffer = acquire_response_buffer(app->buffers);
 
     CURL* url = curl_url();
-    curl_url_set(url, CURLUPART_SCHEME, "https", 0);
-    curl_url_set(url, CURLUPART_HOST, REDDIT_HOST, 0);
+    curl_url_set(url, CURLUPART_URL, app->config->api.auth_url, 0);
     curl_url_set(url, CURLUPART_PATH, "api/v1/access_token/", 0);
     char* url_str = NULL;
     curl_url_get(url, CURLUPART_URL, &url_str, 0);
@@ -296,71 +799,62 @@ const struct reddit_api_response* fetch_reddit_access_token_from_api(const Reddi
     curl_easy_setopt(app->http_client, CURLOPT_POST, 1L);
     curl_easy_setopt(app->http_client, CURLOPT_USERNAME, app->config->auth->client_id);
     curl_easy_setopt(app->http_client, CURLOPT_PASSWORD, app->config->auth->client_secret);
-    curl_easy_setopt(app->http_client, CURLOPT_WRITEFUNCTION, write_callback);
+    curl_easy_setopt(app->http_client, CURLOPT_WRITEFUNCTION, write_to_response_buffer);
     curl_easy_setopt(app->http_client, CURLOPT_WRITEDATA, buffer);
     curl_easy_setopt(app->http_client, CURLOPT_URL, url_str);
     curl_easy_setopt(app->http_client, CURLOPT_HTTPAUTH, CURLAUTH_BASIC);
-    curl_easy_setopt(app->http_client, CURLOPT_HTTPHEADER, ua_header);
+    curl_easy_setopt(app->http_client, CURLOPT_USERAGENT, app->config->auth->client_name);
     curl_easy_setopt(app->http_client, CURLOPT_POSTFIELDS, "scope=read&grant_type=client_credentials");
+    curl_easy_setopt(app->http_client, CURLOPT_ACCEPT_ENCODING, "");
+    curl_easy_setopt(app->http_client, CURLOPT_CONNECTTIMEOUT_MS, (long)app->config->api.connect_timeout_ms);
     // curl_easy_setopt(app->http_client, CURLOPT_VERBOSE, 1L);
 
-    curl_easy_perform(app->http_client);
+    CURLcode result = curl_easy_perform(app->http_client);
+    log_connection_reuse(app->http_client, "Access token request");
     long* resp_status = get_response_status(app->http_client);
-    curl_slist_free_all(ua_header);
     curl_url_cleanup(url);
     curl_free(url_str);
-    return new_reddit_api_response(buffer, resp_status);
+    struct reddit_api_response* response = new_reddit_api_response(buffer, resp_status);
+    response->transport_result = result;
+    request_timing_from_curl(app->http_client, &response->timing);
+    return response;
 }
 
 RedditAccessToken* fetch_and_cache_token(RedditApp* app) {
     const struct reddit_api_response* response = fetch_reddit_access_token_from_api(app);
-    if (response->status_code == HTTP_OK) {
-        RedditAccessToken* token = deserialize_access_token(response->response_buffer);
-        fprintf(stdout, "Obtained access token from API of size: %zu. Caching to %s\n", strlen(token->token),
+    RedditAccessToken* token = NULL;
+    app->auth_unreachable = is_unreachable(response->transport_result);
+    if (response->transport_result != CURLE_OK)
+        fprintf(stderr, "Access token request failed: %s\n", curl_easy_strerror(response->transport_result));
+    struct request_timing timing = response->timing;
+    gint64 started = g_get_monotonic_time();
+    if (response->status_code == HTTP_OK)
+        token = deserialize_access_token(response->response_buffer);
+    timing.deserialize_us = g_get_monotonic_time() - started;
+    timing_log_record(app->timings, TIMED_REQUEST_ACCESS_TOKEN, NULL, response->status_code, &timing);
+    if (token) {
+        fprintf(stdout, "Obtained access token from API of size: %zu, expiring in %" PRId64 "s. Caching to %s\n",
+                strlen(token->token), (int64_t)(token->expires_at - time(NULL)),
                 app->config->paths->access_token_cache_path);
-        FILE* const CACHE = fopen(app->config->paths->access_token_cache_path, "w+");
-        if (!CACHE) {
-            fprintf(stderr, "Failed to create or open access token cache file at: %s\n",
-                    app->config->paths->access_token_cache_path);
-            free_reddit_api_response(response);
-            free_reddit_access_token(token);
-            free_reddit_app(app);
-            exit(EXIT_FAILURE);
-        }
-        fputs(token->token, CACHE);
-        fclose(CACHE);
-        app->config->paths = new_rofi_reddit_paths();
-        return token;
+        // a token that couldn't be cached is still good for this session
+        if (write_access_token_cache(app->config->paths->access_token_cache_path, token))
+            app->config->paths->access_token_cache_exists = true;
     }
-    return NULL;
+    release_response_buffer(app->buffers, (struct response_buffer*)response->response_buffer);
+    free_reddit_api_response(response);
+    return token;
 }
 
 RedditAccessToken* new_reddit_access_token(RedditApp* app) {
     RedditAccessToken* reddit_token = NULL;
-    if (app->config->paths->access_token_cache_exists) {
-        FILE* const CACHE = fopen(app->config->paths->access_token_cache_path, "r");
-        if (!CACHE) {
-            fprintf(stderr, "Failed to open access token cache file for reading: %s\n",
-                    app->config->paths->access_token_cache_path);
-            free_reddit_app(app);
-            exit(EXIT_FAILURE);
-        }
-        char* buffer = malloc(*ACCESS_TOKEN_MAX_SIZE);
-        if (fgets(buffer, *ACCESS_TOKEN_MAX_SIZE, CACHE) == NULL) {
-            fprintf(stderr, "Failed to read access token from cache file: %s\n",
-                    app->config->paths->access_token_cache_path);
-            free(buffer);
-            fclose(CACHE);
-            free_reddit_app(app);
-            exit(EXIT_FAILURE);
-        }
-        RedditAccessToken* cached_token = LOG_ERR_MALLOC(RedditAccessToken, 1);
-        cached_token->token = buffer;
-        reddit_token = cached_token;
+    if (app->config->paths->access_token_cache_exists)
+        reddit_token = read_access_token_cache(app->config->paths->access_token_cache_path);
+    if (reddit_token && access_token_refresh_in(reddit_token) > 0) {
         fprintf(stdout, "Access token cache hit.\n");
-        fclose(CACHE);
     } else {
-        fprintf(stdout, "Access token cache miss. Fetching from API.\n");
+        fprintf(stdout, reddit_token ? "Cached access token is about to expire. Fetching a new one.\n"
+                                     : "Access token cache miss. Fetching from API.\n");
+        free_reddit_access_token(reddit_token);
         reddit_token = fetch_and_cache_token(app);
     }
     if (!reddit_token)
@@ -368,6 +862,23 @@ RedditAccessToken* new_reddit_access_token(RedditApp* app) {
     return reddit_token;
 }
 
+void warm_up_listings_connection(const RedditApp* app) {
+    curl_easy_reset(app->http_client);
+    use_connection_pool(app->http_client, app->connections);
+    curl_easy_setopt(app->http_client, CURLOPT_URL, app->config->api.listings_url);
+    curl_easy_setopt(app->http_client, CURLOPT_CONNECT_ONLY, 1L);
+    curl_easy_setopt(app->http_client, CURLOPT_CONNECTTIMEOUT_MS, (long)app->config->api.connect_timeout_ms);
+    CURLcode result = curl_easy_perform(app->http_client);
+    if (result == CURLE_OK) {
+        log_connection_reuse(app->http_client, "Warm up");
+    } else {
+        fprintf(stderr, "Failed to connect to %s ahead of time: %s\n", app->config->api.listings_url,
+                curl_easy_strerror(result));
+    }
+    // closes the connection, which only fetches would have used
+    curl_easy_reset(app->http_client);
+}
+
 void free_reddit_access_token(const RedditAccessToken* token) {
     if (!token)
         return;
@@ -375,40 +886,272 @@ void free_reddit_access_token(const RedditAccessToken* token) {
     free((void*)token);
 }
 
-const struct reddit_api_response* fetch_hot_listings(const RedditApp* app, const RedditAccessToken* token,
-                                                     const char* subreddit) {
-    curl_easy_reset(app->http_client);
-    struct response_buffer* response_buffer = new_response_buffer();
-    struct curl_slist* ua_header = user_agent_header(app);
+// Everything a listings transfer needs to stay alive between setting up its handle and collecting its response.
+struct listings_request {
+    CURL* client;
+    struct response_buffer* response_buffer;
+    struct curl_slist* headers;
+    char* if_none_match_header;
+    char* url;
+    const char* subreddit;
+    const char* sort;
+    struct listings_sink sink;
+    struct timing_log* timings;
+    CURLcode result;
+};
 
-    CURL* url = curl_url();
-    curl_url_set(url, CURLUPART_SCHEME, "https", 0);
-    curl_url_set(url, CURLUPART_HOST, REDDIT_API_HOST, 0);
+static void setup_listings_request(const RedditApp* app, CURL* client, const RedditAccessToken* token,
+                                   const struct subreddit_fetch* fetch, struct listings_request* request) {
+    use_connection_pool(client, app->connections);
+    request->client = client;
+    request->subreddit = fetch->subreddit;
+    request->sort = fetch->sort;
+    request->timings = app->timings;
+    request->result = CURLE_OK;
+    const char* etag = fetch->etag;
+    request->response_buffer = acquire_response_buffer(app->buffers);
+    request->headers = NULL;
+    request->if_none_match_header = NULL;
+    if (etag) {
+        request->if_none_match_header = g_strdup_printf("If-None-Match: %s", etag);
+        request->headers = curl_slist_append(request->headers, request->if_none_match_header);
+    }
+
+    CURLU* url = curl_url();
+    curl_url_set(url, CURLUPART_URL, app->config->api.listings_url, 0);
+    // "top:week" is requested as r/<subreddit>/top/?t=week
+    const char* range = strchr(fetch->sort, ':');
+    int sort_size = range ? (int)(range - fetch->sort) : (int)strlen(fetch->sort);
     char url_path[100];
-    snprintf(url_path, 100, "r/%s/hot/", subreddit);
+    snprintf(url_path, 100, "r/%s/%.*s/", fetch->subreddit, sort_size, fetch->sort);
     curl_url_set(url, CURLUPART_PATH, url_path, 0);
-    curl_url_set(url, CURLUPART_QUERY, "limit=15", 0); // TODO: make configurable
+    char limit[32];
+    snprintf(limit, sizeof(limit), "limit=%" PRId64, app->config->listings.page_size);
+    curl_url_set(url, CURLUPART_QUERY, limit, 0);
+    if (range) {
+        char* time_range = g_strdup_printf("t=%s", range + 1);
+        curl_url_set(url, CURLUPART_QUERY, time_range, CURLU_APPENDQUERY | CURLU_URLENCODE);
+        g_free(time_range);
+    }
+    if (fetch->after) {
+        char* after = g_strdup_printf("after=%s", fetch->after);
+        curl_url_set(url, CURLUPART_QUERY, after, CURLU_APPENDQUERY | CURLU_URLENCODE);
+        g_free(after);
+    }
+    request->url = NULL;
+    curl_url_get(url, CURLUPART_URL, &request->url, 0);
+    curl_url_cleanup(url);
+
+    request->sink = (struct listings_sink){.client = client, .raw = request->response_buffer, .stream = NULL};
+    curl_easy_setopt(client, CURLOPT_POST, 0L);
+    curl_easy_setopt(client, CURLOPT_WRITEFUNCTION, listings_write_callback);
+    curl_easy_setopt(client, CURLOPT_WRITEDATA, &request->sink);
+    curl_easy_setopt(client, CURLOPT_URL, request->url);
+    curl_easy_setopt(client, CURLOPT_HTTPAUTH, CURLAUTH_BEARER);
+    curl_easy_setopt(client, CURLOPT_XOAUTH2_BEARER, token->token);
+    curl_easy_setopt(client, CURLOPT_USERAGENT, app->config->auth->client_name);
+    curl_easy_setopt(client, CURLOPT_HTTPHEADER, request->headers);
+    curl_easy_setopt(client, CURLOPT_FOLLOWLOCATION, 1L);
+    // "" offers every encoding curl was built with, e.g. gzip and brotli. Listings JSON shrinks to a fraction.
+    curl_easy_setopt(client, CURLOPT_ACCEPT_ENCODING, "");
+    curl_easy_setopt(client, CURLOPT_CONNECTTIMEOUT_MS, (long)app->config->api.connect_timeout_ms);
+    // curl_easy_setopt(client, CURLOPT_VERBOSE, 1L);
+}
+
+// Value of a numeric response header, like "598.0" for X-Ratelimit-Remaining, or -1 when it is absent or garbled.
+static double response_header_number(CURL* client, const char* name) {
+    char* value = get_response_header(client, name);
+    char* end = value;
+    double number = value ? g_ascii_strtod(value, &end) : -1;
+    bool parsed = value && end != value && number >= 0;
+    free(value);
+    return parsed ? number : -1;
+}
+
+static void read_rate_limit(CURL* client, struct reddit_api_response* response) {
+    response->ratelimit_used = response_header_number(client, "X-Ratelimit-Used");
+    response->ratelimit_remaining = response_header_number(client, "X-Ratelimit-Remaining");
+    response->ratelimit_reset = (int64_t)response_header_number(client, "X-Ratelimit-Reset");
+}
+
+static const struct reddit_api_response* finish_listings_request(struct listings_request* request) {
+    log_connection_reuse(request->client, "Listings request");
+    long* resp_status = get_response_status(request->client);
+
+    curl_slist_free_all(request->headers);
+    g_free(request->if_none_match_header);
+    curl_free(request->url);
+    struct reddit_api_response* response = new_reddit_api_response(request->response_buffer, resp_status);
+    response->etag = get_response_header(request->client, "ETag");
+    read_rate_limit(request->client, response);
+    response->transport_result = request->result;
+    if (request->result != CURLE_OK)
+        fprintf(stderr, "Listings request for subreddit=%s sort=%s failed: %s\n", request->subreddit, request->sort,
+                curl_easy_strerror(request->result));
+    request_timing_from_curl(request->client, &response->timing);
+    if (request->sink.stream) {
+        gint64 started = g_get_monotonic_time();
+        response->listings = listing_stream_finish(request->sink.stream);
+        free_listing_stream(request->sink.stream);
+        request->sink.deserialize_us += g_get_monotonic_time() - started;
+    }
+    response->timing.deserialize_us = request->sink.deserialize_us;
+    timing_log_record(request->timings, TIMED_REQUEST_LISTINGS, request->subreddit, response->status_code,
+                      &response->timing);
+    // the payload only knows where the page ends, not which subreddit it belongs to
+    if (response->listings && response->listings->cursor_count == 1) {
+        struct listings_cursor* cursor = (struct listings_cursor*)response->listings->cursors;
+        cursor->subreddit = arena_strdup(response->listings->arena, request->subreddit);
+    }
+    return response;
+}
+
+const struct reddit_api_response* fetch_listings(const RedditApp* app, const RedditAccessToken* token,
+                                                 const char* subreddit, const char* sort, const char* etag,
+                                                 const char* after) {
+    curl_easy_reset(app->http_client);
+    struct listings_request request;
+    const struct subreddit_fetch fetch = {.subreddit = subreddit, .sort = sort, .etag = etag, .after = after};
+    setup_listings_request(app, app->http_client, token, &fetch, &request);
+    request.result = curl_easy_perform(app->http_client);
+    return finish_listings_request(&request);
+}
+
+// Stands in for the response of a request that couldn't even be set up, which callers then treat like any other failed
+// one.
+static const struct reddit_api_response* new_failed_listings_response(const struct subreddit_fetch* fetch) {
+    fprintf(stderr, "Failed to initialize CURL for subreddit=%s sort=%s.\n", fetch->subreddit, fetch->sort);
+    long status = 0;
+    struct reddit_api_response* response = new_reddit_api_response(NULL, &status);
+    response->transport_result = CURLE_FAILED_INIT;
+    return response;
+}
+
+void fetch_listings_concurrently(const RedditApp* app, const RedditAccessToken* token, struct subreddit_fetch* fetches,
+                                 size_t count) {
+    CURLM* multi = curl_multi_init();
+    if (!multi) {
+        fprintf(stderr, "Failed to initialize CURL multi. Fetching subreddits one after another.\n");
+        for (size_t i = 0; i < count; i++) {
+            fetches[i].response = fetch_listings(app, token, fetches[i].subreddit, fetches[i].sort, fetches[i].etag,
+                                                 fetches[i].after);
+        }
+        return;
+    }
+    struct listings_request* requests = LOG_ERR_MALLOC(struct listings_request, count);
+    for (size_t i = 0; i < count; i++) {
+        CURL* client = curl_easy_init();
+        if (!client) {
+            requests[i].client = NULL;
+            fetches[i].response = new_failed_listings_response(&fetches[i]);
+            continue;
+        }
+        setup_listings_request(app, client, token, &fetches[i], &requests[i]);
+        curl_multi_add_handle(multi, client);
+    }
+    int running = 0;
+    do {
+        if (curl_multi_perform(multi, &running) != CURLM_OK)
+            break;
+        if (running > 0)
+            curl_multi_poll(multi, NULL, 0, 1000, NULL);
+    } while (running > 0);
+    int queued = 0;
+    CURLMsg* message = NULL;
+    while ((message = curl_multi_info_read(multi, &queued)) != NULL) {
+        for (size_t i = 0; i < count && message->msg == CURLMSG_DONE; i++) {
+            if (requests[i].client == message->easy_handle)
+                requests[i].result = message->data.result;
+        }
+    }
+    for (size_t i = 0; i < count; i++) {
+        if (!requests[i].client)
+            continue;
+        curl_multi_remove_handle(multi, requests[i].client);
+        fetches[i].response = finish_listings_request(&requests[i]);
+        curl_easy_cleanup(requests[i].client);
+    }
+    curl_multi_cleanup(multi);
+    free(requests);
+}
+
+// Comments are parsed once the whole tree is in, as it may nest down to the last byte.
+static const struct reddit_api_response* fetch_comments_json(const RedditApp* app, const RedditAccessToken* token,
+                                                             CURLU* url) {
+    curl_easy_reset(app->http_client);
+    use_connection_pool(app->http_client, app->connections);
+    struct response_buffer* buffer = acquire_response_buffer(app->buffers);
     char* url_str = NULL;
     curl_url_get(url, CURLUPART_URL, &url_str, 0);
-
-    curl_easy_setopt(app->http_client, CURLOPT_POST, 0L);
-    curl_easy_setopt(app->http_client, CURLOPT_WRITEFUNCTION, write_callback);
-    curl_easy_setopt(app->http_client, CURLOPT_WRITEDATA, response_buffer);
+    curl_easy_setopt(app->http_client, CURLOPT_WRITEFUNCTION, write_to_response_buffer);
+    curl_easy_setopt(app->http_client, CURLOPT_WRITEDATA, buffer);
     curl_easy_setopt(app->http_client, CURLOPT_URL, url_str);
     curl_easy_setopt(app->http_client, CURLOPT_HTTPAUTH, CURLAUTH_BEARER);
     curl_easy_setopt(app->http_client, CURLOPT_XOAUTH2_BEARER, token->token);
-    curl_easy_setopt(app->http_client, CURLOPT_HTTPHEADER, ua_header);
+    curl_easy_setopt(app->http_client, CURLOPT_USERAGENT, app->config->auth->client_name);
     curl_easy_setopt(app->http_client, CURLOPT_FOLLOWLOCATION, 1L);
-    // curl_easy_setopt(app->http_client, CURLOPT_VERBOSE, 1L);
+    curl_easy_setopt(app->http_client, CURLOPT_ACCEPT_ENCODING, "");
+    curl_easy_setopt(app->http_client, CURLOPT_CONNECTTIMEOUT_MS, (long)app->config->api.connect_timeout_ms);
+    CURLcode result = curl_easy_perform(app->http_client);
+    log_connection_reuse(app->http_client, "Comments request");
+    if (result != CURLE_OK)
+        fprintf(stderr, "Request for %s failed: %s\n", url_str, curl_easy_strerror(result));
+    long* resp_status = get_response_status(app->http_client);
+    curl_free(url_str);
+    struct reddit_api_response* response = new_reddit_api_response(buffer, resp_status);
+    read_rate_limit(app->http_client, response);
+    response->transport_result = result;
+    request_timing_from_curl(app->http_client, &response->timing);
+    timing_log_record(app->timings, TIMED_REQUEST_COMMENTS, NULL, response->status_code, &response->timing);
+    return response;
+}
 
-    curl_easy_perform(app->http_client);
+static void append_query(CURLU* url, const char* format, ...) __attribute__((format(printf, 2, 3)));
 
-    long* resp_status = get_response_status(app->http_client);
+static void append_query(CURLU* url, const char* format, ...) {
+    va_list args;
+    va_start(args, format);
+    char* parameter = g_strdup_vprintf(format, args);
+    va_end(args);
+    curl_url_set(url, CURLUPART_QUERY, parameter, CURLU_APPENDQUERY | CURLU_URLENCODE);
+    g_free(parameter);
+}
 
-    curl_slist_free_all(ua_header);
+const struct reddit_api_response* fetch_comments(const RedditApp* app, const RedditAccessToken* token,
+                                                 const char* article) {
+    CURLU* url = curl_url();
+    curl_url_set(url, CURLUPART_URL, app->config->api.listings_url, 0);
+    char* path = g_strdup_printf("comments/%s/", article);
+    curl_url_set(url, CURLUPART_PATH, path, 0);
+    g_free(path);
+    append_query(url, "limit=%" PRId64, app->config->comments.limit);
+    append_query(url, "depth=%" PRId64, app->config->comments.depth);
+    // bodies come as written rather than HTML escaped
+    append_query(url, "raw_json=1");
+    const struct reddit_api_response* response = fetch_comments_json(app, token, url);
     curl_url_cleanup(url);
-    curl_free(url_str);
-    return new_reddit_api_response(response_buffer, resp_status);
+    return response;
+}
+
+const struct reddit_api_response* fetch_more_comments(const RedditApp* app, const RedditAccessToken* token,
+                                                      const char* article, const char* const* ids, size_t count) {
+    CURLU* url = curl_url();
+    curl_url_set(url, CURLUPART_URL, app->config->api.listings_url, 0);
+    curl_url_set(url, CURLUPART_PATH, "api/morechildren", 0);
+    append_query(url, "api_type=json");
+    append_query(url, "link_id=t3_%s", article);
+    GString* children = g_string_new(NULL);
+    for (size_t i = 0; i < count; i++) {
+        g_string_append_printf(children, "%s%s", i > 0 ? "," : "", ids[i]);
+    }
+    append_query(url, "children=%s", children->str);
+    g_string_free(children, TRUE);
+    append_query(url, "limit_children=false");
+    append_query(url, "depth=%" PRId64, app->config->comments.depth);
+    append_query(url, "raw_json=1");
+    const struct reddit_api_response* response = fetch_comments_json(app, token, url);
+    curl_url_cleanup(url);
+    return response;
 }
 
 struct reddit_api_response* new_reddit_api_response(struct response_buffer* response, long* status_code) {
@@ -416,6 +1159,13 @@ struct reddit_api_response* new_reddit_api_response(struct response_buffer* resp
         (struct reddit_api_response*)LOG_ERR_MALLOC(struct reddit_api_response, 1);
     reddit_response->status_code = http_status_code_from(*status_code);
     reddit_response->response_buffer = response;
+    reddit_response->etag = NULL;
+    reddit_response->listings = NULL;
+    reddit_response->timing = (struct request_timing){0};
+    reddit_response->transport_result = CURLE_OK;
+    reddit_response->ratelimit_used = -1;
+    reddit_response->ratelimit_remaining = -1;
+    reddit_response->ratelimit_reset = -1;
     return reddit_response;
 }
 
@@ -423,5 +1173,45 @@ void free_reddit_api_response(const struct reddit_api_response* response) {
     if (!response)
         return;
     // pointer to data is owned by the caller, so we don't free it here
+    free(response->etag);
     free((void*)response);
 }
+
+static enum subreddit_access subreddit_access_denied_reason(const struct reddit_api_response* response) {
+    json_error_t error;
+    json_t* root = json_loads((const char*)response->response_buffer->buffer, 0, &error);
+    enum subreddit_access access_status = SUBREDDIT_ACCESS_EXPIRED_TOKEN;
+    if (response->status_code == HTTP_FORBIDDEN && root && json_is_object(root)) {
+        access_status = SUBREDDIT_ACCESS_UNKNOWN;
+        json_t* reason = json_object_get(root, "reason");
+        if (reason && json_is_string(reason)) {
+            const char* reason_str = json_string_value(reason);
+            if (strcmp(reason_str, "private") == 0) {
+                access_status = SUBREDDIT_ACCESS_PRIVATE;
+            } else if (strcmp(reason_str, "quarantined") == 0) {
+                access_status = SUBREDDIT_ACCESS_QUARANTINED;
+            }
+        }
+    }
+    json_decref(root);
+    return access_status;
+}
+
+enum subreddit_access subreddit_access_from_response(const struct reddit_api_response* response) {
+    if (is_unreachable(response->transport_result))
+        return SUBREDDIT_ACCESS_UNREACHABLE;
+    switch (response->status_code) {
+    case HTTP_OK:
+    case HTTP_NOT_MODIFIED:
+        return SUBREDDIT_ACCESS_OK;
+    case HTTP_UNAUTHORIZED:
+    case HTTP_FORBIDDEN:
+        return subreddit_access_denied_reason(response);
+    case HTTP_NOT_FOUND:
+        return SUBREDDIT_ACCESS_DOESNT_EXIST;
+    case HTTP_TOO_MANY_REQUESTS:
+        return SUBREDDIT_ACCESS_RATE_LIMITED;
+    default:
+        return SUBREDDIT_ACCESS_UNKNOWN;
+    }
+}
@@ -1,9 +1,14 @@
+#include "connection.h"
 #include "curl_wrappers.h"
+#include "memory.h"
+#include "request_timing.h"
+#include "search_index.h"
 #include <curl/curl.h>
 #include <jansson.h>
 #include <stdbool.h>
 #include <stddef.h>
 #include <stdint.h>
+#include <time.h>
 
 #ifndef _REDDIT_H
 #define _REDDIT_H
@@ -12,8 +17,19 @@ struct rofi_reddit_paths {
     const char* config_path;
     const char* access_token_cache_path;
     bool access_token_cache_exists;
+    const char* cache_dir;
+    const char* listings_cache_dir;
+    const char* subreddit_index_path;
+    const char* subreddit_history_path;
+    const char* search_index_dir;
+    const char* timing_log_path;
+    const char* timing_histogram_path;
+    const char* thumbnails_cache_dir;
+    // where rofi-reddit-daemon listens, in the runtime directory
+    const char* daemon_socket_path;
 };
 
+// Creates the cache directories. NULL if the config file or the cache directory can't be accessed.
 struct rofi_reddit_paths* new_rofi_reddit_paths();
 void free_rofi_reddit_paths(const struct rofi_reddit_paths* paths);
 
@@ -23,17 +39,120 @@ struct app_auth {
     char* client_secret;
 };
 
+struct api_cfg {
+    // scheme and host, optionally with a port, that access tokens are requested from
+    char* auth_url;
+    // scheme and host, optionally with a port, that listings are requested from
+    char* listings_url;
+    // how long connecting to either may take before Reddit counts as unreachable, 0 for libcurl's default
+    int64_t connect_timeout_ms;
+};
+
+struct cache_cfg {
+    // listings older than this are still served, but revalidated in the background
+    int64_t ttl_seconds;
+};
+
+enum listings_merge_order {
+    // interleaves the subreddits rank by rank, keeping each one's hot order
+    LISTINGS_MERGE_HOT,
+    LISTINGS_MERGE_UPS
+};
+
+struct listings_cfg {
+    // how threads of several subreddits queried at once are ranked
+    enum listings_merge_order merge_order;
+    // threads requested per subreddit and page, Reddit caps it at 100
+    int64_t page_size;
+    // the next page is prefetched once a row this close to the end is displayed
+    int64_t prefetch_rows;
+    // sorts switched between, normalized and NULL terminated. The first one is shown when a subreddit is opened.
+    char** sorts;
+    size_t sort_count;
+    // fetch the other sorts in the background once a subreddit is shown
+    bool prefetch_sorts;
+};
+
+struct completion_cfg {
+    // list of subreddit names merged into the completion index whenever it changes, NULL if not configured
+    char* import_path;
+};
+
+struct filter_cfg {
+    // typing also matches the text of self posts, not just titles
+    bool match_selftext;
+    // typed words also match when their letters appear in order with gaps in between
+    bool fuzzy;
+};
+
+struct timing_cfg {
+    // append the timing of every request to a log in the cache directory
+    bool log;
+    // show how long the last fetch took, and how long fetches usually take, in the message bar
+    bool show_summary;
+};
+
+struct thumbnails_cfg {
+    // show thread thumbnails as row icons, which also needs rofi's -show-icons
+    bool show;
+    // downloaded thumbnails are kept on disk up to this size, least recently shown ones are deleted first
+    int64_t cache_size_mb;
+    // thumbnails downloaded at the same time
+    int64_t concurrent_downloads;
+};
+
+struct comments_cfg {
+    // comments requested when a thread is opened, and again whenever hidden ones are loaded
+    int64_t limit;
+    // levels of replies requested at once, deeper ones are loaded on demand
+    int64_t depth;
+};
+
+struct daemon_cfg {
+    // fetch listings through rofi-reddit-daemon, starting it when it isn't running yet
+    bool enabled;
+    // the daemon exits after going this long without a request
+    int64_t idle_timeout_minutes;
+};
+
+struct search_cfg {
+    // index every fetched thread, so that typing "/" and some words searches all of them offline
+    bool enabled;
+    // threads shown for a search, best match first
+    int64_t max_results;
+};
+
 struct rofi_reddit_cfg {
     struct app_auth* auth;
+    struct api_cfg api;
+    struct cache_cfg cache;
+    struct listings_cfg listings;
+    struct completion_cfg completion;
+    struct filter_cfg filter;
+    struct timing_cfg timing;
+    struct thumbnails_cfg thumbnails;
+    struct comments_cfg comments;
+    struct daemon_cfg daemon;
+    struct search_cfg search;
     struct rofi_reddit_paths* paths;
 };
 
 struct rofi_reddit_cfg* new_rofi_reddit_cfg(struct rofi_reddit_paths* paths);
 void free_rofi_reddit_cfg(const struct rofi_reddit_cfg* cfg);
+// The installed config with the default paths, NULL if either is unusable.
+struct rofi_reddit_cfg* load_rofi_reddit_cfg(void);
 
 typedef struct {
     struct rofi_reddit_cfg* config;
     CURL* http_client;
+    struct connection_pool* connections;
+    struct response_buffer_pool* buffers;
+    // NULL unless timing.log or timing.show_summary is set
+    struct timing_log* timings;
+    // NULL unless search.enabled is set
+    struct search_index* search;
+    // the last access token request failed before Reddit answered, e.g. while offline
+    bool auth_unreachable;
 } RedditApp;
 
 RedditApp* new_reddit_app(struct rofi_reddit_cfg* config);
@@ -42,39 +161,133 @@ void free_reddit_app(RedditApp* app);
 
 typedef struct {
     const char* token;
+    // when Reddit stops accepting the token
+    time_t expires_at;
 } RedditAccessToken;
 
+// Seconds left until the token should be replaced, zero or less once it is due. Tokens are replaced a while before
+// they expire so that no request goes out with a token that is about to be rejected.
+int64_t access_token_refresh_in(const RedditAccessToken* token);
+
+// The cache holds the token together with its expiry. NULL if it is missing or unreadable.
+RedditAccessToken* read_access_token_cache(const char* path);
+bool write_access_token_cache(const char* path, const RedditAccessToken* token);
+
 const struct reddit_api_response* fetch_reddit_access_token_from_api(const RedditApp* app);
 RedditAccessToken* fetch_and_cache_token(RedditApp* app);
 
 struct listing {
+    // e.g. "1abc2d", what the thread's comments are requested by. NULL for listings cached before ids were kept.
+    char* id;
+    char* subreddit;
     char* title;
+    // decoded selftext of listings read from the cache, NULL for fetched ones. Read it through listing_selftext.
     char* selftext;
+    // selftext of fetched listings as it came in, still JSON escaped, so that it is only decoded when looked at
+    const char* escaped_selftext;
+    size_t escaped_selftext_size;
     char* url;
+    // image shown next to the thread, NULL for self posts and threads Reddit has no thumbnail for
+    char* thumbnail_url;
     uint32_t ups;
 };
-void free_listing(const struct listing* listing);
+
+// The text of a self post, decoded on every call. Free with g_free. NULL for link posts and listings without one.
+char* listing_selftext(const struct listing* listing);
+
+// Where the next page of a subreddit starts. Subreddits that ran out of threads have no cursor.
+struct listings_cursor {
+    const char* subreddit;
+    const char* after;
+};
 
 struct listings {
     const struct listing* items;
     size_t count;
+    // owns the strings of every item and cursor
+    struct arena* arena;
+    const struct listings_cursor* cursors;
+    size_t cursor_count;
 };
 
 struct listings* deserialize_listings(const struct response_buffer* resp);
-void deserialize_listing(json_t* listing_json, struct listing* deserialize_to, size_t index);
+// Reads the fields rows are made of; selftext is left for the listing stream to attach.
+void deserialize_listing(json_t* listing_json, struct listing* deserialize_to, size_t index, struct arena* arena);
 
 void free_listings(const struct listings* listings);
 
-const struct reddit_api_response* fetch_hot_listings(const RedditApp* app, const RedditAccessToken* token,
-                                                     const char* subreddit);
+// Merges the listings of several subreddits into one, taking ownership of every part. NULL parts are skipped.
+struct listings* merge_listings(struct listings** parts, size_t count, enum listings_merge_order order);
+
+// Appends the threads of a later page, taking ownership of it. fetched is the NULL terminated list of subreddits whose
+// page came back: their cursors are replaced by the page's, or dropped if it has none, while the others keep theirs to
+// be fetched again.
+void append_listings(struct listings* listings, struct listings* page, const char* const* fetched);
+
+bool has_more_listings(const struct listings* listings);
+
+// Splits a query like "linux,cpp,rust" into its subreddit names, dropping empty and repeated ones. Free with
+// g_strfreev.
+char** split_subreddit_query(const char* query, size_t* count);
+
+extern const char* const HOT_LISTINGS_SORT;
+
+// Sorts are spelled like "hot", "new", "rising", or "top:week" and "controversial:all" for the sorts that rank threads
+// over a time range. Returns the normalized spelling of sort, e.g. "top:day" for "Top", or NULL if Reddit has no such
+// sort. Caller frees.
+char* normalize_listings_sort(const char* sort);
+
+// sort is a normalized one. When etag is non-NULL the request is conditional and may come back as HTTP_NOT_MODIFIED
+// with an empty body. after is the cursor of the page to fetch, NULL for the first one.
+const struct reddit_api_response* fetch_listings(const RedditApp* app, const RedditAccessToken* token,
+                                                 const char* subreddit, const char* sort, const char* etag,
+                                                 const char* after);
+
+struct subreddit_fetch {
+    const char* subreddit;
+    const char* sort;
+    const char* etag;
+    const char* after;
+    const struct reddit_api_response* response;
+};
+
+// Runs one fetch_listings per entry in parallel over the app's connection pool, filling in each response. An entry
+// whose request couldn't be set up gets a response with transport_result CURLE_FAILED_INIT.
+void fetch_listings_concurrently(const RedditApp* app, const RedditAccessToken* token, struct subreddit_fetch* fetches,
+                                 size_t count);
 
 RedditAccessToken* new_reddit_access_token(RedditApp* app);
 
+// Resolves the listings host and performs the TLS handshake ahead of the first fetch. That connection is closed again,
+// but the resolved address and the TLS session stay in the connection pool, so the first fetch skips the lookup and
+// resumes the session.
+void warm_up_listings_connection(const RedditApp* app);
+
 void free_reddit_access_token(const RedditAccessToken* token);
 
+// The comments of a thread, comments.limit of them and comments.depth levels deep at most. The others come as
+// "more" things listing their ids.
+const struct reddit_api_response* fetch_comments(const RedditApp* app, const RedditAccessToken* token,
+                                                 const char* article);
+
+// Comments of the thread that fetch_comments left out, by id. Reddit takes 100 ids at most.
+const struct reddit_api_response* fetch_more_comments(const RedditApp* app, const RedditAccessToken* token,
+                                                      const char* article, const char* const* ids, size_t count);
+
 struct reddit_api_response {
     enum http_status_code status_code;
     const struct response_buffer* response_buffer;
+    char* etag;
+    // deserialized while downloading for successful listing fetches, owned by the caller like response_buffer
+    struct listings* listings;
+    struct request_timing timing;
+    // CURLE_OK once Reddit answered, whatever the status. status_code is 0 otherwise.
+    CURLcode transport_result;
+    // X-Ratelimit-Used, -Remaining and -Reset of listings and comments responses: requests made and left in the
+    // current window, and seconds until it ends. -1 when Reddit didn't send them.
+    double ratelimit_used;
+    double ratelimit_remaining;
+    int64_t ratelimit_reset;
 };
 
 struct reddit_api_response* new_reddit_api_response(struct response_buffer* response, long* status_code);
@@ -87,7 +300,13 @@ enum subreddit_access {
     SUBREDDIT_ACCESS_PRIVATE,
     SUBREDDIT_ACCESS_QUARANTINED,
     SUBREDDIT_ACCESS_EXPIRED_TOKEN,
+    // no answer at all: the host couldn't be resolved or connected to, or the connection broke off
+    SUBREDDIT_ACCESS_UNREACHABLE,
+    // Reddit's request limit is used up, either answered with a 429 or not sent at all
+    SUBREDDIT_ACCESS_RATE_LIMITED,
     SUBREDDIT_ACCESS_UNKNOWN
 };
 
+enum subreddit_access subreddit_access_from_response(const struct reddit_api_response* response);
+
 #endif
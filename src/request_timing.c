@@ -0,0 +1,294 @@
+#include "request_timing.h"
+#include "curl_wrappers.h"
+#include "memory.h"
+#include <curl/curl.h>
+#include <curl/easy.h>
+#include <glib.h>
+#include <inttypes.h>
+#include <jansson.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+
+// Every doubling from 1 us up to about 70 minutes is split into four buckets, which keeps percentiles within about 10%.
+// Bucket 0 holds anything under 1 us.
+#define HISTOGRAM_BUCKETS 128
+// Once a histogram holds this many requests, all of its counts are halved
+static const double HISTOGRAM_DECAY_COUNT = 1000;
+static const int HISTOGRAM_VERSION = 1;
+// the log is moved aside to <log>.1 when it grows beyond this on opening
+static const off_t MAX_LOG_SIZE = 1024 * 1024;
+
+static const char* const REQUEST_NAMES[TIMED_REQUEST_COUNT] = {"access_token", "listings", "comments"};
+static const char* const PHASE_NAMES[TIMING_PHASE_COUNT] = {"dns",      "connect",     "tls",  "first_byte",
+                                                            "transfer", "deserialize", "total"};
+
+struct timing_log {
+    GMutex lock;
+    char* log_path;
+    char* histogram_path;
+    double histograms[TIMED_REQUEST_COUNT][TIMING_PHASE_COUNT][HISTOGRAM_BUCKETS];
+    bool has_last;
+    struct request_timing last;
+    char* last_subreddit;
+};
+
+static int64_t curl_time(CURL* client, CURLINFO info) {
+    curl_off_t value = 0;
+    curl_easy_getinfo(client, info, &value);
+    return (int64_t)value;
+}
+
+static int64_t max_of(int64_t a, int64_t b) {
+    return a > b ? a : b;
+}
+
+void request_timing_from_curl(CURL* client, struct request_timing* timing) {
+    // curl reports the time from the start of the transfer until the end of each phase
+    int64_t resolved = curl_time(client, CURLINFO_NAMELOOKUP_TIME_T);
+    int64_t connected = max_of(resolved, curl_time(client, CURLINFO_CONNECT_TIME_T));
+    int64_t tls_done = curl_time(client, CURLINFO_APPCONNECT_TIME_T);
+    int64_t handshake_done = max_of(connected, tls_done);
+    int64_t first_byte = max_of(handshake_done, curl_time(client, CURLINFO_STARTTRANSFER_TIME_T));
+    int64_t total = max_of(first_byte, curl_time(client, CURLINFO_TOTAL_TIME_T));
+    timing->dns_us = resolved;
+    timing->connect_us = connected - resolved;
+    // zero for plain HTTP and reused connections
+    timing->tls_us = tls_done > 0 ? handshake_done - connected : 0;
+    timing->first_byte_us = first_byte - handshake_done;
+    timing->transfer_us = total - first_byte;
+    timing->total_us = total;
+    timing->bytes = curl_time(client, CURLINFO_SIZE_DOWNLOAD_T);
+}
+
+static int64_t phase_of(const struct request_timing* timing, enum timing_phase phase) {
+    switch (phase) {
+    case TIMING_PHASE_DNS:
+        return timing->dns_us;
+    case TIMING_PHASE_CONNECT:
+        return timing->connect_us;
+    case TIMING_PHASE_TLS:
+        return timing->tls_us;
+    case TIMING_PHASE_FIRST_BYTE:
+        return timing->first_byte_us;
+    case TIMING_PHASE_TRANSFER:
+        return timing->transfer_us;
+    case TIMING_PHASE_DESERIALIZE:
+        return timing->deserialize_us;
+    default:
+        return timing->total_us;
+    }
+}
+
+// The highest set bit picks the doubling, the two bits below it the quarter.
+static size_t bucket_of(int64_t us) {
+    if (us < 1)
+        return 0;
+    int highest = 63 - __builtin_clzll((unsigned long long)us);
+    uint64_t quarter = highest >= 2 ? ((uint64_t)us >> (highest - 2)) & 3 : ((uint64_t)us << (2 - highest)) & 3;
+    size_t bucket = 1 + 4 * (size_t)highest + (size_t)quarter;
+    return bucket < HISTOGRAM_BUCKETS ? bucket : HISTOGRAM_BUCKETS - 1;
+}
+
+// Middle of the bucket's range.
+static int64_t bucket_value(size_t bucket) {
+    if (bucket == 0)
+        return 0;
+    size_t highest = (bucket - 1) / 4;
+    uint64_t quarter = (bucket - 1) % 4;
+    // the range is [(4 + quarter) / 4, (5 + quarter) / 4) times 2^highest
+    return (int64_t)(((9 + 2 * quarter) << highest) / 8);
+}
+
+static void load_histograms(struct timing_log* log) {
+    json_t* root = json_load_file(log->histogram_path, 0, NULL);
+    if (!root)
+        return;
+    json_t* version = json_object_get(root, "version");
+    if (!json_is_integer(version) || json_integer_value(version) != HISTOGRAM_VERSION) {
+        json_decref(root);
+        return;
+    }
+    for (size_t request = 0; request < TIMED_REQUEST_COUNT; request++) {
+        json_t* phases = json_object_get(root, REQUEST_NAMES[request]);
+        for (size_t phase = 0; phase < TIMING_PHASE_COUNT; phase++) {
+            json_t* counts = json_object_get(phases, PHASE_NAMES[phase]);
+            if (json_array_size(counts) != HISTOGRAM_BUCKETS)
+                continue;
+            for (size_t bucket = 0; bucket < HISTOGRAM_BUCKETS; bucket++) {
+                double count = json_number_value(json_array_get(counts, bucket));
+                log->histograms[request][phase][bucket] = count > 0 ? count : 0;
+            }
+        }
+    }
+    json_decref(root);
+}
+
+static void save_histograms(const struct timing_log* log) {
+    json_t* root = json_object();
+    json_object_set_new(root, "version", json_integer(HISTOGRAM_VERSION));
+    for (size_t request = 0; request < TIMED_REQUEST_COUNT; request++) {
+        json_t* phases = json_object();
+        for (size_t phase = 0; phase < TIMING_PHASE_COUNT; phase++) {
+            json_t* counts = json_array();
+            for (size_t bucket = 0; bucket < HISTOGRAM_BUCKETS; bucket++) {
+                json_array_append_new(counts, json_real(log->histograms[request][phase][bucket]));
+            }
+            json_object_set_new(phases, PHASE_NAMES[phase], counts);
+        }
+        json_object_set_new(root, REQUEST_NAMES[request], phases);
+    }
+    char* contents = json_dumps(root, JSON_COMPACT);
+    json_decref(root);
+    GError* error = NULL;
+    if (!contents || !g_file_set_contents(log->histogram_path, contents, -1, &error)) {
+        fprintf(stderr, "Failed to save request timings at %s: %s\n", log->histogram_path,
+                error ? error->message : "out of memory");
+        if (error)
+            g_error_free(error);
+    }
+    free(contents);
+}
+
+static void rotate_log(const char* log_path) {
+    struct stat log_stat;
+    if (stat(log_path, &log_stat) != 0 || log_stat.st_size <= MAX_LOG_SIZE)
+        return;
+    char* rotated_path = g_strdup_printf("%s.1", log_path);
+    if (rename(log_path, rotated_path) != 0)
+        perror("Failed to rotate request timing log");
+    g_free(rotated_path);
+}
+
+struct timing_log* new_timing_log(const char* log_path, const char* histogram_path) {
+    struct timing_log* log = LOG_ERR_MALLOC(struct timing_log, 1);
+    memset(log, 0, sizeof(*log));
+    g_mutex_init(&log->lock);
+    log->log_path = g_strdup(log_path);
+    log->histogram_path = g_strdup(histogram_path);
+    if (log->log_path)
+        rotate_log(log->log_path);
+    if (log->histogram_path)
+        load_histograms(log);
+    return log;
+}
+
+static void append_to_log(const struct timing_log* log, enum timed_request request, const char* subreddit,
+                          enum http_status_code status, const struct request_timing* timing) {
+    json_t* line = json_object();
+    json_object_set_new(line, "at", json_integer((json_int_t)time(NULL)));
+    json_object_set_new(line, "request", json_string(REQUEST_NAMES[request]));
+    json_object_set_new(line, "status", json_integer(status));
+    if (subreddit)
+        json_object_set_new(line, "subreddit", json_string(subreddit));
+    for (size_t phase = 0; phase < TIMING_PHASE_COUNT; phase++) {
+        char* key = g_strdup_printf("%s_us", PHASE_NAMES[phase]);
+        json_object_set_new(line, key, json_integer(phase_of(timing, (enum timing_phase)phase)));
+        g_free(key);
+    }
+    json_object_set_new(line, "bytes", json_integer(timing->bytes));
+    char* serialized = json_dumps(line, JSON_COMPACT);
+    json_decref(line);
+    FILE* file = fopen(log->log_path, "a");
+    if (file && serialized) {
+        fprintf(file, "%s\n", serialized);
+    } else {
+        perror("Failed to append to request timing log");
+    }
+    if (file)
+        fclose(file);
+    free(serialized);
+}
+
+void timing_log_record(struct timing_log* log, enum timed_request request, const char* subreddit,
+                       enum http_status_code status, const struct request_timing* timing) {
+    if (!log)
+        return;
+    g_mutex_lock(&log->lock);
+    for (size_t phase = 0; phase < TIMING_PHASE_COUNT; phase++) {
+        double* histogram = log->histograms[request][phase];
+        double count = 0;
+        for (size_t bucket = 0; bucket < HISTOGRAM_BUCKETS; bucket++) {
+            count += histogram[bucket];
+        }
+        if (count >= HISTOGRAM_DECAY_COUNT) {
+            for (size_t bucket = 0; bucket < HISTOGRAM_BUCKETS; bucket++) {
+                histogram[bucket] /= 2;
+            }
+        }
+        histogram[bucket_of(phase_of(timing, (enum timing_phase)phase))] += 1;
+    }
+    if (request == TIMED_REQUEST_LISTINGS) {
+        log->has_last = true;
+        log->last = *timing;
+        g_free(log->last_subreddit);
+        log->last_subreddit = g_strdup(subreddit);
+    }
+    if (log->log_path)
+        append_to_log(log, request, subreddit, status, timing);
+    g_mutex_unlock(&log->lock);
+}
+
+static int64_t percentile_of(const double* histogram, double fraction) {
+    double count = 0;
+    for (size_t bucket = 0; bucket < HISTOGRAM_BUCKETS; bucket++) {
+        count += histogram[bucket];
+    }
+    if (count <= 0)
+        return -1;
+    double seen = 0;
+    for (size_t bucket = 0; bucket < HISTOGRAM_BUCKETS; bucket++) {
+        seen += histogram[bucket];
+        if (seen >= fraction * count)
+            return bucket_value(bucket);
+    }
+    return bucket_value(HISTOGRAM_BUCKETS - 1);
+}
+
+int64_t timing_log_percentile(struct timing_log* log, enum timed_request request, enum timing_phase phase,
+                              double fraction) {
+    g_mutex_lock(&log->lock);
+    int64_t value = percentile_of(log->histograms[request][phase], fraction);
+    g_mutex_unlock(&log->lock);
+    return value;
+}
+
+static int64_t ms(int64_t us) {
+    return (us + 500) / 1000;
+}
+
+char* timing_log_summary(struct timing_log* log) {
+    if (!log)
+        return NULL;
+    g_mutex_lock(&log->lock);
+    char* summary = NULL;
+    if (log->has_last) {
+        const struct request_timing* last = &log->last;
+        const double* totals = log->histograms[TIMED_REQUEST_LISTINGS][TIMING_PHASE_TOTAL];
+        summary = g_strdup_printf("r/%s took %" PRId64 " ms: DNS %" PRId64 ", connect %" PRId64 ", TLS %" PRId64
+                                  ", waiting %" PRId64 ", download %" PRId64 ", parsing %" PRId64 ". p50 %" PRId64
+                                  " ms, p95 %" PRId64 " ms.",
+                                  log->last_subreddit ? log->last_subreddit : "?", ms(last->total_us),
+                                  ms(last->dns_us), ms(last->connect_us), ms(last->tls_us), ms(last->first_byte_us),
+                                  ms(last->transfer_us), ms(last->deserialize_us), ms(percentile_of(totals, 0.5)),
+                                  ms(percentile_of(totals, 0.95)));
+    }
+    g_mutex_unlock(&log->lock);
+    return summary;
+}
+
+void free_timing_log(struct timing_log* log) {
+    if (!log)
+        return;
+    if (log->histogram_path)
+        save_histograms(log);
+    g_mutex_clear(&log->lock);
+    g_free(log->log_path);
+    g_free(log->histogram_path);
+    g_free(log->last_subreddit);
+    free(log);
+}
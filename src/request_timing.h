@@ -0,0 +1,67 @@
+#ifndef REQUEST_TIMING_H
+#define REQUEST_TIMING_H
+
+#include "curl_wrappers.h"
+#include <curl/curl.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+// Where the time of one request went, in microseconds. The network phases follow each other and add up to total_us.
+struct request_timing {
+    int64_t dns_us;
+    int64_t connect_us;
+    int64_t tls_us;
+    // from the handshake being done until the first byte of the response, mostly Reddit putting it together
+    int64_t first_byte_us;
+    int64_t transfer_us;
+    int64_t total_us;
+    // spent parsing JSON, not part of total_us. Listings are parsed while they download, so it overlaps transfer_us.
+    int64_t deserialize_us;
+    int64_t bytes;
+};
+
+// Fills in the network phases of the last transfer of client.
+void request_timing_from_curl(CURL* client, struct request_timing* timing);
+
+enum timed_request {
+    TIMED_REQUEST_ACCESS_TOKEN,
+    TIMED_REQUEST_LISTINGS,
+    // both the first comments of a thread and the hidden ones loaded later
+    TIMED_REQUEST_COMMENTS,
+    TIMED_REQUEST_COUNT
+};
+
+enum timing_phase {
+    TIMING_PHASE_DNS,
+    TIMING_PHASE_CONNECT,
+    TIMING_PHASE_TLS,
+    TIMING_PHASE_FIRST_BYTE,
+    TIMING_PHASE_TRANSFER,
+    TIMING_PHASE_DESERIALIZE,
+    TIMING_PHASE_TOTAL,
+    TIMING_PHASE_COUNT
+};
+
+// Appends every request's timing as a line of JSON to a log, and keeps histograms of each phase that carry over from
+// one session to the next. Older requests weigh less and less, so percentiles follow the network as it changes.
+// Safe to use from several threads.
+struct timing_log;
+
+// Either path may be NULL to skip that part.
+struct timing_log* new_timing_log(const char* log_path, const char* histogram_path);
+
+// Does nothing when log is NULL. subreddit is NULL for access token and comments requests.
+void timing_log_record(struct timing_log* log, enum timed_request request, const char* subreddit,
+                       enum http_status_code status, const struct request_timing* timing);
+
+// Of every recorded request of the kind, in microseconds. Negative when there are none.
+int64_t timing_log_percentile(struct timing_log* log, enum timed_request request, enum timing_phase phase,
+                              double fraction);
+
+// One line on the last listings request and how it compares, e.g. "r/linux took 412 ms: ...". NULL before the first.
+char* timing_log_summary(struct timing_log* log);
+
+// Saves the histograms.
+void free_timing_log(struct timing_log* log);
+
+#endif
@@ -1,76 +1,232 @@
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <unistd.h>
 
+#include "comments.h"
 #include "curl_wrappers.h"
+#include "fetch_worker.h"
 #include "glib.h"
+#include "listings_cache.h"
+#include "listings_filter.h"
 #include "reddit.h"
+#include "request_timing.h"
+#include "search_index.h"
+#include "subreddit_history.h"
+#include "subreddit_index.h"
+#include "thumbnail_cache.h"
+#include "thumbnail_fetcher.h"
 #include <rofi/helper.h>
 #include <rofi/mode-private.h>
 #include <rofi/mode.h>
+#include <rofi/rofi-icon-fetcher.h>
 
+#include <inttypes.h>
 #include <stdint.h>
+#include <sys/stat.h>
+#include <time.h>
 
 G_MODULE_EXPORT Mode mode;
 
+// Typing this in front of the input completes subreddit names even while threads are shown.
+static const char* const SUBREDDIT_PREFIX = "r/";
+// Typing this in front of the input searches every thread fetched so far rather than filtering the shown ones.
+static const char* const SEARCH_PREFIX = "/";
+
+// kb-custom-1, Alt+1 by default, shows the text of the selected thread in the message bar.
+static const unsigned int PREVIEW_CUSTOM_KEY = 0;
+// kb-custom-2, Alt+2 by default, shows the threads in the next of the configured sorts.
+static const unsigned int SORT_CUSTOM_KEY = 1;
+// The message bar grows with its text, so long self posts are cut short.
+static const glong MAX_PREVIEW_CHARS = 1500;
+// Replies nested deeper than this are indented no further, so that their text stays on screen.
+static const uint32_t MAX_COMMENT_INDENT = 8;
+// Rows show the start of a comment, the rest is in its preview.
+static const glong MAX_COMMENT_ROW_CHARS = 300;
+
+// Not part of rofi's plugin headers, but exported by the rofi binary: refreshes rows and message bar of the active view.
+void rofi_view_reload(void);
+
 typedef struct {
+    // owned by the fetch worker, NULL until it has read the config
     RedditApp* app;
-    const RedditAccessToken* token;
+    // why the app couldn't be set up, NULL while it is being set up and once it is
+    const char* startup_error;
+    // the query selected before the app was set up, selected again once it is
+    char* pending_query;
+    struct fetch_worker* fetch_worker;
     struct listings* listings;
     char* selected_subreddit;
+    // normalized, e.g. "top:week". NULL until a query has been selected with the app set up.
+    char* selected_sort;
+    // waiting for listings with nothing to show yet
+    bool loading;
+    // showing cached listings while fresher ones are being fetched
+    bool revalidating;
+    // when the oldest shown listings were cached, if they are shown because Reddit couldn't be reached or was rate
+    // limiting; 0 otherwise
+    time_t offline_cached_at;
+    // some of them are shown because Reddit's request limit was used up
+    bool rate_limited;
     enum subreddit_access subreddit_access;
+    // number of subreddits in the selected query, rows are labeled with their subreddit when there are several
+    size_t subreddit_count;
+    // which subreddits of a multi-subreddit query could not be fetched, and why
+    char* unavailable_subreddits;
+    // bumped whenever listings is replaced, so that a late page is never appended to listings it doesn't continue
+    unsigned int listings_generation;
+    bool fetching_page;
+    // stops prefetching after a failed page until listings is replaced, rather than retrying on every redraw
+    bool paging_failed;
+    struct subreddit_index* subreddit_index;
+    struct subreddit_history* history;
+    // the selected query is recorded in the history once its threads are shown, switching sorts doesn't count again
+    bool visit_pending;
+    // rows are the subreddit names of the index rather than threads
+    bool completing;
+    // positions of the index names that start like the subreddit being typed
+    size_t completion_first;
+    size_t completion_last;
+    // the input before the subreddit being typed, e.g. "linux,cpp," for "linux,cpp,ru"
+    char* completion_head;
+    // the start of the subreddit being typed, looked up again once the index took in new names
+    char* completion_prefix;
+    // rows are the threads of the search index matching the input rather than listings
+    bool searching;
+    struct listings* search_results;
+    // the input after the prefix as typed, NULL while not searching. Results are shown once the worker has looked it
+    // up, the previous ones until then.
+    char* search_query;
+    // folded text of the threads in listings, in the same order
+    struct listings_filter* filter;
+    // what the threads are being filtered by, NULL while nothing is typed
+    struct filter_query* filter_query;
+    // markup of the thread shown in the message bar instead of the status, NULL when none is previewed
+    char* preview;
+    unsigned int preview_line;
+    // NULL unless thumbnails.show is set
+    struct thumbnail_cache* thumbnails;
+    struct thumbnail_fetcher* thumbnail_fetcher;
+    // rows are the comments of a thread rather than threads, toggled with kb-accept-alt
+    bool showing_comments;
+    // NULL while the first comments are being fetched, and if they couldn't be
+    struct comment_thread* comments;
+    char* comments_article;
+    char* comments_title;
+    enum subreddit_access comments_access;
+    // bumped whenever comments is replaced, so that late hidden comments are never spliced into another thread
+    unsigned int comments_generation;
+    // rows of hidden comments are loaded one at a time, which keeps the index of the one in flight valid
+    bool loading_more_comments;
 } RofiRedditModePrivateData;
 
+// Candidates move once the index took in new names, the ones being shown are looked up again.
+static void on_subreddit_index_updated(void* user_data) {
+    RofiRedditModePrivateData* private_data = (RofiRedditModePrivateData*)user_data;
+    if (private_data->completing && private_data->completion_prefix)
+        subreddit_index_find_prefix(private_data->subreddit_index, private_data->completion_prefix,
+                                    &private_data->completion_first, &private_data->completion_last);
+    rofi_view_reload();
+}
+
+// Merges the configured subreddit list into the index when the list changed since the index was last written. The
+// list can be long, it is read and merged in the background.
+static void import_subreddit_list(RofiRedditModePrivateData* private_data, const char* list_path,
+                                  const char* index_path) {
+    struct stat list_stat;
+    struct stat index_stat;
+    if (stat(list_path, &list_stat) != 0) {
+        fprintf(stderr, "Subreddit list to import at %s doesn't exist.\n", list_path);
+        return;
+    }
+    if (stat(index_path, &index_stat) == 0 && index_stat.st_mtime >= list_stat.st_mtime)
+        return;
+    fprintf(stdout, "Importing subreddit list at %s.\n", list_path);
+    subreddit_index_add_in_background(private_data->subreddit_index, NULL, 0, list_path, on_subreddit_index_updated,
+                                      private_data);
+}
+
+static void on_app_ready(RedditApp* app, const char* error, void* user_data);
+
+// Only sets up state, so that the window shows up right away. The config, the access token and the first connection
+// to Reddit are taken care of by the fetch worker; see on_app_ready.
 static int rofi_reddit_mode_init(Mode* mode) {
     if (mode_get_private_data(mode) == NULL) {
-        struct rofi_reddit_paths* paths = new_rofi_reddit_paths();
-        struct rofi_reddit_cfg* config = new_rofi_reddit_cfg(paths);
-        if (!config)
-            exit(EXIT_FAILURE);
-        RedditApp* app = new_reddit_app(config);
+        gint64 started = g_get_monotonic_time();
         RofiRedditModePrivateData* private_data = g_malloc0(sizeof(*private_data));
         mode_set_private_data(mode, (void*)private_data);
-        private_data->app = app;
-        RedditAccessToken* token = new_reddit_access_token(app);
-        if (!token)
-            exit(EXIT_FAILURE);
-        private_data->token = token;
+        private_data->app = NULL;
+        private_data->startup_error = NULL;
+        private_data->pending_query = NULL;
         private_data->listings = NULL;
         private_data->selected_subreddit = NULL;
+        private_data->selected_sort = NULL;
+        private_data->loading = false;
+        private_data->revalidating = false;
+        private_data->offline_cached_at = 0;
+        private_data->rate_limited = false;
         private_data->subreddit_access = SUBREDDIT_ACCESS_UNINITIALIZED;
-        fprintf(stdout, "Initialized Rofi Reddit Mode with app: %s\n", app->config->auth->client_name);
+        private_data->subreddit_count = 0;
+        private_data->unavailable_subreddits = NULL;
+        private_data->listings_generation = 0;
+        private_data->fetching_page = false;
+        private_data->paging_failed = false;
+        private_data->subreddit_index = NULL;
+        private_data->history = NULL;
+        private_data->visit_pending = false;
+        private_data->completing = false;
+        private_data->completion_first = 0;
+        private_data->completion_last = 0;
+        private_data->completion_head = NULL;
+        private_data->completion_prefix = NULL;
+        private_data->searching = false;
+        private_data->search_results = NULL;
+        private_data->search_query = NULL;
+        private_data->filter = NULL;
+        private_data->filter_query = NULL;
+        private_data->preview = NULL;
+        private_data->preview_line = 0;
+        private_data->thumbnails = NULL;
+        private_data->thumbnail_fetcher = NULL;
+        private_data->showing_comments = false;
+        private_data->comments = NULL;
+        private_data->comments_article = NULL;
+        private_data->comments_title = NULL;
+        private_data->comments_access = SUBREDDIT_ACCESS_UNINITIALIZED;
+        private_data->comments_generation = 0;
+        private_data->loading_more_comments = false;
+        private_data->fetch_worker = new_fetch_worker(load_rofi_reddit_cfg, on_app_ready, private_data);
+        if (!private_data->fetch_worker)
+            private_data->startup_error = "Rofi Reddit failed to start fetching in the background.";
+        fprintf(stdout, "Initialized Rofi Reddit Mode in %" PRId64 " us.\n", g_get_monotonic_time() - started);
     }
     return TRUE;
 }
 
+// Rows are the subreddits of the history, most frecent first, while there are no threads to show and nothing else
+// took their place. Derived rather than kept, so that they show up as soon as the history is loaded, before anything
+// is typed, and again whenever a query leaves no threads.
+static bool is_showing_history(const RofiRedditModePrivateData* private_data) {
+    return !private_data->completing && !private_data->searching && !private_data->showing_comments &&
+           !private_data->listings && !private_data->loading && subreddit_history_count(private_data->history) > 0;
+}
+
 static unsigned int rofi_reddit_mode_get_num_entries(const Mode* mode) {
     const RofiRedditModePrivateData* private_data = (const RofiRedditModePrivateData*)mode_get_private_data(mode);
+    if (private_data->completing)
+        return subreddit_index_count(private_data->subreddit_index);
+    if (is_showing_history(private_data))
+        return subreddit_history_count(private_data->history);
+    if (private_data->searching)
+        return private_data->search_results ? private_data->search_results->count : 0;
+    if (private_data->showing_comments)
+        return private_data->comments ? private_data->comments->count : 0;
     if (private_data->listings)
         return private_data->listings->count;
     return 0;
 }
 
-static enum subreddit_access subreddit_access_denied_reason(const struct reddit_api_response* response) {
-    json_error_t error;
-    json_t* root = json_loads((const char*)response->response_buffer->buffer, 0, &error);
-    enum subreddit_access access_status = SUBREDDIT_ACCESS_EXPIRED_TOKEN;
-    if (response->status_code == HTTP_FORBIDDEN && root && json_is_object(root)) {
-        access_status = SUBREDDIT_ACCESS_UNKNOWN;
-        json_t* reason = json_object_get(root, "reason");
-        if (reason && json_is_string(reason)) {
-            const char* reason_str = json_string_value(reason);
-            if (strcmp(reason_str, "private") == 0) {
-                access_status = SUBREDDIT_ACCESS_PRIVATE;
-            } else if (strcmp(reason_str, "quarantined") == 0) {
-                access_status = SUBREDDIT_ACCESS_QUARANTINED;
-            }
-        }
-        json_decref(root);
-    }
-    return access_status;
-}
-
 static char* sanitize_subrredit_name(const char* subreddit) {
     if (!subreddit || strlen(subreddit) == 0)
         return NULL;
@@ -87,66 +243,554 @@ static char* sanitize_subrredit_name(const char* subreddit) {
     return final;
 }
 
+static const char* subreddit_access_reason(enum subreddit_access access) {
+    switch (access) {
+    case SUBREDDIT_ACCESS_DOESNT_EXIST:
+        return "doesn't exist";
+    case SUBREDDIT_ACCESS_PRIVATE:
+        return "is private";
+    case SUBREDDIT_ACCESS_QUARANTINED:
+        return "is quarantined";
+    case SUBREDDIT_ACCESS_UNREACHABLE:
+        return "isn't cached for offline use";
+    case SUBREDDIT_ACCESS_RATE_LIMITED:
+        return "isn't cached and Reddit's request limit is used up";
+    default:
+        return "couldn't be fetched";
+    }
+}
+
+static char* describe_unavailable_subreddits(const struct fetch_result* result) {
+    GString* description = g_string_new(NULL);
+    for (size_t i = 0; i < result->status_count; i++) {
+        if (result->statuses[i].access == SUBREDDIT_ACCESS_OK)
+            continue;
+        g_string_append_printf(description, " r/%s %s.", result->statuses[i].subreddit,
+                               subreddit_access_reason(result->statuses[i].access));
+    }
+    return g_string_free(description, description->len == 0);
+}
+
+static void replace_listings(RofiRedditModePrivateData* private_data, struct listings* listings) {
+    free_listings(private_data->listings);
+    private_data->listings = listings;
+    free_listings_filter(private_data->filter);
+    private_data->filter = NULL;
+    if (listings) {
+        private_data->filter = new_listings_filter(private_data->app->config->filter.match_selftext);
+        listings_filter_add(private_data->filter, listings->items, listings->count);
+    }
+    g_free(private_data->preview);
+    private_data->preview = NULL;
+    private_data->offline_cached_at = 0;
+    private_data->rate_limited = false;
+    private_data->listings_generation++;
+    private_data->fetching_page = false;
+    private_data->paging_failed = false;
+}
+
+// Shows the cached listings of the query if every one of its subreddits is cached. Returns whether all of them are
+// still fresh.
+static bool show_cached_listings(RofiRedditModePrivateData* private_data, char** subreddits, size_t count) {
+    const struct rofi_reddit_cfg* config = private_data->app->config;
+    struct listings** parts = g_new0(struct listings*, count);
+    bool all_cached = true;
+    bool all_fresh = true;
+    for (size_t i = 0; i < count; i++) {
+        struct cached_listings* cached =
+            read_listings_cache(config->paths, subreddits[i], private_data->selected_sort);
+        all_cached = all_cached && cached;
+        all_fresh = all_fresh && is_listings_cache_fresh(cached, config->cache.ttl_seconds);
+        if (cached) {
+            parts[i] = cached->listings;
+            cached->listings = NULL;
+            free_cached_listings(cached);
+        }
+    }
+    if (all_cached) {
+        fprintf(stdout, "Listings cache hit for subreddit=%s sort=%s.\n", private_data->selected_subreddit,
+                private_data->selected_sort);
+        replace_listings(private_data, merge_listings(parts, count, config->listings.merge_order));
+        private_data->subreddit_access = SUBREDDIT_ACCESS_OK;
+    } else {
+        for (size_t i = 0; i < count; i++) {
+            free_listings(parts[i]);
+        }
+    }
+    g_free(parts);
+    return all_cached && all_fresh;
+}
+
+// Reddit's spelling of the subreddit, e.g. "linux" typed as "LINUX", when one of its threads is at hand.
+static const char* canonical_subreddit_name(const struct listings* listings, const char* typed) {
+    for (size_t i = 0; listings && i < listings->count; i++) {
+        if (listings->items[i].subreddit && g_ascii_strcasecmp(listings->items[i].subreddit, typed) == 0)
+            return listings->items[i].subreddit;
+    }
+    return typed;
+}
+
+static void record_visit(RofiRedditModePrivateData* private_data) {
+    if (!private_data->visit_pending)
+        return;
+    private_data->visit_pending = false;
+    subreddit_history_visit(private_data->history,
+                            canonical_subreddit_name(private_data->listings, private_data->selected_subreddit),
+                            time(NULL));
+}
+
+// Every subreddit that could be fetched becomes a completion candidate.
+static void remember_subreddits(RofiRedditModePrivateData* private_data, const struct fetch_result* result) {
+    const char** names = g_new(const char*, result->status_count + 1);
+    size_t count = 0;
+    for (size_t i = 0; i < result->status_count; i++) {
+        if (result->statuses[i].access == SUBREDDIT_ACCESS_OK)
+            names[count++] = canonical_subreddit_name(result->listings, result->statuses[i].subreddit);
+    }
+    subreddit_index_add_in_background(private_data->subreddit_index, names, count, NULL, on_subreddit_index_updated,
+                                      private_data);
+    g_free(names);
+}
+
+// Fetches the shown query in every other configured sort in the background, so that switching to one of them shows
+// its threads right away. Sorts cached recently enough are skipped by the worker.
+static void prefetch_other_sorts(RofiRedditModePrivateData* private_data) {
+    const struct listings_cfg* config = &private_data->app->config->listings;
+    if (!config->prefetch_sorts || private_data->offline_cached_at)
+        return;
+    const char** others = g_new(const char*, config->sort_count);
+    size_t count = 0;
+    for (size_t i = 0; i < config->sort_count; i++) {
+        if (strcmp(config->sorts[i], private_data->selected_sort) != 0)
+            others[count++] = config->sorts[i];
+    }
+    if (count > 0)
+        fetch_worker_submit_prefetch(private_data->fetch_worker, private_data->selected_subreddit, others, count, NULL,
+                                     NULL);
+    g_free(others);
+}
+
+static void on_listings_fetched(struct fetch_result* result, void* user_data) {
+    RofiRedditModePrivateData* private_data = (RofiRedditModePrivateData*)user_data;
+    // a newer query or sort superseded this one while it was in flight
+    if (!private_data->selected_subreddit || strcmp(result->subreddit, private_data->selected_subreddit) != 0 ||
+        strcmp(result->sort, private_data->selected_sort) != 0) {
+        free_fetch_result(result);
+        return;
+    }
+    bool was_revalidating = private_data->revalidating;
+    private_data->loading = false;
+    private_data->revalidating = false;
+    if (was_revalidating && result->access != SUBREDDIT_ACCESS_OK) {
+        // stale threads are more useful than an error about a refresh nobody asked for
+        fprintf(stderr, "Revalidating subreddit=%s failed, keeping cached listings.\n", result->subreddit);
+        free_fetch_result(result);
+        rofi_view_reload();
+        return;
+    }
+    private_data->subreddit_access = result->access;
+    remember_subreddits(private_data, result);
+    replace_listings(private_data, result->listings);
+    result->listings = NULL;
+    private_data->offline_cached_at = result->offline_cached_at;
+    private_data->rate_limited = result->rate_limited;
+    free(private_data->unavailable_subreddits);
+    private_data->unavailable_subreddits = result->status_count > 1 ? describe_unavailable_subreddits(result) : NULL;
+    if (private_data->listings && private_data->listings->count > 0) {
+        fprintf(stdout, "Collected listings: %zu\n", private_data->listings->count);
+    }
+    if (result->access == SUBREDDIT_ACCESS_OK) {
+        record_visit(private_data);
+        prefetch_other_sorts(private_data);
+    }
+    free_fetch_result(result);
+    rofi_view_reload();
+}
+
+static void on_next_page_fetched(struct fetch_result* result, void* user_data) {
+    RofiRedditModePrivateData* private_data = (RofiRedditModePrivateData*)user_data;
+    if (result->generation != private_data->listings_generation) {
+        free_fetch_result(result);
+        return;
+    }
+    private_data->fetching_page = false;
+    if (result->access != SUBREDDIT_ACCESS_OK || !result->listings) {
+        fprintf(stderr, "Fetching the next page of subreddit=%s failed.\n", result->subreddit);
+        private_data->paging_failed = true;
+    } else {
+        // a subreddit whose page failed keeps its cursor, so that the next page retries it
+        const char** fetched = g_new0(const char*, result->status_count + 1);
+        for (size_t i = 0, count = 0; i < result->status_count; i++) {
+            if (result->statuses[i].access == SUBREDDIT_ACCESS_OK)
+                fetched[count++] = result->statuses[i].subreddit;
+        }
+        listings_filter_add(private_data->filter, result->listings->items, result->listings->count);
+        append_listings(private_data->listings, result->listings, fetched);
+        result->listings = NULL;
+        g_free(fetched);
+        fprintf(stdout, "Collected listings: %zu\n", private_data->listings->count);
+    }
+    free_fetch_result(result);
+    rofi_view_reload();
+}
+
+// Requests the next page once a row close enough to the end is displayed, so that it is usually there before the
+// selection reaches the end.
+static void prefetch_next_page(RofiRedditModePrivateData* private_data, unsigned int displayed_line) {
+    const struct listings* listings = private_data->listings;
+    if (private_data->loading || private_data->fetching_page || private_data->paging_failed ||
+        !has_more_listings(listings))
+        return;
+    size_t rows_left = listings->count - 1 - displayed_line;
+    if ((int64_t)rows_left > private_data->app->config->listings.prefetch_rows)
+        return;
+    private_data->fetching_page = true;
+    fetch_worker_submit_next_page(private_data->fetch_worker, private_data->selected_subreddit,
+                                  private_data->selected_sort, listings, private_data->listings_generation,
+                                  on_next_page_fetched, private_data);
+}
+
+// Back to the threads, which were kept as they were.
+static void close_comments(RofiRedditModePrivateData* private_data) {
+    free_comment_thread(private_data->comments);
+    private_data->comments = NULL;
+    g_free(private_data->comments_article);
+    private_data->comments_article = NULL;
+    g_free(private_data->comments_title);
+    private_data->comments_title = NULL;
+    g_free(private_data->preview);
+    private_data->preview = NULL;
+    private_data->showing_comments = false;
+    private_data->loading_more_comments = false;
+    private_data->comments_generation++;
+}
+
+static const char* strip_subreddit_prefix(const char* input) {
+    return g_str_has_prefix(input, SUBREDDIT_PREFIX) ? input + strlen(SUBREDDIT_PREFIX) : input;
+}
+
+// Splits off the sort a query may end in, e.g. "top:week" of "linux,cpp/top:week". Returns the subreddits; sort is
+// the first configured one if the query names none, or one Reddit doesn't have.
+static char* split_query_sort(const RofiRedditModePrivateData* private_data, const char* query, char** sort) {
+    const char* slash = strrchr(query, '/');
+    *sort = slash ? normalize_listings_sort(slash + 1) : NULL;
+    if (slash && !*sort)
+        fprintf(stderr, "Unknown sort '%s', falling back to '%s'.\n", slash + 1,
+                private_data->app->config->listings.sorts[0]);
+    if (!*sort)
+        *sort = g_strdup(private_data->app->config->listings.sorts[0]);
+    char* subreddits = g_strndup(query, slash ? (gsize)(slash - query) : strlen(query));
+    char* subreddit = sanitize_subrredit_name(subreddits);
+    g_free(subreddits);
+    return subreddit;
+}
+
+// Shows the threads of one or more comma separated subreddits in a normalized sort, from the cache when possible.
+// Takes ownership of both.
+static ModeMode show_subreddits(RofiRedditModePrivateData* private_data, char* subreddit, char* sort) {
+    if (!subreddit || strlen(subreddit) == 0) {
+        free(subreddit);
+        g_free(sort);
+        private_data->subreddit_access = SUBREDDIT_ACCESS_UNKNOWN;
+        return RELOAD_DIALOG;
+    }
+    free(private_data->selected_subreddit);
+    private_data->selected_subreddit = subreddit;
+    g_free(private_data->selected_sort);
+    private_data->selected_sort = sort;
+    replace_listings(private_data, NULL);
+    free(private_data->unavailable_subreddits);
+    private_data->unavailable_subreddits = NULL;
+    size_t subreddit_count = 0;
+    char** subreddits = split_subreddit_query(subreddit, &subreddit_count);
+    private_data->subreddit_count = subreddit_count;
+    bool fresh = subreddit_count > 0 && show_cached_listings(private_data, subreddits, subreddit_count);
+    g_strfreev(subreddits);
+    if (subreddit_count == 0) {
+        private_data->loading = false;
+        private_data->revalidating = false;
+        private_data->subreddit_access = SUBREDDIT_ACCESS_UNKNOWN;
+        return RELOAD_DIALOG;
+    }
+    private_data->loading = !private_data->listings;
+    private_data->revalidating = private_data->listings && !fresh;
+    if (fresh) {
+        prefetch_other_sorts(private_data);
+    } else {
+        fetch_worker_submit(private_data->fetch_worker, subreddit, sort, on_listings_fetched, private_data);
+    }
+    return RELOAD_DIALOG;
+}
+
+// Shows the threads of the query typed, e.g. "linux", "r/linux/new" or "linux,cpp/top:week".
+static ModeMode select_subreddit_query(RofiRedditModePrivateData* private_data, const char* input) {
+    private_data->completing = false;
+    close_comments(private_data);
+    if (!private_data->app) {
+        g_free(private_data->pending_query);
+        private_data->pending_query = private_data->startup_error ? NULL : g_strdup(input);
+        free(private_data->selected_subreddit);
+        private_data->selected_subreddit = sanitize_subrredit_name(strip_subreddit_prefix(input));
+        private_data->loading = private_data->pending_query && private_data->selected_subreddit;
+        return RELOAD_DIALOG;
+    }
+    char* sort = NULL;
+    char* subreddit = split_query_sort(private_data, strip_subreddit_prefix(input), &sort);
+    private_data->visit_pending = true;
+    ModeMode retv = show_subreddits(private_data, subreddit, sort);
+    // shown from the cache right away
+    if (private_data->listings)
+        record_visit(private_data);
+    return retv;
+}
+
+// Shows the threads of the selected query in the configured sort after the shown one.
+static ModeMode switch_sort(RofiRedditModePrivateData* private_data) {
+    if (!private_data->app || !private_data->selected_sort || private_data->showing_comments)
+        return RELOAD_DIALOG;
+    const struct listings_cfg* config = &private_data->app->config->listings;
+    size_t next = 0;
+    for (size_t i = 0; i < config->sort_count; i++) {
+        if (strcmp(config->sorts[i], private_data->selected_sort) == 0)
+            next = (i + 1) % config->sort_count;
+    }
+    return show_subreddits(private_data, strdup(private_data->selected_subreddit), g_strdup(config->sorts[next]));
+}
+
+static void on_thumbnail_done(const char* url, bool cached, void* user_data) {
+    // the row asks for its icon again on the redraw
+    if (cached)
+        rofi_view_reload();
+}
+
+static void start_thumbnails(RofiRedditModePrivateData* private_data, const struct rofi_reddit_cfg* config) {
+    if (!config->thumbnails.show || !config->paths->thumbnails_cache_dir)
+        return;
+    size_t max_bytes = (size_t)config->thumbnails.cache_size_mb * 1024 * 1024;
+    private_data->thumbnails = new_thumbnail_cache(config->paths->thumbnails_cache_dir, max_bytes);
+    if (private_data->thumbnails)
+        private_data->thumbnail_fetcher =
+            new_thumbnail_fetcher(config, private_data->thumbnails, on_thumbnail_done, private_data);
+}
+
+static void on_app_ready(RedditApp* app, const char* error, void* user_data) {
+    RofiRedditModePrivateData* private_data = (RofiRedditModePrivateData*)user_data;
+    if (!app) {
+        fprintf(stderr, "%s\n", error);
+        private_data->startup_error = error;
+        private_data->loading = false;
+        g_free(private_data->pending_query);
+        private_data->pending_query = NULL;
+        rofi_view_reload();
+        return;
+    }
+    private_data->app = app;
+    const struct rofi_reddit_cfg* config = app->config;
+    private_data->subreddit_index = new_subreddit_index(config->paths->subreddit_index_path);
+    private_data->history = new_subreddit_history(config->paths->subreddit_history_path);
+    if (config->completion.import_path)
+        import_subreddit_list(private_data, config->completion.import_path, config->paths->subreddit_index_path);
+    start_thumbnails(private_data, config);
+    fprintf(stdout, "Set up Rofi Reddit Mode with app: %s\n", config->auth->client_name);
+    if (private_data->pending_query) {
+        char* query = private_data->pending_query;
+        private_data->pending_query = NULL;
+        select_subreddit_query(private_data, query);
+        g_free(query);
+    }
+    rofi_view_reload();
+}
+
+static bool is_completion_candidate(const RofiRedditModePrivateData* private_data, unsigned int line) {
+    return private_data->completing && line >= private_data->completion_first &&
+           line < private_data->completion_last;
+}
+
+// The input with the subreddit being typed replaced by the candidate at line.
+static char* complete_subreddit(const RofiRedditModePrivateData* private_data, unsigned int line) {
+    return g_strdup_printf("%s%s", private_data->completion_head ? private_data->completion_head : "",
+                           subreddit_index_name(private_data->subreddit_index, line));
+}
+
+// text cut to at most max_chars characters, with an ellipsis if anything was cut.
+static char* shorten(const char* text, glong max_chars) {
+    if (g_utf8_strlen(text, -1) <= max_chars)
+        return g_strdup(text);
+    char* cut = g_utf8_substring(text, 0, max_chars);
+    char* shortened = g_strdup_printf("%s…", cut);
+    g_free(cut);
+    return shortened;
+}
+
+// The whole comment at line, which rows only show the start of.
+static char* comment_preview(const RofiRedditModePrivateData* private_data, unsigned int line) {
+    if (!private_data->comments || line >= private_data->comments->count ||
+        private_data->comments->items[line].is_more)
+        return NULL;
+    const struct comment* comment = &private_data->comments->items[line];
+    char* shown = shorten(comment->body, MAX_PREVIEW_CHARS);
+    const char* author = comment->author ? comment->author : "[deleted]";
+    char* preview = g_markup_printf_escaped("<b>%s</b> · %d points\n%s", author, comment->score, shown);
+    g_free(shown);
+    return preview;
+}
+
+// Selftext is only decoded here, for the one thread looked at. Previewing the same thread again hides it.
+static char* thread_preview(const RofiRedditModePrivateData* private_data, unsigned int line) {
+    if (!private_data->listings || line >= private_data->listings->count)
+        return NULL;
+    const struct listing* item = &private_data->listings->items[line];
+    char* selftext = listing_selftext(item);
+    char* shown = selftext ? shorten(selftext, MAX_PREVIEW_CHARS) : g_strdup("No text, this thread is a link.");
+    char* preview = g_markup_printf_escaped("<b>%s</b>\n%s", item->title, shown);
+    g_free(shown);
+    g_free(selftext);
+    return preview;
+}
+
+static ModeMode toggle_preview(RofiRedditModePrivateData* private_data, unsigned int line) {
+    bool was_shown = private_data->preview && private_data->preview_line == line;
+    g_free(private_data->preview);
+    private_data->preview = NULL;
+    // search results keep no selftext to preview
+    if (was_shown || private_data->completing || private_data->searching)
+        return RELOAD_DIALOG;
+    private_data->preview = private_data->showing_comments ? comment_preview(private_data, line)
+                                                           : thread_preview(private_data, line);
+    private_data->preview_line = line;
+    return RELOAD_DIALOG;
+}
+
+static void open_in_browser(const char* url) {
+    char* cmdline = g_strdup_printf("xdg-open '%s'", url);
+    g_spawn_command_line_async(cmdline, NULL);
+    g_free(cmdline);
+}
+
+static void on_comments_fetched(struct comments_result* result, void* user_data) {
+    RofiRedditModePrivateData* private_data = (RofiRedditModePrivateData*)user_data;
+    // the view was closed, or another thread opened, while they were in flight
+    if (result->generation != private_data->comments_generation) {
+        free_comments_result(result);
+        return;
+    }
+    private_data->comments_access = result->access;
+    private_data->comments = result->comments;
+    result->comments = NULL;
+    if (private_data->comments)
+        fprintf(stdout, "Collected comments: %zu\n", private_data->comments->count);
+    free_comments_result(result);
+    rofi_view_reload();
+}
+
+static void on_more_comments_fetched(struct comments_result* result, void* user_data) {
+    RofiRedditModePrivateData* private_data = (RofiRedditModePrivateData*)user_data;
+    if (result->generation != private_data->comments_generation) {
+        free_comments_result(result);
+        return;
+    }
+    private_data->loading_more_comments = false;
+    if (result->access != SUBREDDIT_ACCESS_OK || !result->comments) {
+        // the row stays, selecting it again retries
+        fprintf(stderr, "Fetching more comments of thread=%s failed.\n", result->article);
+    } else {
+        replace_more_comments(private_data->comments, result->index, result->comments, result->requested);
+        result->comments = NULL;
+        fprintf(stdout, "Collected comments: %zu\n", private_data->comments->count);
+    }
+    // rows moved, a preview would describe whatever took the previewed one's place
+    g_free(private_data->preview);
+    private_data->preview = NULL;
+    free_comments_result(result);
+    rofi_view_reload();
+}
+
+// The threads rows are showing, search results while searching.
+static const struct listings* shown_listings(const RofiRedditModePrivateData* private_data) {
+    return private_data->searching ? private_data->search_results : private_data->listings;
+}
+
+// Shows the comments of the thread at line instead of the threads.
+static ModeMode open_comments(RofiRedditModePrivateData* private_data, unsigned int line) {
+    const struct listings* listings = shown_listings(private_data);
+    if (!listings || line >= listings->count)
+        return RELOAD_DIALOG;
+    const struct listing* item = &listings->items[line];
+    if (!item->id) {
+        fprintf(stderr, "Thread %s has no id to fetch comments by.\n", item->title);
+        return RELOAD_DIALOG;
+    }
+    close_comments(private_data);
+    private_data->showing_comments = true;
+    private_data->comments_article = g_strdup(item->id);
+    private_data->comments_title = g_strdup(item->title);
+    private_data->comments_access = SUBREDDIT_ACCESS_UNINITIALIZED;
+    fetch_worker_submit_comments(private_data->fetch_worker, item->id, private_data->comments_generation,
+                                 on_comments_fetched, private_data);
+    // the input filtered threads, it would hide most comments
+    return RESET_DIALOG;
+}
+
+// Loads the hidden comments of the row at line in its place, or opens the comment in the browser.
+static ModeMode select_comment(RofiRedditModePrivateData* private_data, unsigned int line) {
+    if (!private_data->comments || line >= private_data->comments->count)
+        return RELOAD_DIALOG;
+    const struct comment* row = &private_data->comments->items[line];
+    if (row->is_more && row->more_count > 0) {
+        if (!private_data->loading_more_comments) {
+            private_data->loading_more_comments = true;
+            fetch_worker_submit_more_comments(private_data->fetch_worker, private_data->comments_article, row, line,
+                                              private_data->comments_generation, on_more_comments_fetched,
+                                              private_data);
+        }
+        return RELOAD_DIALOG;
+    }
+    if (!row->url)
+        return RELOAD_DIALOG;
+    open_in_browser(row->url);
+    return MODE_EXIT;
+}
+
 static ModeMode rofi_reddit_mode_result(Mode* mode, int mretv, char** input, unsigned int selected_line) {
     ModeMode retv = MODE_EXIT;
     RofiRedditModePrivateData* private_data = (RofiRedditModePrivateData*)mode_get_private_data(mode);
     if (mretv & MENU_NEXT) {
         retv = NEXT_DIALOG;
+    } else if ((mretv & MENU_OK) && private_data->completing) {
+        if (!is_completion_candidate(private_data, selected_line))
+            return RELOAD_DIALOG;
+        char* query = complete_subreddit(private_data, selected_line);
+        retv = select_subreddit_query(private_data, query);
+        g_free(query);
+    } else if ((mretv & MENU_OK) && is_showing_history(private_data)) {
+        const char* name = subreddit_history_name(private_data->history, selected_line);
+        if (!name)
+            return RELOAD_DIALOG;
+        // visiting it reorders the history, which may free the name
+        char* query = g_strdup(name);
+        retv = select_subreddit_query(private_data, query);
+        g_free(query);
+    } else if ((mretv & MENU_OK) && (mretv & MENU_CUSTOM_ACTION)) {
+        if (private_data->searching || !private_data->showing_comments)
+            return open_comments(private_data, selected_line);
+        close_comments(private_data);
+        retv = RESET_DIALOG;
+    } else if ((mretv & MENU_OK) && private_data->showing_comments && !private_data->searching) {
+        retv = select_comment(private_data, selected_line);
     } else if (mretv & MENU_OK) {
-        if (!private_data->listings || selected_line >= private_data->listings->count)
+        const struct listings* listings = shown_listings(private_data);
+        if (!listings || selected_line >= listings->count || !listings->items[selected_line].url)
             return MODE_EXIT;
-        char* url = private_data->listings->items[selected_line].url;
-        char* cmdline = g_strdup_printf("xdg-open '%s'", url);
-        g_spawn_command_line_async(cmdline, NULL);
-        g_free(cmdline);
+        open_in_browser(listings->items[selected_line].url);
         return MODE_EXIT;
+    } else if ((mretv & MENU_CUSTOM_COMMAND) && (mretv & MENU_LOWER_MASK) == PREVIEW_CUSTOM_KEY) {
+        retv = toggle_preview(private_data, selected_line);
+    } else if ((mretv & MENU_CUSTOM_COMMAND) && (mretv & MENU_LOWER_MASK) == SORT_CUSTOM_KEY) {
+        retv = switch_sort(private_data);
     } else if (mretv & MENU_PREVIOUS) {
         retv = PREVIOUS_DIALOG;
     } else if ((mretv & MENU_CUSTOM_INPUT)) {
-        char* subreddit = sanitize_subrredit_name(*input);
-        if (!subreddit || strlen(subreddit) == 0) {
-            private_data->subreddit_access = SUBREDDIT_ACCESS_UNKNOWN;
-            return RELOAD_DIALOG;
-        }
-        private_data->selected_subreddit = subreddit;
-        fprintf(stdout, "Fetching subreddit=%s listings.\n", subreddit);
-        const struct reddit_api_response* response =
-            fetch_hot_listings(private_data->app, private_data->token, subreddit);
-        switch (response->status_code) {
-        case HTTP_OK:
-            private_data->listings = deserialize_listings(response->response_buffer);
-            private_data->subreddit_access = SUBREDDIT_ACCESS_OK;
-            break;
-        case HTTP_UNAUTHORIZED:
-        case HTTP_FORBIDDEN:
-            enum subreddit_access denied_reason = subreddit_access_denied_reason(response);
-            switch (denied_reason) {
-            case SUBREDDIT_ACCESS_EXPIRED_TOKEN:
-                free_reddit_access_token(private_data->token);
-                private_data->token = fetch_and_cache_token(private_data->app);
-                retv = rofi_reddit_mode_result(mode, mretv, (char**)&subreddit, selected_line);
-                break;
-            case SUBREDDIT_ACCESS_QUARANTINED:
-            case SUBREDDIT_ACCESS_UNKNOWN:
-            case SUBREDDIT_ACCESS_PRIVATE:
-                private_data->subreddit_access = denied_reason;
-                break;
-            default:
-                break;
-            }
-            break;
-        case HTTP_NOT_FOUND:
-            private_data->subreddit_access = SUBREDDIT_ACCESS_DOESNT_EXIST;
-            retv = RELOAD_DIALOG;
-        default:
-            break;
-        }
-        if (private_data->listings && private_data->listings->count > 0) {
-            fprintf(stdout, "Collected listings: %zu\n", private_data->listings->count);
-        }
-        retv = RELOAD_DIALOG;
-        if (response)
-            free_reddit_api_response(response);
+        retv = select_subreddit_query(private_data, *input);
     }
     return retv;
 }
@@ -155,44 +799,297 @@ static void rofi_reddit_mode_destroy(Mode* mode) {
     RofiRedditModePrivateData* private_data = (RofiRedditModePrivateData*)mode_get_private_data(mode);
     if (private_data != NULL) {
         fprintf(stdout, "Destroying Rofi Reddit Mode.\n");
-        free_reddit_access_token(private_data->token);
-        free_reddit_app(private_data->app);
+        close_comments(private_data);
+        // uses the config, so it goes before the app
+        free_thumbnail_fetcher(private_data->thumbnail_fetcher);
+        free_thumbnail_cache(private_data->thumbnails);
+        // also frees the app
+        free_fetch_worker(private_data->fetch_worker);
         free_listings(private_data->listings);
+        g_free(private_data->pending_query);
         free(private_data->selected_subreddit);
+        g_free(private_data->selected_sort);
+        free(private_data->unavailable_subreddits);
+        free_subreddit_index(private_data->subreddit_index);
+        free_subreddit_history(private_data->history);
+        g_free(private_data->completion_head);
+        g_free(private_data->completion_prefix);
+        free_listings(private_data->search_results);
+        g_free(private_data->search_query);
+        free_listings_filter(private_data->filter);
+        free_filter_query(private_data->filter_query);
+        g_free(private_data->preview);
         g_free(private_data);
         mode_set_private_data(mode, NULL);
     }
 }
 
+// e.g. "    alice · 12 · First line of the reply…", indented by depth.
+static char* describe_comment(const struct comment* row) {
+    char* indent = g_strnfill(2 * MIN(row->depth, MAX_COMMENT_INDENT), ' ');
+    char* description = NULL;
+    if (row->is_more && row->more_count > 0) {
+        description =
+            g_strdup_printf("%s↳ %zu more repl%s", indent, row->more_count, row->more_count == 1 ? "y" : "ies");
+    } else if (row->is_more) {
+        description = g_strdup_printf("%s↳ Continue this thread in the browser", indent);
+    } else {
+        char* body = shorten(row->body, MAX_COMMENT_ROW_CHARS);
+        g_strdelimit(body, "\r\n\t", ' ');
+        description =
+            g_strdup_printf("%s%s · %d · %s", indent, row->author ? row->author : "[deleted]", row->score, body);
+        g_free(body);
+    }
+    g_free(indent);
+    return description;
+}
+
 static char* get_display_value(const Mode* mode, unsigned int selected_line, G_GNUC_UNUSED int* state,
                                G_GNUC_UNUSED GList** attr_list, int get_entry) {
     RofiRedditModePrivateData* private_data = (RofiRedditModePrivateData*)mode_get_private_data(mode);
-    if (!private_data->listings) {
-        return g_strdup("OOPS!"); // TODO: implement history of subreddits
+    if (private_data->completing) {
+        if (selected_line >= subreddit_index_count(private_data->subreddit_index))
+            return NULL;
+        return g_strdup_printf("r/%s", subreddit_index_name(private_data->subreddit_index, selected_line));
     }
+    if (private_data->searching) {
+        if (!private_data->search_results || selected_line >= private_data->search_results->count)
+            return NULL;
+        const struct listing* hit = &private_data->search_results->items[selected_line];
+        return g_strdup_printf("r/%s · %s", hit->subreddit ? hit->subreddit : "?", hit->title);
+    }
+    if (private_data->showing_comments) {
+        if (!private_data->comments || selected_line >= private_data->comments->count)
+            return NULL;
+        return describe_comment(&private_data->comments->items[selected_line]);
+    }
+    if (is_showing_history(private_data)) {
+        const char* name = subreddit_history_name(private_data->history, selected_line);
+        return name ? g_strdup_printf("r/%s", name) : NULL;
+    }
+    if (!private_data->listings)
+        return NULL;
     if (selected_line >= private_data->listings->count) {
         fprintf(stderr, "Selected line out of range.\n");
         return NULL;
     }
-    return g_strdup_printf("%s", private_data->listings->items[selected_line].title);
+    prefetch_next_page(private_data, selected_line);
+    const struct listing* item = &private_data->listings->items[selected_line];
+    if (private_data->subreddit_count > 1 && item->subreddit)
+        return g_strdup_printf("r/%s · %s", item->subreddit, item->title);
+    return g_strdup_printf("%s", item->title);
 }
 
-static int rofi_reddit_token_match(const Mode* sw, rofi_int_matcher** tokens, unsigned int index) {
+// Rows never wait for their thumbnail: one that isn't cached yet is requested and the row drawn without it. Loading
+// a cached one is left to rofi's icon fetcher, which does it off the main thread as well and reloads once it's done.
+static cairo_surface_t* get_icon(const Mode* mode, unsigned int selected_line, unsigned int height) {
+    RofiRedditModePrivateData* private_data = (RofiRedditModePrivateData*)mode_get_private_data(mode);
+    if (!private_data->thumbnail_fetcher || private_data->completing || private_data->searching ||
+        private_data->showing_comments || !private_data->listings ||
+        selected_line >= private_data->listings->count)
+        return NULL;
+    const char* url = private_data->listings->items[selected_line].thumbnail_url;
+    if (!url)
+        return NULL;
+    char* path = thumbnail_cache_lookup(private_data->thumbnails, url);
+    if (!path) {
+        thumbnail_fetcher_request(private_data->thumbnail_fetcher, url);
+        return NULL;
+    }
+    uint32_t uid = rofi_icon_fetcher_query(path, (int)height);
+    g_free(path);
+    return rofi_icon_fetcher_get(uid);
+}
+
+// Whether rofi matches tokens the way the packed filter does: plain text ignoring case, as with its default
+// -matching normal. Other methods, and -case-sensitive, compile to patterns with unescaped metacharacters or without
+// G_REGEX_CASELESS.
+static bool is_plain_matching(rofi_int_matcher* const* tokens) {
+    for (size_t i = 0; tokens && tokens[i]; i++) {
+        if (!(g_regex_get_compile_flags(tokens[i]->regex) & G_REGEX_CASELESS))
+            return false;
+        for (const char* c = g_regex_get_pattern(tokens[i]->regex); *c; c++) {
+            if (*c == '\\' && c[1] != '\0') {
+                c++;
+            } else if (strchr(".^$*+?()[]{}|", *c)) {
+                return false;
+            }
+        }
+    }
     return true;
 }
 
-static char* get_message(const Mode* mode) {
+// rofi's own matching of a thread, used for the methods the packed filter doesn't do. Like the filter, each token is
+// matched against the title and the selftext separately.
+static bool thread_matches_tokens(const struct listing* item, bool include_selftext, rofi_int_matcher* const* tokens) {
+    char* selftext = include_selftext ? listing_selftext(item) : NULL;
+    bool matched = true;
+    for (size_t i = 0; matched && tokens[i]; i++) {
+        bool found = (item->title && g_regex_match(tokens[i]->regex, item->title, 0, NULL)) ||
+                     (selftext && g_regex_match(tokens[i]->regex, selftext, 0, NULL));
+        matched = found != (bool)tokens[i]->invert;
+    }
+    g_free(selftext);
+    return matched;
+}
+
+static int rofi_reddit_token_match(const Mode* sw, rofi_int_matcher** tokens, unsigned int index) {
+    const RofiRedditModePrivateData* private_data = (const RofiRedditModePrivateData*)mode_get_private_data(sw);
+    // the candidates were narrowed down once per keystroke in rofi_reddit_preprocess_input
+    if (private_data->completing)
+        return is_completion_candidate(private_data, index);
+    // typing narrows them down while there is no index to complete from
+    if (is_showing_history(private_data)) {
+        const char* name = subreddit_history_name(private_data->history, index);
+        return name && helper_token_match(tokens, name);
+    }
+    // every search result matches, the index already ranked and capped them
+    if (private_data->searching)
+        return true;
+    if (private_data->showing_comments) {
+        const struct comment_thread* comments = private_data->comments;
+        if (!comments || index >= comments->count)
+            return false;
+        // rows of hidden comments have no text to match, they only get in the way of the comments that do
+        return comments->items[index].is_more ? !private_data->filter_query
+                                              : helper_token_match(tokens, comments->items[index].body);
+    }
+    if (!private_data->filter || !private_data->filter_query || !tokens)
+        return true;
+    if (is_plain_matching(tokens))
+        return listings_filter_match(private_data->filter, index, private_data->filter_query);
+    if (!private_data->listings || index >= private_data->listings->count)
+        return false;
+    return thread_matches_tokens(&private_data->listings->items[index],
+                                 private_data->app->config->filter.match_selftext, tokens);
+}
+
+static void on_search_done(struct fetch_result* result, void* user_data) {
+    RofiRedditModePrivateData* private_data = (RofiRedditModePrivateData*)user_data;
+    // dropped by the worker, or the input changed while it was looked up
+    if (result->access != SUBREDDIT_ACCESS_OK || !private_data->search_query ||
+        strcmp(result->subreddit, private_data->search_query) != 0) {
+        free_fetch_result(result);
+        return;
+    }
+    free_listings(private_data->search_results);
+    private_data->search_results = result->listings;
+    result->listings = NULL;
+    free_fetch_result(result);
+    // the input is unchanged, so the reload doesn't search again
+    rofi_view_reload();
+}
+
+// Looks query up unless it already was, since the reload that follows a change runs preprocessing again with the same
+// input.
+static void search_threads(RofiRedditModePrivateData* private_data, const char* query) {
+    if (private_data->search_query && strcmp(private_data->search_query, query) == 0)
+        return;
+    g_free(private_data->search_query);
+    private_data->search_query = g_strdup(query);
+    // a trailing space tells the index that the last word is complete, so the query is passed on as typed
+    fetch_worker_submit_search(private_data->fetch_worker, query, on_search_done, private_data);
+}
+
+// Runs once per keystroke before rows are matched. Rows turn into the threads of the search index matching the input
+// while it starts with "/", into the subreddits of the history while there are no threads to show and nothing is typed,
+// and into subreddit candidates while there are no threads to show or the input starts with "r/", whose candidates for
+// the subreddit being typed are looked up in the index. Otherwise the input becomes the query threads are filtered by.
+static char* rofi_reddit_preprocess_input(Mode* mode, const char* input) {
     RofiRedditModePrivateData* private_data = (RofiRedditModePrivateData*)mode_get_private_data(mode);
+    bool was_showing_history = is_showing_history(private_data);
+    bool searching = private_data->app && private_data->app->search && g_str_has_prefix(input, SEARCH_PREFIX);
+    if (searching) {
+        search_threads(private_data, input + strlen(SEARCH_PREFIX));
+    } else {
+        // typing the same words again looks them up again, other threads may have been fetched meanwhile
+        g_free(private_data->search_query);
+        private_data->search_query = NULL;
+    }
+    bool nothing_shown = !private_data->listings && !private_data->loading;
+    // the history takes the place of every candidate while nothing is typed
+    bool history_shown = nothing_shown && input[0] == '\0' && subreddit_history_count(private_data->history) > 0;
+    bool completing = !searching && !history_shown && (g_str_has_prefix(input, SUBREDDIT_PREFIX) || nothing_shown);
+    completing = completing && subreddit_index_count(private_data->subreddit_index) > 0;
+    if (completing) {
+        const char* last_comma = strrchr(input, ',');
+        const char* typed = last_comma ? last_comma + 1 : strip_subreddit_prefix(input);
+        g_free(private_data->completion_head);
+        private_data->completion_head = g_strndup(input, typed - input);
+        g_free(private_data->completion_prefix);
+        private_data->completion_prefix = g_strstrip(g_strdup(typed));
+        subreddit_index_find_prefix(private_data->subreddit_index, private_data->completion_prefix,
+                                    &private_data->completion_first, &private_data->completion_last);
+    }
+    // parsed here rather than per row, token_match runs once for every thread
+    free_filter_query(private_data->filter_query);
+    private_data->filter_query = !completing && !searching && input[0] != '\0' && private_data->app
+                                     ? new_filter_query(input, private_data->app->config->filter.fuzzy)
+                                     : NULL;
+    bool changed = completing != private_data->completing || searching != private_data->searching;
+    private_data->completing = completing;
+    private_data->searching = searching;
+    if (changed || was_showing_history != is_showing_history(private_data)) {
+        // the number of rows changes, which rofi only picks up on a reload
+        rofi_view_reload();
+    }
+    return g_strdup(input);
+}
+
+static char* rofi_reddit_get_completion(const Mode* mode, unsigned int selected_line) {
+    const RofiRedditModePrivateData* private_data = (const RofiRedditModePrivateData*)mode_get_private_data(mode);
+    if (is_completion_candidate(private_data, selected_line))
+        return complete_subreddit(private_data, selected_line);
+    if (is_showing_history(private_data) && subreddit_history_name(private_data->history, selected_line))
+        return g_strdup_printf("%s%s", SUBREDDIT_PREFIX, subreddit_history_name(private_data->history, selected_line));
+    const struct listings* listings = shown_listings(private_data);
+    if (!private_data->completing && (private_data->searching || !private_data->showing_comments) && listings &&
+        selected_line < listings->count && listings->items[selected_line].subreddit)
+        return g_strdup_printf("%s%s", SUBREDDIT_PREFIX, listings->items[selected_line].subreddit);
+    return NULL;
+}
+
+// e.g. "Offline, cached 12 minutes ago. " or "Rate limited, cached just now. ", empty while the shown threads are
+// current.
+static char* offline_banner(const RofiRedditModePrivateData* private_data) {
+    if (!private_data->offline_cached_at)
+        return g_strdup("");
+    const char* reason = private_data->rate_limited ? "Rate limited" : "Offline";
+    int64_t minutes = (int64_t)(time(NULL) - private_data->offline_cached_at) / 60;
+    if (minutes < 1)
+        return g_strdup_printf("%s, cached just now. ", reason);
+    return g_strdup_printf("%s, cached %" PRId64 " minute%s ago. ", reason, minutes, minutes == 1 ? "" : "s");
+}
+
+static char* access_message(const RofiRedditModePrivateData* private_data) {
+    if (private_data->startup_error)
+        return g_strdup(private_data->startup_error);
+    if (private_data->loading && private_data->selected_sort)
+        return g_strdup_printf("Loading r/%s/%s…", private_data->selected_subreddit, private_data->selected_sort);
+    if (private_data->loading) {
+        return g_strdup_printf("Loading r/%s…", private_data->selected_subreddit);
+    }
     char* message = NULL;
     switch (private_data->subreddit_access) {
     case SUBREDDIT_ACCESS_UNINITIALIZED:
-        message = "Type a subreddit to fetch threads for!";
+        message = is_showing_history(private_data)
+                      ? "Pick a subreddit you visited before, or type one to fetch threads for!"
+                      : "Type a subreddit to fetch threads for!";
         break;
     case SUBREDDIT_ACCESS_OK:
         if (private_data->listings && private_data->listings->count > 0) {
-            message = g_strdup_printf("Found %zu threads for subreddit '%s'. Now select a thread "
-                                      "to open in your browser!",
-                                      private_data->listings->count, private_data->selected_subreddit);
+            char* banner = offline_banner(private_data);
+            char* found = g_strdup_printf("%sFound %zu threads for subreddit '%s' (%s). Now select a thread to open in "
+                                          "your browser, Shift+Enter for its comments, or Alt+2 for another "
+                                          "sort!%s%s%s",
+                                          banner, private_data->listings->count, private_data->selected_subreddit,
+                                          private_data->selected_sort,
+                                          private_data->unavailable_subreddits ? private_data->unavailable_subreddits
+                                                                               : "",
+                                          private_data->revalidating ? " Refreshing…" : "",
+                                          private_data->fetching_page ? " Loading more…" : "");
+            g_free(banner);
+            return found;
         } else {
             message = "No threads available on this subreddit. Type another subreddit to fetch "
                       "threads for!";
@@ -210,6 +1107,15 @@ static char* get_message(const Mode* mode) {
     case SUBREDDIT_ACCESS_UNKNOWN:
         message = "Unknown access status for subreddit. Can't fetch threads.";
         break;
+    case SUBREDDIT_ACCESS_EXPIRED_TOKEN:
+        message = "Could not obtain a fresh Reddit access token. Check your app credentials.";
+        break;
+    case SUBREDDIT_ACCESS_UNREACHABLE:
+        message = "Reddit can't be reached and this subreddit isn't cached. Check your connection.";
+        break;
+    case SUBREDDIT_ACCESS_RATE_LIMITED:
+        message = "Reddit's request limit is used up and this subreddit isn't cached. Try again in a few minutes.";
+        break;
     default:
         message = "An unknown error occurred. Please try again.";
         break;
@@ -217,6 +1123,73 @@ static char* get_message(const Mode* mode) {
     return g_strdup(message);
 }
 
+static char* comments_message(const RofiRedditModePrivateData* private_data) {
+    const char* title = private_data->comments_title;
+    const struct comment_thread* comments = private_data->comments;
+    if (!comments) {
+        switch (private_data->comments_access) {
+        case SUBREDDIT_ACCESS_UNINITIALIZED:
+            return g_markup_printf_escaped("Loading comments of '%s'…", title);
+        case SUBREDDIT_ACCESS_UNREACHABLE:
+            return g_strdup("Reddit can't be reached, comments aren't cached. Shift+Enter goes back to the threads.");
+        case SUBREDDIT_ACCESS_RATE_LIMITED:
+            return g_strdup("Reddit's request limit is used up, try again in a few minutes. Shift+Enter goes back to "
+                            "the threads.");
+        default:
+            return g_markup_printf_escaped(
+                "Comments of '%s' couldn't be fetched. Shift+Enter goes back to the threads.", title);
+        }
+    }
+    size_t loaded = 0;
+    for (size_t i = 0; i < comments->count; i++) {
+        loaded += comments->items[i].is_more ? 0 : 1;
+    }
+    if (comments->count == 0)
+        return g_markup_printf_escaped("No comments on '%s' yet. Shift+Enter goes back to the threads.", title);
+    return g_markup_printf_escaped("%zu comments of '%s'. Select a row of hidden replies to load them, Shift+Enter "
+                                   "goes back to the threads.%s",
+                                   loaded, title, private_data->loading_more_comments ? " Loading more…" : "");
+}
+
+static char* search_message(const RofiRedditModePrivateData* private_data) {
+    size_t count = private_data->search_results ? private_data->search_results->count : 0;
+    char* words = g_strstrip(g_strdup(private_data->search_query ? private_data->search_query : ""));
+    char* message = NULL;
+    if (words[0] == '\0') {
+        message = g_strdup("Type words to search every thread fetched so far.");
+    } else if (count == 0) {
+        message = g_markup_printf_escaped("No fetched thread matches '%s'.", words);
+    } else {
+        message = g_markup_printf_escaped("%zu threads match '%s'. Select one to open in your browser, or Shift+Enter "
+                                          "for its comments!",
+                                          count, words);
+    }
+    g_free(words);
+    return message;
+}
+
+static char* get_message(const Mode* mode) {
+    RofiRedditModePrivateData* private_data = (RofiRedditModePrivateData*)mode_get_private_data(mode);
+    if (private_data->preview)
+        return g_strdup(private_data->preview);
+    char* message = NULL;
+    if (private_data->searching)
+        message = search_message(private_data);
+    else if (private_data->showing_comments && !private_data->completing)
+        message = comments_message(private_data);
+    else
+        message = access_message(private_data);
+    char* summary = private_data->app && private_data->app->config->timing.show_summary
+                        ? timing_log_summary(private_data->app->timings)
+                        : NULL;
+    if (!summary)
+        return message;
+    char* message_with_summary = g_strdup_printf("%s\n%s", message, summary);
+    g_free(message);
+    g_free(summary);
+    return message_with_summary;
+}
+
 Mode mode = {
     .abi_version = ABI_VERSION,
     .name = "reddit",
@@ -227,9 +1200,10 @@ Mode mode = {
     ._destroy = rofi_reddit_mode_destroy,
     ._token_match = rofi_reddit_token_match,
     ._get_display_value = get_display_value,
+    ._get_icon = get_icon,
     ._get_message = get_message,
-    ._get_completion = NULL,
-    ._preprocess_input = NULL,
+    ._get_completion = rofi_reddit_get_completion,
+    ._preprocess_input = rofi_reddit_preprocess_input,
     .private_data = NULL,
     .free = NULL,
 };
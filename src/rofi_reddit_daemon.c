@@ -0,0 +1,74 @@
+#include "fetch_daemon.h"
+#include "fetch_worker.h"
+#include "reddit.h"
+#include <glib-unix.h>
+#include <glib.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+// rofi-reddit-daemon: started by the plugin when daemon.enabled is set, exits after daemon.idle_timeout_minutes
+// without a request, or on SIGTERM.
+
+struct daemon_state {
+    GMainLoop* loop;
+    struct fetch_worker* worker;
+    struct fetch_daemon* daemon;
+};
+
+// The daemon fetches everything itself, it must never hand queries back to a daemon.
+static struct rofi_reddit_cfg* load_daemon_cfg(void) {
+    struct rofi_reddit_cfg* cfg = load_rofi_reddit_cfg();
+    if (cfg)
+        cfg->daemon.enabled = false;
+    return cfg;
+}
+
+static void on_idle(void* user_data) {
+    struct daemon_state* state = (struct daemon_state*)user_data;
+    fprintf(stdout, "No requests for a while, exiting.\n");
+    g_main_loop_quit(state->loop);
+}
+
+static gboolean on_signal(gpointer user_data) {
+    struct daemon_state* state = (struct daemon_state*)user_data;
+    g_main_loop_quit(state->loop);
+    return G_SOURCE_REMOVE;
+}
+
+static void on_app_ready(RedditApp* app, const char* error, void* user_data) {
+    struct daemon_state* state = (struct daemon_state*)user_data;
+    if (!app) {
+        fprintf(stderr, "%s\n", error);
+        g_main_loop_quit(state->loop);
+        return;
+    }
+    const struct rofi_reddit_cfg* config = app->config;
+    state->daemon = new_fetch_daemon(config->paths->daemon_socket_path, state->worker,
+                                     config->daemon.idle_timeout_minutes * 60, on_idle, state);
+    if (!state->daemon) {
+        g_main_loop_quit(state->loop);
+        return;
+    }
+    fprintf(stdout, "Listening at %s.\n", config->paths->daemon_socket_path);
+}
+
+int main(void) {
+    // outlives the rofi session that started it, and its terminal if there was one
+    setsid();
+    struct daemon_state state = {.loop = g_main_loop_new(NULL, FALSE), .worker = NULL, .daemon = NULL};
+    g_unix_signal_add(SIGTERM, on_signal, &state);
+    g_unix_signal_add(SIGINT, on_signal, &state);
+    state.worker = new_fetch_worker(load_daemon_cfg, on_app_ready, &state);
+    if (!state.worker) {
+        g_main_loop_unref(state.loop);
+        return EXIT_FAILURE;
+    }
+    g_main_loop_run(state.loop);
+    // the worker first, so that no fetch in flight is delivered to a client of the freed daemon
+    free_fetch_worker(state.worker);
+    free_fetch_daemon(state.daemon);
+    g_main_loop_unref(state.loop);
+    return EXIT_SUCCESS;
+}
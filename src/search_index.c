@@ -0,0 +1,986 @@
+#include "search_index.h"
+#include "memory.h"
+#include "reddit.h"
+#include <fcntl.h>
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <inttypes.h>
+#include <jansson.h>
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// File layout: header, doc records, term records sorted by their text, posting records grouped by term, then the heap
+// of NUL terminated strings the records point into.
+static const char SEARCH_INDEX_MAGIC[4] = {'R', 'R', 'S', 'X'};
+// an index from a machine of the other byte order reads as another version
+static const uint32_t SEARCH_INDEX_VERSION = 1;
+static const uint32_t NO_STRING = UINT32_MAX;
+// position of a doc that a merge drops, as a later version of it is in the log
+static const uint32_t NO_DOC = UINT32_MAX;
+// a word of the title counts as much as this many of the selftext
+static const uint32_t TITLE_WEIGHT = 3;
+// longer words, e.g. links, are cut to this many bytes
+static const size_t MAX_TERM_SIZE = 32;
+// words of a long self post past these aren't indexed
+static const size_t MAX_SELFTEXT_TERMS = 1000;
+// every query scans the threads of the log, they are merged into the index file once there are this many
+static const size_t COMPACT_AFTER_THREADS = 2000;
+// a word being typed matches at most this many words it is the start of, and only once it is this long
+static const size_t MAX_PREFIX_TERMS = 128;
+static const size_t MIN_PREFIX_SIZE = 2;
+// words of a query past these are ignored
+static const size_t MAX_QUERY_TERMS = 8;
+// Okapi BM25 with its usual parameters
+static const float BM25_K1 = 1.2f;
+static const float BM25_B = 0.75f;
+
+struct search_index_header {
+    char magic[4];
+    uint32_t version;
+    uint32_t doc_count;
+    uint32_t term_count;
+    uint32_t posting_count;
+    uint32_t heap_size;
+    // of every doc, for their average
+    uint64_t total_length;
+};
+
+struct search_index_doc {
+    uint32_t id;
+    uint32_t subreddit;
+    uint32_t title;
+    uint32_t url;
+    uint32_t ups;
+    // words of the title and selftext, those of the title weighted
+    uint32_t length;
+};
+
+struct search_index_term {
+    uint32_t text;
+    uint32_t first_posting;
+    uint32_t posting_count;
+};
+
+struct search_index_posting {
+    uint32_t doc;
+    // weighted occurrences of the term in the doc
+    uint32_t frequency;
+};
+
+// The index file, mapped. Its records are only bounds checked once they are used, which keeps mapping it O(1).
+struct index_segment {
+    GMappedFile* file;
+    struct search_index_header header;
+    const struct search_index_doc* docs;
+    const struct search_index_term* terms;
+    const struct search_index_posting* postings;
+    const char* heap;
+};
+
+struct log_doc {
+    const char* id;
+    const char* subreddit;
+    const char* title;
+    const char* url;
+    // kept to index it again when the log is merged
+    const char* selftext;
+    uint32_t ups;
+    uint32_t length;
+    // a later line of the log has the same id
+    bool superseded;
+};
+
+// Threads of the log, indexed in memory.
+struct log_segment {
+    // owns every string of docs and the keys of terms and ids
+    struct arena* arena;
+    GArray* docs;
+    // word to a GArray of struct search_index_posting, whose doc is a position in docs
+    GHashTable* terms;
+    // id to the position in docs of its latest version
+    GHashTable* ids;
+    size_t live_count;
+    uint64_t total_length;
+};
+
+struct log_file {
+    bool exists;
+    dev_t device;
+    ino_t inode;
+    // read up to here, the end of the last complete line
+    off_t offset;
+};
+
+struct search_index {
+    char* index_path;
+    char* log_path;
+    // the log while it is being merged
+    char* merging_path;
+    // held while appending to the log or moving it to merging_path
+    char* append_lock_path;
+    // held by the process merging
+    char* merge_lock_path;
+    GMutex lock;
+    struct index_segment base;
+    bool base_exists;
+    struct stat base_stat;
+    // the threads of merging_path, then those of log_path
+    struct log_segment* log;
+    struct log_file merging_file;
+    struct log_file log_file;
+    GThread* compactor;
+    bool compacting;
+};
+
+typedef void (*term_handler)(const char* term, uint32_t weight, void* data);
+
+// Splits text into words, runs of letters and digits, case folded and composed, and hands at most max_terms of them to
+// add.
+static void tokenize(const char* text, size_t max_terms, uint32_t weight, term_handler add, void* data) {
+    if (!text)
+        return;
+    char* valid = g_utf8_make_valid(text, -1);
+    char* folded = g_utf8_casefold(valid, -1);
+    char* normalized = g_utf8_normalize(folded, -1, G_NORMALIZE_DEFAULT_COMPOSE);
+    GString* term = g_string_sized_new(MAX_TERM_SIZE);
+    size_t count = 0;
+    for (const char* p = normalized; p && count < max_terms; p = g_utf8_next_char(p)) {
+        gunichar c = g_utf8_get_char(p);
+        if (c != 0 && g_unichar_isalnum(c)) {
+            size_t size = (size_t)(g_utf8_next_char(p) - p);
+            if (term->len + size <= MAX_TERM_SIZE)
+                g_string_append_len(term, p, (gssize)size);
+            continue;
+        }
+        if (term->len > 0) {
+            add(term->str, weight, data);
+            count++;
+            g_string_truncate(term, 0);
+        }
+        if (c == 0)
+            break;
+    }
+    g_string_free(term, TRUE);
+    g_free(normalized);
+    g_free(folded);
+    g_free(valid);
+}
+
+struct doc_terms {
+    // word to its weighted occurrences
+    GHashTable* frequencies;
+    uint32_t length;
+};
+
+static void count_term(const char* term, uint32_t weight, void* data) {
+    struct doc_terms* terms = (struct doc_terms*)data;
+    uint32_t frequency = GPOINTER_TO_UINT(g_hash_table_lookup(terms->frequencies, term));
+    g_hash_table_insert(terms->frequencies, g_strdup(term), GUINT_TO_POINTER(frequency + weight));
+    terms->length += weight;
+}
+
+static char* arena_strdup_or_null(struct arena* arena, const char* value) {
+    return value ? arena_strdup(arena, value) : NULL;
+}
+
+static void free_postings(gpointer postings) {
+    g_array_free((GArray*)postings, TRUE);
+}
+
+static struct log_segment* new_log_segment(void) {
+    struct log_segment* log = LOG_ERR_MALLOC(struct log_segment, 1);
+    log->arena = new_arena();
+    log->docs = g_array_new(FALSE, FALSE, sizeof(struct log_doc));
+    log->terms = g_hash_table_new_full(g_str_hash, g_str_equal, NULL, free_postings);
+    log->ids = g_hash_table_new(g_str_hash, g_str_equal);
+    log->live_count = 0;
+    log->total_length = 0;
+    return log;
+}
+
+static void free_log_segment(struct log_segment* log) {
+    if (!log)
+        return;
+    g_hash_table_destroy(log->ids);
+    g_hash_table_destroy(log->terms);
+    g_array_free(log->docs, TRUE);
+    free_arena(log->arena);
+    free(log);
+}
+
+static void log_segment_add(struct log_segment* log, const char* id, const char* subreddit, const char* title,
+                            const char* selftext, const char* url, uint32_t ups) {
+    struct doc_terms terms = {.frequencies = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL),
+                              .length = 0};
+    tokenize(title, SIZE_MAX, TITLE_WEIGHT, count_term, &terms);
+    tokenize(selftext, MAX_SELFTEXT_TERMS, 1, count_term, &terms);
+    uint32_t position = log->docs->len;
+    struct log_doc doc = {.id = arena_strdup(log->arena, id),
+                          .subreddit = arena_strdup_or_null(log->arena, subreddit),
+                          .title = arena_strdup(log->arena, title),
+                          .url = arena_strdup_or_null(log->arena, url),
+                          .selftext = arena_strdup_or_null(log->arena, selftext),
+                          .ups = ups,
+                          .length = terms.length,
+                          .superseded = false};
+    gpointer previous = NULL;
+    if (g_hash_table_lookup_extended(log->ids, id, NULL, &previous)) {
+        struct log_doc* replaced = &g_array_index(log->docs, struct log_doc, GPOINTER_TO_UINT(previous));
+        replaced->superseded = true;
+        log->live_count--;
+        log->total_length -= replaced->length;
+    }
+    g_array_append_val(log->docs, doc);
+    g_hash_table_insert(log->ids, (gpointer)doc.id, GUINT_TO_POINTER(position));
+    log->live_count++;
+    log->total_length += doc.length;
+
+    GHashTableIter iter;
+    gpointer term = NULL;
+    gpointer frequency = NULL;
+    g_hash_table_iter_init(&iter, terms.frequencies);
+    while (g_hash_table_iter_next(&iter, &term, &frequency)) {
+        GArray* postings = g_hash_table_lookup(log->terms, term);
+        if (!postings) {
+            postings = g_array_new(FALSE, FALSE, sizeof(struct search_index_posting));
+            g_hash_table_insert(log->terms, arena_strdup(log->arena, term), postings);
+        }
+        struct search_index_posting posting = {.doc = position, .frequency = GPOINTER_TO_UINT(frequency)};
+        g_array_append_val(postings, posting);
+    }
+    g_hash_table_destroy(terms.frequencies);
+}
+
+// Lines that aren't a thread, e.g. one cut short by a full disk, are skipped.
+static void add_log_line(struct log_segment* log, const char* line, size_t size) {
+    json_t* json = json_loadb(line, size, 0, NULL);
+    const char* id = json_string_value(json_object_get(json, "id"));
+    const char* title = json_string_value(json_object_get(json, "title"));
+    if (id && title)
+        log_segment_add(log, id, json_string_value(json_object_get(json, "subreddit")), title,
+                        json_string_value(json_object_get(json, "selftext")),
+                        json_string_value(json_object_get(json, "url")),
+                        (uint32_t)json_integer_value(json_object_get(json, "ups")));
+    json_decref(json);
+}
+
+// Adds every complete line of data, returns how many bytes they take up.
+static size_t add_log_lines(struct log_segment* log, const char* data, size_t size) {
+    size_t consumed = 0;
+    const char* end = NULL;
+    while (consumed < size && (end = memchr(data + consumed, '\n', size - consumed)) != NULL) {
+        add_log_line(log, data + consumed, (size_t)(end - data) - consumed);
+        consumed = (size_t)(end - data) + 1;
+    }
+    return consumed;
+}
+
+// Adds the lines appended to the log at path since file->offset. Returns false if the file was replaced, removed or
+// truncated since, which takes reading everything again.
+static bool read_log(struct log_segment* log, const char* path, struct log_file* file) {
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return !file->exists;
+    struct stat log_stat;
+    if (fstat(fd, &log_stat) != 0) {
+        close(fd);
+        return false;
+    }
+    if (file->exists &&
+        (log_stat.st_dev != file->device || log_stat.st_ino != file->inode || log_stat.st_size < file->offset)) {
+        close(fd);
+        return false;
+    }
+    if (!file->exists)
+        *file = (struct log_file){.exists = true, .device = log_stat.st_dev, .inode = log_stat.st_ino, .offset = 0};
+    size_t size = (size_t)(log_stat.st_size - file->offset);
+    char* data = size > 0 ? g_malloc(size) : NULL;
+    size_t read = 0;
+    while (read < size) {
+        ssize_t got = pread(fd, data + read, size - read, file->offset + (off_t)read);
+        if (got <= 0)
+            break;
+        read += (size_t)got;
+    }
+    close(fd);
+    file->offset += (off_t)add_log_lines(log, data, read);
+    g_free(data);
+    return true;
+}
+
+static void unmap_segment(struct index_segment* segment) {
+    if (segment->file)
+        g_mapped_file_unref(segment->file);
+    memset(segment, 0, sizeof(*segment));
+}
+
+// Maps the index file at path, leaving the segment empty if it is missing or damaged. Returns whether it exists,
+// filling in file_stat if it does.
+static bool map_segment(struct index_segment* segment, const char* path, struct stat* file_stat) {
+    memset(segment, 0, sizeof(*segment));
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return false;
+    bool exists = fstat(fd, file_stat) == 0;
+    // the mapping outlives the descriptor
+    GMappedFile* file = exists && file_stat->st_size > 0 ? g_mapped_file_new_from_fd(fd, FALSE, NULL) : NULL;
+    close(fd);
+    if (!file)
+        return exists;
+    const char* contents = g_mapped_file_get_contents(file);
+    size_t size = g_mapped_file_get_length(file);
+    struct search_index_header header;
+    bool valid = size >= sizeof(header);
+    if (valid) {
+        memcpy(&header, contents, sizeof(header));
+        // the counts are 32 bits wide, none of this can overflow
+        uint64_t records_size = (uint64_t)header.doc_count * sizeof(struct search_index_doc) +
+                                (uint64_t)header.term_count * sizeof(struct search_index_term) +
+                                (uint64_t)header.posting_count * sizeof(struct search_index_posting);
+        valid = memcmp(header.magic, SEARCH_INDEX_MAGIC, sizeof(header.magic)) == 0 &&
+                header.version == SEARCH_INDEX_VERSION &&
+                (uint64_t)size == sizeof(header) + records_size + header.heap_size &&
+                (header.heap_size == 0 || contents[size - 1] == '\0');
+    }
+    if (!valid) {
+        fprintf(stderr, "Ignoring damaged search index at %s.\n", path);
+        g_mapped_file_unref(file);
+        return exists;
+    }
+    // mappings start on a page and every record is a multiple of 4 bytes, so the tables are aligned
+    segment->file = file;
+    segment->header = header;
+    segment->docs = (const struct search_index_doc*)(contents + sizeof(header));
+    segment->terms = (const struct search_index_term*)(segment->docs + header.doc_count);
+    segment->postings = (const struct search_index_posting*)(segment->terms + header.term_count);
+    segment->heap = (const char*)(segment->postings + header.posting_count);
+    return exists;
+}
+
+// NULL for NO_STRING, and for offsets a damaged file has out of bounds.
+static const char* segment_string(const struct index_segment* segment, uint32_t offset) {
+    return offset < segment->header.heap_size ? segment->heap + offset : NULL;
+}
+
+static const char* term_text(const struct index_segment* segment, size_t term) {
+    const char* text = segment_string(segment, segment->terms[term].text);
+    return text ? text : "";
+}
+
+static const struct search_index_posting* term_postings(const struct index_segment* segment, size_t term,
+                                                        size_t* count) {
+    const struct search_index_term* record = &segment->terms[term];
+    if ((uint64_t)record->first_posting + record->posting_count > segment->header.posting_count) {
+        *count = 0;
+        return NULL;
+    }
+    *count = record->posting_count;
+    return segment->postings + record->first_posting;
+}
+
+// Position of the first term that isn't sorted before text.
+static size_t find_term(const struct index_segment* segment, const char* text) {
+    size_t first = 0;
+    size_t last = segment->header.term_count;
+    while (first < last) {
+        size_t middle = first + (last - first) / 2;
+        if (strcmp(term_text(segment, middle), text) < 0)
+            first = middle + 1;
+        else
+            last = middle;
+    }
+    return first;
+}
+
+static size_t base_frequency(const struct index_segment* base, const char* text) {
+    size_t position = find_term(base, text);
+    size_t count = 0;
+    if (position < base->header.term_count && strcmp(term_text(base, position), text) == 0)
+        term_postings(base, position, &count);
+    return count;
+}
+
+static size_t log_frequency(const struct log_segment* log, const char* text) {
+    const GArray* postings = g_hash_table_lookup(log->terms, text);
+    return postings ? postings->len : 0;
+}
+
+static void reload(struct search_index* index) {
+    unmap_segment(&index->base);
+    index->base_exists = map_segment(&index->base, index->index_path, &index->base_stat);
+    free_log_segment(index->log);
+    index->log = new_log_segment();
+    index->merging_file = (struct log_file){.exists = false};
+    index->log_file = (struct log_file){.exists = false};
+    read_log(index->log, index->merging_path, &index->merging_file);
+    read_log(index->log, index->log_path, &index->log_file);
+}
+
+// Picks up what was appended to the log since, or everything again once a merge replaced the files.
+static void refresh(struct search_index* index) {
+    struct stat base_stat;
+    bool base_exists = stat(index->index_path, &base_stat) == 0;
+    bool base_replaced = base_exists != index->base_exists ||
+                         (base_exists && (base_stat.st_dev != index->base_stat.st_dev ||
+                                          base_stat.st_ino != index->base_stat.st_ino ||
+                                          base_stat.st_size != index->base_stat.st_size ||
+                                          base_stat.st_mtime != index->base_stat.st_mtime));
+    if (base_replaced || !read_log(index->log, index->merging_path, &index->merging_file) ||
+        !read_log(index->log, index->log_path, &index->log_file))
+        reload(index);
+}
+
+struct search_index* new_search_index(const char* dir) {
+    if (g_mkdir_with_parents(dir, 0700) != 0) {
+        fprintf(stderr, "Failed to create search index directory %s.\n", dir);
+        return NULL;
+    }
+    struct search_index* index = LOG_ERR_MALLOC(struct search_index, 1);
+    memset(index, 0, sizeof(*index));
+    g_mutex_init(&index->lock);
+    index->index_path = g_build_filename(dir, "threads.idx", NULL);
+    index->log_path = g_build_filename(dir, "threads.jsonl", NULL);
+    index->merging_path = g_build_filename(dir, "threads.jsonl.merging", NULL);
+    index->append_lock_path = g_build_filename(dir, "append.lock", NULL);
+    index->merge_lock_path = g_build_filename(dir, "merge.lock", NULL);
+    // nothing is read before the index is first used
+    index->log = new_log_segment();
+    index->base_exists = false;
+    index->compactor = NULL;
+    index->compacting = false;
+    return index;
+}
+
+// Opens and locks path. -1 if it can't be, or with LOCK_NB, if another process holds the lock.
+static int lock_file(const char* path, int operation) {
+    int fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+    if (fd < 0)
+        return -1;
+    if (flock(fd, operation) != 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+static void unlock_file(int fd) {
+    if (fd < 0)
+        return;
+    flock(fd, LOCK_UN);
+    close(fd);
+}
+
+static bool append_to_log(const struct search_index* index, const GString* lines) {
+    int lock = lock_file(index->append_lock_path, LOCK_EX);
+    int fd = lock >= 0 ? open(index->log_path, O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC, 0600) : -1;
+    size_t written = 0;
+    while (fd >= 0 && written < lines->len) {
+        ssize_t wrote = write(fd, lines->str + written, lines->len - written);
+        if (wrote <= 0)
+            break;
+        written += (size_t)wrote;
+    }
+    if (written < lines->len)
+        fprintf(stderr, "Failed to append to search index log at %s.\n", index->log_path);
+    if (fd >= 0)
+        close(fd);
+    unlock_file(lock);
+    return written == lines->len;
+}
+
+static gpointer compact_in_background(gpointer data) {
+    struct search_index* index = (struct search_index*)data;
+    search_index_compact(index);
+    g_mutex_lock(&index->lock);
+    index->compacting = false;
+    g_mutex_unlock(&index->lock);
+    return NULL;
+}
+
+bool search_index_add(struct search_index* index, const struct listing* items, size_t count) {
+    GString* lines = g_string_new(NULL);
+    for (size_t i = 0; i < count; i++) {
+        const struct listing* item = &items[i];
+        if (!item->id || !item->title)
+            continue;
+        json_t* line = json_object();
+        json_object_set_new(line, "id", json_string(item->id));
+        json_object_set_new(line, "subreddit", item->subreddit ? json_string(item->subreddit) : json_null());
+        json_object_set_new(line, "title", json_string(item->title));
+        char* selftext = listing_selftext(item);
+        json_object_set_new(line, "selftext", selftext ? json_string(selftext) : json_null());
+        g_free(selftext);
+        json_object_set_new(line, "url", item->url ? json_string(item->url) : json_null());
+        json_object_set_new(line, "ups", json_integer(item->ups));
+        char* serialized = json_dumps(line, JSON_COMPACT);
+        json_decref(line);
+        if (serialized)
+            g_string_append_printf(lines, "%s\n", serialized);
+        free(serialized);
+    }
+    bool written = lines->len == 0 || append_to_log(index, lines);
+    g_string_free(lines, TRUE);
+    if (!written)
+        return false;
+    // indexed in memory here rather than by the next query, which may run on the main thread
+    g_mutex_lock(&index->lock);
+    refresh(index);
+    if (index->log->docs->len >= COMPACT_AFTER_THREADS && !index->compacting) {
+        if (index->compactor)
+            g_thread_join(index->compactor);
+        index->compacting = true;
+        index->compactor = g_thread_new("search-index", compact_in_background, index);
+    }
+    g_mutex_unlock(&index->lock);
+    return true;
+}
+
+struct query {
+    const struct index_segment* base;
+    const struct log_segment* log;
+    // per doc, those of the index file first, then those of the log
+    float* scores;
+    // number of query terms the doc matched so far
+    uint8_t* matched;
+    float doc_count;
+    float average_length;
+};
+
+static float inverse_document_frequency(const struct query* query, size_t frequency) {
+    float docs = (float)frequency;
+    return logf(1.0f + (query->doc_count - docs + 0.5f) / (docs + 0.5f));
+}
+
+// Whether doc matched every query term before term, which it is then marked to match as well.
+static bool advance(struct query* query, size_t doc, uint8_t term) {
+    if (query->matched[doc] == term)
+        query->matched[doc] = term + 1;
+    return query->matched[doc] == term + 1;
+}
+
+static void add_score(struct query* query, size_t doc, uint32_t frequency, uint32_t length, float idf) {
+    float norm = BM25_K1 * (1.0f - BM25_B + BM25_B * (float)length / query->average_length);
+    query->scores[doc] += idf * (float)frequency * (BM25_K1 + 1.0f) / ((float)frequency + norm);
+}
+
+static void score_base_term(struct query* query, size_t position, uint8_t term) {
+    size_t count = 0;
+    const struct search_index_posting* postings = term_postings(query->base, position, &count);
+    float idf = inverse_document_frequency(query, count + log_frequency(query->log, term_text(query->base, position)));
+    for (size_t i = 0; i < count; i++) {
+        uint32_t doc = postings[i].doc;
+        if (doc < query->base->header.doc_count && advance(query, doc, term))
+            add_score(query, doc, postings[i].frequency, query->base->docs[doc].length, idf);
+    }
+}
+
+static void score_log_term(struct query* query, const char* text, const GArray* postings, uint8_t term) {
+    float idf = inverse_document_frequency(query, postings->len + base_frequency(query->base, text));
+    size_t first_doc = query->base->header.doc_count;
+    for (guint i = 0; i < postings->len; i++) {
+        const struct search_index_posting* posting = &g_array_index(postings, struct search_index_posting, i);
+        const struct log_doc* doc = &g_array_index(query->log->docs, struct log_doc, posting->doc);
+        if (!doc->superseded && advance(query, first_doc + posting->doc, term))
+            add_score(query, first_doc + posting->doc, posting->frequency, doc->length, idf);
+    }
+}
+
+// Scores the docs containing text, or with prefix set, any word starting with it.
+static void score_term(struct query* query, const char* text, bool prefix, uint8_t term) {
+    size_t expanded = 0;
+    for (size_t position = find_term(query->base, text);
+         position < query->base->header.term_count && expanded < MAX_PREFIX_TERMS; position++, expanded++) {
+        const char* candidate = term_text(query->base, position);
+        if (prefix ? !g_str_has_prefix(candidate, text) : strcmp(candidate, text) != 0)
+            break;
+        score_base_term(query, position, term);
+    }
+    if (!prefix) {
+        const GArray* postings = g_hash_table_lookup(query->log->terms, text);
+        if (postings)
+            score_log_term(query, text, postings, term);
+        return;
+    }
+    GHashTableIter iter;
+    gpointer candidate = NULL;
+    gpointer postings = NULL;
+    expanded = 0;
+    g_hash_table_iter_init(&iter, query->log->terms);
+    while (expanded < MAX_PREFIX_TERMS && g_hash_table_iter_next(&iter, &candidate, &postings)) {
+        if (!g_str_has_prefix(candidate, text))
+            continue;
+        score_log_term(query, candidate, postings, term);
+        expanded++;
+    }
+}
+
+struct hit {
+    size_t doc;
+    float score;
+    uint32_t ups;
+};
+
+// Lower score, or as high a score with fewer upvotes.
+static bool ranks_below(const struct hit* a, const struct hit* b) {
+    return a->score < b->score || (a->score == b->score && a->ups < b->ups);
+}
+
+static void swap_hits(struct hit* a, struct hit* b) {
+    struct hit swapped = *a;
+    *a = *b;
+    *b = swapped;
+}
+
+// Keeps the best max_results hits offered in a min-heap, so that picking them out of many matches stays cheap.
+static void offer_hit(struct hit* heap, size_t* count, size_t max_results, struct hit hit) {
+    size_t at = 0;
+    if (*count < max_results) {
+        at = (*count)++;
+        heap[at] = hit;
+        while (at > 0 && ranks_below(&heap[at], &heap[(at - 1) / 2])) {
+            swap_hits(&heap[at], &heap[(at - 1) / 2]);
+            at = (at - 1) / 2;
+        }
+        return;
+    }
+    if (*count == 0 || !ranks_below(&heap[0], &hit))
+        return;
+    heap[0] = hit;
+    for (;;) {
+        size_t lowest = at;
+        size_t left = 2 * at + 1;
+        size_t right = left + 1;
+        if (left < *count && ranks_below(&heap[left], &heap[lowest]))
+            lowest = left;
+        if (right < *count && ranks_below(&heap[right], &heap[lowest]))
+            lowest = right;
+        if (lowest == at)
+            return;
+        swap_hits(&heap[at], &heap[lowest]);
+        at = lowest;
+    }
+}
+
+static int compare_best_first(const void* a, const void* b) {
+    return ranks_below(a, b) - ranks_below(b, a);
+}
+
+static struct listing copy_hit(struct arena* arena, const struct query* query, size_t doc) {
+    const char* id = NULL;
+    const char* subreddit = NULL;
+    const char* title = NULL;
+    const char* url = NULL;
+    uint32_t ups = 0;
+    if (doc < query->base->header.doc_count) {
+        const struct search_index_doc* record = &query->base->docs[doc];
+        id = segment_string(query->base, record->id);
+        subreddit = segment_string(query->base, record->subreddit);
+        title = segment_string(query->base, record->title);
+        url = segment_string(query->base, record->url);
+        ups = record->ups;
+    } else {
+        const struct log_doc* log_doc =
+            &g_array_index(query->log->docs, struct log_doc, doc - query->base->header.doc_count);
+        id = log_doc->id;
+        subreddit = log_doc->subreddit;
+        title = log_doc->title;
+        url = log_doc->url;
+        ups = log_doc->ups;
+    }
+    return (struct listing){.id = arena_strdup_or_null(arena, id),
+                            .subreddit = arena_strdup_or_null(arena, subreddit),
+                            .title = arena_strdup(arena, title ? title : ""),
+                            .selftext = NULL,
+                            .escaped_selftext = NULL,
+                            .escaped_selftext_size = 0,
+                            .url = arena_strdup_or_null(arena, url),
+                            .thumbnail_url = NULL,
+                            .ups = ups};
+}
+
+// Whether the doc of the index file has a later version in the log, which is the one to show.
+static bool is_replaced(const struct query* query, size_t doc) {
+    if (doc >= query->base->header.doc_count)
+        return false;
+    const char* id = segment_string(query->base, query->base->docs[doc].id);
+    return id && g_hash_table_contains(query->log->ids, id);
+}
+
+static void collect_term(const char* term, uint32_t weight, void* data) {
+    g_ptr_array_add((GPtrArray*)data, g_strdup(term));
+}
+
+// Whether the query ends in the middle of a word, which is then matched as a prefix.
+static bool ends_in_word(const char* query) {
+    const char* last = g_utf8_find_prev_char(query, query + strlen(query));
+    return last && g_unichar_isalnum(g_utf8_get_char_validated(last, -1));
+}
+
+struct listings* search_index_query(struct search_index* index, const char* text, size_t max_results) {
+    GPtrArray* terms = g_ptr_array_new_with_free_func(g_free);
+    tokenize(text, MAX_QUERY_TERMS, 1, collect_term, terms);
+    bool prefix = ends_in_word(text);
+
+    g_mutex_lock(&index->lock);
+    refresh(index);
+    size_t base_count = index->base.header.doc_count;
+    size_t doc_count = base_count + index->log->docs->len;
+    uint64_t total_length = index->base.header.total_length + index->log->total_length;
+    struct query query = {.base = &index->base,
+                          .log = index->log,
+                          .scores = g_new0(float, doc_count + 1),
+                          .matched = g_new0(uint8_t, doc_count + 1),
+                          // threads in both the file and the log are counted twice until they are merged
+                          .doc_count = (float)(base_count + index->log->live_count)};
+    query.average_length = query.doc_count > 0 && total_length > 0 ? (float)total_length / query.doc_count : 1.0f;
+    for (guint i = 0; i < terms->len; i++) {
+        const char* term = g_ptr_array_index(terms, i);
+        bool is_prefix = prefix && i + 1 == terms->len && strlen(term) >= MIN_PREFIX_SIZE;
+        score_term(&query, term, is_prefix, (uint8_t)i);
+    }
+    struct hit* hits = g_new(struct hit, max_results + 1);
+    size_t hit_count = 0;
+    for (size_t doc = 0; terms->len > 0 && doc < doc_count; doc++) {
+        if (query.matched[doc] != terms->len || is_replaced(&query, doc))
+            continue;
+        uint32_t ups = doc < base_count ? index->base.docs[doc].ups
+                                        : g_array_index(index->log->docs, struct log_doc, doc - base_count).ups;
+        offer_hit(hits, &hit_count, max_results, (struct hit){.doc = doc, .score = query.scores[doc], .ups = ups});
+    }
+    qsort(hits, hit_count, sizeof(*hits), compare_best_first);
+
+    struct listings* results = LOG_ERR_MALLOC(struct listings, 1);
+    struct listing* items = LOG_ERR_MALLOC(struct listing, hit_count + 1);
+    results->arena = new_arena();
+    for (size_t i = 0; i < hit_count; i++) {
+        items[i] = copy_hit(results->arena, &query, hits[i].doc);
+    }
+    g_mutex_unlock(&index->lock);
+    results->items = items;
+    results->count = hit_count;
+    results->cursors = NULL;
+    results->cursor_count = 0;
+    g_free(hits);
+    g_free(query.matched);
+    g_free(query.scores);
+    g_ptr_array_free(terms, TRUE);
+    return results;
+}
+
+struct index_writer {
+    GArray* docs;
+    GArray* terms;
+    GArray* postings;
+    GByteArray* heap;
+    // offset of every string added to heap so far
+    GHashTable* offsets;
+    uint64_t total_length;
+};
+
+static uint32_t add_string(struct index_writer* writer, const char* value) {
+    if (!value)
+        return NO_STRING;
+    gpointer known = NULL;
+    if (g_hash_table_lookup_extended(writer->offsets, value, NULL, &known))
+        return GPOINTER_TO_UINT(known);
+    uint32_t offset = writer->heap->len;
+    g_byte_array_append(writer->heap, (const guint8*)value, strlen(value) + 1);
+    g_hash_table_insert(writer->offsets, (gpointer)value, GUINT_TO_POINTER(offset));
+    return offset;
+}
+
+static uint32_t add_doc(struct index_writer* writer, const char* id, const char* subreddit, const char* title,
+                        const char* url, uint32_t ups, uint32_t length) {
+    struct search_index_doc doc = {.id = add_string(writer, id),
+                                   .subreddit = add_string(writer, subreddit),
+                                   .title = add_string(writer, title),
+                                   .url = add_string(writer, url),
+                                   .ups = ups,
+                                   .length = length};
+    g_array_append_val(writer->docs, doc);
+    writer->total_length += length;
+    return writer->docs->len - 1;
+}
+
+static void add_posting(struct index_writer* writer, uint32_t doc, uint32_t frequency) {
+    struct search_index_posting posting = {.doc = doc, .frequency = frequency};
+    g_array_append_val(writer->postings, posting);
+}
+
+static int compare_strings(const void* a, const void* b) {
+    return strcmp(*(const char* const*)a, *(const char* const*)b);
+}
+
+// Walks the sorted terms of both in step, so that the merged ones come out sorted without being sorted again.
+static void merge_terms(struct index_writer* writer, const struct index_segment* base, const uint32_t* base_docs,
+                        const struct log_segment* log, const uint32_t* log_docs) {
+    guint log_term_count = 0;
+    const char** log_terms = (const char**)g_hash_table_get_keys_as_array(log->terms, &log_term_count);
+    qsort(log_terms, log_term_count, sizeof(*log_terms), compare_strings);
+    size_t base_term = 0;
+    guint log_term = 0;
+    while (base_term < base->header.term_count || log_term < log_term_count) {
+        const char* base_text = base_term < base->header.term_count ? term_text(base, base_term) : NULL;
+        const char* log_text = log_term < log_term_count ? log_terms[log_term] : NULL;
+        int order = !base_text ? 1 : !log_text ? -1 : strcmp(base_text, log_text);
+        const char* text = order <= 0 ? base_text : log_text;
+        uint32_t first_posting = writer->postings->len;
+        if (order <= 0) {
+            size_t count = 0;
+            const struct search_index_posting* postings = term_postings(base, base_term++, &count);
+            for (size_t i = 0; i < count; i++) {
+                if (postings[i].doc < base->header.doc_count && base_docs[postings[i].doc] != NO_DOC)
+                    add_posting(writer, base_docs[postings[i].doc], postings[i].frequency);
+            }
+        }
+        if (order >= 0) {
+            const GArray* postings = g_hash_table_lookup(log->terms, log_terms[log_term++]);
+            for (guint i = 0; i < postings->len; i++) {
+                const struct search_index_posting* posting = &g_array_index(postings, struct search_index_posting, i);
+                if (log_docs[posting->doc] != NO_DOC)
+                    add_posting(writer, log_docs[posting->doc], posting->frequency);
+            }
+        }
+        // terms whose every doc was replaced are dropped, as is whatever a damaged file has without text
+        if (writer->postings->len == first_posting || text[0] == '\0') {
+            g_array_set_size(writer->postings, first_posting);
+            continue;
+        }
+        struct search_index_term term = {.text = add_string(writer, text),
+                                         .first_posting = first_posting,
+                                         .posting_count = writer->postings->len - first_posting};
+        g_array_append_val(writer->terms, term);
+    }
+    g_free(log_terms);
+}
+
+// The index file holding the threads of base and log, only the latest version of each, *size bytes. Free with g_free.
+static char* merge_segments(const struct index_segment* base, const struct log_segment* log, size_t* size) {
+    struct index_writer writer = {.docs = g_array_new(FALSE, FALSE, sizeof(struct search_index_doc)),
+                                  .terms = g_array_new(FALSE, FALSE, sizeof(struct search_index_term)),
+                                  .postings = g_array_new(FALSE, FALSE, sizeof(struct search_index_posting)),
+                                  .heap = g_byte_array_new(),
+                                  .offsets = g_hash_table_new(g_str_hash, g_str_equal),
+                                  .total_length = 0};
+    // where every doc ends up, NO_DOC for those left out
+    uint32_t* base_docs = g_new(uint32_t, base->header.doc_count + 1);
+    for (size_t doc = 0; doc < base->header.doc_count; doc++) {
+        const struct search_index_doc* record = &base->docs[doc];
+        const char* id = segment_string(base, record->id);
+        const char* title = segment_string(base, record->title);
+        base_docs[doc] = id && title && !g_hash_table_contains(log->ids, id)
+                             ? add_doc(&writer, id, segment_string(base, record->subreddit), title,
+                                       segment_string(base, record->url), record->ups, record->length)
+                             : NO_DOC;
+    }
+    uint32_t* log_docs = g_new(uint32_t, log->docs->len + 1);
+    for (guint doc = 0; doc < log->docs->len; doc++) {
+        const struct log_doc* record = &g_array_index(log->docs, struct log_doc, doc);
+        log_docs[doc] = record->superseded ? NO_DOC
+                                           : add_doc(&writer, record->id, record->subreddit, record->title,
+                                                     record->url, record->ups, record->length);
+    }
+    merge_terms(&writer, base, base_docs, log, log_docs);
+
+    struct search_index_header header = {.version = SEARCH_INDEX_VERSION,
+                                         .doc_count = writer.docs->len,
+                                         .term_count = writer.terms->len,
+                                         .posting_count = writer.postings->len,
+                                         .heap_size = writer.heap->len,
+                                         .total_length = writer.total_length};
+    memcpy(header.magic, SEARCH_INDEX_MAGIC, sizeof(header.magic));
+    size_t docs_size = sizeof(struct search_index_doc) * writer.docs->len;
+    size_t terms_size = sizeof(struct search_index_term) * writer.terms->len;
+    size_t postings_size = sizeof(struct search_index_posting) * writer.postings->len;
+    *size = sizeof(header) + docs_size + terms_size + postings_size + writer.heap->len;
+    char* contents = g_malloc(*size);
+    char* at = contents;
+    memcpy(at, &header, sizeof(header));
+    at += sizeof(header);
+    memcpy(at, writer.docs->data, docs_size);
+    at += docs_size;
+    memcpy(at, writer.terms->data, terms_size);
+    at += terms_size;
+    memcpy(at, writer.postings->data, postings_size);
+    at += postings_size;
+    memcpy(at, writer.heap->data, writer.heap->len);
+
+    g_free(log_docs);
+    g_free(base_docs);
+    g_hash_table_destroy(writer.offsets);
+    g_byte_array_free(writer.heap, TRUE);
+    g_array_free(writer.postings, TRUE);
+    g_array_free(writer.terms, TRUE);
+    g_array_free(writer.docs, TRUE);
+    return contents;
+}
+
+// The log is moved aside before merging so that threads keep being appended meanwhile, and the index file is replaced
+// by renaming so that the mappings of readers stay intact.
+bool search_index_compact(struct search_index* index) {
+    int merge_lock = lock_file(index->merge_lock_path, LOCK_EX | LOCK_NB);
+    if (merge_lock < 0)
+        return false;
+    int append_lock = lock_file(index->append_lock_path, LOCK_EX);
+    // a log moved aside by a merge that was interrupted is merged first, the current one waits for the next merge
+    bool moved = append_lock >= 0 && (g_file_test(index->merging_path, G_FILE_TEST_EXISTS) ||
+                                      rename(index->log_path, index->merging_path) == 0);
+    unlock_file(append_lock);
+    bool merged = false;
+    if (moved) {
+        gint64 started = g_get_monotonic_time();
+        struct log_segment* log = new_log_segment();
+        struct log_file file = {.exists = false};
+        read_log(log, index->merging_path, &file);
+        if (log->docs->len == 0) {
+            // nothing readable, rewriting the index file would only cost time
+            g_remove(index->merging_path);
+            free_log_segment(log);
+            unlock_file(merge_lock);
+            return false;
+        }
+        struct index_segment base;
+        struct stat base_stat;
+        map_segment(&base, index->index_path, &base_stat);
+        size_t size = 0;
+        char* contents = merge_segments(&base, log, &size);
+        GError* error = NULL;
+        merged = g_file_set_contents(index->index_path, contents, (gssize)size, &error);
+        if (merged) {
+            g_remove(index->merging_path);
+            fprintf(stdout, "Merged %zu threads into the search index in %" PRId64 " ms.\n", log->live_count,
+                    (g_get_monotonic_time() - started) / 1000);
+        } else {
+            fprintf(stderr, "Failed to write search index at %s: %s\n", index->index_path, error->message);
+            g_error_free(error);
+        }
+        g_free(contents);
+        unmap_segment(&base);
+        free_log_segment(log);
+    }
+    unlock_file(merge_lock);
+    return merged;
+}
+
+void free_search_index(struct search_index* index) {
+    if (!index)
+        return;
+    if (index->compactor)
+        g_thread_join(index->compactor);
+    unmap_segment(&index->base);
+    free_log_segment(index->log);
+    g_mutex_clear(&index->lock);
+    g_free(index->index_path);
+    g_free(index->log_path);
+    g_free(index->merging_path);
+    g_free(index->append_lock_path);
+    g_free(index->merge_lock_path);
+    free(index);
+}
@@ -0,0 +1,35 @@
+#ifndef SEARCH_INDEX_H
+#define SEARCH_INDEX_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+struct listing;
+struct listings;
+
+// Full-text index of the title and selftext of every thread ever fetched, in a directory of its own. Threads are
+// appended to a log, which is merged into a mapped index file of sorted words once it grows, so that adding is cheap
+// and a query only scans the few threads added since. Safe to use from several threads, and several processes may share
+// the directory: each query picks up what the others added.
+struct search_index;
+
+// Creates dir if needed. A damaged index file is ignored and rewritten by the next compaction.
+struct search_index* new_search_index(const char* dir);
+
+// Adds the threads, replacing those with the same id indexed before. Threads without an id are skipped. Once the log
+// holds enough threads, it is merged into the index file in the background. Returns whether they could be written.
+bool search_index_add(struct search_index* index, const struct listing* items, size_t count);
+
+// The threads containing every word of query, best match first, at most max_results of them. Words match regardless of
+// case, and while the last one is still being typed, i.e. the query doesn't end in a space, it also matches the words
+// it is the start of. Only id, subreddit, title, url and ups of the threads are kept. Free with free_listings.
+struct listings* search_index_query(struct search_index* index, const char* query, size_t max_results);
+
+// Merges the log into the index file, which is what happens in the background. Returns whether there was anything to
+// merge and it could be written; false as well while another process is merging.
+bool search_index_compact(struct search_index* index);
+
+// Waits for a merge in the background to finish.
+void free_search_index(struct search_index* index);
+
+#endif
@@ -0,0 +1,214 @@
+#include "subreddit_history.h"
+#include "memory.h"
+#include <fcntl.h>
+#include <glib.h>
+#include <math.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+// A visit counts half as much once this much older than another.
+static const double HALF_LIFE_SECONDS = 7.0 * 24 * 60 * 60;
+// kept when the file is rewritten, the least frecent subreddits beyond are forgotten
+static const size_t MAX_ENTRIES = 100;
+// the file is rewritten once it holds this many lines per subreddit, and never while it is shorter than the minimum
+static const size_t COMPACT_LINES_PER_ENTRY = 4;
+static const size_t MIN_COMPACT_LINES = 256;
+// enough for a handful of comma separated subreddits
+static const size_t MAX_NAME_SIZE = 256;
+
+// Every visit adds 2^(visited_at / HALF_LIFE_SECONDS) to the frecency of a subreddit. Rather than the sum, rank is
+// the time a single visit worth as much would have happened at, which compares without being decayed to the current
+// time, and lets a line of the file hold either one visit or everything known about a subreddit: "<rank>\t<name>".
+struct history_entry {
+    // lowercase name, subreddit names are case insensitive
+    char* key;
+    char* name;
+    double rank;
+    guint position;
+};
+
+struct subreddit_history {
+    char* path;
+    // most frecent first
+    GPtrArray* entries;
+    GHashTable* by_key;
+    size_t line_count;
+};
+
+static bool is_valid_name(const char* name) {
+    size_t size = strlen(name);
+    if (size == 0 || size > MAX_NAME_SIZE)
+        return false;
+    for (size_t i = 0; i < size; i++) {
+        if (!g_ascii_isalnum(name[i]) && name[i] != '_' && name[i] != ',')
+            return false;
+    }
+    return true;
+}
+
+// log2(2^(a / HALF_LIFE_SECONDS) + 2^(b / HALF_LIFE_SECONDS)) scaled back, without overflowing for either.
+static double add_ranks(double a, double b) {
+    double later = MAX(a, b);
+    double earlier = MIN(a, b);
+    return later + HALF_LIFE_SECONDS * log2(1 + exp2((earlier - later) / HALF_LIFE_SECONDS));
+}
+
+static void free_history_entry(void* data) {
+    struct history_entry* entry = data;
+    g_free(entry->key);
+    g_free(entry->name);
+    free(entry);
+}
+
+static struct history_entry* add_to_history(struct subreddit_history* history, const char* name, double rank) {
+    char* key = g_ascii_strdown(name, -1);
+    struct history_entry* entry = g_hash_table_lookup(history->by_key, key);
+    if (entry) {
+        g_free(key);
+        g_free(entry->name);
+        entry->name = g_strdup(name);
+        entry->rank = add_ranks(entry->rank, rank);
+        return entry;
+    }
+    entry = LOG_ERR_MALLOC(struct history_entry, 1);
+    entry->key = key;
+    entry->name = g_strdup(name);
+    entry->rank = rank;
+    entry->position = history->entries->len;
+    g_ptr_array_add(history->entries, entry);
+    g_hash_table_insert(history->by_key, entry->key, entry);
+    return entry;
+}
+
+// Moves entry up past the ones it outranks now. Visits only ever raise a rank, so it never moves down.
+static void promote(GPtrArray* entries, struct history_entry* entry) {
+    while (entry->position > 0) {
+        struct history_entry* above = g_ptr_array_index(entries, entry->position - 1);
+        if (above->rank >= entry->rank)
+            return;
+        entries->pdata[entry->position] = above;
+        entries->pdata[entry->position - 1] = entry;
+        above->position++;
+        entry->position--;
+    }
+}
+
+static gint compare_most_frecent_first(gconstpointer a, gconstpointer b) {
+    const struct history_entry* first = *(const struct history_entry* const*)a;
+    const struct history_entry* second = *(const struct history_entry* const*)b;
+    return (first->rank < second->rank) - (first->rank > second->rank);
+}
+
+static void append_history_line(GString* lines, const char* name, double rank) {
+    char formatted[G_ASCII_DTOSTR_BUF_SIZE];
+    // not printf, whose decimal separator depends on the locale rofi runs in
+    g_string_append_printf(lines, "%s\t%s\n", g_ascii_formatd(formatted, sizeof(formatted), "%.3f", rank), name);
+}
+
+// Only complete lines count, the last one may have been cut short by a crash while it was appended.
+static void read_history(struct subreddit_history* history) {
+    char* contents = NULL;
+    gsize size = 0;
+    if (!g_file_get_contents(history->path, &contents, &size, NULL))
+        return;
+    char* line = contents;
+    char* end = NULL;
+    while ((end = memchr(line, '\n', size - (size_t)(line - contents))) != NULL) {
+        *end = '\0';
+        history->line_count++;
+        char* tab = strchr(line, '\t');
+        char* rank_end = NULL;
+        double rank = tab ? g_ascii_strtod(line, &rank_end) : NAN;
+        if (tab && rank_end == tab && isfinite(rank) && is_valid_name(tab + 1))
+            add_to_history(history, tab + 1, rank);
+        line = end + 1;
+    }
+    g_free(contents);
+    g_ptr_array_sort(history->entries, compare_most_frecent_first);
+    for (guint i = 0; i < history->entries->len; i++) {
+        ((struct history_entry*)g_ptr_array_index(history->entries, i))->position = i;
+    }
+}
+
+struct subreddit_history* new_subreddit_history(const char* path) {
+    struct subreddit_history* history = LOG_ERR_MALLOC(struct subreddit_history, 1);
+    history->path = g_strdup(path);
+    history->entries = g_ptr_array_new_with_free_func(free_history_entry);
+    history->by_key = g_hash_table_new(g_str_hash, g_str_equal);
+    history->line_count = 0;
+    read_history(history);
+    return history;
+}
+
+size_t subreddit_history_count(const struct subreddit_history* history) {
+    return history ? history->entries->len : 0;
+}
+
+const char* subreddit_history_name(const struct subreddit_history* history, size_t position) {
+    if (position >= history->entries->len)
+        return NULL;
+    return ((const struct history_entry*)g_ptr_array_index(history->entries, position))->name;
+}
+
+static bool append_to_history_file(const char* path, const GString* line) {
+    int fd = open(path, O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC, 0600);
+    bool written = fd >= 0 && write(fd, line->str, line->len) == (ssize_t)line->len;
+    if (fd >= 0)
+        close(fd);
+    if (!written)
+        fprintf(stderr, "Failed to append to subreddit history at %s.\n", path);
+    return written;
+}
+
+// Rewrites the file with a line per subreddit. Visits another rofi appended since the file was read are lost, which
+// only costs their subreddits a little rank.
+static bool compact_history(struct subreddit_history* history) {
+    while (history->entries->len > MAX_ENTRIES) {
+        const struct history_entry* last = g_ptr_array_index(history->entries, history->entries->len - 1);
+        g_hash_table_remove(history->by_key, last->key);
+        g_ptr_array_remove_index(history->entries, history->entries->len - 1);
+    }
+    GString* lines = g_string_new(NULL);
+    for (guint i = 0; i < history->entries->len; i++) {
+        const struct history_entry* entry = g_ptr_array_index(history->entries, i);
+        append_history_line(lines, entry->name, entry->rank);
+    }
+    GError* error = NULL;
+    bool written = g_file_set_contents(history->path, lines->str, (gssize)lines->len, &error);
+    if (written) {
+        history->line_count = history->entries->len;
+    } else {
+        fprintf(stderr, "Failed to write subreddit history at %s: %s\n", history->path, error->message);
+        g_error_free(error);
+    }
+    g_string_free(lines, TRUE);
+    return written;
+}
+
+bool subreddit_history_visit(struct subreddit_history* history, const char* name, time_t visited_at) {
+    if (!is_valid_name(name))
+        return false;
+    GString* line = g_string_new(NULL);
+    append_history_line(line, name, (double)visited_at);
+    bool written = append_to_history_file(history->path, line);
+    g_string_free(line, TRUE);
+    promote(history->entries, add_to_history(history, name, (double)visited_at));
+    history->line_count++;
+    size_t compact_at = MAX(MIN_COMPACT_LINES, COMPACT_LINES_PER_ENTRY * MIN(history->entries->len, MAX_ENTRIES));
+    // also the way out when appending failed, the rewritten file holds the visit as well
+    if (history->line_count >= compact_at || !written)
+        written = compact_history(history);
+    return written;
+}
+
+void free_subreddit_history(struct subreddit_history* history) {
+    if (!history)
+        return;
+    g_hash_table_destroy(history->by_key);
+    g_ptr_array_free(history->entries, TRUE);
+    g_free(history->path);
+    free(history);
+}
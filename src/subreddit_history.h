@@ -0,0 +1,27 @@
+#ifndef SUBREDDIT_HISTORY_H
+#define SUBREDDIT_HISTORY_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <time.h>
+
+// Subreddits visited before, most frecent first, i.e. ranked by how often and how recently they were visited. A visit
+// appends one line to a text file; once the file has grown well past one line per subreddit, it is rewritten with
+// just that.
+struct subreddit_history;
+
+// Missing files yield an empty history, damaged lines are skipped.
+struct subreddit_history* new_subreddit_history(const char* path);
+
+size_t subreddit_history_count(const struct subreddit_history* history);
+
+// Valid until the next visit.
+const char* subreddit_history_name(const struct subreddit_history* history, size_t position);
+
+// Ranks name, a subreddit or comma separated subreddits as in "linux,cpp", higher. Names are case insensitive, the
+// latest spelling is kept. Returns whether the visit could be written.
+bool subreddit_history_visit(struct subreddit_history* history, const char* name, time_t visited_at);
+
+void free_subreddit_history(struct subreddit_history* history);
+
+#endif
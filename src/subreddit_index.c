@@ -0,0 +1,396 @@
+#include "subreddit_index.h"
+#include "memory.h"
+#include <glib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// File layout: header, one offset into the string heap per name, then the heap of NUL terminated names.
+static const char SUBREDDIT_INDEX_MAGIC[4] = {'R', 'R', 'S', 'I'};
+static const uint32_t SUBREDDIT_INDEX_VERSION = 1;
+// Reddit allows up to 21 characters, some older subreddits are a bit longer
+static const size_t MAX_SUBREDDIT_NAME_SIZE = 32;
+// background rewrites start at least this far apart, names coming in meanwhile wait for the next one
+static const guint MIN_UPDATE_INTERVAL_MS = 30 * 1000;
+
+struct subreddit_index_header {
+    char magic[4];
+    uint32_t version;
+    uint32_t count;
+    uint32_t heap_size;
+};
+
+struct index_update;
+
+struct subreddit_index {
+    char* path;
+    GMappedFile* file;
+    const uint32_t* offsets;
+    const char* heap;
+    size_t count;
+    // names waiting for the next background rewrite, and their lowercase spelling to skip repeats
+    GPtrArray* pending;
+    GHashTable* pending_keys;
+    // list to import with the next background rewrite, NULL if none
+    char* pending_import_path;
+    // the background rewrite in flight, NULL if none
+    struct index_update* update;
+    // main loop timeout that starts the next rewrite, 0 if none is due
+    guint update_source;
+    gint64 last_update_at;
+    subreddit_index_updated_callback callback;
+    void* user_data;
+};
+
+// A rewrite of the index file on a thread of its own. The mapping is only swapped on the main loop, so that names
+// handed out there stay valid until then.
+struct index_update {
+    struct subreddit_index* index;
+    GThread* thread;
+    // owned by the update
+    char* path;
+    GPtrArray* names;
+    char* import_path;
+    size_t added;
+    bool written;
+};
+
+static bool is_valid_subreddit_name(const char* name, size_t size) {
+    if (size == 0 || size > MAX_SUBREDDIT_NAME_SIZE)
+        return false;
+    for (size_t i = 0; i < size; i++) {
+        if (!g_ascii_isalnum(name[i]) && name[i] != '_')
+            return false;
+    }
+    return true;
+}
+
+static void unmap_subreddit_index(struct subreddit_index* index) {
+    if (index->file)
+        g_mapped_file_unref(index->file);
+    index->file = NULL;
+    index->offsets = NULL;
+    index->heap = NULL;
+    index->count = 0;
+}
+
+static void map_subreddit_index(struct subreddit_index* index) {
+    unmap_subreddit_index(index);
+    GMappedFile* file = g_mapped_file_new(index->path, FALSE, NULL);
+    if (!file)
+        return;
+    const char* contents = g_mapped_file_get_contents(file);
+    size_t size = g_mapped_file_get_length(file);
+    struct subreddit_index_header header;
+    if (size < sizeof(header)) {
+        g_mapped_file_unref(file);
+        return;
+    }
+    memcpy(&header, contents, sizeof(header));
+    size_t table_size = (size_t)header.count * sizeof(uint32_t);
+    const uint32_t* offsets = (const uint32_t*)(contents + sizeof(header));
+    const char* heap = contents + sizeof(header) + table_size;
+    bool valid = memcmp(header.magic, SUBREDDIT_INDEX_MAGIC, sizeof(header.magic)) == 0 &&
+                 header.version == SUBREDDIT_INDEX_VERSION && size == sizeof(header) + table_size + header.heap_size &&
+                 (header.heap_size == 0 || heap[header.heap_size - 1] == '\0');
+    // every name has to end inside the heap, which the trailing NUL guarantees once its offset is in bounds
+    for (size_t i = 0; valid && i < header.count; i++) {
+        valid = offsets[i] < header.heap_size;
+    }
+    if (!valid) {
+        fprintf(stderr, "Ignoring damaged subreddit index at %s.\n", index->path);
+        g_mapped_file_unref(file);
+        return;
+    }
+    index->file = file;
+    index->offsets = offsets;
+    index->heap = heap;
+    index->count = header.count;
+}
+
+struct subreddit_index* new_subreddit_index(const char* path) {
+    struct subreddit_index* index = LOG_ERR_MALLOC(struct subreddit_index, 1);
+    index->path = g_strdup(path);
+    index->file = NULL;
+    index->pending = g_ptr_array_new_with_free_func(g_free);
+    index->pending_keys = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+    index->pending_import_path = NULL;
+    index->update = NULL;
+    index->update_source = 0;
+    index->last_update_at = 0;
+    index->callback = NULL;
+    index->user_data = NULL;
+    map_subreddit_index(index);
+    return index;
+}
+
+size_t subreddit_index_count(const struct subreddit_index* index) {
+    return index ? index->count : 0;
+}
+
+const char* subreddit_index_name(const struct subreddit_index* index, size_t position) {
+    return index->heap + index->offsets[position];
+}
+
+// First position whose name compares above prefix (when inclusive is false) or not below it, looking at no more than
+// the prefix's length.
+static size_t search_prefix(const struct subreddit_index* index, const char* prefix, size_t prefix_size,
+                            bool inclusive) {
+    size_t low = 0;
+    size_t high = index->count;
+    while (low < high) {
+        size_t middle = low + (high - low) / 2;
+        int order = g_ascii_strncasecmp(subreddit_index_name(index, middle), prefix, prefix_size);
+        if (order < 0 || (!inclusive && order == 0)) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+    return low;
+}
+
+void subreddit_index_find_prefix(const struct subreddit_index* index, const char* prefix, size_t* first,
+                                 size_t* last) {
+    size_t prefix_size = strlen(prefix);
+    *first = search_prefix(index, prefix, prefix_size, true);
+    *last = search_prefix(index, prefix, prefix_size, false);
+}
+
+bool subreddit_index_contains(const struct subreddit_index* index, const char* name) {
+    size_t first = search_prefix(index, name, strlen(name), true);
+    return first < index->count && g_ascii_strcasecmp(subreddit_index_name(index, first), name) == 0;
+}
+
+static gint compare_names(gconstpointer a, gconstpointer b) {
+    return g_ascii_strcasecmp(*(const char* const*)a, *(const char* const*)b);
+}
+
+static bool write_subreddit_index(const struct subreddit_index* index, GPtrArray* names) {
+    g_ptr_array_sort(names, compare_names);
+    GByteArray* heap = g_byte_array_new();
+    GArray* offsets = g_array_new(FALSE, FALSE, sizeof(uint32_t));
+    for (guint i = 0; i < names->len; i++) {
+        const char* name = g_ptr_array_index(names, i);
+        // the earliest spelling wins, so names already in the index keep theirs
+        if (i > 0 && g_ascii_strcasecmp(name, g_ptr_array_index(names, i - 1)) == 0)
+            continue;
+        uint32_t offset = heap->len;
+        g_array_append_val(offsets, offset);
+        g_byte_array_append(heap, (const guint8*)name, strlen(name) + 1);
+    }
+    struct subreddit_index_header header = {.version = SUBREDDIT_INDEX_VERSION,
+                                            .count = offsets->len,
+                                            .heap_size = heap->len};
+    memcpy(header.magic, SUBREDDIT_INDEX_MAGIC, sizeof(header.magic));
+    size_t table_size = (size_t)offsets->len * sizeof(uint32_t);
+    size_t size = sizeof(header) + table_size + heap->len;
+    char* contents = LOG_ERR_MALLOC(char, size);
+    memcpy(contents, &header, sizeof(header));
+    memcpy(contents + sizeof(header), offsets->data, table_size);
+    memcpy(contents + sizeof(header) + table_size, heap->data, heap->len);
+    g_array_free(offsets, TRUE);
+    g_byte_array_free(heap, TRUE);
+
+    GError* error = NULL;
+    // replaced by renaming, so the mapping still held by this process keeps the old contents
+    bool written = g_file_set_contents(index->path, contents, (gssize)size, &error);
+    if (!written) {
+        fprintf(stderr, "Failed to write subreddit index at %s: %s\n", index->path, error->message);
+        g_error_free(error);
+    }
+    free(contents);
+    return written;
+}
+
+// Writes the names of index and those of names it lacks to its file, without mapping the result. *added tells how
+// many were new.
+static bool write_merged_index(const struct subreddit_index* index, const char* const* names, size_t count,
+                               size_t* added) {
+    GPtrArray* merged = g_ptr_array_sized_new((guint)(index->count + count));
+    for (size_t i = 0; i < index->count; i++) {
+        g_ptr_array_add(merged, (gpointer)subreddit_index_name(index, i));
+    }
+    *added = 0;
+    for (size_t i = 0; i < count; i++) {
+        if (!is_valid_subreddit_name(names[i], strlen(names[i])) || subreddit_index_contains(index, names[i]))
+            continue;
+        g_ptr_array_add(merged, (gpointer)names[i]);
+        (*added)++;
+    }
+    bool written = *added == 0 || write_subreddit_index(index, merged);
+    g_ptr_array_free(merged, TRUE);
+    if (*added > 0 && written)
+        fprintf(stdout, "Added %zu subreddits to the subreddit index.\n", *added);
+    return written;
+}
+
+bool subreddit_index_add(struct subreddit_index* index, const char* const* names, size_t count) {
+    size_t added = 0;
+    bool written = write_merged_index(index, names, count, &added);
+    if (added > 0 && written)
+        map_subreddit_index(index);
+    return written;
+}
+
+// Appends the names of a text file with one subreddit per line to names, as strings of their own.
+static bool read_subreddit_list(const char* list_path, GPtrArray* names) {
+    char* contents = NULL;
+    GError* error = NULL;
+    if (!g_file_get_contents(list_path, &contents, NULL, &error)) {
+        fprintf(stderr, "Failed to read subreddit list at %s: %s\n", list_path, error->message);
+        g_error_free(error);
+        return false;
+    }
+    char** lines = g_strsplit(contents, "\n", -1);
+    g_free(contents);
+    for (size_t i = 0; lines[i]; i++) {
+        char* name = g_strchug(lines[i]);
+        if (g_str_has_prefix(name, "/r/")) {
+            name += 3;
+        } else if (g_str_has_prefix(name, "r/")) {
+            name += 2;
+        }
+        name[strcspn(name, ", \t\r")] = '\0';
+        if (name[0] != '\0')
+            g_ptr_array_add(names, g_strdup(name));
+    }
+    g_strfreev(lines);
+    return true;
+}
+
+bool subreddit_index_import(struct subreddit_index* index, const char* list_path) {
+    GPtrArray* names = g_ptr_array_new_with_free_func(g_free);
+    bool imported = read_subreddit_list(list_path, names) &&
+                    subreddit_index_add(index, (const char* const*)names->pdata, names->len);
+    g_ptr_array_free(names, TRUE);
+    return imported;
+}
+
+static void free_index_update(struct index_update* update) {
+    g_free(update->path);
+    g_ptr_array_free(update->names, TRUE);
+    g_free(update->import_path);
+    free(update);
+}
+
+static void schedule_update(struct subreddit_index* index);
+
+static gboolean deliver_update(gpointer data) {
+    struct index_update* update = (struct index_update*)data;
+    struct subreddit_index* index = update->index;
+    g_thread_join(update->thread);
+    index->update = NULL;
+    index->last_update_at = g_get_monotonic_time();
+    if (!update->written) {
+        // kept for the next rewrite, which may well succeed
+        for (guint i = 0; i < update->names->len; i++) {
+            g_ptr_array_add(index->pending, g_strdup(g_ptr_array_index(update->names, i)));
+        }
+    }
+    // mapping checks every offset but reads no name, which is quick even for a large index
+    if (update->added > 0)
+        map_subreddit_index(index);
+    if (update->added > 0 && index->callback)
+        index->callback(index->user_data);
+    free_index_update(update);
+    if (index->pending->len > 0 || index->pending_import_path)
+        schedule_update(index);
+    return G_SOURCE_REMOVE;
+}
+
+// The file is read afresh rather than through the index, whose mapping belongs to the main loop.
+static gpointer update_in_background(gpointer data) {
+    struct index_update* update = (struct index_update*)data;
+    if (update->import_path)
+        read_subreddit_list(update->import_path, update->names);
+    struct subreddit_index* current = new_subreddit_index(update->path);
+    update->written =
+        write_merged_index(current, (const char* const*)update->names->pdata, update->names->len, &update->added);
+    free_subreddit_index(current);
+    g_idle_add(deliver_update, update);
+    return NULL;
+}
+
+static void start_update(struct subreddit_index* index) {
+    struct index_update* update = LOG_ERR_MALLOC(struct index_update, 1);
+    update->index = index;
+    update->path = g_strdup(index->path);
+    update->names = index->pending;
+    update->import_path = index->pending_import_path;
+    update->added = 0;
+    update->written = false;
+    index->pending = g_ptr_array_new_with_free_func(g_free);
+    g_hash_table_remove_all(index->pending_keys);
+    index->pending_import_path = NULL;
+    index->update = update;
+    update->thread = g_thread_new("subreddit-index", update_in_background, update);
+}
+
+static gboolean on_update_due(gpointer data) {
+    struct subreddit_index* index = (struct subreddit_index*)data;
+    index->update_source = 0;
+    start_update(index);
+    return G_SOURCE_REMOVE;
+}
+
+// Starts a rewrite right away unless one ran recently, which batches the names of fetches in quick succession.
+static void schedule_update(struct subreddit_index* index) {
+    if (index->update || index->update_source)
+        return;
+    gint64 due_at = index->last_update_at + (gint64)MIN_UPDATE_INTERVAL_MS * 1000;
+    gint64 now = g_get_monotonic_time();
+    if (index->last_update_at == 0 || due_at <= now) {
+        start_update(index);
+    } else {
+        index->update_source = g_timeout_add((guint)((due_at - now) / 1000), on_update_due, index);
+    }
+}
+
+void subreddit_index_add_in_background(struct subreddit_index* index, const char* const* names, size_t count,
+                                       const char* import_path, subreddit_index_updated_callback callback,
+                                       void* user_data) {
+    index->callback = callback;
+    index->user_data = user_data;
+    for (size_t i = 0; i < count; i++) {
+        if (!is_valid_subreddit_name(names[i], strlen(names[i])) || subreddit_index_contains(index, names[i]))
+            continue;
+        char* key = g_ascii_strdown(names[i], -1);
+        if (g_hash_table_contains(index->pending_keys, key)) {
+            g_free(key);
+            continue;
+        }
+        g_hash_table_add(index->pending_keys, key);
+        g_ptr_array_add(index->pending, g_strdup(names[i]));
+    }
+    if (import_path) {
+        g_free(index->pending_import_path);
+        index->pending_import_path = g_strdup(import_path);
+    }
+    if (index->pending->len > 0 || index->pending_import_path)
+        schedule_update(index);
+}
+
+void free_subreddit_index(struct subreddit_index* index) {
+    if (!index)
+        return;
+    if (index->update_source)
+        g_source_remove(index->update_source);
+    if (index->update) {
+        g_thread_join(index->update->thread);
+        // its delivery is still queued on the main loop
+        g_source_remove_by_user_data(index->update);
+        free_index_update(index->update);
+    }
+    // names that didn't make it into a rewrite are written now rather than lost
+    if (index->pending->len > 0)
+        subreddit_index_add(index, (const char* const*)index->pending->pdata, index->pending->len);
+    unmap_subreddit_index(index);
+    g_ptr_array_free(index->pending, TRUE);
+    g_hash_table_destroy(index->pending_keys);
+    g_free(index->pending_import_path);
+    g_free(index->path);
+    free(index);
+}
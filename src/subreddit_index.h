@@ -0,0 +1,44 @@
+#ifndef SUBREDDIT_INDEX_H
+#define SUBREDDIT_INDEX_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+// Known subreddit names, sorted case insensitively in a file that is mapped rather than read, so that opening an index
+// of hundreds of thousands of names costs next to nothing and a prefix lookup is a binary search.
+struct subreddit_index;
+
+// A missing or damaged file yields an empty index, which is rewritten on the next addition.
+struct subreddit_index* new_subreddit_index(const char* path);
+
+size_t subreddit_index_count(const struct subreddit_index* index);
+
+// Valid until the index is next modified.
+const char* subreddit_index_name(const struct subreddit_index* index, size_t position);
+
+// Narrows down the names starting with prefix, case insensitively, to positions [first, last).
+void subreddit_index_find_prefix(const struct subreddit_index* index, const char* prefix, size_t* first,
+                                 size_t* last);
+
+bool subreddit_index_contains(const struct subreddit_index* index, const char* name);
+
+// Merges names into the index and rewrites its file. Names that aren't valid subreddit names are skipped.
+bool subreddit_index_add(struct subreddit_index* index, const char* const* names, size_t count);
+
+typedef void (*subreddit_index_updated_callback)(void* user_data);
+
+// Like subreddit_index_add, plus the names of the list at import_path unless it is NULL, but the file is merged,
+// sorted and rewritten on a thread of its own. Names coming in while a rewrite runs, or shortly after one, are
+// batched into the next. The index takes in the new names on the main loop, and calls callback once it did. Names
+// still waiting are written when the index is freed.
+void subreddit_index_add_in_background(struct subreddit_index* index, const char* const* names, size_t count,
+                                       const char* import_path, subreddit_index_updated_callback callback,
+                                       void* user_data);
+
+// Adds the names of a text file with one subreddit per line. Leading "r/" and anything after the first comma or
+// whitespace are ignored, so CSV exports work as they are.
+bool subreddit_index_import(struct subreddit_index* index, const char* list_path);
+
+void free_subreddit_index(struct subreddit_index* index);
+
+#endif
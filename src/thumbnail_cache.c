@@ -0,0 +1,215 @@
+#include "thumbnail_cache.h"
+#include "memory.h"
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+
+// longest extension kept from the image URL, so that the file type stays recognizable, e.g. ".jpeg"
+static const size_t MAX_EXTENSION_SIZE = 5;
+
+struct thumbnail_entry {
+    char* name;
+    size_t size;
+    time_t used_at;
+    // lookups happen on every redraw, the file is only touched on the first one of a session
+    bool touched;
+};
+
+struct thumbnail_cache {
+    char* dir;
+    size_t max_bytes;
+    GMutex lock;
+    // most recently used first
+    GQueue order;
+    // file name to its link in order
+    GHashTable* links;
+    struct thumbnail_cache_stats stats;
+};
+
+// The URL's digest with the URL's extension, e.g. "3f78…a1.jpg".
+static char* entry_name(const char* url) {
+    char* digest = g_compute_checksum_for_string(G_CHECKSUM_SHA1, url, -1);
+    const char* path_end = url + strcspn(url, "?#");
+    const char* dot = NULL;
+    for (const char* p = url; p < path_end; p++) {
+        if (*p == '.')
+            dot = p;
+        else if (*p == '/')
+            dot = NULL;
+    }
+    bool keep = dot && (size_t)(path_end - dot) <= MAX_EXTENSION_SIZE;
+    for (const char* p = dot ? dot + 1 : path_end; keep && p < path_end; p++) {
+        keep = g_ascii_isalnum(*p);
+    }
+    char* extension = keep ? g_ascii_strdown(dot, path_end - dot) : g_strdup("");
+    char* name = g_strconcat(digest, extension, NULL);
+    g_free(extension);
+    g_free(digest);
+    return name;
+}
+
+static void free_thumbnail_entry(struct thumbnail_entry* entry) {
+    g_free(entry->name);
+    free(entry);
+}
+
+static gint compare_most_recent_first(gconstpointer a, gconstpointer b) {
+    time_t x = (*(struct thumbnail_entry* const*)a)->used_at;
+    time_t y = (*(struct thumbnail_entry* const*)b)->used_at;
+    return (x < y) - (x > y);
+}
+
+// Deletes the least recently used images until the cache fits, never keep.
+static void evict_until_fits(struct thumbnail_cache* cache, const struct thumbnail_entry* keep) {
+    while (cache->stats.bytes > cache->max_bytes && cache->order.tail && cache->order.tail->data != keep) {
+        GList* link = cache->order.tail;
+        struct thumbnail_entry* entry = link->data;
+        char* path = g_build_filename(cache->dir, entry->name, NULL);
+        if (g_remove(path) != 0)
+            fprintf(stderr, "Failed to delete cached thumbnail %s.\n", path);
+        g_free(path);
+        g_queue_unlink(&cache->order, link);
+        g_hash_table_remove(cache->links, entry->name);
+        cache->stats.bytes -= entry->size;
+        cache->stats.evicted++;
+        free_thumbnail_entry(entry);
+        g_list_free_1(link);
+    }
+    cache->stats.count = cache->order.length;
+}
+
+static void add_entry(struct thumbnail_cache* cache, struct thumbnail_entry* entry, bool most_recent) {
+    if (most_recent) {
+        g_queue_push_head(&cache->order, entry);
+        g_hash_table_insert(cache->links, entry->name, cache->order.head);
+    } else {
+        g_queue_push_tail(&cache->order, entry);
+        g_hash_table_insert(cache->links, entry->name, cache->order.tail);
+    }
+    cache->stats.bytes += entry->size;
+    cache->stats.count = cache->order.length;
+}
+
+static void load_entries(struct thumbnail_cache* cache) {
+    GDir* dir = g_dir_open(cache->dir, 0, NULL);
+    if (!dir)
+        return;
+    GPtrArray* found = g_ptr_array_new();
+    const char* name = NULL;
+    while ((name = g_dir_read_name(dir)) != NULL) {
+        char* path = g_build_filename(cache->dir, name, NULL);
+        GStatBuf st;
+        if (g_stat(path, &st) == 0 && S_ISREG(st.st_mode)) {
+            struct thumbnail_entry* entry = LOG_ERR_MALLOC(struct thumbnail_entry, 1);
+            *entry = (struct thumbnail_entry){
+                .name = g_strdup(name), .size = (size_t)st.st_size, .used_at = st.st_mtime, .touched = false};
+            g_ptr_array_add(found, entry);
+        }
+        g_free(path);
+    }
+    g_dir_close(dir);
+    g_ptr_array_sort(found, compare_most_recent_first);
+    for (guint i = 0; i < found->len; i++) {
+        add_entry(cache, g_ptr_array_index(found, i), false);
+    }
+    g_ptr_array_free(found, TRUE);
+}
+
+struct thumbnail_cache* new_thumbnail_cache(const char* dir, size_t max_bytes) {
+    if (g_mkdir_with_parents(dir, 0700) != 0) {
+        fprintf(stderr, "Failed to create thumbnail cache directory at %s.\n", dir);
+        return NULL;
+    }
+    struct thumbnail_cache* cache = LOG_ERR_MALLOC(struct thumbnail_cache, 1);
+    cache->dir = g_strdup(dir);
+    cache->max_bytes = max_bytes;
+    g_mutex_init(&cache->lock);
+    g_queue_init(&cache->order);
+    cache->links = g_hash_table_new(g_str_hash, g_str_equal);
+    cache->stats = (struct thumbnail_cache_stats){0};
+    load_entries(cache);
+    // max_bytes may have been lowered since the last session
+    evict_until_fits(cache, NULL);
+    return cache;
+}
+
+char* thumbnail_cache_lookup(struct thumbnail_cache* cache, const char* url) {
+    char* name = entry_name(url);
+    char* path = NULL;
+    g_mutex_lock(&cache->lock);
+    GList* link = g_hash_table_lookup(cache->links, name);
+    if (link) {
+        struct thumbnail_entry* entry = link->data;
+        g_queue_unlink(&cache->order, link);
+        g_queue_push_head_link(&cache->order, link);
+        path = g_build_filename(cache->dir, name, NULL);
+        if (!entry->touched) {
+            entry->touched = true;
+            entry->used_at = time(NULL);
+            g_utime(path, NULL);
+        }
+    }
+    g_mutex_unlock(&cache->lock);
+    g_free(name);
+    return path;
+}
+
+bool thumbnail_cache_store(struct thumbnail_cache* cache, const char* url, const char* data, size_t size) {
+    char* name = entry_name(url);
+    char* path = g_build_filename(cache->dir, name, NULL);
+    GError* error = NULL;
+    // written to a temporary file and renamed, so that rofi never loads half an image
+    bool written = g_file_set_contents(path, data, (gssize)size, &error);
+    if (!written) {
+        fprintf(stderr, "Failed to cache thumbnail of %s: %s\n", url, error->message);
+        g_error_free(error);
+        g_free(path);
+        g_free(name);
+        return false;
+    }
+    g_mutex_lock(&cache->lock);
+    GList* link = g_hash_table_lookup(cache->links, name);
+    struct thumbnail_entry* entry = NULL;
+    if (link) {
+        entry = link->data;
+        cache->stats.bytes -= entry->size;
+        cache->stats.bytes += size;
+        entry->size = size;
+        g_queue_unlink(&cache->order, link);
+        g_queue_push_head_link(&cache->order, link);
+        g_free(name);
+    } else {
+        entry = LOG_ERR_MALLOC(struct thumbnail_entry, 1);
+        *entry = (struct thumbnail_entry){.name = name, .size = size, .used_at = time(NULL), .touched = true};
+        add_entry(cache, entry, true);
+    }
+    evict_until_fits(cache, entry);
+    g_mutex_unlock(&cache->lock);
+    g_free(path);
+    return true;
+}
+
+struct thumbnail_cache_stats thumbnail_cache_stats(struct thumbnail_cache* cache) {
+    g_mutex_lock(&cache->lock);
+    struct thumbnail_cache_stats stats = cache->stats;
+    g_mutex_unlock(&cache->lock);
+    return stats;
+}
+
+void free_thumbnail_cache(struct thumbnail_cache* cache) {
+    if (!cache)
+        return;
+    g_hash_table_destroy(cache->links);
+    for (GList* link = cache->order.head; link; link = link->next) {
+        free_thumbnail_entry(link->data);
+    }
+    g_queue_clear(&cache->order);
+    g_mutex_clear(&cache->lock);
+    g_free(cache->dir);
+    free(cache);
+}
@@ -0,0 +1,33 @@
+#ifndef THUMBNAIL_CACHE_H
+#define THUMBNAIL_CACHE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+// Downloaded thumbnails, one file per image URL in a directory of their own. Once they take up more than max_bytes,
+// the least recently used ones are deleted. Use is tracked by modification time, so the order survives restarts. Safe
+// to use from several threads.
+struct thumbnail_cache;
+
+// Creates dir if needed and picks up the images earlier sessions left there.
+struct thumbnail_cache* new_thumbnail_cache(const char* dir, size_t max_bytes);
+
+// Path of the cached image of url, marking it as used. NULL if it isn't cached. Free with g_free.
+char* thumbnail_cache_lookup(struct thumbnail_cache* cache, const char* url);
+
+// Stores the image of url, then deletes the least recently used others until the cache fits again. Returns whether
+// it could be written.
+bool thumbnail_cache_store(struct thumbnail_cache* cache, const char* url, const char* data, size_t size);
+
+struct thumbnail_cache_stats {
+    size_t count;
+    size_t bytes;
+    // images deleted to make room since the cache was opened
+    size_t evicted;
+};
+
+struct thumbnail_cache_stats thumbnail_cache_stats(struct thumbnail_cache* cache);
+
+void free_thumbnail_cache(struct thumbnail_cache* cache);
+
+#endif
@@ -0,0 +1,167 @@
+#include "thumbnail_fetcher.h"
+#include "connection.h"
+#include "curl_wrappers.h"
+#include "memory.h"
+#include <curl/curl.h>
+#include <glib.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+// Reddit's thumbnails are 140 pixels wide and a few KiB, anything much larger is not a thumbnail
+static const size_t MAX_THUMBNAIL_SIZE = 1024 * 1024;
+// a download that trickles in would otherwise hold one of the few threads indefinitely
+static const long THUMBNAIL_TIMEOUT_MS = 10000L;
+
+enum thumbnail_state {
+    THUMBNAIL_QUEUED = 1,
+    THUMBNAIL_FAILED
+};
+
+struct thumbnail_fetcher {
+    const struct rofi_reddit_cfg* config;
+    struct thumbnail_cache* cache;
+    // images come from other hosts than the API, so they don't share the app's connections
+    struct connection_pool* connections;
+    GThreadPool* pool;
+    // URL to enum thumbnail_state, for URLs queued, in flight or failed. Only touched by the main thread.
+    GHashTable* states;
+    // orders the queue, only touched by the main thread
+    guint requests;
+    thumbnail_done_callback callback;
+    void* user_data;
+    gint refcount;
+    gint shutting_down;
+};
+
+struct thumbnail_job {
+    struct thumbnail_fetcher* fetcher;
+    char* url;
+    guint sequence;
+    bool cached;
+};
+
+static struct thumbnail_fetcher* ref_thumbnail_fetcher(struct thumbnail_fetcher* fetcher) {
+    g_atomic_int_inc(&fetcher->refcount);
+    return fetcher;
+}
+
+static void unref_thumbnail_fetcher(struct thumbnail_fetcher* fetcher) {
+    if (!g_atomic_int_dec_and_test(&fetcher->refcount))
+        return;
+    free_connection_pool(fetcher->connections);
+    g_hash_table_destroy(fetcher->states);
+    free(fetcher);
+}
+
+// Aborts the transfer once the image grows past MAX_THUMBNAIL_SIZE.
+static size_t write_thumbnail(char* buffer, size_t chunks, size_t chunk_size, void* stream) {
+    struct response_buffer* resp = (struct response_buffer*)stream;
+    if (resp->size + chunks * chunk_size > MAX_THUMBNAIL_SIZE)
+        return 0;
+    return write_to_response_buffer(buffer, chunks, chunk_size, stream);
+}
+
+static bool download_thumbnail(struct thumbnail_fetcher* fetcher, const char* url) {
+    CURL* client = curl_easy_init();
+    if (!client) {
+        fprintf(stderr, "Failed to initialize CURL.\n");
+        return false;
+    }
+    struct response_buffer* resp = new_response_buffer();
+    use_connection_pool(client, fetcher->connections);
+    curl_easy_setopt(client, CURLOPT_URL, url);
+    curl_easy_setopt(client, CURLOPT_WRITEFUNCTION, write_thumbnail);
+    curl_easy_setopt(client, CURLOPT_WRITEDATA, resp);
+    curl_easy_setopt(client, CURLOPT_USERAGENT, fetcher->config->auth->client_name);
+    curl_easy_setopt(client, CURLOPT_FOLLOWLOCATION, 1L);
+    curl_easy_setopt(client, CURLOPT_CONNECTTIMEOUT_MS, (long)fetcher->config->api.connect_timeout_ms);
+    curl_easy_setopt(client, CURLOPT_TIMEOUT_MS, THUMBNAIL_TIMEOUT_MS);
+    CURLcode result = curl_easy_perform(client);
+    long status = 0;
+    curl_easy_getinfo(client, CURLINFO_RESPONSE_CODE, &status);
+    bool cached = result == CURLE_OK && http_status_code_from(status) == HTTP_OK && resp->size > 0 &&
+                  thumbnail_cache_store(fetcher->cache, url, resp->buffer, resp->size);
+    if (!cached)
+        fprintf(stderr, "Failed to download thumbnail %s: %s, status %ld.\n", url, curl_easy_strerror(result), status);
+    free_response_buffer(resp);
+    curl_easy_cleanup(client);
+    return cached;
+}
+
+static gboolean deliver_thumbnail(gpointer data) {
+    struct thumbnail_job* job = (struct thumbnail_job*)data;
+    struct thumbnail_fetcher* fetcher = job->fetcher;
+    if (!g_atomic_int_get(&fetcher->shutting_down)) {
+        if (job->cached) {
+            g_hash_table_remove(fetcher->states, job->url);
+        } else {
+            g_hash_table_insert(fetcher->states, g_strdup(job->url), GINT_TO_POINTER(THUMBNAIL_FAILED));
+        }
+        fetcher->callback(job->url, job->cached, fetcher->user_data);
+    }
+    unref_thumbnail_fetcher(fetcher);
+    g_free(job->url);
+    free(job);
+    return G_SOURCE_REMOVE;
+}
+
+static void run_thumbnail_job(gpointer data, gpointer user_data) {
+    struct thumbnail_job* job = (struct thumbnail_job*)data;
+    if (!g_atomic_int_get(&job->fetcher->shutting_down))
+        job->cached = download_thumbnail(job->fetcher, job->url);
+    g_idle_add(deliver_thumbnail, job);
+}
+
+static gint compare_latest_first(gconstpointer a, gconstpointer b, gpointer user_data) {
+    guint x = ((const struct thumbnail_job*)a)->sequence;
+    guint y = ((const struct thumbnail_job*)b)->sequence;
+    return (x < y) - (x > y);
+}
+
+struct thumbnail_fetcher* new_thumbnail_fetcher(const struct rofi_reddit_cfg* config, struct thumbnail_cache* cache,
+                                                thumbnail_done_callback callback, void* user_data) {
+    struct thumbnail_fetcher* fetcher = LOG_ERR_MALLOC(struct thumbnail_fetcher, 1);
+    fetcher->config = config;
+    fetcher->cache = cache;
+    // downloads run on several threads at once
+    fetcher->connections = new_connection_pool(false);
+    fetcher->states = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+    fetcher->requests = 0;
+    fetcher->callback = callback;
+    fetcher->user_data = user_data;
+    fetcher->refcount = 1;
+    fetcher->shutting_down = false;
+    GError* error = NULL;
+    fetcher->pool =
+        g_thread_pool_new(run_thumbnail_job, fetcher, (gint)config->thumbnails.concurrent_downloads, FALSE, &error);
+    if (!fetcher->pool) {
+        fprintf(stderr, "Failed to start thumbnail downloads: %s\n", error->message);
+        g_error_free(error);
+        unref_thumbnail_fetcher(fetcher);
+        return NULL;
+    }
+    g_thread_pool_set_sort_function(fetcher->pool, compare_latest_first, NULL);
+    return fetcher;
+}
+
+void thumbnail_fetcher_request(struct thumbnail_fetcher* fetcher, const char* url) {
+    if (g_hash_table_contains(fetcher->states, url))
+        return;
+    g_hash_table_insert(fetcher->states, g_strdup(url), GINT_TO_POINTER(THUMBNAIL_QUEUED));
+    struct thumbnail_job* job = LOG_ERR_MALLOC(struct thumbnail_job, 1);
+    job->fetcher = ref_thumbnail_fetcher(fetcher);
+    job->url = g_strdup(url);
+    job->sequence = ++fetcher->requests;
+    job->cached = false;
+    g_thread_pool_push(fetcher->pool, job, NULL);
+}
+
+void free_thumbnail_fetcher(struct thumbnail_fetcher* fetcher) {
+    if (!fetcher)
+        return;
+    g_atomic_int_set(&fetcher->shutting_down, true);
+    // queued jobs still run (as no-ops) so that their idle callbacks release what they hold
+    g_thread_pool_free(fetcher->pool, FALSE, TRUE);
+    unref_thumbnail_fetcher(fetcher);
+}
@@ -0,0 +1,26 @@
+#ifndef THUMBNAIL_FETCHER_H
+#define THUMBNAIL_FETCHER_H
+
+#include "reddit.h"
+#include "thumbnail_cache.h"
+
+// Invoked on the GLib main loop once a thumbnail is in the cache, or couldn't be downloaded. Failed URLs are not
+// requested again for as long as the fetcher lives.
+typedef void (*thumbnail_done_callback)(const char* url, bool cached, void* user_data);
+
+// Downloads thumbnails into the cache on a few threads of its own, thumbnails.concurrent_downloads at most, so that
+// neither rows nor fetches of listings ever wait for an image.
+struct thumbnail_fetcher;
+
+// config must outlive the fetcher.
+struct thumbnail_fetcher* new_thumbnail_fetcher(const struct rofi_reddit_cfg* config, struct thumbnail_cache* cache,
+                                                thumbnail_done_callback callback, void* user_data);
+
+// Queues a download unless url is already queued, in flight or failed before. The latest requests are served first,
+// those are the rows on screen.
+void thumbnail_fetcher_request(struct thumbnail_fetcher* fetcher, const char* url);
+
+// Waits for the downloads in flight and drops the queued ones. Their callbacks are not invoked.
+void free_thumbnail_fetcher(struct thumbnail_fetcher* fetcher);
+
+#endif
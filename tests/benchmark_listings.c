@@ -0,0 +1,252 @@
+#include "curl_wrappers.h"
+#include "listing_stream.h"
+#include "listings_filter.h"
+#include "memory.h"
+#include "mock_reddit_server.h"
+#include "reddit.h"
+#include <glib.h>
+#include <jansson.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <time.h>
+
+// Every benchmark runs for at least this long and this many iterations, whichever takes more.
+static const double MIN_SECONDS = 0.5;
+static const size_t MIN_ITERATIONS = 5;
+static const size_t MAX_ITERATIONS = 2000;
+// what libcurl hands to its write callback at most per call (CURL_MAX_WRITE_SIZE)
+static const size_t CURL_CHUNK_SIZE = 16384;
+static const size_t LARGE_SELFTEXT_SIZE = 8192;
+
+static const size_t FIXTURE_CHILDREN[] = {15, 100, 1000, 10000};
+// Reddit serves at most 100 threads per request, so larger fixtures are only deserialized, never fetched
+static const size_t MAX_FETCHED_CHILDREN = 100;
+
+// Allocations made through jansson, which does most of them while deserializing.
+static size_t json_allocations = 0;
+
+static void* counting_malloc(size_t size) {
+    json_allocations++;
+    return malloc(size);
+}
+
+struct fixture {
+    char* name;
+    char* body;
+    size_t size;
+    size_t children;
+    // prepared up front for the benchmarks that start from parsed or deserialized threads
+    json_t* parsed;
+    struct listings* listings;
+    struct listings_filter* filter;
+};
+
+struct measurement {
+    double* samples;
+    size_t count;
+    size_t json_allocations;
+    struct arena_stats arena;
+};
+
+static double now_seconds(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (double)now.tv_sec + (double)now.tv_nsec / 1e9;
+}
+
+static long peak_rss_kib(void) {
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_maxrss;
+}
+
+static void check_listings(const struct fixture* fixture, const struct listings* listings) {
+    if (!listings || listings->count != fixture->children) {
+        fprintf(stderr, "Deserialized %zu of %zu children of %s.\n", listings ? listings->count : 0,
+                fixture->children, fixture->name);
+        exit(EXIT_FAILURE);
+    }
+}
+
+static struct fixture new_fixture(size_t children, bool large_selftext) {
+    struct fixture fixture = {
+        .name = g_strdup_printf("%zu children%s", children, large_selftext ? ", 8 KiB selftext" : ""),
+        .children = children};
+    fixture.body = mock_listings_json("linux", 0, children, large_selftext ? LARGE_SELFTEXT_SIZE : 0, "t3_p1",
+                                      &fixture.size);
+    fixture.parsed = json_loadb(fixture.body, fixture.size, 0, NULL);
+    struct response_buffer resp = {.buffer = fixture.body, .size = fixture.size};
+    fixture.listings = deserialize_listings(&resp);
+    check_listings(&fixture, fixture.listings);
+    fixture.filter = new_listings_filter(false);
+    listings_filter_add(fixture.filter, fixture.listings->items, fixture.listings->count);
+    return fixture;
+}
+
+static void free_fixture(struct fixture* fixture) {
+    free_listings_filter(fixture->filter);
+    free_listings(fixture->listings);
+    json_decref(fixture->parsed);
+    g_free(fixture->name);
+    g_free(fixture->body);
+}
+
+static int compare_doubles(const void* a, const void* b) {
+    double x = *(const double*)a;
+    double y = *(const double*)b;
+    return (x > y) - (x < y);
+}
+
+static double percentile(const struct measurement* measurement, double fraction) {
+    size_t rank = (size_t)(fraction * (double)(measurement->count - 1) + 0.5);
+    return measurement->samples[rank];
+}
+
+// Throughput is of the fixture's body, so that it compares across benchmarks of the same fixture.
+static void report(const char* benchmark, const struct fixture* fixture, struct measurement* measurement) {
+    qsort(measurement->samples, measurement->count, sizeof(double), compare_doubles);
+    double total = 0;
+    for (size_t i = 0; i < measurement->count; i++) {
+        total += measurement->samples[i];
+    }
+    double throughput = (double)fixture->size * (double)measurement->count / total / 1e6;
+    fprintf(stdout,
+            "%-22s %-34s %6zu runs %9.1f MB/s  p50 %9.3f ms  p99 %9.3f ms  %8zu json allocs  %4zu arena blocks "
+            "(%zu KiB)  peak RSS %ld KiB\n",
+            benchmark, fixture->name, measurement->count, throughput, percentile(measurement, 0.5) * 1e3,
+            percentile(measurement, 0.99) * 1e3, measurement->json_allocations, measurement->arena.allocations,
+            measurement->arena.bytes_allocated / 1024, peak_rss_kib());
+    free(measurement->samples);
+}
+
+typedef void (*benchmark_iteration)(const struct fixture* fixture, struct measurement* measurement);
+
+// Runs iteration until enough samples are in. Allocation counts are those of the last iteration.
+static void run_benchmark(const char* benchmark, const struct fixture* fixture, benchmark_iteration iteration) {
+    struct measurement measurement = {.samples = LOG_ERR_MALLOC(double, MAX_ITERATIONS), .count = 0};
+    double started = now_seconds();
+    while (measurement.count < MAX_ITERATIONS &&
+           (measurement.count < MIN_ITERATIONS || now_seconds() - started < MIN_SECONDS)) {
+        json_allocations = 0;
+        measurement.arena = (struct arena_stats){0};
+        double iteration_started = now_seconds();
+        iteration(fixture, &measurement);
+        measurement.samples[measurement.count++] = now_seconds() - iteration_started;
+        measurement.json_allocations = json_allocations;
+    }
+    report(benchmark, fixture, &measurement);
+}
+
+static void deserialize_whole_body(const struct fixture* fixture, struct measurement* measurement) {
+    struct response_buffer resp = {.buffer = fixture->body, .size = fixture->size};
+    struct listings* listings = deserialize_listings(&resp);
+    check_listings(fixture, listings);
+    measurement->arena = arena_stats(listings->arena);
+    free_listings(listings);
+}
+
+// What listings_write_callback does with a successful response as libcurl delivers it.
+static void stream_curl_chunks(const struct fixture* fixture, struct measurement* measurement) {
+    struct listing_stream* stream = new_listing_stream();
+    for (size_t offset = 0; offset < fixture->size; offset += CURL_CHUNK_SIZE) {
+        size_t remaining = fixture->size - offset;
+        listing_stream_feed(stream, fixture->body + offset, remaining < CURL_CHUNK_SIZE ? remaining : CURL_CHUNK_SIZE);
+    }
+    struct listings* listings = listing_stream_finish(stream);
+    free_listing_stream(stream);
+    check_listings(fixture, listings);
+    measurement->arena = arena_stats(listings->arena);
+    free_listings(listings);
+}
+
+// What the non-streaming path, e.g. for error bodies, does with the same chunks.
+static void buffer_curl_chunks(const struct fixture* fixture, struct measurement* measurement) {
+    struct response_buffer* resp = new_response_buffer();
+    for (size_t offset = 0; offset < fixture->size; offset += CURL_CHUNK_SIZE) {
+        size_t remaining = fixture->size - offset;
+        write_to_response_buffer(fixture->body + offset, 1, remaining < CURL_CHUNK_SIZE ? remaining : CURL_CHUNK_SIZE,
+                                 resp);
+    }
+    if (resp->size != fixture->size)
+        exit(EXIT_FAILURE);
+    free_response_buffer(resp);
+}
+
+// Converting already parsed children, i.e. deserialize_listings without json_loadb. The document is parsed once.
+static void deserialize_each_child(const struct fixture* fixture, struct measurement* measurement) {
+    json_t* children = json_object_get(json_object_get(fixture->parsed, "data"), "children");
+    size_t count = json_array_size(children);
+    struct listing* items = g_new0(struct listing, count);
+    struct arena* arena = new_arena();
+    for (size_t i = 0; i < count; i++) {
+        deserialize_listing(json_array_get(children, i), items, i, arena);
+    }
+    measurement->arena = arena_stats(arena);
+    free_arena(arena);
+    g_free(items);
+}
+
+// The whole of fetch_listings against the mock server on a loopback port, curl and HTTP parsing included.
+static RedditApp* fetch_app = NULL;
+static RedditAccessToken fetch_token = {0};
+
+static void fetch_over_loopback(const struct fixture* fixture, struct measurement* measurement) {
+    const struct reddit_api_response* response =
+        fetch_listings(fetch_app, &fetch_token, "linux", HOT_LISTINGS_SORT, NULL, NULL);
+    check_listings(fixture, response->listings);
+    measurement->arena = arena_stats(response->listings->arena);
+    free_listings(response->listings);
+    release_response_buffer(fetch_app->buffers, (struct response_buffer*)response->response_buffer);
+    free_reddit_api_response(response);
+}
+
+// Matching one typed word against every thread, which happens on each keystroke.
+static void filter_titles(const struct fixture* fixture, struct measurement* measurement) {
+    struct filter_query* query = new_filter_query("drivers 42", true);
+    size_t count = listings_filter_count(fixture->filter);
+    size_t matched = 0;
+    for (size_t i = 0; i < count; i++) {
+        matched += listings_filter_match(fixture->filter, i, query);
+    }
+    free_filter_query(query);
+    if (matched > count)
+        exit(EXIT_FAILURE);
+}
+
+int main(void) {
+    json_set_alloc_funcs(counting_malloc, free);
+    struct mock_reddit_options options = mock_reddit_default_options();
+    struct mock_reddit_server* server = new_mock_reddit_server(&options);
+    if (!server)
+        return EXIT_FAILURE;
+    char* cache_dir = g_dir_make_tmp("rofi-reddit-benchmark-XXXXXX", NULL);
+    fetch_app = new_reddit_app(new_mock_reddit_cfg(server, cache_dir));
+    fetch_token = (RedditAccessToken){.token = MOCK_REDDIT_ACCESS_TOKEN, .expires_at = time(NULL) + 3600};
+    fprintf(stdout, "Peak RSS before fixtures: %ld KiB\n", peak_rss_kib());
+    for (size_t i = 0; i < sizeof(FIXTURE_CHILDREN) / sizeof(FIXTURE_CHILDREN[0]); i++) {
+        for (int large_selftext = 0; large_selftext <= 1; large_selftext++) {
+            struct fixture fixture = new_fixture(FIXTURE_CHILDREN[i], large_selftext);
+            run_benchmark("deserialize_listings", &fixture, deserialize_whole_body);
+            run_benchmark("listing_stream", &fixture, stream_curl_chunks);
+            run_benchmark("write_to_response_buffer", &fixture, buffer_curl_chunks);
+            run_benchmark("deserialize_listing", &fixture, deserialize_each_child);
+            run_benchmark("listings_filter_match", &fixture, filter_titles);
+            if (fixture.children <= MAX_FETCHED_CHILDREN) {
+                options.selftext_size = large_selftext ? LARGE_SELFTEXT_SIZE : 0;
+                mock_reddit_server_set_options(server, &options);
+                fetch_app->config->listings.page_size = (int64_t)fixture.children;
+                run_benchmark("fetch_hot_listings", &fixture, fetch_over_loopback);
+            }
+            free_fixture(&fixture);
+        }
+    }
+    free_reddit_app(fetch_app);
+    free_mock_reddit_server(server);
+    remove(cache_dir);
+    g_free(cache_dir);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,156 @@
+#include "fetch_worker.h"
+#include "mock_reddit_server.h"
+#include "reddit.h"
+#include <glib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+// Every startup is a handful of requests to the mock server, each delayed like a round trip to Reddit.
+static const unsigned LATENCY_MS = 50;
+static const size_t RUNS = 15;
+
+static struct mock_reddit_server* server = NULL;
+static char* cache_dir = NULL;
+static char* listings_cache_dir = NULL;
+static bool token_cached = false;
+
+struct startup {
+    gint64 started;
+    gint64 ready_at;
+    gint64 listings_at;
+    bool failed;
+};
+
+struct column {
+    const char* name;
+    // milliseconds, one per run
+    double* samples;
+};
+
+// Stands in for load_rofi_reddit_cfg, which reads the installed config.
+static struct rofi_reddit_cfg* load_mock_cfg(void) {
+    struct rofi_reddit_cfg* cfg = new_mock_reddit_cfg(server, cache_dir);
+    cfg->paths->listings_cache_dir = g_strdup(listings_cache_dir);
+    cfg->paths->access_token_cache_exists = token_cached;
+    return cfg;
+}
+
+// Every run starts from the same cache: no listings, and a token only when token_cached.
+static void reset_cache(void) {
+    remove_files_in(listings_cache_dir);
+    remove_files_in(cache_dir);
+    if (!token_cached)
+        return;
+    char* token_path = g_build_filename(cache_dir, "access_token", NULL);
+    RedditAccessToken token = {.token = MOCK_REDDIT_ACCESS_TOKEN, .expires_at = time(NULL) + 3600};
+    write_access_token_cache(token_path, &token);
+    g_free(token_path);
+}
+
+static void on_ready(RedditApp* app, const char* error, void* user_data) {
+    struct startup* startup = (struct startup*)user_data;
+    startup->ready_at = g_get_monotonic_time();
+    startup->failed = startup->failed || !app;
+}
+
+static void on_fetched(struct fetch_result* result, void* user_data) {
+    struct startup* startup = (struct startup*)user_data;
+    startup->listings_at = g_get_monotonic_time();
+    startup->failed = startup->failed || result->access != SUBREDDIT_ACCESS_OK || !result->listings;
+    free_fetch_result(result);
+}
+
+// What rofi_reddit_mode_init used to do before returning: read the config, set up curl and obtain a token.
+static double synchronous_init_ms(void) {
+    gint64 started = g_get_monotonic_time();
+    RedditApp* app = new_reddit_app(load_mock_cfg());
+    RedditAccessToken* token = new_reddit_access_token(app);
+    double elapsed = (double)(g_get_monotonic_time() - started) / 1e3;
+    if (!token)
+        exit(EXIT_FAILURE);
+    free_reddit_access_token(token);
+    free_reddit_app(app);
+    return elapsed;
+}
+
+// What it does now, followed by typing a subreddit right away.
+static struct startup deferred_init(double* init_ms) {
+    struct startup startup = {.started = g_get_monotonic_time(), .ready_at = 0, .listings_at = 0, .failed = false};
+    struct fetch_worker* worker = new_fetch_worker(load_mock_cfg, on_ready, &startup);
+    *init_ms = (double)(g_get_monotonic_time() - startup.started) / 1e3;
+    fetch_worker_submit(worker, "linux", HOT_LISTINGS_SORT, on_fetched, &startup);
+    while (!startup.listings_at) {
+        g_main_context_iteration(NULL, TRUE);
+    }
+    free_fetch_worker(worker);
+    if (startup.failed)
+        exit(EXIT_FAILURE);
+    return startup;
+}
+
+static int compare_doubles(const void* a, const void* b) {
+    double x = *(const double*)a;
+    double y = *(const double*)b;
+    return (x > y) - (x < y);
+}
+
+static double percentile(const struct column* column, double fraction) {
+    size_t rank = (size_t)(fraction * (double)(RUNS - 1) + 0.5);
+    return column->samples[rank];
+}
+
+static void report(const char* scenario, struct column* column) {
+    qsort(column->samples, RUNS, sizeof(double), compare_doubles);
+    fprintf(stdout, "%-14s %-34s %3zu runs  p50 %9.3f ms  p99 %9.3f ms\n", scenario, column->name, RUNS,
+            percentile(column, 0.5), percentile(column, 0.99));
+}
+
+static void run_scenario(const char* scenario) {
+    struct column columns[] = {{.name = "init before (sync token)"},
+                               {.name = "init now (returns to rofi)"},
+                               {.name = "config read and app set up"},
+                               {.name = "first listings shown"}};
+    for (size_t i = 0; i < G_N_ELEMENTS(columns); i++) {
+        columns[i].samples = g_new0(double, RUNS);
+    }
+    for (size_t run = 0; run < RUNS; run++) {
+        reset_cache();
+        columns[0].samples[run] = synchronous_init_ms();
+        reset_cache();
+        struct startup startup = deferred_init(&columns[1].samples[run]);
+        columns[2].samples[run] = (double)(startup.ready_at - startup.started) / 1e3;
+        columns[3].samples[run] = (double)(startup.listings_at - startup.started) / 1e3;
+    }
+    for (size_t i = 0; i < G_N_ELEMENTS(columns); i++) {
+        report(scenario, &columns[i]);
+        g_free(columns[i].samples);
+    }
+}
+
+int main(void) {
+    struct mock_reddit_options options = mock_reddit_default_options();
+    options.latency_ms = LATENCY_MS;
+    server = new_mock_reddit_server(&options);
+    if (!server)
+        return EXIT_FAILURE;
+    cache_dir = g_dir_make_tmp("rofi-reddit-benchmark-XXXXXX", NULL);
+    listings_cache_dir = g_build_filename(cache_dir, "listings", NULL);
+    g_mkdir_with_parents(listings_cache_dir, 0700);
+
+    token_cached = true;
+    run_scenario("token cached");
+    token_cached = false;
+    run_scenario("token fetched");
+
+    remove_files_in(listings_cache_dir);
+    remove_files_in(cache_dir);
+    remove(listings_cache_dir);
+    remove(cache_dir);
+    g_free(listings_cache_dir);
+    g_free(cache_dir);
+    free_mock_reddit_server(server);
+    return EXIT_SUCCESS;
+}
@@ -11,8 +11,14 @@ RedditApp* fake_app() {
     auth->client_name = "lol";
     auth->client_id = "id";
     auth->client_secret = "sicrit";
+    config->api = (struct api_cfg){.auth_url = "https://www.reddit.com", .listings_url = "https://oauth.reddit.com"};
     app->config = config;
     app->http_client = curl_easy_init();
+    app->connections = NULL;
+    app->buffers = NULL;
+    app->timings = NULL;
+    app->search = NULL;
+    app->auth_unreachable = false;
     return app;
 }
 
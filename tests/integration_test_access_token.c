@@ -21,13 +21,15 @@ void test_hot_listings_fetch_end_to_end(void) {
     RedditApp* app = new_reddit_app(cfg);
 
     RedditAccessToken* token = new_reddit_access_token(app);
-    const struct reddit_api_response* response = fetch_hot_listings(app, token, "libertarian");
+    const struct reddit_api_response* response =
+        fetch_listings(app, token, "libertarian", HOT_LISTINGS_SORT, NULL, NULL);
     if (response->status_code != HTTP_OK) {
         fprintf(stdout, "Access token is invalid or expired. Trying to fetch new one.\n");
         fetch_and_cache_token(app);
     }
 
-    const struct listings* listings = deserialize_listings(response->response_buffer);
+    const struct listings* listings = response->listings;
+    TEST_ASSERT_NOT_NULL(listings);
     fprintf(stdout, "Fetched %zu threads from subreddit 'libertarian'.\n", listings->count);
     for (int i = 0; i < listings->count; i++) {
         char* title = listings->items[i].title;
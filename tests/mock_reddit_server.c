@@ -0,0 +1,719 @@
+#include "mock_reddit_server.h"
+#include "curl_wrappers.h"
+#include "memory.h"
+#include "reddit.h"
+#include <arpa/inet.h>
+#include <glib.h>
+#include <inttypes.h>
+#include <netinet/in.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+const char* const MOCK_REDDIT_ACCESS_TOKEN = "mock-access-token";
+
+static const size_t DEFAULT_LIMIT = 25;
+static const size_t MAX_LIMIT = 100;
+static const size_t MAX_REQUEST_HEAD_SIZE = 16384;
+// every top-level comment starts a chain of replies this many levels deep
+static const size_t MOCK_COMMENT_LEVELS = 3;
+static const char* const MOCK_SORTS[] = {"hot", "new", "rising", "top", "controversial"};
+static const char* const MOCK_TIME_RANGES[] = {"hour", "day", "week", "month", "year", "all"};
+// bandwidth is metered in slices of this fraction of a second
+static const size_t BANDWIDTH_SLICES_PER_SECOND = 20;
+
+struct mock_reddit_server {
+    int listener;
+    char* url;
+    GThread* acceptor;
+    GMutex lock;
+    struct mock_reddit_options options;
+    struct mock_reddit_stats stats;
+    // API requests counted against options.rate_limit
+    size_t rate_limit_used;
+    bool stopping;
+    // of the connection threads, and their sockets to shut down when stopping
+    GPtrArray* threads;
+    GArray* clients;
+};
+
+struct mock_request {
+    char method[8];
+    char path[512];
+    char* query;
+    char* authorization;
+    char* if_none_match;
+    char* accept_encoding;
+    size_t content_length;
+    // X-Ratelimit header lines of the response, NULL when options.rate_limit is 0
+    char* rate_limit_headers;
+};
+
+struct mock_reddit_options mock_reddit_default_options(void) {
+    return (struct mock_reddit_options){.latency_ms = 0,
+                                        .bandwidth = 0,
+                                        .token_status = HTTP_OK,
+                                        .token_expires_in = 86400,
+                                        .listings_status = HTTP_OK,
+                                        .failing_subreddit = NULL,
+                                        .reason = "private",
+                                        .selftext_size = 0,
+                                        .pages = 4,
+                                        .comments = 30,
+                                        .rate_limit = 0,
+                                        .rate_limit_reset = 600};
+}
+
+static void append_selftext(GString* body, size_t size) {
+    static const char* const PARAGRAPH = "Lorem ipsum dolor sit amet, \\\"consectetur\\\" adipiscing elit.\\n\\n"
+                                         "Sed do eiusmod tempor incididunt ut labore et dolore magna aliqua. ";
+    size_t start = body->len;
+    while (body->len - start < size) {
+        g_string_append(body, PARAGRAPH);
+    }
+}
+
+char* mock_listings_json(const char* subreddit, size_t first, size_t children, size_t selftext_size, const char* after,
+                         size_t* size) {
+    GString* body = g_string_new("{\"kind\": \"Listing\", \"data\": {\"after\": ");
+    if (after) {
+        g_string_append_printf(body, "\"%s\"", after);
+    } else {
+        g_string_append(body, "null");
+    }
+    g_string_append_printf(body, ", \"dist\": %zu, \"modhash\": \"\", \"geo_filter\": null, \"children\": [", children);
+    for (size_t i = first; i < first + children; i++) {
+        g_string_append_printf(
+            body, "%s{\"kind\": \"t3\", \"data\": {\"approved_at_utc\": null, \"subreddit\": \"%s\", \"selftext\": \"",
+            i > first ? ", " : "", subreddit);
+        append_selftext(body, selftext_size);
+        g_string_append_printf(
+            body,
+            "\", \"author_fullname\": \"t2_%zu\", \"title\": \"Thread number %zu about kernels, \\\"drivers\\\" and "
+            "caf\\u00e9s\", \"link_flair_richtext\": [{\"e\": \"text\", \"t\": \"Discussion\"}], \"ups\": %zu, "
+            "\"num_comments\": %zu, \"created_utc\": 1700000000.0, \"thumbnail\": \"self\", \"preview\": {\"images\": "
+            "[{\"source\": {\"url\": \"https://preview.redd.it/%zu.png\", \"width\": 640, \"height\": 480}, "
+            "\"resolutions\": [{\"url\": \"https://preview.redd.it/%zu-108.png\", \"width\": 108, \"height\": 81}], "
+            "\"id\": \"img%zu\"}], \"enabled\": false}, \"id\": \"%zx\", "
+            "\"permalink\": \"/r/%s/comments/%zx/thread_number_%zu/\", "
+            "\"url\": \"https://www.reddit.com/r/%s/comments/%zx/thread_number_%zu/\", \"stickied\": false}}",
+            i, i, i * 7 % 5000, i % 300, i, i, i, i, subreddit, i, i, subreddit, i, i);
+    }
+    g_string_append(body, "], \"before\": null}}");
+    *size = body->len;
+    return g_string_free(body, FALSE);
+}
+
+// "c4" for top-level comment 4, "c4r2" for the reply to its reply.
+static char* mock_comment_id(size_t top, size_t level) {
+    return level == 0 ? g_strdup_printf("c%zu", top) : g_strdup_printf("c%zur%zu", top, level);
+}
+
+// Appends the comment at level of the chain of top, or a "continue this thread" stub once level reaches depth. Replies
+// are nested inside it like in /comments responses, or left out like in /api/morechildren responses.
+static void append_mock_comment(GString* body, const char* article, size_t top, size_t level, size_t depth,
+                                bool nested) {
+    char* parent = level == 0 ? g_strdup_printf("t3_%s", article) : NULL;
+    if (!parent) {
+        char* parent_id = mock_comment_id(top, level - 1);
+        parent = g_strdup_printf("t1_%s", parent_id);
+        g_free(parent_id);
+    }
+    if (level >= depth) {
+        g_string_append_printf(body,
+                               "{\"kind\": \"more\", \"data\": {\"count\": 0, \"name\": \"t1__\", \"id\": \"_\", "
+                               "\"parent_id\": \"%s\", \"depth\": %zu, \"children\": []}}",
+                               parent, level);
+        g_free(parent);
+        return;
+    }
+    char* id = mock_comment_id(top, level);
+    g_string_append_printf(body,
+                           "{\"kind\": \"t1\", \"data\": {\"id\": \"%s\", \"name\": \"t1_%s\", \"parent_id\": \"%s\", "
+                           "\"author\": \"user%zu\", \"score\": %zu, \"depth\": %zu, \"body\": \"Comment %s\\nwith a "
+                           "second line\", \"permalink\": \"/r/mock/comments/%s/thread/%s/\", \"replies\": ",
+                           id, id, parent, top, top + level, level, id, article, id);
+    if (nested && level + 1 < MOCK_COMMENT_LEVELS) {
+        g_string_append(body, "{\"kind\": \"Listing\", \"data\": {\"children\": [");
+        append_mock_comment(body, article, top, level + 1, depth, true);
+        g_string_append(body, "]}}");
+    } else {
+        g_string_append(body, "\"\"");
+    }
+    g_string_append(body, "}}");
+    g_free(id);
+    g_free(parent);
+}
+
+char* mock_comments_json(const char* article, size_t comments, size_t limit, size_t depth, size_t* size) {
+    GString* body = g_string_new(NULL);
+    g_string_append_printf(body,
+                           "[{\"kind\": \"Listing\", \"data\": {\"children\": [{\"kind\": \"t3\", \"data\": "
+                           "{\"id\": \"%s\", \"title\": \"Thread %s\"}}]}}, {\"kind\": \"Listing\", \"data\": "
+                           "{\"children\": [",
+                           article, article);
+    size_t shown = comments < limit ? comments : limit;
+    for (size_t i = 0; i < shown; i++) {
+        if (i > 0)
+            g_string_append(body, ", ");
+        append_mock_comment(body, article, i, 0, depth, true);
+    }
+    if (comments > shown) {
+        g_string_append_printf(body,
+                               "%s{\"kind\": \"more\", \"data\": {\"count\": %zu, \"name\": \"t1_c%zu\", "
+                               "\"id\": \"c%zu\", \"parent_id\": \"t3_%s\", \"depth\": 0, \"children\": [",
+                               shown > 0 ? ", " : "", comments - shown, shown, shown, article);
+        for (size_t i = shown; i < comments; i++) {
+            g_string_append_printf(body, "%s\"c%zu\"", i > shown ? ", " : "", i);
+        }
+        g_string_append(body, "]}}");
+    }
+    g_string_append(body, "]}}]");
+    *size = body->len;
+    return g_string_free(body, FALSE);
+}
+
+char* mock_more_comments_json(const char* article, char** ids, size_t depth, size_t* size) {
+    GString* body = g_string_new("{\"json\": {\"errors\": [], \"data\": {\"things\": [");
+    bool first = true;
+    // every requested comment first, then all of their replies, the way Reddit doesn't keep them in reading order
+    for (size_t level = 0; level < MOCK_COMMENT_LEVELS && level <= depth; level++) {
+        for (size_t i = 0; ids[i]; i++) {
+            if (ids[i][0] != 'c')
+                continue;
+            if (!first)
+                g_string_append(body, ", ");
+            first = false;
+            append_mock_comment(body, article, (size_t)g_ascii_strtoull(ids[i] + 1, NULL, 10), level, depth, false);
+        }
+    }
+    g_string_append(body, "]}}}");
+    *size = body->len;
+    return g_string_free(body, FALSE);
+}
+
+static const char* reason_phrase(enum http_status_code status) {
+    switch (status) {
+    case HTTP_OK:
+        return "OK";
+    case HTTP_NOT_MODIFIED:
+        return "Not Modified";
+    case HTTP_BAD_REQUEST:
+        return "Bad Request";
+    case HTTP_UNAUTHORIZED:
+        return "Unauthorized";
+    case HTTP_FORBIDDEN:
+        return "Forbidden";
+    case HTTP_NOT_FOUND:
+        return "Not Found";
+    case HTTP_TOO_MANY_REQUESTS:
+        return "Too Many Requests";
+    default:
+        return "Error";
+    }
+}
+
+static bool send_all(int client, const char* data, size_t size) {
+    while (size > 0) {
+        ssize_t sent = send(client, data, size, MSG_NOSIGNAL);
+        if (sent <= 0)
+            return false;
+        data += sent;
+        size -= (size_t)sent;
+    }
+    return true;
+}
+
+static bool send_body(int client, const char* body, size_t size, size_t bandwidth) {
+    if (bandwidth == 0)
+        return send_all(client, body, size);
+    size_t slice = bandwidth / BANDWIDTH_SLICES_PER_SECOND > 0 ? bandwidth / BANDWIDTH_SLICES_PER_SECOND : 1;
+    for (size_t offset = 0; offset < size; offset += slice) {
+        size_t remaining = size - offset;
+        size_t slice_size = remaining < slice ? remaining : slice;
+        if (!send_all(client, body + offset, slice_size))
+            return false;
+        g_usleep((gulong)(slice_size * G_USEC_PER_SEC / bandwidth));
+    }
+    return true;
+}
+
+// headers are further header lines, each ending in "\r\n", or NULL.
+static bool respond(int client, enum http_status_code status, const char* headers, const char* body, size_t size,
+                    const struct mock_reddit_options* options) {
+    if (options->latency_ms > 0)
+        g_usleep((gulong)options->latency_ms * 1000);
+    char* head = g_strdup_printf("HTTP/1.1 %d %s\r\nContent-Type: application/json; charset=UTF-8\r\n"
+                                 "Content-Length: %zu\r\n%sConnection: keep-alive\r\n\r\n",
+                                 status, reason_phrase(status), size, headers ? headers : "");
+    bool sent = send_all(client, head, strlen(head)) && send_body(client, body, size, options->bandwidth);
+    g_free(head);
+    return sent;
+}
+
+static bool respond_error(int client, enum http_status_code status, const struct mock_reddit_options* options) {
+    char* body = status == HTTP_FORBIDDEN
+                     ? g_strdup_printf("{\"reason\": \"%s\", \"message\": \"%s\", \"error\": %d}", options->reason,
+                                       reason_phrase(status), status)
+                     : g_strdup_printf("{\"message\": \"%s\", \"error\": %d}", reason_phrase(status), status);
+    bool sent = respond(client, status, NULL, body, strlen(body), options);
+    g_free(body);
+    return sent;
+}
+
+static bool handle_token_request(struct mock_reddit_server* server, int client, const struct mock_request* request,
+                                 const struct mock_reddit_options* options) {
+    g_mutex_lock(&server->lock);
+    server->stats.token_requests++;
+    g_mutex_unlock(&server->lock);
+    if (strcmp(request->method, "POST") != 0)
+        return respond_error(client, HTTP_NOT_FOUND, options);
+    if (!request->authorization || !g_str_has_prefix(request->authorization, "Basic "))
+        return respond_error(client, HTTP_UNAUTHORIZED, options);
+    if (options->token_status != HTTP_OK)
+        return respond_error(client, options->token_status, options);
+    char* body = g_strdup_printf("{\"access_token\": \"%s\", \"token_type\": \"bearer\", \"expires_in\": %" PRId64
+                                 ", \"scope\": \"read\"}",
+                                 MOCK_REDDIT_ACCESS_TOKEN, options->token_expires_in);
+    bool sent = respond(client, HTTP_OK, NULL, body, strlen(body), options);
+    g_free(body);
+    return sent;
+}
+
+// Value of key in a query string like "limit=25&after=t3_p1", or NULL. Caller frees.
+static char* query_value(const char* query, const char* key) {
+    if (!query)
+        return NULL;
+    char** pairs = g_strsplit(query, "&", -1);
+    char* value = NULL;
+    size_t key_size = strlen(key);
+    for (size_t i = 0; pairs[i] && !value; i++) {
+        if (strncmp(pairs[i], key, key_size) == 0 && pairs[i][key_size] == '=')
+            value = g_uri_unescape_string(pairs[i] + key_size + 1, NULL);
+    }
+    g_strfreev(pairs);
+    return value;
+}
+
+static bool is_authorized(const struct mock_request* request) {
+    char* bearer = g_strdup_printf("Bearer %s", MOCK_REDDIT_ACCESS_TOKEN);
+    bool authorized = request->authorization && strcmp(request->authorization, bearer) == 0;
+    g_free(bearer);
+    return authorized;
+}
+
+// Position of value in values, count if it isn't one of them.
+static size_t index_of(const char* value, const char* const* values, size_t count) {
+    size_t i = 0;
+    while (i < count && (!value || strcmp(value, values[i]) != 0)) {
+        i++;
+    }
+    return i;
+}
+
+// Threads of every sort are numbered from a different first one, e.g. 32000 for top with t=week, 0 for hot. Returns
+// false for sorts and time ranges Reddit doesn't have.
+static bool first_of_sort(const struct mock_request* request, const char* sort, size_t* first) {
+    size_t sort_index = index_of(sort, MOCK_SORTS, G_N_ELEMENTS(MOCK_SORTS));
+    char* range = query_value(request->query, "t");
+    // Reddit ranks over a day when t is left out
+    size_t range_index = index_of(range ? range : "day", MOCK_TIME_RANGES, G_N_ELEMENTS(MOCK_TIME_RANGES));
+    bool ranked = strcmp(sort, "top") == 0 || strcmp(sort, "controversial") == 0;
+    g_free(range);
+    *first = 10000 * sort_index + (ranked ? 1000 * range_index : 0);
+    return sort_index < G_N_ELEMENTS(MOCK_SORTS) && range_index < G_N_ELEMENTS(MOCK_TIME_RANGES);
+}
+
+static bool handle_listings_request(struct mock_reddit_server* server, int client, const struct mock_request* request,
+                                    const char* subreddit, const char* sort,
+                                    const struct mock_reddit_options* options) {
+    g_mutex_lock(&server->lock);
+    server->stats.listings_requests++;
+    g_mutex_unlock(&server->lock);
+    if (!is_authorized(request))
+        return respond_error(client, HTTP_UNAUTHORIZED, options);
+    size_t first = 0;
+    if (!first_of_sort(request, sort, &first))
+        return respond_error(client, HTTP_BAD_REQUEST, options);
+    bool failing = !options->failing_subreddit || g_ascii_strcasecmp(options->failing_subreddit, subreddit) == 0;
+    if (failing && options->listings_status != HTTP_OK)
+        return respond_error(client, options->listings_status, options);
+
+    // cursors are "t3_p<page>", the page they lead to
+    char* after = query_value(request->query, "after");
+    size_t page = after && g_str_has_prefix(after, "t3_p") ? (size_t)g_ascii_strtoull(after + 4, NULL, 10) : 0;
+    g_free(after);
+    char* limit_value = query_value(request->query, "limit");
+    size_t limit = limit_value ? (size_t)g_ascii_strtoull(limit_value, NULL, 10) : DEFAULT_LIMIT;
+    g_free(limit_value);
+    if (limit == 0 || limit > MAX_LIMIT)
+        limit = DEFAULT_LIMIT;
+    if (page >= options->pages)
+        return respond_error(client, HTTP_NOT_FOUND, options);
+
+    char* etag = g_strdup_printf("\"%s-%zu-%zu-%zu-%zu\"", subreddit, first, page, limit, options->selftext_size);
+    char* headers =
+        g_strdup_printf("ETag: %s\r\n%s", etag, request->rate_limit_headers ? request->rate_limit_headers : "");
+    bool sent;
+    if (request->if_none_match && strcmp(request->if_none_match, etag) == 0) {
+        g_mutex_lock(&server->lock);
+        server->stats.not_modified++;
+        g_mutex_unlock(&server->lock);
+        sent = respond(client, HTTP_NOT_MODIFIED, headers, "", 0, options);
+    } else {
+        char* next = page + 1 < options->pages ? g_strdup_printf("t3_p%zu", page + 1) : NULL;
+        size_t size = 0;
+        char* body = mock_listings_json(subreddit, first + page * limit, limit, options->selftext_size, next, &size);
+        sent = respond(client, HTTP_OK, headers, body, size, options);
+        g_free(body);
+        g_free(next);
+    }
+    g_free(headers);
+    g_free(etag);
+    return sent;
+}
+
+static bool handle_thumbnail_request(struct mock_reddit_server* server, int client, const char* name,
+                                     const struct mock_reddit_options* options) {
+    g_mutex_lock(&server->lock);
+    server->stats.thumbnail_requests++;
+    g_mutex_unlock(&server->lock);
+    if (g_str_has_prefix(name, "missing"))
+        return respond_error(client, HTTP_NOT_FOUND, options);
+    char* body = mock_reddit_thumbnail(name);
+    bool sent = respond(client, HTTP_OK, NULL, body, strlen(body), options);
+    g_free(body);
+    return sent;
+}
+
+static size_t query_size_or(const char* query, const char* key, size_t default_value) {
+    char* value = query_value(query, key);
+    size_t parsed = value ? (size_t)g_ascii_strtoull(value, NULL, 10) : default_value;
+    g_free(value);
+    return parsed;
+}
+
+static bool handle_comments_request(struct mock_reddit_server* server, int client, const struct mock_request* request,
+                                    const char* article, const struct mock_reddit_options* options) {
+    g_mutex_lock(&server->lock);
+    server->stats.comments_requests++;
+    g_mutex_unlock(&server->lock);
+    if (!is_authorized(request))
+        return respond_error(client, HTTP_UNAUTHORIZED, options);
+    size_t size = 0;
+    char* body = mock_comments_json(article, options->comments, query_size_or(request->query, "limit", 200),
+                                    query_size_or(request->query, "depth", MOCK_COMMENT_LEVELS), &size);
+    bool sent = respond(client, HTTP_OK, request->rate_limit_headers, body, size, options);
+    g_free(body);
+    return sent;
+}
+
+static bool handle_more_comments_request(struct mock_reddit_server* server, int client,
+                                         const struct mock_request* request,
+                                         const struct mock_reddit_options* options) {
+    char* link_id = query_value(request->query, "link_id");
+    char* children = query_value(request->query, "children");
+    char** ids = g_strsplit(children ? children : "", ",", -1);
+    g_mutex_lock(&server->lock);
+    server->stats.more_comments_requests++;
+    server->stats.more_comments_ids += g_strv_length(ids);
+    g_mutex_unlock(&server->lock);
+    bool sent;
+    if (!is_authorized(request)) {
+        sent = respond_error(client, HTTP_UNAUTHORIZED, options);
+    } else if (!link_id || !g_str_has_prefix(link_id, "t3_") || !children) {
+        sent = respond_error(client, HTTP_BAD_REQUEST, options);
+    } else {
+        size_t size = 0;
+        char* body = mock_more_comments_json(link_id + strlen("t3_"), ids,
+                                             query_size_or(request->query, "depth", MOCK_COMMENT_LEVELS), &size);
+        sent = respond(client, HTTP_OK, request->rate_limit_headers, body, size, options);
+        g_free(body);
+    }
+    g_strfreev(ids);
+    g_free(children);
+    g_free(link_id);
+    return sent;
+}
+
+// Counts an API request against the rate limit and sets the headers announcing what is left of it. Returns false once
+// the limit is used up.
+static bool count_rate_limited_request(struct mock_reddit_server* server, struct mock_request* request,
+                                       const struct mock_reddit_options* options) {
+    if (options->rate_limit == 0)
+        return true;
+    g_mutex_lock(&server->lock);
+    size_t used = ++server->rate_limit_used;
+    bool allowed = used <= options->rate_limit;
+    if (!allowed)
+        server->stats.rate_limited++;
+    g_mutex_unlock(&server->lock);
+    request->rate_limit_headers = g_strdup_printf("X-Ratelimit-Used: %zu\r\nX-Ratelimit-Remaining: %zu.0\r\n"
+                                                  "X-Ratelimit-Reset: %" PRId64 "\r\n",
+                                                  used, allowed ? options->rate_limit - used : 0,
+                                                  options->rate_limit_reset);
+    return allowed;
+}
+
+static bool handle_request(struct mock_reddit_server* server, int client, struct mock_request* request) {
+    g_mutex_lock(&server->lock);
+    struct mock_reddit_options options = server->options;
+    // bodies are always sent as they are, compression is only recorded as offered
+    if (request->accept_encoding && strstr(request->accept_encoding, "gzip"))
+        server->stats.gzip_offered++;
+    g_mutex_unlock(&server->lock);
+    const char* path = request->path;
+    if (strcmp(path, "/api/v1/access_token") == 0 || strcmp(path, "/api/v1/access_token/") == 0)
+        return handle_token_request(server, client, request, &options);
+    if (g_str_has_prefix(path, "/thumbs/") && strcmp(request->method, "GET") == 0)
+        return handle_thumbnail_request(server, client, path + strlen("/thumbs/"), &options);
+    if (!count_rate_limited_request(server, request, &options)) {
+        const char* body = "{\"message\": \"Too Many Requests\", \"error\": 429}";
+        return respond(client, HTTP_TOO_MANY_REQUESTS, request->rate_limit_headers, body, strlen(body), &options);
+    }
+    if (strcmp(path, "/api/morechildren") == 0 && strcmp(request->method, "GET") == 0)
+        return handle_more_comments_request(server, client, request, &options);
+    char** segments = g_strsplit(path, "/", -1);
+    // "/comments/<article>" or "/comments/<article>/"
+    if (g_strv_length(segments) >= 3 && strcmp(segments[1], "comments") == 0 && segments[2][0] != '\0' &&
+        (!segments[3] || (segments[3][0] == '\0' && !segments[4]))) {
+        bool sent = handle_comments_request(server, client, request, segments[2], &options);
+        g_strfreev(segments);
+        return sent;
+    }
+    // "/r/<subreddit>/<sort>" or "/r/<subreddit>/<sort>/", e.g. "/r/linux/hot"
+    bool listings = g_strv_length(segments) >= 4 && strcmp(segments[1], "r") == 0 && segments[2][0] != '\0' &&
+                    segments[3][0] != '\0' && (!segments[4] || (segments[4][0] == '\0' && !segments[5]));
+    bool sent = listings ? handle_listings_request(server, client, request, segments[2], segments[3], &options)
+                         : respond_error(client, HTTP_NOT_FOUND, &options);
+    g_strfreev(segments);
+    return sent;
+}
+
+static void free_mock_request(struct mock_request* request) {
+    g_free(request->query);
+    g_free(request->authorization);
+    g_free(request->if_none_match);
+    g_free(request->accept_encoding);
+    g_free(request->rate_limit_headers);
+}
+
+// Parses the request line and the headers the endpoints care about out of head, which ends in a blank line.
+static bool parse_request(const char* head, struct mock_request* request) {
+    *request = (struct mock_request){0};
+    char** lines = g_strsplit(head, "\r\n", -1);
+    char target[sizeof(request->path)] = "";
+    bool parsed = lines[0] && sscanf(lines[0], "%7s %511s HTTP/1.1", request->method, target) == 2;
+    char* query = strchr(target, '?');
+    if (query) {
+        request->query = g_strdup(query + 1);
+        *query = '\0';
+    }
+    g_strlcpy(request->path, target, sizeof(request->path));
+    for (size_t i = 1; parsed && lines[i] && lines[i][0] != '\0'; i++) {
+        char* colon = strchr(lines[i], ':');
+        if (!colon)
+            continue;
+        *colon = '\0';
+        const char* value = g_strstrip(colon + 1);
+        if (g_ascii_strcasecmp(lines[i], "Authorization") == 0) {
+            request->authorization = g_strdup(value);
+        } else if (g_ascii_strcasecmp(lines[i], "If-None-Match") == 0) {
+            request->if_none_match = g_strdup(value);
+        } else if (g_ascii_strcasecmp(lines[i], "Accept-Encoding") == 0) {
+            request->accept_encoding = g_strdup(value);
+        } else if (g_ascii_strcasecmp(lines[i], "Content-Length") == 0) {
+            request->content_length = (size_t)g_ascii_strtoull(value, NULL, 10);
+        }
+    }
+    g_strfreev(lines);
+    return parsed;
+}
+
+struct mock_connection {
+    struct mock_reddit_server* server;
+    int client;
+};
+
+// Serves the requests of one keep-alive connection until the client closes it.
+static gpointer serve_connection(gpointer data) {
+    struct mock_connection* connection = data;
+    GString* received = g_string_new(NULL);
+    char chunk[4096];
+    bool open = true;
+    while (open) {
+        char* head_end = strstr(received->str, "\r\n\r\n");
+        if (!head_end) {
+            // a head this long is not one of ours, so the connection is dropped
+            ssize_t size =
+                received->len < MAX_REQUEST_HEAD_SIZE ? recv(connection->client, chunk, sizeof(chunk), 0) : 0;
+            open = size > 0;
+            if (open)
+                g_string_append_len(received, chunk, size);
+            continue;
+        }
+        size_t head_size = (size_t)(head_end - received->str) + 4;
+        char* head = g_strndup(received->str, head_size);
+        struct mock_request request;
+        open = parse_request(head, &request);
+        g_free(head);
+        // the token request's form body is not looked at
+        while (open && received->len < head_size + request.content_length) {
+            ssize_t size = recv(connection->client, chunk, sizeof(chunk), 0);
+            open = size > 0;
+            if (open)
+                g_string_append_len(received, chunk, size);
+        }
+        if (open) {
+            g_string_erase(received, 0, (gssize)(head_size + request.content_length));
+            open = handle_request(connection->server, connection->client, &request);
+        }
+        free_mock_request(&request);
+    }
+    g_string_free(received, TRUE);
+    struct mock_reddit_server* server = connection->server;
+    g_mutex_lock(&server->lock);
+    // so that stopping doesn't shut down a socket that reused the number
+    for (guint i = 0; i < server->clients->len; i++) {
+        if (g_array_index(server->clients, int, i) == connection->client)
+            g_array_index(server->clients, int, i) = -1;
+    }
+    close(connection->client);
+    g_mutex_unlock(&server->lock);
+    g_free(connection);
+    return NULL;
+}
+
+static gpointer accept_connections(gpointer data) {
+    struct mock_reddit_server* server = data;
+    while (true) {
+        int client = accept(server->listener, NULL, NULL);
+        g_mutex_lock(&server->lock);
+        if (client < 0 || server->stopping) {
+            g_mutex_unlock(&server->lock);
+            if (client >= 0)
+                close(client);
+            break;
+        }
+        server->stats.connections++;
+        struct mock_connection* connection = g_new(struct mock_connection, 1);
+        *connection = (struct mock_connection){.server = server, .client = client};
+        g_array_append_val(server->clients, client);
+        g_ptr_array_add(server->threads, g_thread_new("mock-reddit-connection", serve_connection, connection));
+        g_mutex_unlock(&server->lock);
+    }
+    return NULL;
+}
+
+struct mock_reddit_server* new_mock_reddit_server(const struct mock_reddit_options* options) {
+    int listener = socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in address = {.sin_family = AF_INET, .sin_port = 0, .sin_addr.s_addr = htonl(INADDR_LOOPBACK)};
+    socklen_t address_size = sizeof(address);
+    if (listener < 0 || bind(listener, (struct sockaddr*)&address, sizeof(address)) != 0 || listen(listener, 64) != 0 ||
+        getsockname(listener, (struct sockaddr*)&address, &address_size) != 0) {
+        perror("Failed to start mock Reddit server");
+        if (listener >= 0)
+            close(listener);
+        return NULL;
+    }
+    struct mock_reddit_server* server = g_new0(struct mock_reddit_server, 1);
+    server->listener = listener;
+    server->url = g_strdup_printf("http://127.0.0.1:%u", ntohs(address.sin_port));
+    g_mutex_init(&server->lock);
+    server->options = *options;
+    server->threads = g_ptr_array_new();
+    server->clients = g_array_new(FALSE, FALSE, sizeof(int));
+    server->acceptor = g_thread_new("mock-reddit-acceptor", accept_connections, server);
+    return server;
+}
+
+const char* mock_reddit_server_url(const struct mock_reddit_server* server) {
+    return server->url;
+}
+
+char* mock_reddit_thumbnail_url(const struct mock_reddit_server* server, const char* name) {
+    return g_strdup_printf("%s/thumbs/%s", server->url, name);
+}
+
+char* mock_reddit_thumbnail(const char* name) {
+    return g_strdup_printf("\x89PNG mock thumbnail %s", name);
+}
+
+void mock_reddit_server_set_options(struct mock_reddit_server* server, const struct mock_reddit_options* options) {
+    g_mutex_lock(&server->lock);
+    server->options = *options;
+    g_mutex_unlock(&server->lock);
+}
+
+struct mock_reddit_stats mock_reddit_server_stats(struct mock_reddit_server* server) {
+    g_mutex_lock(&server->lock);
+    struct mock_reddit_stats stats = server->stats;
+    g_mutex_unlock(&server->lock);
+    return stats;
+}
+
+void free_mock_reddit_server(struct mock_reddit_server* server) {
+    if (!server)
+        return;
+    g_mutex_lock(&server->lock);
+    server->stopping = true;
+    // wakes up accept and every recv, connections still pooled by curl included
+    shutdown(server->listener, SHUT_RDWR);
+    for (guint i = 0; i < server->clients->len; i++) {
+        int client = g_array_index(server->clients, int, i);
+        if (client >= 0)
+            shutdown(client, SHUT_RDWR);
+    }
+    g_mutex_unlock(&server->lock);
+    g_thread_join(server->acceptor);
+    for (guint i = 0; i < server->threads->len; i++) {
+        g_thread_join(g_ptr_array_index(server->threads, i));
+    }
+    close(server->listener);
+    g_ptr_array_free(server->threads, TRUE);
+    g_array_free(server->clients, TRUE);
+    g_mutex_clear(&server->lock);
+    g_free(server->url);
+    g_free(server);
+}
+
+struct rofi_reddit_cfg* new_mock_reddit_cfg(const struct mock_reddit_server* server, const char* cache_dir) {
+    struct rofi_reddit_cfg* cfg = LOG_ERR_MALLOC(struct rofi_reddit_cfg, 1);
+    *cfg = (struct rofi_reddit_cfg){0};
+    cfg->auth = LOG_ERR_MALLOC(struct app_auth, 1);
+    cfg->auth->client_name = strdup("rofi-reddit-test");
+    cfg->auth->client_id = strdup("id");
+    cfg->auth->client_secret = strdup("sicrit");
+    cfg->api = (struct api_cfg){
+        .auth_url = g_strdup(server->url), .listings_url = g_strdup(server->url), .connect_timeout_ms = 1000};
+    cfg->listings = (struct listings_cfg){.merge_order = LISTINGS_MERGE_HOT,
+                                          .page_size = 25,
+                                          .prefetch_rows = 10,
+                                          .sorts = g_strsplit("hot,new,top:week", ",", -1),
+                                          .sort_count = 3,
+                                          .prefetch_sorts = true};
+    cfg->thumbnails = (struct thumbnails_cfg){.show = true, .cache_size_mb = 1, .concurrent_downloads = 2};
+    cfg->comments = (struct comments_cfg){.limit = 10, .depth = 2};
+    cfg->paths = LOG_ERR_MALLOC(struct rofi_reddit_paths, 1);
+    *cfg->paths = (struct rofi_reddit_paths){0};
+    cfg->paths->access_token_cache_path = g_build_filename(cache_dir, "access_token", NULL);
+    return cfg;
+}
+
+void remove_files_in(const char* dir) {
+    GDir* handle = g_dir_open(dir, 0, NULL);
+    const char* name = NULL;
+    while (handle && (name = g_dir_read_name(handle)) != NULL) {
+        char* path = g_build_filename(dir, name, NULL);
+        // directories nested in it, like the listings cache in the cache directory, are left to the caller
+        if (!g_file_test(path, G_FILE_TEST_IS_DIR))
+            remove(path);
+        g_free(path);
+    }
+    if (handle)
+        g_dir_close(handle);
+}
@@ -0,0 +1,102 @@
+#ifndef MOCK_REDDIT_SERVER_H
+#define MOCK_REDDIT_SERVER_H
+
+#include "curl_wrappers.h"
+#include "reddit.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Stand-in for the Reddit endpoints the plugin uses and for the host thumbnails come from, listening on a loopback
+// port, so that the real curl paths can be tested and benchmarked offline. Point api_cfg's auth_url and listings_url at
+// mock_reddit_server_url.
+struct mock_reddit_server;
+
+struct mock_reddit_options {
+    // delay before every response
+    unsigned latency_ms;
+    // body bytes sent per second, 0 for as fast as the socket takes them
+    size_t bandwidth;
+    // status of POST /api/v1/access_token
+    enum http_status_code token_status;
+    int64_t token_expires_in;
+    // status of GET /r/<subreddit>/<sort>, for every subreddit or only failing_subreddit when set
+    enum http_status_code listings_status;
+    const char* failing_subreddit;
+    // "reason" of 403 bodies, e.g. "private" or "quarantined"
+    const char* reason;
+    // bytes of selftext per thread, 0 for link posts
+    size_t selftext_size;
+    // pages each subreddit has before the after cursor runs out
+    size_t pages;
+    // top-level comments of every thread, each with a chain of two replies
+    size_t comments;
+    // listings and comments requests answered before every further one gets a 429, counted from the server's start.
+    // Responses announce what is left in X-Ratelimit headers, which are left out when this is 0.
+    size_t rate_limit;
+    // announced as X-Ratelimit-Reset, the window never actually ends
+    int64_t rate_limit_reset;
+};
+
+// Answers with 200s, full pages of link posts and no delay.
+struct mock_reddit_options mock_reddit_default_options(void);
+
+// The bearer token handed out by the token endpoint and expected by the listings endpoint.
+extern const char* const MOCK_REDDIT_ACCESS_TOKEN;
+
+struct mock_reddit_server* new_mock_reddit_server(const struct mock_reddit_options* options);
+
+// e.g. "http://127.0.0.1:40211"
+const char* mock_reddit_server_url(const struct mock_reddit_server* server);
+
+// Where GET /thumbs/<name> answers with the bytes of mock_reddit_thumbnail(name), or a 404 for names starting with
+// "missing". Caller frees.
+char* mock_reddit_thumbnail_url(const struct mock_reddit_server* server, const char* name);
+
+// Stand-in image data, different for every name. Caller frees.
+char* mock_reddit_thumbnail(const char* name);
+
+// Applies to requests received from now on.
+void mock_reddit_server_set_options(struct mock_reddit_server* server, const struct mock_reddit_options* options);
+
+struct mock_reddit_stats {
+    size_t connections;
+    size_t token_requests;
+    size_t listings_requests;
+    size_t not_modified;
+    // requests whose Accept-Encoding included gzip
+    size_t gzip_offered;
+    size_t thumbnail_requests;
+    size_t comments_requests;
+    size_t more_comments_requests;
+    // comment ids asked for across every morechildren request
+    size_t more_comments_ids;
+    // requests answered with a 429
+    size_t rate_limited;
+};
+
+struct mock_reddit_stats mock_reddit_server_stats(struct mock_reddit_server* server);
+
+void free_mock_reddit_server(struct mock_reddit_server* server);
+
+// Config of an app talking to server, with 25 threads per page and the sorts hot, new and top:week. The access token is
+// cached in cache_dir.
+struct rofi_reddit_cfg* new_mock_reddit_cfg(const struct mock_reddit_server* server, const char* cache_dir);
+
+// Removes the files directly in dir, e.g. the caches a test wrote to, so that dir itself can be removed.
+void remove_files_in(const char* dir);
+
+// A hot listing shaped like Reddit's, with threads of subreddit numbered from first and a "data.after" cursor unless
+// after is NULL. Also used by the benchmarks as a fixture. Caller frees.
+char* mock_listings_json(const char* subreddit, size_t first, size_t children, size_t selftext_size, const char* after,
+                         size_t* size);
+
+// Response of /comments/<article> with limit of its top-level comments, and a row of hidden comments for the others.
+// Replies nested depth levels deep or more are cut off like Reddit does. Caller frees.
+char* mock_comments_json(const char* article, size_t comments, size_t limit, size_t depth, size_t* size);
+
+// Response of /api/morechildren for the comments with the given ids, like "c31", and their replies, listed flat with
+// every top-level comment before any reply. ids is NULL terminated. Caller frees.
+char* mock_more_comments_json(const char* article, char** ids, size_t depth, size_t* size);
+
+#endif
@@ -0,0 +1,56 @@
+#include "reddit.h"
+#include "unity.h"
+#include <glib.h>
+#include <stdlib.h>
+#include <time.h>
+
+static char* cache_dir;
+static char* cache_path;
+
+void setUp(void) {
+    cache_dir = g_dir_make_tmp("rofi-reddit-test-XXXXXX", NULL);
+    cache_path = g_build_filename(cache_dir, "access_token", NULL);
+}
+
+void tearDown(void) {
+    remove(cache_path);
+    remove(cache_dir);
+    g_free(cache_path);
+    g_free(cache_dir);
+}
+
+void test_miss(void) {
+    TEST_ASSERT_NULL(read_access_token_cache(cache_path));
+}
+
+void test_round_trip(void) {
+    RedditAccessToken token = {.token = "the reddit app token", .expires_at = time(NULL) + 3600};
+    TEST_ASSERT_TRUE(write_access_token_cache(cache_path, &token));
+
+    RedditAccessToken* cached = read_access_token_cache(cache_path);
+    TEST_ASSERT_NOT_NULL(cached);
+    TEST_ASSERT_EQUAL_STRING(token.token, cached->token);
+    TEST_ASSERT_EQUAL_INT64((int64_t)token.expires_at, (int64_t)cached->expires_at);
+    TEST_ASSERT_TRUE(access_token_refresh_in(cached) > 0);
+    free_reddit_access_token(cached);
+}
+
+void test_bare_token_is_a_miss(void) {
+    // the layout used before expiries were tracked
+    TEST_ASSERT_TRUE(g_file_set_contents(cache_path, "the reddit app token", -1, NULL));
+    TEST_ASSERT_NULL(read_access_token_cache(cache_path));
+}
+
+void test_refresh_is_due_before_expiry(void) {
+    RedditAccessToken token = {.token = "the reddit app token", .expires_at = time(NULL) + 60};
+    TEST_ASSERT_TRUE(access_token_refresh_in(&token) <= 0);
+}
+
+int main(void) {
+    UNITY_BEGIN();
+    RUN_TEST(test_miss);
+    RUN_TEST(test_round_trip);
+    RUN_TEST(test_bare_token_is_a_miss);
+    RUN_TEST(test_refresh_is_due_before_expiry);
+    return UNITY_END();
+}
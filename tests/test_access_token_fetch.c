@@ -22,7 +22,7 @@ void tearDown(void) {
 // in CMock's curl config). Would be good to find another way.
 
 void test_happy_path(void) {
-    new_response_buffer_ExpectAndReturn(some_response);
+    acquire_response_buffer_ExpectAndReturn(app->buffers, some_response);
 
     curl_easy_reset_Expect(app->http_client);
     curl_easy_perform_ExpectAndReturn(app->http_client, CURLE_OK);
@@ -37,7 +37,7 @@ void test_happy_path(void) {
 }
 
 void test_fetch_reddit_access_token_non_200_response_status(void) {
-    new_response_buffer_ExpectAndReturn(some_response);
+    acquire_response_buffer_ExpectAndReturn(app->buffers, some_response);
     curl_easy_reset_Expect(app->http_client);
 
     curl_easy_perform_ExpectAndReturn(app->http_client, CURLE_OK);
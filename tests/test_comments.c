@@ -0,0 +1,159 @@
+#include "comments.h"
+#include "curl_wrappers.h"
+#include "mock_reddit_server.h"
+#include "unity.h"
+#include <glib.h>
+#include <stdlib.h>
+#include <string.h>
+
+static struct response_buffer* buffer_of(char* json, size_t size) {
+    struct response_buffer* resp = new_response_buffer();
+    write_to_response_buffer(json, 1, size, resp);
+    g_free(json);
+    return resp;
+}
+
+static struct comment_thread* thread_of(size_t comments, size_t limit, size_t depth) {
+    size_t size = 0;
+    struct response_buffer* resp = buffer_of(mock_comments_json("abc", comments, limit, depth, &size), size);
+    struct comment_thread* thread = deserialize_comment_thread(resp, "abc");
+    free_response_buffer(resp);
+    TEST_ASSERT_NOT_NULL(thread);
+    return thread;
+}
+
+static struct comment_thread* more_comments_of(const char* ids, size_t depth, uint32_t row_depth) {
+    char** split = g_strsplit(ids, ",", -1);
+    size_t size = 0;
+    struct response_buffer* resp = buffer_of(mock_more_comments_json("abc", split, depth, &size), size);
+    struct comment_thread* loaded = deserialize_more_comments(resp, "abc", row_depth);
+    free_response_buffer(resp);
+    g_strfreev(split);
+    TEST_ASSERT_NOT_NULL(loaded);
+    return loaded;
+}
+
+static void assert_comment(const struct comment_thread* thread, size_t index, const char* id, uint32_t depth) {
+    TEST_ASSERT_TRUE(index < thread->count);
+    const struct comment* row = &thread->items[index];
+    TEST_ASSERT_FALSE(row->is_more);
+    TEST_ASSERT_EQUAL_STRING(id, row->id);
+    TEST_ASSERT_EQUAL_UINT32(depth, row->depth);
+}
+
+void setUp(void) {
+}
+
+void tearDown(void) {
+}
+
+void test_replies_follow_their_comment(void) {
+    struct comment_thread* thread = thread_of(2, 10, 10);
+    TEST_ASSERT_EQUAL_size_t(6, thread->count);
+    assert_comment(thread, 0, "c0", 0);
+    assert_comment(thread, 1, "c0r1", 1);
+    assert_comment(thread, 2, "c0r2", 2);
+    assert_comment(thread, 3, "c1", 0);
+    assert_comment(thread, 4, "c1r1", 1);
+    assert_comment(thread, 5, "c1r2", 2);
+    TEST_ASSERT_EQUAL_STRING("user1", thread->items[3].author);
+    TEST_ASSERT_EQUAL_STRING("Comment c1\nwith a second line", thread->items[3].body);
+    TEST_ASSERT_EQUAL_STRING("https://www.reddit.com/r/mock/comments/abc/thread/c1/", thread->items[3].url);
+    free_comment_thread(thread);
+}
+
+void test_comments_past_the_limit_are_one_row(void) {
+    struct comment_thread* thread = thread_of(5, 2, 10);
+    TEST_ASSERT_EQUAL_size_t(7, thread->count);
+    const struct comment* more = &thread->items[6];
+    TEST_ASSERT_TRUE(more->is_more);
+    TEST_ASSERT_EQUAL_UINT32(0, more->depth);
+    TEST_ASSERT_EQUAL_size_t(3, more->more_count);
+    TEST_ASSERT_EQUAL_STRING("c2", more->more_ids[0]);
+    TEST_ASSERT_EQUAL_STRING("c4", more->more_ids[2]);
+    free_comment_thread(thread);
+}
+
+void test_deep_replies_continue_in_the_browser(void) {
+    struct comment_thread* thread = thread_of(1, 10, 2);
+    TEST_ASSERT_EQUAL_size_t(3, thread->count);
+    assert_comment(thread, 1, "c0r1", 1);
+    const struct comment* stub = &thread->items[2];
+    TEST_ASSERT_TRUE(stub->is_more);
+    TEST_ASSERT_EQUAL_size_t(0, stub->more_count);
+    TEST_ASSERT_EQUAL_UINT32(2, stub->depth);
+    TEST_ASSERT_EQUAL_STRING("https://www.reddit.com/comments/abc/_/c0r1/", stub->url);
+    free_comment_thread(thread);
+}
+
+void test_more_comments_are_put_in_reading_order(void) {
+    struct comment_thread* loaded = more_comments_of("c2,c3", 10, 0);
+    TEST_ASSERT_EQUAL_size_t(6, loaded->count);
+    assert_comment(loaded, 0, "c2", 0);
+    assert_comment(loaded, 1, "c2r1", 1);
+    assert_comment(loaded, 2, "c2r2", 2);
+    assert_comment(loaded, 3, "c3", 0);
+    assert_comment(loaded, 4, "c3r1", 1);
+    assert_comment(loaded, 5, "c3r2", 2);
+    free_comment_thread(loaded);
+}
+
+void test_loaded_comments_replace_their_row(void) {
+    struct comment_thread* thread = thread_of(5, 2, 10);
+    replace_more_comments(thread, 6, more_comments_of("c2,c3", 10, 0), 2);
+    // the row stays for the comment that wasn't requested
+    TEST_ASSERT_EQUAL_size_t(13, thread->count);
+    assert_comment(thread, 5, "c1r2", 2);
+    assert_comment(thread, 6, "c2", 0);
+    assert_comment(thread, 11, "c3r2", 2);
+    const struct comment* more = &thread->items[12];
+    TEST_ASSERT_TRUE(more->is_more);
+    TEST_ASSERT_EQUAL_size_t(1, more->more_count);
+    TEST_ASSERT_EQUAL_STRING("c4", more->more_ids[0]);
+
+    replace_more_comments(thread, 12, more_comments_of("c4", 10, 0), 1);
+    TEST_ASSERT_EQUAL_size_t(15, thread->count);
+    assert_comment(thread, 14, "c4r2", 2);
+    free_comment_thread(thread);
+}
+
+void test_more_comments_replying_in_a_circle_are_dropped(void) {
+    const char* json = "{\"json\": {\"data\": {\"things\": ["
+                       "{\"kind\": \"t1\", \"data\": {\"id\": \"a\", \"name\": \"t1_a\", \"parent_id\": \"t1_b\", "
+                       "\"body\": \"a\"}},"
+                       "{\"kind\": \"t1\", \"data\": {\"id\": \"b\", \"name\": \"t1_b\", \"parent_id\": \"t1_a\", "
+                       "\"body\": \"b\"}},"
+                       "{\"kind\": \"t1\", \"data\": {\"id\": \"c\", \"name\": \"t1_c\", \"parent_id\": \"t1_c\", "
+                       "\"body\": \"c\"}},"
+                       "{\"kind\": \"t1\", \"data\": {\"id\": \"d\", \"name\": \"t1_d\", \"parent_id\": \"t3_abc\", "
+                       "\"body\": \"d\"}}]}}}";
+    struct response_buffer* resp = buffer_of(g_strdup(json), strlen(json));
+    struct comment_thread* loaded = deserialize_more_comments(resp, "abc", 1);
+    free_response_buffer(resp);
+    TEST_ASSERT_NOT_NULL(loaded);
+    TEST_ASSERT_EQUAL_size_t(1, loaded->count);
+    assert_comment(loaded, 0, "d", 1);
+    free_comment_thread(loaded);
+}
+
+void test_malformed_responses(void) {
+    struct response_buffer* resp = buffer_of(g_strdup("{\"error\": 404}"), strlen("{\"error\": 404}"));
+    TEST_ASSERT_NULL(deserialize_comment_thread(resp, "abc"));
+    TEST_ASSERT_NULL(deserialize_more_comments(resp, "abc", 0));
+    free_response_buffer(resp);
+    resp = buffer_of(g_strdup("[{\"kind\""), strlen("[{\"kind\""));
+    TEST_ASSERT_NULL(deserialize_comment_thread(resp, "abc"));
+    free_response_buffer(resp);
+}
+
+int main(void) {
+    UNITY_BEGIN();
+    RUN_TEST(test_replies_follow_their_comment);
+    RUN_TEST(test_comments_past_the_limit_are_one_row);
+    RUN_TEST(test_deep_replies_continue_in_the_browser);
+    RUN_TEST(test_more_comments_are_put_in_reading_order);
+    RUN_TEST(test_loaded_comments_replace_their_row);
+    RUN_TEST(test_more_comments_replying_in_a_circle_are_dropped);
+    RUN_TEST(test_malformed_responses);
+    return UNITY_END();
+}
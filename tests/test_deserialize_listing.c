@@ -3,8 +3,11 @@
 #include "reddit.h"
 #include "unity.h"
 #include <jansson.h>
+#include <stdlib.h>
+#include <string.h>
 
 static void assert_listing_equal(const struct listing* expected, const struct listing* actual) {
+    TEST_ASSERT_EQUAL_STRING(expected->id, actual->id);
     TEST_ASSERT_EQUAL_STRING(expected->title, actual->title);
     TEST_ASSERT_EQUAL_STRING(expected->selftext, actual->selftext);
     TEST_ASSERT_EQUAL_UINT32(expected->ups, actual->ups);
@@ -14,13 +17,16 @@ static void assert_listing_equal(const struct listing* expected, const struct li
 static void assert_listing_not_initialized(const struct listing* listing) {
     TEST_ASSERT_NULL(listing->title);
     TEST_ASSERT_NULL(listing->selftext);
+    TEST_ASSERT_NULL(listing->escaped_selftext);
     TEST_ASSERT_EQUAL_UINT32(0, listing->ups);
     TEST_ASSERT_NULL(listing->url);
 }
 
 static struct listing new_expected_listing(void) {
-    struct listing l = {.title = "Test Title",
-                        .selftext = "Test selftext",
+    // selftext is in the JSON, but attached by the listing stream rather than copied here
+    struct listing l = {.id = "12345",
+                        .title = "Test Title",
+                        .selftext = NULL,
                         .ups = 42,
                         .url = "https://www.reddit.com/r/test/comments/12345/test_title/"};
     return l;
@@ -28,6 +34,7 @@ static struct listing new_expected_listing(void) {
 
 static json_t* new_json(void) {
     json_t* data = json_object();
+    json_object_set_new(data, "id", json_string("12345"));
     json_object_set_new(data, "title", json_string("Test Title"));
     json_object_set_new(data, "selftext", json_string("Test selftext"));
     json_object_set_new(data, "ups", json_integer(42));
@@ -38,30 +45,33 @@ static json_t* new_json(void) {
     return listing;
 }
 
+static struct arena* arena;
+
 void setUp(void) {
+    arena = new_arena();
 }
 
 void tearDown(void) {
+    free_arena(arena);
 }
 
 void test_happy_path(void) {
     struct listing* listing = LOG_ERR_MALLOC(struct listing, 1);
     json_t* json = new_json();
-    deserialize_listing(json, listing, 0);
+    deserialize_listing(json, listing, 0, arena);
     struct listing expected = new_expected_listing();
     assert_listing_equal(&expected, listing);
-    free_listing(listing);
+    free(listing);
     json_decref(json);
-    ;
 }
 
 void test_no_data_key(void) {
     struct listing* listing = calloc(1, sizeof(struct listing));
     json_t* json = new_json();
     json_object_del(json, "data");
-    deserialize_listing(json, listing, 0);
+    deserialize_listing(json, listing, 0, arena);
     assert_listing_not_initialized(listing);
-    free_listing(listing);
+    free(listing);
     json_decref(json);
 }
 
@@ -69,9 +79,9 @@ void test_no_title_key(void) {
     struct listing* listing = calloc(1, sizeof(struct listing));
     json_t* json = new_json();
     json_object_del(json_object_get(json, "data"), "title");
-    deserialize_listing(json, listing, 0);
+    deserialize_listing(json, listing, 0, arena);
     assert_listing_not_initialized(listing);
-    free_listing(listing);
+    free(listing);
     json_decref(json);
 }
 
@@ -80,12 +90,11 @@ void test_nullable_keys_are_missing(void) {
     json_t* json = new_json();
     json_object_del(json_object_get(json, "data"), "selftext");
     json_object_del(json_object_get(json, "data"), "ups");
-    deserialize_listing(json, listing, 0);
+    deserialize_listing(json, listing, 0, arena);
     struct listing expected = new_expected_listing();
-    expected.selftext = NULL;
     expected.ups = 0;
     assert_listing_equal(&expected, listing);
-    free_listing(listing);
+    free(listing);
     json_decref(json);
 }
 
@@ -94,11 +103,11 @@ void test_permalink_fallsback_to_url(void) {
     json_t* json = new_json();
     json_object_del(json_object_get(json, "data"), "permalink");
     json_object_set_new(json_object_get(json, "data"), "url", json_string("/fallback_url"));
-    deserialize_listing(json, listing, 0);
+    deserialize_listing(json, listing, 0, arena);
     struct listing expected = new_expected_listing();
     expected.url = "https://www.reddit.com/fallback_url";
     assert_listing_equal(&expected, listing);
-    free_listing(listing);
+    free(listing);
     json_decref(json);
 }
 
@@ -106,14 +115,64 @@ void test_permalink_and_url_missing(void) {
     struct listing* listing = calloc(1, sizeof(struct listing));
     json_t* json = new_json();
     json_object_del(json_object_get(json, "data"), "permalink");
-    deserialize_listing(json, listing, 0);
+    deserialize_listing(json, listing, 0, arena);
     struct listing expected = new_expected_listing();
     expected.url = NULL;
     assert_listing_equal(&expected, listing);
-    free_listing(listing);
+    free(listing);
+    json_decref(json);
+}
+
+void test_thumbnail(void) {
+    struct listing* listing = calloc(1, sizeof(struct listing));
+    json_t* json = new_json();
+    json_object_set_new(json_object_get(json, "data"), "thumbnail",
+                        json_string("https://b.thumbs.redditmedia.com/abc.jpg"));
+    deserialize_listing(json, listing, 0, arena);
+    TEST_ASSERT_EQUAL_STRING("https://b.thumbs.redditmedia.com/abc.jpg", listing->thumbnail_url);
+    // placeholders of self posts and the like
+    json_object_set_new(json_object_get(json, "data"), "thumbnail", json_string("self"));
+    deserialize_listing(json, listing, 0, arena);
+    TEST_ASSERT_NULL(listing->thumbnail_url);
+    free(listing);
+    json_decref(json);
+}
+
+void test_strings_share_one_allocation(void) {
+    struct listing* listings = calloc(2, sizeof(struct listing));
+    json_t* json = new_json();
+    deserialize_listing(json, listings, 0, arena);
+    deserialize_listing(json, listings, 1, arena);
+    struct arena_stats stats = arena_stats(arena);
+    // title and url of both listings used to be four separate mallocs
+    TEST_ASSERT_EQUAL_size_t(1, stats.allocations);
+    size_t url_size = strlen("https://www.reddit.com/r/test/comments/12345/test_title/");
+    TEST_ASSERT_EQUAL_size_t(2 * (strlen("Test Title") + url_size + 2), stats.bytes_used);
+    free(listings);
     json_decref(json);
 }
 
+void test_arena_grows_past_first_block(void) {
+    char big[10000];
+    memset(big, 'x', sizeof(big) - 1);
+    big[sizeof(big) - 1] = '\0';
+    char* copy = arena_strdup(arena, big);
+    TEST_ASSERT_EQUAL_STRING(big, copy);
+    TEST_ASSERT_EQUAL_STRING("small", arena_strdup(arena, "small"));
+    TEST_ASSERT_GREATER_OR_EQUAL(sizeof(big), arena_stats(arena).bytes_allocated);
+}
+
+void test_oversized_allocation_keeps_current_block(void) {
+    char big[10000];
+    memset(big, 'x', sizeof(big) - 1);
+    big[sizeof(big) - 1] = '\0';
+    TEST_ASSERT_EQUAL_STRING("small", arena_strdup(arena, "small"));
+    TEST_ASSERT_EQUAL_STRING(big, arena_strdup(arena, big));
+    // still fits behind "small" in the first block
+    TEST_ASSERT_EQUAL_STRING("after", arena_strdup(arena, "after"));
+    TEST_ASSERT_EQUAL_size_t(2, arena_stats(arena).allocations);
+}
+
 int main(void) {
     UNITY_BEGIN();
     RUN_TEST(test_happy_path);
@@ -122,5 +181,9 @@ int main(void) {
     RUN_TEST(test_nullable_keys_are_missing);
     RUN_TEST(test_permalink_fallsback_to_url);
     RUN_TEST(test_permalink_and_url_missing);
+    RUN_TEST(test_thumbnail);
+    RUN_TEST(test_strings_share_one_allocation);
+    RUN_TEST(test_arena_grows_past_first_block);
+    RUN_TEST(test_oversized_allocation_keeps_current_block);
     return UNITY_END();
 }
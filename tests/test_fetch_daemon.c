@@ -0,0 +1,184 @@
+#include "fetch_daemon.h"
+#include "fetch_worker.h"
+#include "mock_reddit_server.h"
+#include "reddit.h"
+#include "unity.h"
+#include <glib.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+static struct mock_reddit_server* server;
+static char* cache_dir;
+static char* listings_cache_dir;
+static char* socket_path;
+// where the plugin's own fetches are pointed, nothing listens there
+static char* closed_url;
+static struct fetch_worker* daemon_worker;
+static struct fetch_daemon* daemon;
+
+static struct rofi_reddit_cfg* load_cfg(void) {
+    struct rofi_reddit_cfg* cfg = new_mock_reddit_cfg(server, cache_dir);
+    cfg->paths->listings_cache_dir = g_strdup(listings_cache_dir);
+    cfg->paths->daemon_socket_path = g_strdup(socket_path);
+    return cfg;
+}
+
+// The plugin's, which can only get listings through the daemon.
+static struct rofi_reddit_cfg* load_plugin_cfg(void) {
+    struct rofi_reddit_cfg* cfg = load_cfg();
+    g_free(cfg->api.auth_url);
+    g_free(cfg->api.listings_url);
+    cfg->api.auth_url = g_strdup(closed_url);
+    cfg->api.listings_url = g_strdup(closed_url);
+    cfg->daemon = (struct daemon_cfg){.enabled = true, .idle_timeout_minutes = 1};
+    return cfg;
+}
+
+static void on_ready(RedditApp* app, const char* error, void* user_data) {
+    TEST_ASSERT_NOT_NULL(app);
+}
+
+static void on_idle(void* user_data) {
+    *(bool*)user_data = true;
+}
+
+static void on_fetched(struct fetch_result* result, void* user_data) {
+    *(struct fetch_result**)user_data = result;
+}
+
+struct daemon_request {
+    const char* query;
+    const char* sort;
+    struct fetch_result* result;
+    gint done;
+};
+
+static gpointer request_from_daemon(gpointer data) {
+    struct daemon_request* request = (struct daemon_request*)data;
+    request->result = fetch_through_daemon(socket_path, request->query, request->sort);
+    g_atomic_int_set(&request->done, 1);
+    g_main_context_wakeup(NULL);
+    return NULL;
+}
+
+// Asks like the plugin would, from another thread, while the daemon is served by the main loop.
+static struct fetch_result* fetch_from_daemon(const char* query, const char* sort) {
+    struct daemon_request request = {.query = query, .sort = sort, .result = NULL, .done = 0};
+    GThread* thread = g_thread_new("daemon-client", request_from_daemon, &request);
+    while (!g_atomic_int_get(&request.done)) {
+        g_main_context_iteration(NULL, TRUE);
+    }
+    g_thread_join(thread);
+    return request.result;
+}
+
+void setUp(void) {
+    struct mock_reddit_options options = mock_reddit_default_options();
+    struct mock_reddit_server* closed = new_mock_reddit_server(&options);
+    closed_url = g_strdup(mock_reddit_server_url(closed));
+    free_mock_reddit_server(closed);
+    server = new_mock_reddit_server(&options);
+    TEST_ASSERT_NOT_NULL(server);
+    cache_dir = g_dir_make_tmp("rofi-reddit-test-XXXXXX", NULL);
+    listings_cache_dir = g_build_filename(cache_dir, "listings", NULL);
+    g_mkdir_with_parents(listings_cache_dir, 0700);
+    socket_path = g_build_filename(cache_dir, "daemon.sock", NULL);
+    daemon_worker = new_fetch_worker(load_cfg, on_ready, NULL);
+    daemon = new_fetch_daemon(socket_path, daemon_worker, 60, on_idle, NULL);
+    TEST_ASSERT_NOT_NULL(daemon);
+}
+
+void tearDown(void) {
+    free_fetch_worker(daemon_worker);
+    free_fetch_daemon(daemon);
+    remove_files_in(listings_cache_dir);
+    remove(listings_cache_dir);
+    remove_files_in(cache_dir);
+    remove(cache_dir);
+    g_free(listings_cache_dir);
+    g_free(socket_path);
+    g_free(cache_dir);
+    g_free(closed_url);
+    free_mock_reddit_server(server);
+}
+
+void test_listings_round_trip(void) {
+    TEST_ASSERT_TRUE(is_fetch_daemon_running(socket_path));
+    struct fetch_result* result = fetch_from_daemon("linux,cpp", "top:week");
+    TEST_ASSERT_NOT_NULL(result);
+    TEST_ASSERT_EQUAL_STRING("linux,cpp", result->subreddit);
+    TEST_ASSERT_EQUAL_STRING("top:week", result->sort);
+    TEST_ASSERT_EQUAL(SUBREDDIT_ACCESS_OK, result->access);
+    TEST_ASSERT_EQUAL(50, result->listings->count);
+    TEST_ASSERT_TRUE(g_str_has_prefix(result->listings->items[0].title, "Thread number 32000 "));
+    // the cursors come along, so that the plugin can fetch the next page itself
+    TEST_ASSERT_TRUE(has_more_listings(result->listings));
+    TEST_ASSERT_EQUAL(0, result->offline_cached_at);
+    TEST_ASSERT_FALSE(result->rate_limited);
+    TEST_ASSERT_EQUAL(2, result->status_count);
+    TEST_ASSERT_EQUAL_STRING("cpp", result->statuses[1].subreddit);
+    TEST_ASSERT_EQUAL(SUBREDDIT_ACCESS_OK, result->statuses[1].access);
+    free_fetch_result(result);
+    TEST_ASSERT_EQUAL_size_t(2, mock_reddit_server_stats(server).listings_requests);
+}
+
+void test_failures_are_answered_too(void) {
+    struct mock_reddit_options options = mock_reddit_default_options();
+    options.listings_status = HTTP_FORBIDDEN;
+    mock_reddit_server_set_options(server, &options);
+    struct fetch_result* result = fetch_from_daemon("secret", "hot");
+    TEST_ASSERT_NOT_NULL(result);
+    TEST_ASSERT_EQUAL(SUBREDDIT_ACCESS_PRIVATE, result->access);
+    TEST_ASSERT_NULL(result->listings);
+    free_fetch_result(result);
+}
+
+void test_without_daemon(void) {
+    free_fetch_daemon(daemon);
+    daemon = NULL;
+    TEST_ASSERT_FALSE(is_fetch_daemon_running(socket_path));
+    TEST_ASSERT_NULL(fetch_through_daemon(socket_path, "linux", "hot"));
+}
+
+void test_second_daemon_is_refused(void) {
+    TEST_ASSERT_NULL(new_fetch_daemon(socket_path, daemon_worker, 60, on_idle, NULL));
+    // and the first one keeps its socket
+    TEST_ASSERT_TRUE(is_fetch_daemon_running(socket_path));
+}
+
+void test_exits_when_idle(void) {
+    free_fetch_daemon(daemon);
+    bool idle = false;
+    daemon = new_fetch_daemon(socket_path, daemon_worker, 1, on_idle, &idle);
+    TEST_ASSERT_NOT_NULL(daemon);
+    while (!idle) {
+        g_main_context_iteration(NULL, TRUE);
+    }
+}
+
+void test_fetch_worker_uses_the_daemon(void) {
+    struct fetch_worker* worker = new_fetch_worker(load_plugin_cfg, on_ready, NULL);
+    struct fetch_result* result = NULL;
+    fetch_worker_submit(worker, "linux", "hot", on_fetched, &result);
+    while (!result) {
+        g_main_context_iteration(NULL, TRUE);
+    }
+    free_fetch_worker(worker);
+    // fetched by the daemon, the plugin can't reach Reddit and has nothing cached
+    TEST_ASSERT_EQUAL(SUBREDDIT_ACCESS_OK, result->access);
+    TEST_ASSERT_EQUAL(25, result->listings->count);
+    TEST_ASSERT_EQUAL(0, result->offline_cached_at);
+    free_fetch_result(result);
+}
+
+int main(void) {
+    UNITY_BEGIN();
+    RUN_TEST(test_listings_round_trip);
+    RUN_TEST(test_failures_are_answered_too);
+    RUN_TEST(test_without_daemon);
+    RUN_TEST(test_second_daemon_is_refused);
+    RUN_TEST(test_exits_when_idle);
+    RUN_TEST(test_fetch_worker_uses_the_daemon);
+    return UNITY_END();
+}
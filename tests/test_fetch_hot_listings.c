@@ -0,0 +1,333 @@
+#include "mock_reddit_server.h"
+#include "reddit.h"
+#include "unity.h"
+#include <glib.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+static struct mock_reddit_server* server;
+static RedditApp* app;
+static char* cache_dir;
+static RedditAccessToken token;
+
+void setUp(void) {
+    cache_dir = g_dir_make_tmp("rofi-reddit-test-XXXXXX", NULL);
+    struct mock_reddit_options options = mock_reddit_default_options();
+    server = new_mock_reddit_server(&options);
+    TEST_ASSERT_NOT_NULL(server);
+    app = new_reddit_app(new_mock_reddit_cfg(server, cache_dir));
+    token = (RedditAccessToken){.token = MOCK_REDDIT_ACCESS_TOKEN, .expires_at = time(NULL) + 3600};
+}
+
+void tearDown(void) {
+    char* cache_path = g_build_filename(cache_dir, "access_token", NULL);
+    remove(cache_path);
+    g_free(cache_path);
+    remove(cache_dir);
+    g_free(cache_dir);
+    free_reddit_app(app);
+    free_mock_reddit_server(server);
+}
+
+static void set_options(struct mock_reddit_options options) {
+    mock_reddit_server_set_options(server, &options);
+}
+
+static void free_response(const struct reddit_api_response* response) {
+    free_listings(response->listings);
+    release_response_buffer(app->buffers, (struct response_buffer*)response->response_buffer);
+    free_reddit_api_response(response);
+}
+
+void test_token_is_fetched_once_and_cached(void) {
+    RedditAccessToken* fetched = new_reddit_access_token(app);
+    TEST_ASSERT_NOT_NULL(fetched);
+    TEST_ASSERT_EQUAL_STRING(MOCK_REDDIT_ACCESS_TOKEN, fetched->token);
+    TEST_ASSERT_TRUE(access_token_refresh_in(fetched) > 0);
+    free_reddit_access_token(fetched);
+
+    RedditAccessToken* cached = new_reddit_access_token(app);
+    TEST_ASSERT_NOT_NULL(cached);
+    TEST_ASSERT_EQUAL_STRING(MOCK_REDDIT_ACCESS_TOKEN, cached->token);
+    free_reddit_access_token(cached);
+    TEST_ASSERT_EQUAL(1, mock_reddit_server_stats(server).token_requests);
+}
+
+void test_token_about_to_expire_is_refetched(void) {
+    struct mock_reddit_options options = mock_reddit_default_options();
+    options.token_expires_in = 60;
+    set_options(options);
+    free_reddit_access_token(new_reddit_access_token(app));
+    free_reddit_access_token(new_reddit_access_token(app));
+    TEST_ASSERT_EQUAL(2, mock_reddit_server_stats(server).token_requests);
+}
+
+void test_token_endpoint_rejecting_credentials(void) {
+    struct mock_reddit_options options = mock_reddit_default_options();
+    options.token_status = HTTP_UNAUTHORIZED;
+    set_options(options);
+    TEST_ASSERT_NULL(fetch_and_cache_token(app));
+}
+
+void test_first_page(void) {
+    const struct reddit_api_response* response = fetch_listings(app, &token, "linux", HOT_LISTINGS_SORT, NULL, NULL);
+    TEST_ASSERT_EQUAL(HTTP_OK, response->status_code);
+    TEST_ASSERT_NOT_NULL(response->etag);
+    TEST_ASSERT_NOT_NULL(response->listings);
+    TEST_ASSERT_EQUAL(25, response->listings->count);
+    TEST_ASSERT_EQUAL_STRING("linux", response->listings->items[0].subreddit);
+    TEST_ASSERT_EQUAL_STRING("Thread number 0 about kernels, \"drivers\" and caf\xc3\xa9s",
+                             response->listings->items[0].title);
+    TEST_ASSERT_EQUAL_STRING("https://www.reddit.com/r/linux/comments/0/thread_number_0/",
+                             response->listings->items[0].url);
+    TEST_ASSERT_EQUAL(1, response->listings->cursor_count);
+    TEST_ASSERT_EQUAL_STRING("linux", response->listings->cursors[0].subreddit);
+    TEST_ASSERT_EQUAL_STRING("t3_p1", response->listings->cursors[0].after);
+    TEST_ASSERT_EQUAL(1, mock_reddit_server_stats(server).gzip_offered);
+    free_response(response);
+}
+
+void test_pages_until_the_cursor_runs_out(void) {
+    struct mock_reddit_options options = mock_reddit_default_options();
+    options.pages = 2;
+    set_options(options);
+    const struct reddit_api_response* response = fetch_listings(app, &token, "linux", HOT_LISTINGS_SORT, NULL, "t3_p1");
+    TEST_ASSERT_EQUAL(HTTP_OK, response->status_code);
+    TEST_ASSERT_EQUAL(25, response->listings->count);
+    TEST_ASSERT_EQUAL_STRING("Thread number 25 about kernels, \"drivers\" and caf\xc3\xa9s",
+                             response->listings->items[0].title);
+    TEST_ASSERT_FALSE(has_more_listings(response->listings));
+    free_response(response);
+}
+
+void test_unchanged_listings_are_not_modified(void) {
+    const struct reddit_api_response* first = fetch_listings(app, &token, "linux", HOT_LISTINGS_SORT, NULL, NULL);
+    const struct reddit_api_response* second =
+        fetch_listings(app, &token, "linux", HOT_LISTINGS_SORT, first->etag, NULL);
+    TEST_ASSERT_EQUAL(HTTP_NOT_MODIFIED, second->status_code);
+    TEST_ASSERT_NULL(second->listings);
+    TEST_ASSERT_EQUAL(SUBREDDIT_ACCESS_OK, subreddit_access_from_response(second));
+    TEST_ASSERT_EQUAL(1, mock_reddit_server_stats(server).not_modified);
+    // both went over the same connection
+    TEST_ASSERT_EQUAL(1, mock_reddit_server_stats(server).connections);
+    free_response(first);
+    free_response(second);
+}
+
+static enum subreddit_access access_with(enum http_status_code status, const char* reason) {
+    struct mock_reddit_options options = mock_reddit_default_options();
+    options.listings_status = status;
+    options.reason = reason;
+    set_options(options);
+    const struct reddit_api_response* response = fetch_listings(app, &token, "linux", HOT_LISTINGS_SORT, NULL, NULL);
+    TEST_ASSERT_EQUAL(status, response->status_code);
+    TEST_ASSERT_NULL(response->listings);
+    enum subreddit_access access = subreddit_access_from_response(response);
+    free_response(response);
+    return access;
+}
+
+void test_denied_subreddits(void) {
+    TEST_ASSERT_EQUAL(SUBREDDIT_ACCESS_PRIVATE, access_with(HTTP_FORBIDDEN, "private"));
+    TEST_ASSERT_EQUAL(SUBREDDIT_ACCESS_QUARANTINED, access_with(HTTP_FORBIDDEN, "quarantined"));
+    TEST_ASSERT_EQUAL(SUBREDDIT_ACCESS_UNKNOWN, access_with(HTTP_FORBIDDEN, "banned"));
+    TEST_ASSERT_EQUAL(SUBREDDIT_ACCESS_EXPIRED_TOKEN, access_with(HTTP_UNAUTHORIZED, NULL));
+    TEST_ASSERT_EQUAL(SUBREDDIT_ACCESS_DOESNT_EXIST, access_with(HTTP_NOT_FOUND, NULL));
+    // the error bodies were all read into the same buffer
+    struct response_buffer_pool_stats stats = response_buffer_pool_stats(app->buffers);
+    TEST_ASSERT_EQUAL(5, stats.acquired);
+    TEST_ASSERT_EQUAL(4, stats.reused);
+}
+
+void test_rejected_token(void) {
+    RedditAccessToken stale = {.token = "stale", .expires_at = time(NULL) + 3600};
+    const struct reddit_api_response* response = fetch_listings(app, &stale, "linux", HOT_LISTINGS_SORT, NULL, NULL);
+    TEST_ASSERT_EQUAL(SUBREDDIT_ACCESS_EXPIRED_TOKEN, subreddit_access_from_response(response));
+    free_response(response);
+}
+
+void test_concurrent_fetch_with_one_failing_subreddit(void) {
+    struct mock_reddit_options options = mock_reddit_default_options();
+    options.listings_status = HTTP_FORBIDDEN;
+    options.failing_subreddit = "secret";
+    options.latency_ms = 100;
+    set_options(options);
+    struct subreddit_fetch fetches[] = {{.subreddit = "linux", .sort = HOT_LISTINGS_SORT},
+                                        {.subreddit = "secret", .sort = HOT_LISTINGS_SORT},
+                                        {.subreddit = "cpp", .sort = HOT_LISTINGS_SORT}};
+    gint64 started = g_get_monotonic_time();
+    fetch_listings_concurrently(app, &token, fetches, 3);
+    gint64 elapsed = g_get_monotonic_time() - started;
+    TEST_ASSERT_EQUAL(HTTP_OK, fetches[0].response->status_code);
+    TEST_ASSERT_EQUAL(SUBREDDIT_ACCESS_PRIVATE, subreddit_access_from_response(fetches[1].response));
+    TEST_ASSERT_EQUAL(HTTP_OK, fetches[2].response->status_code);
+    TEST_ASSERT_EQUAL_STRING("cpp", fetches[2].response->listings->items[0].subreddit);
+    // the three waits overlap rather than add up
+    TEST_ASSERT_TRUE(elapsed < 3 * 100 * 1000);
+    for (size_t i = 0; i < 3; i++) {
+        free_response(fetches[i].response);
+    }
+}
+
+void test_large_selftext_over_slow_link(void) {
+    struct mock_reddit_options options = mock_reddit_default_options();
+    options.selftext_size = 8192;
+    options.bandwidth = 2 * 1024 * 1024;
+    set_options(options);
+    const struct reddit_api_response* response = fetch_listings(app, &token, "linux", HOT_LISTINGS_SORT, NULL, NULL);
+    TEST_ASSERT_EQUAL(HTTP_OK, response->status_code);
+    TEST_ASSERT_EQUAL(25, response->listings->count);
+    char* selftext = listing_selftext(&response->listings->items[24]);
+    TEST_ASSERT_TRUE(strlen(selftext) >= 8192 / 2);
+    g_free(selftext);
+    free_response(response);
+}
+
+void test_timing_of_a_slow_response(void) {
+    struct mock_reddit_options options = mock_reddit_default_options();
+    options.latency_ms = 50;
+    set_options(options);
+    app->timings = new_timing_log(NULL, NULL);
+    const struct reddit_api_response* response = fetch_listings(app, &token, "linux", HOT_LISTINGS_SORT, NULL, NULL);
+    const struct request_timing* timing = &response->timing;
+    TEST_ASSERT_TRUE(timing->first_byte_us >= 50 * 1000);
+    TEST_ASSERT_EQUAL_INT64(timing->total_us, timing->dns_us + timing->connect_us + timing->tls_us +
+                                                  timing->first_byte_us + timing->transfer_us);
+    // plain HTTP
+    TEST_ASSERT_EQUAL_INT64(0, timing->tls_us);
+    TEST_ASSERT_TRUE(timing->bytes > 0);
+    char* summary = timing_log_summary(app->timings);
+    TEST_ASSERT_NOT_NULL(summary);
+    TEST_ASSERT_TRUE(g_str_has_prefix(summary, "r/linux took "));
+    g_free(summary);
+    free_response(response);
+}
+
+static char* first_title_in(const char* sort) {
+    const struct reddit_api_response* response = fetch_listings(app, &token, "linux", sort, NULL, NULL);
+    TEST_ASSERT_EQUAL(HTTP_OK, response->status_code);
+    char* title = g_strdup(response->listings->items[0].title);
+    free_response(response);
+    return title;
+}
+
+void test_sorts(void) {
+    // the mock numbers the threads of every sort and time range from a different first one
+    const char* expected[][2] = {
+        {"new", "Thread number 10000 "},
+        {"rising", "Thread number 20000 "},
+        {"top:day", "Thread number 31000 "},
+        {"top:week", "Thread number 32000 "},
+        {"controversial:all", "Thread number 45000 "},
+    };
+    for (size_t i = 0; i < G_N_ELEMENTS(expected); i++) {
+        char* title = first_title_in(expected[i][0]);
+        TEST_ASSERT_TRUE_MESSAGE(g_str_has_prefix(title, expected[i][1]), expected[i][0]);
+        g_free(title);
+    }
+}
+
+void test_sort_names_are_normalized(void) {
+    const char* spellings[][2] = {
+        {"hot", "hot"},
+        {"New", "new"},
+        {" rising ", "rising"},
+        {"top", "top:day"},
+        {"TOP:Week", "top:week"},
+        {"best", NULL},
+        {"top:decade", NULL},
+        {"new:week", NULL},
+        {"", NULL},
+    };
+    for (size_t i = 0; i < G_N_ELEMENTS(spellings); i++) {
+        char* normalized = normalize_listings_sort(spellings[i][0]);
+        TEST_ASSERT_EQUAL_STRING_MESSAGE(spellings[i][1], normalized, spellings[i][0]);
+        g_free(normalized);
+    }
+}
+
+// Whatever listened there has stopped, so connecting is refused the way it is while offline.
+static char* new_closed_url(void) {
+    struct mock_reddit_options options = mock_reddit_default_options();
+    struct mock_reddit_server* closed = new_mock_reddit_server(&options);
+    char* url = g_strdup(mock_reddit_server_url(closed));
+    free_mock_reddit_server(closed);
+    return url;
+}
+
+void test_unreachable_reddit(void) {
+    char* url = new_closed_url();
+    g_free(app->config->api.listings_url);
+    app->config->api.listings_url = g_strdup(url);
+    const struct reddit_api_response* response = fetch_listings(app, &token, "linux", HOT_LISTINGS_SORT, NULL, NULL);
+    TEST_ASSERT_EQUAL(CURLE_COULDNT_CONNECT, response->transport_result);
+    TEST_ASSERT_NULL(response->listings);
+    TEST_ASSERT_EQUAL(SUBREDDIT_ACCESS_UNREACHABLE, subreddit_access_from_response(response));
+    free_response(response);
+
+    g_free(app->config->api.auth_url);
+    app->config->api.auth_url = url;
+    TEST_ASSERT_NULL(fetch_and_cache_token(app));
+    TEST_ASSERT_TRUE(app->auth_unreachable);
+}
+
+void test_rejected_credentials_are_not_unreachable(void) {
+    struct mock_reddit_options options = mock_reddit_default_options();
+    options.token_status = HTTP_UNAUTHORIZED;
+    set_options(options);
+    TEST_ASSERT_NULL(fetch_and_cache_token(app));
+    TEST_ASSERT_FALSE(app->auth_unreachable);
+}
+
+void test_rate_limit_headers(void) {
+    const struct reddit_api_response* response = fetch_listings(app, &token, "linux", HOT_LISTINGS_SORT, NULL, NULL);
+    // left out unless the server limits requests
+    TEST_ASSERT_EQUAL_INT64(-1, (int64_t)response->ratelimit_remaining);
+    TEST_ASSERT_EQUAL_INT64(-1, response->ratelimit_reset);
+    free_response(response);
+
+    struct mock_reddit_options options = mock_reddit_default_options();
+    options.rate_limit = 2;
+    options.rate_limit_reset = 420;
+    set_options(options);
+    response = fetch_listings(app, &token, "linux", HOT_LISTINGS_SORT, NULL, NULL);
+    TEST_ASSERT_EQUAL_INT64(1, (int64_t)response->ratelimit_used);
+    TEST_ASSERT_EQUAL_INT64(1, (int64_t)response->ratelimit_remaining);
+    TEST_ASSERT_EQUAL_INT64(420, response->ratelimit_reset);
+    free_response(response);
+    response = fetch_comments(app, &token, "abc");
+    TEST_ASSERT_EQUAL(SUBREDDIT_ACCESS_OK, subreddit_access_from_response(response));
+    TEST_ASSERT_EQUAL_INT64(0, (int64_t)response->ratelimit_remaining);
+    free_response(response);
+
+    response = fetch_listings(app, &token, "linux", HOT_LISTINGS_SORT, NULL, NULL);
+    TEST_ASSERT_EQUAL(HTTP_TOO_MANY_REQUESTS, response->status_code);
+    TEST_ASSERT_NULL(response->listings);
+    TEST_ASSERT_EQUAL(SUBREDDIT_ACCESS_RATE_LIMITED, subreddit_access_from_response(response));
+    TEST_ASSERT_EQUAL_INT64(0, (int64_t)response->ratelimit_remaining);
+    TEST_ASSERT_EQUAL_size_t(1, mock_reddit_server_stats(server).rate_limited);
+    free_response(response);
+}
+
+int main(void) {
+    UNITY_BEGIN();
+    RUN_TEST(test_token_is_fetched_once_and_cached);
+    RUN_TEST(test_token_about_to_expire_is_refetched);
+    RUN_TEST(test_token_endpoint_rejecting_credentials);
+    RUN_TEST(test_first_page);
+    RUN_TEST(test_pages_until_the_cursor_runs_out);
+    RUN_TEST(test_unchanged_listings_are_not_modified);
+    RUN_TEST(test_denied_subreddits);
+    RUN_TEST(test_rejected_token);
+    RUN_TEST(test_concurrent_fetch_with_one_failing_subreddit);
+    RUN_TEST(test_large_selftext_over_slow_link);
+    RUN_TEST(test_timing_of_a_slow_response);
+    RUN_TEST(test_sorts);
+    RUN_TEST(test_sort_names_are_normalized);
+    RUN_TEST(test_unreachable_reddit);
+    RUN_TEST(test_rejected_credentials_are_not_unreachable);
+    RUN_TEST(test_rate_limit_headers);
+    return UNITY_END();
+}
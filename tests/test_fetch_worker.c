@@ -0,0 +1,340 @@
+#include "fetch_worker.h"
+#include "mock_reddit_server.h"
+#include "reddit.h"
+#include "unity.h"
+#include <glib.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+static struct mock_reddit_server* server;
+static char* cache_dir;
+static char* listings_cache_dir;
+static char* token_cache_path;
+// where the app is pointed while offline, nothing listens there
+static char* closed_url;
+static bool offline;
+static int64_t ttl_seconds;
+
+static struct rofi_reddit_cfg* load_cfg(void) {
+    struct rofi_reddit_cfg* cfg = new_mock_reddit_cfg(server, cache_dir);
+    cfg->paths->listings_cache_dir = g_strdup(listings_cache_dir);
+    cfg->paths->access_token_cache_exists = g_file_test(token_cache_path, G_FILE_TEST_EXISTS);
+    cfg->cache.ttl_seconds = ttl_seconds;
+    if (offline) {
+        g_free(cfg->api.auth_url);
+        g_free(cfg->api.listings_url);
+        cfg->api.auth_url = g_strdup(closed_url);
+        cfg->api.listings_url = g_strdup(closed_url);
+    }
+    return cfg;
+}
+
+static void on_ready(RedditApp* app, const char* error, void* user_data) {
+    TEST_ASSERT_NOT_NULL(app);
+}
+
+static void on_fetched(struct fetch_result* result, void* user_data) {
+    *(struct fetch_result**)user_data = result;
+}
+
+static struct fetch_result* wait_for_listings(struct fetch_result** result) {
+    while (!*result) {
+        g_main_context_iteration(NULL, TRUE);
+    }
+    return *result;
+}
+
+static struct fetch_result* fetch_sorted(const char* subreddit, const char* sort) {
+    struct fetch_worker* worker = new_fetch_worker(load_cfg, on_ready, NULL);
+    struct fetch_result* result = NULL;
+    fetch_worker_submit(worker, subreddit, sort, on_fetched, &result);
+    wait_for_listings(&result);
+    free_fetch_worker(worker);
+    return result;
+}
+
+static struct fetch_result* fetch(const char* subreddit) {
+    return fetch_sorted(subreddit, HOT_LISTINGS_SORT);
+}
+
+// Collects the results of prefetches, in the order they are delivered.
+struct prefetched {
+    struct fetch_result* results[4];
+    size_t count;
+};
+
+static void on_prefetched(struct fetch_result* result, void* user_data) {
+    struct prefetched* prefetched = (struct prefetched*)user_data;
+    prefetched->results[prefetched->count++] = result;
+}
+
+static void on_comments_fetched(struct comments_result* result, void* user_data) {
+    *(struct comments_result**)user_data = result;
+}
+
+static struct comments_result* wait_for_comments(struct comments_result** result) {
+    while (!*result) {
+        g_main_context_iteration(NULL, TRUE);
+    }
+    return *result;
+}
+
+void setUp(void) {
+    struct mock_reddit_options options = mock_reddit_default_options();
+    struct mock_reddit_server* closed = new_mock_reddit_server(&options);
+    closed_url = g_strdup(mock_reddit_server_url(closed));
+    free_mock_reddit_server(closed);
+    server = new_mock_reddit_server(&options);
+    TEST_ASSERT_NOT_NULL(server);
+    cache_dir = g_dir_make_tmp("rofi-reddit-test-XXXXXX", NULL);
+    listings_cache_dir = g_build_filename(cache_dir, "listings", NULL);
+    g_mkdir_with_parents(listings_cache_dir, 0700);
+    token_cache_path = g_build_filename(cache_dir, "access_token", NULL);
+    offline = false;
+    ttl_seconds = 0;
+}
+
+void tearDown(void) {
+    remove_files_in(listings_cache_dir);
+    remove(listings_cache_dir);
+    remove_files_in(cache_dir);
+    remove(cache_dir);
+    g_free(listings_cache_dir);
+    g_free(token_cache_path);
+    g_free(cache_dir);
+    g_free(closed_url);
+    free_mock_reddit_server(server);
+}
+
+void test_online_fetch_is_not_offline(void) {
+    struct fetch_result* result = fetch("linux");
+    TEST_ASSERT_EQUAL(SUBREDDIT_ACCESS_OK, result->access);
+    TEST_ASSERT_EQUAL(25, result->listings->count);
+    TEST_ASSERT_EQUAL(0, result->offline_cached_at);
+    free_fetch_result(result);
+}
+
+void test_offline_serves_stale_cache(void) {
+    time_t before = time(NULL);
+    free_fetch_result(fetch("linux"));
+    offline = true;
+    // the cached token is still good, so it's the listings request that fails
+    struct fetch_result* result = fetch("linux");
+    TEST_ASSERT_EQUAL(SUBREDDIT_ACCESS_OK, result->access);
+    TEST_ASSERT_EQUAL(25, result->listings->count);
+    TEST_ASSERT_TRUE(result->offline_cached_at >= before);
+    TEST_ASSERT_TRUE(result->offline_cached_at <= time(NULL));
+    free_fetch_result(result);
+}
+
+void test_offline_without_token_serves_stale_cache(void) {
+    free_fetch_result(fetch("linux"));
+    remove(token_cache_path);
+    offline = true;
+    struct fetch_result* result = fetch("linux");
+    TEST_ASSERT_EQUAL(SUBREDDIT_ACCESS_OK, result->access);
+    TEST_ASSERT_EQUAL(25, result->listings->count);
+    TEST_ASSERT_TRUE(result->offline_cached_at > 0);
+    free_fetch_result(result);
+}
+
+void test_offline_without_cache(void) {
+    free_fetch_result(fetch("linux"));
+    offline = true;
+    struct fetch_result* result = fetch("linux,cpp");
+    // linux from the cache, cpp was never fetched
+    TEST_ASSERT_EQUAL(SUBREDDIT_ACCESS_OK, result->access);
+    TEST_ASSERT_EQUAL(SUBREDDIT_ACCESS_OK, result->statuses[0].access);
+    TEST_ASSERT_EQUAL(SUBREDDIT_ACCESS_UNREACHABLE, result->statuses[1].access);
+    free_fetch_result(result);
+
+    result = fetch("cpp");
+    TEST_ASSERT_EQUAL(SUBREDDIT_ACCESS_UNREACHABLE, result->access);
+    TEST_ASSERT_NULL(result->listings);
+    TEST_ASSERT_EQUAL(0, result->offline_cached_at);
+    free_fetch_result(result);
+}
+
+void test_prefetched_sorts_are_served_from_the_cache(void) {
+    ttl_seconds = 300;
+    free_fetch_result(fetch("linux"));
+    struct fetch_worker* worker = new_fetch_worker(load_cfg, on_ready, NULL);
+    const char* sorts[] = {"new", "top:week"};
+    struct prefetched prefetched = {.count = 0};
+    fetch_worker_submit_prefetch(worker, "linux", sorts, 2, on_prefetched, &prefetched);
+    while (prefetched.count < 2) {
+        g_main_context_iteration(NULL, TRUE);
+    }
+    free_fetch_worker(worker);
+    for (size_t i = 0; i < 2; i++) {
+        TEST_ASSERT_EQUAL_STRING(sorts[i], prefetched.results[i]->sort);
+        TEST_ASSERT_EQUAL(SUBREDDIT_ACCESS_OK, prefetched.results[i]->access);
+        free_fetch_result(prefetched.results[i]);
+    }
+    TEST_ASSERT_EQUAL_size_t(3, mock_reddit_server_stats(server).listings_requests);
+
+    struct fetch_result* result = fetch_sorted("linux", "top:week");
+    TEST_ASSERT_EQUAL(SUBREDDIT_ACCESS_OK, result->access);
+    TEST_ASSERT_EQUAL_STRING("top:week", result->sort);
+    TEST_ASSERT_TRUE(g_str_has_prefix(result->listings->items[0].title, "Thread number 32000 "));
+    free_fetch_result(result);
+    TEST_ASSERT_EQUAL_size_t(3, mock_reddit_server_stats(server).listings_requests);
+}
+
+void test_prefetches_wait_and_are_dropped_by_a_new_query(void) {
+    struct fetch_worker* worker = new_fetch_worker(load_cfg, on_ready, NULL);
+    const char* sorts[] = {"new"};
+    struct prefetched prefetched = {.count = 0};
+    fetch_worker_submit_prefetch(worker, "linux", sorts, 1, on_prefetched, &prefetched);
+    struct fetch_result* result = NULL;
+    fetch_worker_submit(worker, "cpp", HOT_LISTINGS_SORT, on_fetched, &result);
+    while (prefetched.count < 1) {
+        g_main_context_iteration(NULL, TRUE);
+    }
+    free_fetch_worker(worker);
+    // submitted later, but fetched first
+    TEST_ASSERT_NOT_NULL(result);
+    TEST_ASSERT_EQUAL(SUBREDDIT_ACCESS_OK, result->access);
+    TEST_ASSERT_EQUAL(SUBREDDIT_ACCESS_UNINITIALIZED, prefetched.results[0]->access);
+    TEST_ASSERT_NULL(prefetched.results[0]->listings);
+    TEST_ASSERT_EQUAL_size_t(1, mock_reddit_server_stats(server).listings_requests);
+    free_fetch_result(result);
+    free_fetch_result(prefetched.results[0]);
+}
+
+void test_a_query_submitted_again_while_in_flight_is_fetched_once(void) {
+    struct fetch_worker* worker = new_fetch_worker(load_cfg, on_ready, NULL);
+    struct fetch_result* first = NULL;
+    struct fetch_result* second = NULL;
+    fetch_worker_submit(worker, "linux", HOT_LISTINGS_SORT, on_fetched, &first);
+    fetch_worker_submit(worker, "linux", HOT_LISTINGS_SORT, on_fetched, &second);
+    wait_for_listings(&first);
+    wait_for_listings(&second);
+    TEST_ASSERT_EQUAL(SUBREDDIT_ACCESS_OK, second->access);
+    TEST_ASSERT_EQUAL(25, second->listings->count);
+    TEST_ASSERT_EQUAL_size_t(1, mock_reddit_server_stats(server).listings_requests);
+
+    // submitted once the first response was in, so it is revalidated like any other with a ttl of 0
+    struct fetch_result* third = NULL;
+    fetch_worker_submit(worker, "linux", HOT_LISTINGS_SORT, on_fetched, &third);
+    wait_for_listings(&third);
+    TEST_ASSERT_EQUAL(SUBREDDIT_ACCESS_OK, third->access);
+    TEST_ASSERT_EQUAL_size_t(2, mock_reddit_server_stats(server).listings_requests);
+    TEST_ASSERT_EQUAL_size_t(1, mock_reddit_server_stats(server).not_modified);
+    free_fetch_worker(worker);
+    free_fetch_result(first);
+    free_fetch_result(second);
+    free_fetch_result(third);
+}
+
+void test_prefetches_back_off_before_the_request_limit(void) {
+    struct mock_reddit_options options = mock_reddit_default_options();
+    options.rate_limit = 4;
+    mock_reddit_server_set_options(server, &options);
+    struct fetch_worker* worker = new_fetch_worker(load_cfg, on_ready, NULL);
+    struct fetch_result* result = NULL;
+    fetch_worker_submit(worker, "linux", HOT_LISTINGS_SORT, on_fetched, &result);
+    free_fetch_result(wait_for_listings(&result));
+    // 3 of 4 requests are left, one of which is kept for what the user asks for
+    const char* sorts[] = {"new", "top:week", "rising"};
+    struct prefetched prefetched = {.count = 0};
+    fetch_worker_submit_prefetch(worker, "linux", sorts, 3, on_prefetched, &prefetched);
+    while (prefetched.count < 3) {
+        g_main_context_iteration(NULL, TRUE);
+    }
+    TEST_ASSERT_EQUAL(SUBREDDIT_ACCESS_OK, prefetched.results[0]->access);
+    TEST_ASSERT_EQUAL(SUBREDDIT_ACCESS_OK, prefetched.results[1]->access);
+    TEST_ASSERT_EQUAL(SUBREDDIT_ACCESS_RATE_LIMITED, prefetched.results[2]->access);
+    TEST_ASSERT_EQUAL_size_t(3, mock_reddit_server_stats(server).listings_requests);
+    for (size_t i = 0; i < prefetched.count; i++) {
+        free_fetch_result(prefetched.results[i]);
+    }
+
+    result = NULL;
+    fetch_worker_submit(worker, "cpp", HOT_LISTINGS_SORT, on_fetched, &result);
+    TEST_ASSERT_EQUAL(SUBREDDIT_ACCESS_OK, wait_for_listings(&result)->access);
+    free_fetch_result(result);
+    // not sent at all, as the limit only renews in 10 minutes
+    result = NULL;
+    fetch_worker_submit(worker, "rust", HOT_LISTINGS_SORT, on_fetched, &result);
+    TEST_ASSERT_EQUAL(SUBREDDIT_ACCESS_RATE_LIMITED, wait_for_listings(&result)->access);
+    TEST_ASSERT_NULL(result->listings);
+    free_fetch_result(result);
+    free_fetch_worker(worker);
+    TEST_ASSERT_EQUAL_size_t(4, mock_reddit_server_stats(server).listings_requests);
+    TEST_ASSERT_EQUAL_size_t(0, mock_reddit_server_stats(server).rate_limited);
+}
+
+void test_too_many_requests_serve_stale_cache(void) {
+    struct mock_reddit_options options = mock_reddit_default_options();
+    options.rate_limit = 1;
+    mock_reddit_server_set_options(server, &options);
+    free_fetch_result(fetch("linux"));
+    // every worker starts out not knowing the limit, so these are sent and answered with 429s
+    struct fetch_result* result = fetch("linux");
+    TEST_ASSERT_EQUAL(SUBREDDIT_ACCESS_OK, result->access);
+    TEST_ASSERT_EQUAL(25, result->listings->count);
+    TEST_ASSERT_TRUE(result->rate_limited);
+    TEST_ASSERT_TRUE(result->offline_cached_at > 0);
+    free_fetch_result(result);
+
+    result = fetch("cpp");
+    TEST_ASSERT_EQUAL(SUBREDDIT_ACCESS_RATE_LIMITED, result->access);
+    TEST_ASSERT_NULL(result->listings);
+    TEST_ASSERT_FALSE(result->rate_limited);
+    free_fetch_result(result);
+    TEST_ASSERT_EQUAL_size_t(2, mock_reddit_server_stats(server).rate_limited);
+}
+
+void test_comments_and_hidden_ones(void) {
+    struct fetch_worker* worker = new_fetch_worker(load_cfg, on_ready, NULL);
+    struct comments_result* result = NULL;
+    fetch_worker_submit_comments(worker, "abc", 1, on_comments_fetched, &result);
+    struct comment_thread* thread = wait_for_comments(&result)->comments;
+    TEST_ASSERT_EQUAL(SUBREDDIT_ACCESS_OK, result->access);
+    // 10 comments, each with a reply and a stub for the branch nested deeper than 2, then a row for the other 20
+    TEST_ASSERT_EQUAL_size_t(31, thread->count);
+    TEST_ASSERT_TRUE(thread->items[2].is_more);
+    TEST_ASSERT_TRUE(thread->items[30].is_more);
+    TEST_ASSERT_EQUAL_size_t(20, thread->items[30].more_count);
+    result->comments = NULL;
+    free_comments_result(result);
+
+    // at most comments.limit of them at once
+    result = NULL;
+    fetch_worker_submit_more_comments(worker, "abc", &thread->items[30], 30, 2, on_comments_fetched, &result);
+    wait_for_comments(&result);
+    TEST_ASSERT_EQUAL(SUBREDDIT_ACCESS_OK, result->access);
+    TEST_ASSERT_EQUAL_UINT(2, result->generation);
+    TEST_ASSERT_EQUAL_size_t(30, result->index);
+    TEST_ASSERT_EQUAL_size_t(10, result->requested);
+    TEST_ASSERT_EQUAL_size_t(30, result->comments->count);
+    TEST_ASSERT_EQUAL_STRING("c10", result->comments->items[0].id);
+    TEST_ASSERT_EQUAL_size_t(10, mock_reddit_server_stats(server).more_comments_ids);
+    replace_more_comments(thread, result->index, result->comments, result->requested);
+    result->comments = NULL;
+    free_comments_result(result);
+    TEST_ASSERT_EQUAL_size_t(61, thread->count);
+    TEST_ASSERT_EQUAL_size_t(10, thread->items[60].more_count);
+    TEST_ASSERT_EQUAL_STRING("c20", thread->items[60].more_ids[0]);
+
+    free_comment_thread(thread);
+    free_fetch_worker(worker);
+}
+
+int main(void) {
+    UNITY_BEGIN();
+    RUN_TEST(test_online_fetch_is_not_offline);
+    RUN_TEST(test_offline_serves_stale_cache);
+    RUN_TEST(test_offline_without_token_serves_stale_cache);
+    RUN_TEST(test_offline_without_cache);
+    RUN_TEST(test_prefetched_sorts_are_served_from_the_cache);
+    RUN_TEST(test_prefetches_wait_and_are_dropped_by_a_new_query);
+    RUN_TEST(test_a_query_submitted_again_while_in_flight_is_fetched_once);
+    RUN_TEST(test_prefetches_back_off_before_the_request_limit);
+    RUN_TEST(test_too_many_requests_serve_stale_cache);
+    RUN_TEST(test_comments_and_hidden_ones);
+    return UNITY_END();
+}
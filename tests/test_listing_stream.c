@@ -0,0 +1,152 @@
+#include "listing_stream.h"
+#include "reddit.h"
+#include "unity.h"
+#include <glib.h>
+#include <string.h>
+
+static const char* const LISTING_RESPONSE =
+    "{\"kind\": \"Listing\", \"data\": {\"after\": \"t3_2\", \"dist\": 2, \"children\": ["
+    "{\"kind\": \"t3\", \"data\": {\"title\": \"First {brace} \\\"quoted\\\"\", \"selftext\": \"]}\", \"ups\": 3,"
+    " \"permalink\": \"/r/test/comments/1/first/\", \"preview\": {\"images\": [{\"id\": \"x\"}]}}},"
+    "{\"kind\": \"t3\", \"data\": {\"title\": \"Second\", \"ups\": 5, \"url\": \"/second\"}}"
+    "], \"before\": null}}";
+
+static struct listings* feed_in_chunks_of(size_t chunk_size) {
+    struct listing_stream* stream = new_listing_stream();
+    size_t size = strlen(LISTING_RESPONSE);
+    for (size_t offset = 0; offset < size; offset += chunk_size) {
+        size_t remaining = size - offset;
+        TEST_ASSERT_TRUE(listing_stream_feed(stream, LISTING_RESPONSE + offset, remaining < chunk_size ? remaining
+                                                                                                      : chunk_size));
+    }
+    struct listings* listings = listing_stream_finish(stream);
+    free_listing_stream(stream);
+    return listings;
+}
+
+static void assert_expected_listings(const struct listings* listings) {
+    TEST_ASSERT_NOT_NULL(listings);
+    TEST_ASSERT_EQUAL_size_t(2, listings->count);
+    TEST_ASSERT_EQUAL_STRING("First {brace} \"quoted\"", listings->items[0].title);
+    char* selftext = listing_selftext(&listings->items[0]);
+    TEST_ASSERT_EQUAL_STRING("]}", selftext);
+    g_free(selftext);
+    TEST_ASSERT_NULL(listing_selftext(&listings->items[1]));
+    TEST_ASSERT_EQUAL_UINT32(3, listings->items[0].ups);
+    TEST_ASSERT_EQUAL_STRING("https://www.reddit.com/r/test/comments/1/first/", listings->items[0].url);
+    TEST_ASSERT_EQUAL_STRING("Second", listings->items[1].title);
+    TEST_ASSERT_EQUAL_STRING("https://www.reddit.com/second", listings->items[1].url);
+    TEST_ASSERT_EQUAL_size_t(1, listings->cursor_count);
+    TEST_ASSERT_EQUAL_STRING("t3_2", listings->cursors[0].after);
+}
+
+void setUp(void) {
+}
+
+void tearDown(void) {
+}
+
+void test_whole_body_at_once(void) {
+    struct listings* listings = feed_in_chunks_of(strlen(LISTING_RESPONSE));
+    assert_expected_listings(listings);
+    free_listings(listings);
+}
+
+void test_byte_by_byte(void) {
+    struct listings* listings = feed_in_chunks_of(1);
+    assert_expected_listings(listings);
+    free_listings(listings);
+}
+
+void test_odd_chunk_sizes(void) {
+    for (size_t chunk_size = 2; chunk_size < 64; chunk_size += 7) {
+        struct listings* listings = feed_in_chunks_of(chunk_size);
+        assert_expected_listings(listings);
+        free_listings(listings);
+    }
+}
+
+void test_truncated_body(void) {
+    struct listing_stream* stream = new_listing_stream();
+    listing_stream_feed(stream, LISTING_RESPONSE, strlen(LISTING_RESPONSE) - 3);
+    TEST_ASSERT_NULL(listing_stream_finish(stream));
+    free_listing_stream(stream);
+}
+
+void test_unbalanced_body(void) {
+    struct listing_stream* stream = new_listing_stream();
+    TEST_ASSERT_FALSE(listing_stream_feed(stream, "{}}", 3));
+    TEST_ASSERT_NULL(listing_stream_finish(stream));
+    free_listing_stream(stream);
+}
+
+void test_last_page_has_no_cursor(void) {
+    static const char* const LAST_PAGE =
+        "{\"data\": {\"after\": null, \"children\": [{\"data\": {\"title\": \"after\", \"after\": \"t3_9\"}}]}}";
+    struct listing_stream* stream = new_listing_stream();
+    TEST_ASSERT_TRUE(listing_stream_feed(stream, LAST_PAGE, strlen(LAST_PAGE)));
+    struct listings* listings = listing_stream_finish(stream);
+    TEST_ASSERT_EQUAL_size_t(1, listings->count);
+    TEST_ASSERT_FALSE(has_more_listings(listings));
+    free_listings(listings);
+    free_listing_stream(stream);
+}
+
+void test_selftext_is_decoded_on_demand(void) {
+    static const char* const SELF_POST =
+        "{\"data\": {\"children\": [{\"data\": {\"selftext\": \"caf\\u00e9 \\\"menu\\\"\\nline two\", \"title\": \"t\","
+        " \"selftext_html\": \"&lt;div&gt;\"}}, {\"data\": {\"title\": \"link\", \"selftext\": null}}]}}";
+    for (size_t chunk_size = 1; chunk_size <= strlen(SELF_POST); chunk_size *= 3) {
+        struct listing_stream* stream = new_listing_stream();
+        for (size_t offset = 0; offset < strlen(SELF_POST); offset += chunk_size) {
+            size_t remaining = strlen(SELF_POST) - offset;
+            listing_stream_feed(stream, SELF_POST + offset, remaining < chunk_size ? remaining : chunk_size);
+        }
+        struct listings* listings = listing_stream_finish(stream);
+        TEST_ASSERT_EQUAL_size_t(2, listings->count);
+        // kept as it was sent until asked for
+        TEST_ASSERT_EQUAL_STRING("caf\\u00e9 \\\"menu\\\"\\nline two", listings->items[0].escaped_selftext);
+        char* selftext = listing_selftext(&listings->items[0]);
+        TEST_ASSERT_EQUAL_STRING("café \"menu\"\nline two", selftext);
+        g_free(selftext);
+        TEST_ASSERT_NULL(listing_selftext(&listings->items[1]));
+        free_listings(listings);
+        free_listing_stream(stream);
+    }
+}
+
+void test_fields_that_arent_shown_are_not_parsed(void) {
+    // malformed values of fields that aren't shown don't matter, they never reach the JSON parser
+    static const char* const UNUSED_FIELDS =
+        "{\"data\": {\"children\": [{\"kind\": \"t3\", \"data\": {\"preview\": {\"images\": [tru]},"
+        " \"title\": \"kept\", \"media\": nul, \"ups\": 7, \"all_awardings\": [1, 2,]}}]}}";
+    struct listing_stream* stream = new_listing_stream();
+    TEST_ASSERT_TRUE(listing_stream_feed(stream, UNUSED_FIELDS, strlen(UNUSED_FIELDS)));
+    struct listings* listings = listing_stream_finish(stream);
+    TEST_ASSERT_EQUAL_size_t(1, listings->count);
+    TEST_ASSERT_EQUAL_STRING("kept", listings->items[0].title);
+    TEST_ASSERT_EQUAL_UINT32(7, listings->items[0].ups);
+    free_listings(listings);
+    free_listing_stream(stream);
+}
+
+void test_deserialize_listings_from_buffer(void) {
+    struct response_buffer resp = {.buffer = (char*)LISTING_RESPONSE, .size = strlen(LISTING_RESPONSE)};
+    struct listings* listings = deserialize_listings(&resp);
+    assert_expected_listings(listings);
+    free_listings(listings);
+}
+
+int main(void) {
+    UNITY_BEGIN();
+    RUN_TEST(test_whole_body_at_once);
+    RUN_TEST(test_byte_by_byte);
+    RUN_TEST(test_odd_chunk_sizes);
+    RUN_TEST(test_truncated_body);
+    RUN_TEST(test_unbalanced_body);
+    RUN_TEST(test_last_page_has_no_cursor);
+    RUN_TEST(test_selftext_is_decoded_on_demand);
+    RUN_TEST(test_fields_that_arent_shown_are_not_parsed);
+    RUN_TEST(test_deserialize_listings_from_buffer);
+    return UNITY_END();
+}
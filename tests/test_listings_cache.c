@@ -0,0 +1,149 @@
+#include "listings_cache.h"
+#include "memory.h"
+#include "reddit.h"
+#include "unity.h"
+#include <glib.h>
+#include <stdlib.h>
+#include <string.h>
+
+static struct rofi_reddit_paths* paths;
+
+static struct listings* new_listings(void) {
+    struct arena* arena = new_arena();
+    struct listing* items = LOG_ERR_MALLOC(struct listing, 2);
+    items[0] = (struct listing){.id = arena_strdup(arena, "1"),
+                                .title = arena_strdup(arena, "First"),
+                                .selftext = arena_strdup(arena, "Some selftext"),
+                                .url = arena_strdup(arena, "https://www.reddit.com/r/test/comments/1/first/"),
+                                .thumbnail_url = arena_strdup(arena, "https://b.thumbs.redditmedia.com/first.jpg"),
+                                .ups = 7};
+    items[1] = (struct listing){.title = arena_strdup(arena, "Second"), .selftext = NULL, .url = NULL, .ups = 0};
+    struct listings* listings = LOG_ERR_MALLOC(struct listings, 1);
+    listings->items = items;
+    listings->count = 2;
+    listings->arena = arena;
+    struct listings_cursor* cursor = arena_alloc(arena, sizeof(*cursor));
+    *cursor = (struct listings_cursor){.subreddit = arena_strdup(arena, "linux"), .after = arena_strdup(arena, "t3_2")};
+    listings->cursors = cursor;
+    listings->cursor_count = 1;
+    return listings;
+}
+
+void setUp(void) {
+    paths = calloc(1, sizeof(struct rofi_reddit_paths));
+    paths->listings_cache_dir = g_dir_make_tmp("rofi-reddit-test-XXXXXX", NULL);
+}
+
+void tearDown(void) {
+    GDir* dir = g_dir_open(paths->listings_cache_dir, 0, NULL);
+    const char* name = NULL;
+    while ((name = g_dir_read_name(dir)) != NULL) {
+        char* path = g_build_filename(paths->listings_cache_dir, name, NULL);
+        remove(path);
+        g_free(path);
+    }
+    g_dir_close(dir);
+    remove(paths->listings_cache_dir);
+    free_rofi_reddit_paths(paths);
+}
+
+void test_miss(void) {
+    TEST_ASSERT_NULL(read_listings_cache(paths, "linux", HOT_LISTINGS_SORT));
+}
+
+void test_round_trip(void) {
+    struct listings* listings = new_listings();
+    TEST_ASSERT_TRUE(write_listings_cache(paths, "linux", HOT_LISTINGS_SORT, listings, "\"abc\""));
+
+    struct cached_listings* cached = read_listings_cache(paths, "Linux", HOT_LISTINGS_SORT);
+    TEST_ASSERT_NOT_NULL(cached);
+    TEST_ASSERT_EQUAL_size_t(2, cached->listings->count);
+    TEST_ASSERT_EQUAL_STRING("First", cached->listings->items[0].title);
+    TEST_ASSERT_EQUAL_STRING("Some selftext", cached->listings->items[0].selftext);
+    TEST_ASSERT_EQUAL_STRING(listings->items[0].url, cached->listings->items[0].url);
+    TEST_ASSERT_EQUAL_UINT32(7, cached->listings->items[0].ups);
+    TEST_ASSERT_EQUAL_STRING(listings->items[0].thumbnail_url, cached->listings->items[0].thumbnail_url);
+    TEST_ASSERT_EQUAL_STRING(listings->items[0].id, cached->listings->items[0].id);
+    TEST_ASSERT_NULL(cached->listings->items[1].id);
+    TEST_ASSERT_NULL(cached->listings->items[1].thumbnail_url);
+    TEST_ASSERT_NULL(cached->listings->items[1].selftext);
+    TEST_ASSERT_NULL(cached->listings->items[1].url);
+    TEST_ASSERT_EQUAL_STRING("\"abc\"", cached->etag);
+    TEST_ASSERT_EQUAL_size_t(1, cached->listings->cursor_count);
+    TEST_ASSERT_EQUAL_STRING("linux", cached->listings->cursors[0].subreddit);
+    TEST_ASSERT_EQUAL_STRING("t3_2", cached->listings->cursors[0].after);
+    TEST_ASSERT_TRUE(is_listings_cache_fresh(cached, 60));
+    TEST_ASSERT_FALSE(is_listings_cache_fresh(cached, 0));
+
+    free_cached_listings(cached);
+    free_listings(listings);
+}
+
+void test_fetched_selftext_is_cached_decoded(void) {
+    struct listings* listings = new_listings();
+    struct listing* fetched = (struct listing*)&listings->items[1];
+    fetched->escaped_selftext = "Line one\\nline \\u00e9";
+    fetched->escaped_selftext_size = strlen(fetched->escaped_selftext);
+    TEST_ASSERT_TRUE(write_listings_cache(paths, "linux", HOT_LISTINGS_SORT, listings, NULL));
+
+    struct cached_listings* cached = read_listings_cache(paths, "linux", HOT_LISTINGS_SORT);
+    TEST_ASSERT_EQUAL_STRING("Line one\nline é", cached->listings->items[1].selftext);
+    free_cached_listings(cached);
+    free_listings(listings);
+}
+
+void test_sorts_are_cached_separately(void) {
+    struct listings* listings = new_listings();
+    TEST_ASSERT_TRUE(write_listings_cache(paths, "linux", HOT_LISTINGS_SORT, listings, NULL));
+    TEST_ASSERT_NULL(read_listings_cache(paths, "linux", "new"));
+    // and so are the time ranges of a sort
+    TEST_ASSERT_TRUE(write_listings_cache(paths, "linux", "top:week", listings, NULL));
+    TEST_ASSERT_NULL(read_listings_cache(paths, "linux", "top:day"));
+    struct cached_listings* cached = read_listings_cache(paths, "linux", "top:week");
+    TEST_ASSERT_NOT_NULL(cached);
+    free_cached_listings(cached);
+    free_listings(listings);
+}
+
+void test_subreddit_cannot_escape_cache_dir(void) {
+    struct listings* listings = new_listings();
+    TEST_ASSERT_TRUE(write_listings_cache(paths, "../../escape", HOT_LISTINGS_SORT, listings, NULL));
+    char* escaped = g_build_filename(paths->listings_cache_dir, "..", "..", "escape.hot.snapshot", NULL);
+    TEST_ASSERT_FALSE(g_file_test(escaped, G_FILE_TEST_EXISTS));
+    g_free(escaped);
+    free_listings(listings);
+}
+
+void test_damaged_entry_is_a_miss(void) {
+    struct listings* listings = new_listings();
+    TEST_ASSERT_TRUE(write_listings_cache(paths, "linux", HOT_LISTINGS_SORT, listings, NULL));
+    char* path = g_build_filename(paths->listings_cache_dir, "linux.hot.snapshot", NULL);
+    TEST_ASSERT_TRUE(g_file_set_contents(path, "{\"version\": 1, \"items\": []}", -1, NULL));
+    TEST_ASSERT_NULL(read_listings_cache(paths, "linux", HOT_LISTINGS_SORT));
+    g_free(path);
+    free_listings(listings);
+}
+
+void test_cached_listings_outlive_a_rewrite(void) {
+    struct listings* listings = new_listings();
+    TEST_ASSERT_TRUE(write_listings_cache(paths, "linux", HOT_LISTINGS_SORT, listings, NULL));
+    struct cached_listings* cached = read_listings_cache(paths, "linux", HOT_LISTINGS_SORT);
+    ((struct listing*)&listings->items[0])->title = "Rewritten";
+    TEST_ASSERT_TRUE(write_listings_cache(paths, "linux", HOT_LISTINGS_SORT, listings, NULL));
+    // still viewing the entry as it was read
+    TEST_ASSERT_EQUAL_STRING("First", cached->listings->items[0].title);
+    free_cached_listings(cached);
+    free_listings(listings);
+}
+
+int main(void) {
+    UNITY_BEGIN();
+    RUN_TEST(test_miss);
+    RUN_TEST(test_round_trip);
+    RUN_TEST(test_fetched_selftext_is_cached_decoded);
+    RUN_TEST(test_sorts_are_cached_separately);
+    RUN_TEST(test_subreddit_cannot_escape_cache_dir);
+    RUN_TEST(test_damaged_entry_is_a_miss);
+    RUN_TEST(test_cached_listings_outlive_a_rewrite);
+    return UNITY_END();
+}
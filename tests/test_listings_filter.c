@@ -0,0 +1,88 @@
+#include "listings_filter.h"
+#include "reddit.h"
+#include "unity.h"
+#include <stddef.h>
+
+static struct listing items[] = {
+    {.title = "Rust Language 2.0 released", .selftext = "The borrow checker got faster"},
+    {.title = "Ask: which C++ compiler?", .selftext = NULL},
+    {.title = "Über-fast builds with meson", .selftext = ""},
+};
+
+static struct listings_filter* filter;
+
+void setUp(void) {
+    filter = new_listings_filter(false);
+    listings_filter_add(filter, items, 3);
+}
+
+void tearDown(void) {
+    free_listings_filter(filter);
+}
+
+static bool matches(const struct listings_filter* against, size_t position, const char* input, bool fuzzy) {
+    struct filter_query* query = new_filter_query(input, fuzzy);
+    bool matched = listings_filter_match(against, position, query);
+    free_filter_query(query);
+    return matched;
+}
+
+void test_substring_ignores_case(void) {
+    TEST_ASSERT_TRUE(matches(filter, 0, "rust LANG", false));
+    TEST_ASSERT_TRUE(matches(filter, 1, "c++", false));
+    TEST_ASSERT_FALSE(matches(filter, 1, "rust", false));
+    TEST_ASSERT_TRUE(matches(filter, 2, "über", false));
+}
+
+void test_every_token_has_to_match(void) {
+    TEST_ASSERT_FALSE(matches(filter, 0, "rust compiler", false));
+}
+
+void test_inverted_token(void) {
+    TEST_ASSERT_FALSE(matches(filter, 0, "-rust", false));
+    TEST_ASSERT_TRUE(matches(filter, 1, "-rust", false));
+    // a lone dash is just a dash
+    TEST_ASSERT_TRUE(matches(filter, 2, "-", false));
+}
+
+void test_fuzzy(void) {
+    TEST_ASSERT_FALSE(matches(filter, 0, "rstlng", false));
+    TEST_ASSERT_TRUE(matches(filter, 0, "rstlng", true));
+    TEST_ASSERT_FALSE(matches(filter, 0, "gnlts", true));
+}
+
+void test_selftext_is_opt_in(void) {
+    TEST_ASSERT_FALSE(matches(filter, 0, "borrow", false));
+    struct listings_filter* with_selftext = new_listings_filter(true);
+    listings_filter_add(with_selftext, items, 3);
+    TEST_ASSERT_TRUE(matches(with_selftext, 0, "borrow", false));
+    free_listings_filter(with_selftext);
+}
+
+void test_fuzzy_stays_within_one_field(void) {
+    struct listings_filter* with_selftext = new_listings_filter(true);
+    listings_filter_add(with_selftext, items, 1);
+    TEST_ASSERT_TRUE(matches(with_selftext, 0, "brwchk", true));
+    // the "d" ending the title followed by "the" starting the selftext
+    TEST_ASSERT_FALSE(matches(with_selftext, 0, "dthe", true));
+    free_listings_filter(with_selftext);
+}
+
+void test_added_pages_follow(void) {
+    listings_filter_add(filter, items, 1);
+    TEST_ASSERT_EQUAL_size_t(4, listings_filter_count(filter));
+    TEST_ASSERT_TRUE(matches(filter, 3, "released", false));
+    TEST_ASSERT_FALSE(matches(filter, 4, "released", false));
+}
+
+int main(void) {
+    UNITY_BEGIN();
+    RUN_TEST(test_substring_ignores_case);
+    RUN_TEST(test_every_token_has_to_match);
+    RUN_TEST(test_inverted_token);
+    RUN_TEST(test_fuzzy);
+    RUN_TEST(test_selftext_is_opt_in);
+    RUN_TEST(test_fuzzy_stays_within_one_field);
+    RUN_TEST(test_added_pages_follow);
+    return UNITY_END();
+}
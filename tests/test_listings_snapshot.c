@@ -0,0 +1,224 @@
+#include "listings_snapshot.h"
+#include "memory.h"
+#include "reddit.h"
+#include "unity.h"
+#include <glib.h>
+#include <stdlib.h>
+#include <string.h>
+
+static const time_t FETCHED_AT = 1700000000;
+// mutated snapshots checked per test, with a fixed seed so that failures reproduce
+static const size_t FUZZ_RUNS = 20000;
+static const guint32 FUZZ_SEED = 20231114;
+
+static struct listings* listings;
+static char* snapshot;
+static size_t snapshot_size;
+
+static struct listings* new_listings(void) {
+    struct arena* arena = new_arena();
+    struct listing* items = LOG_ERR_MALLOC(struct listing, 3);
+    items[0] = (struct listing){.id = arena_strdup(arena, "1"),
+                                .subreddit = arena_strdup(arena, "linux"),
+                                .title = arena_strdup(arena, "First"),
+                                .selftext = arena_strdup(arena, "Some selftext"),
+                                .url = arena_strdup(arena, "https://www.reddit.com/r/linux/comments/1/first/"),
+                                .thumbnail_url = arena_strdup(arena, "https://b.thumbs.redditmedia.com/first.jpg"),
+                                .ups = 7};
+    items[1] = (struct listing){.subreddit = arena_strdup(arena, "linux"), .title = arena_strdup(arena, "Second")};
+    items[2] = (struct listing){.id = arena_strdup(arena, "3"),
+                                .subreddit = arena_strdup(arena, "linux"),
+                                .title = arena_strdup(arena, "Third"),
+                                .escaped_selftext = "Line one\\nline \\u00e9",
+                                .escaped_selftext_size = strlen("Line one\\nline \\u00e9"),
+                                .ups = 4000000000u};
+    struct listings* result = LOG_ERR_MALLOC(struct listings, 1);
+    result->items = items;
+    result->count = 3;
+    result->arena = arena;
+    struct listings_cursor* cursor = arena_alloc(arena, sizeof(*cursor));
+    *cursor = (struct listings_cursor){.subreddit = arena_strdup(arena, "linux"), .after = arena_strdup(arena, "t3_3")};
+    result->cursors = cursor;
+    result->cursor_count = 1;
+    return result;
+}
+
+// Reads every string of the view, so that one pointing past the snapshot shows up, at the latest under a sanitizer.
+static size_t touch_strings(const struct listings* view, const struct listings_snapshot_info* info) {
+    size_t total = info->etag ? strlen(info->etag) : 0;
+    for (size_t i = 0; i < view->count; i++) {
+        const struct listing* item = &view->items[i];
+        const char* strings[] = {item->id, item->subreddit, item->title, item->selftext, item->url,
+                                 item->thumbnail_url};
+        for (size_t s = 0; s < G_N_ELEMENTS(strings); s++) {
+            total += strings[s] ? strlen(strings[s]) : 0;
+        }
+    }
+    for (size_t i = 0; i < view->cursor_count; i++) {
+        total += strlen(view->cursors[i].subreddit) + strlen(view->cursors[i].after);
+    }
+    return total;
+}
+
+// Views a copy of exactly size bytes, so that reading past them is reading past an allocation.
+static struct listings* view_copy(const char* data, size_t size, struct listings_snapshot_info* info, char** copy) {
+    *copy = g_memdup2(data, size);
+    return view_listings_snapshot(*copy, size, info);
+}
+
+void setUp(void) {
+    listings = new_listings();
+    snapshot = new_listings_snapshot(listings, FETCHED_AT, "\"abc\"", &snapshot_size);
+}
+
+void tearDown(void) {
+    g_free(snapshot);
+    free_listings(listings);
+}
+
+void test_round_trip(void) {
+    struct listings_snapshot_info info;
+    struct listings* view = view_listings_snapshot(snapshot, snapshot_size, &info);
+    TEST_ASSERT_NOT_NULL(view);
+    TEST_ASSERT_EQUAL_INT64(FETCHED_AT, info.fetched_at);
+    TEST_ASSERT_EQUAL_STRING("\"abc\"", info.etag);
+    TEST_ASSERT_EQUAL_size_t(3, view->count);
+    TEST_ASSERT_EQUAL_STRING("1", view->items[0].id);
+    TEST_ASSERT_EQUAL_STRING("linux", view->items[0].subreddit);
+    TEST_ASSERT_EQUAL_STRING("First", view->items[0].title);
+    TEST_ASSERT_EQUAL_STRING("Some selftext", view->items[0].selftext);
+    TEST_ASSERT_EQUAL_STRING(listings->items[0].url, view->items[0].url);
+    TEST_ASSERT_EQUAL_STRING(listings->items[0].thumbnail_url, view->items[0].thumbnail_url);
+    TEST_ASSERT_EQUAL_UINT32(7, view->items[0].ups);
+    TEST_ASSERT_NULL(view->items[1].id);
+    TEST_ASSERT_NULL(view->items[1].selftext);
+    TEST_ASSERT_NULL(view->items[1].url);
+    TEST_ASSERT_NULL(view->items[1].thumbnail_url);
+    // fetched selftext is stored decoded
+    TEST_ASSERT_EQUAL_STRING("Line one\nline é", view->items[2].selftext);
+    TEST_ASSERT_NULL(view->items[2].escaped_selftext);
+    TEST_ASSERT_EQUAL_UINT32(4000000000u, view->items[2].ups);
+    TEST_ASSERT_EQUAL_size_t(1, view->cursor_count);
+    TEST_ASSERT_EQUAL_STRING("linux", view->cursors[0].subreddit);
+    TEST_ASSERT_EQUAL_STRING("t3_3", view->cursors[0].after);
+    free_listings(view);
+}
+
+void test_strings_point_into_the_snapshot(void) {
+    struct listings_snapshot_info info;
+    struct listings* view = view_listings_snapshot(snapshot, snapshot_size, &info);
+    for (size_t i = 0; i < view->count; i++) {
+        TEST_ASSERT_TRUE(view->items[i].title >= snapshot && view->items[i].title < snapshot + snapshot_size);
+    }
+    // and repeated ones are stored once
+    TEST_ASSERT_EQUAL_PTR(view->items[0].subreddit, view->items[2].subreddit);
+    TEST_ASSERT_EQUAL_PTR(view->items[0].subreddit, view->cursors[0].subreddit);
+    // nothing is copied but the table of cursors
+    TEST_ASSERT_EQUAL_size_t(sizeof(struct listings_cursor), arena_stats(view->arena).bytes_used);
+    free_listings(view);
+}
+
+void test_empty_listings(void) {
+    struct listings empty = {.items = NULL, .count = 0, .arena = NULL, .cursors = NULL, .cursor_count = 0};
+    size_t size = 0;
+    char* data = new_listings_snapshot(&empty, FETCHED_AT, NULL, &size);
+    struct listings_snapshot_info info;
+    struct listings* view = view_listings_snapshot(data, size, &info);
+    TEST_ASSERT_NOT_NULL(view);
+    TEST_ASSERT_EQUAL_size_t(0, view->count);
+    TEST_ASSERT_FALSE(has_more_listings(view));
+    TEST_ASSERT_NULL(info.etag);
+    free_listings(view);
+    g_free(data);
+}
+
+void test_every_truncation_is_rejected(void) {
+    for (size_t size = 0; size < snapshot_size; size++) {
+        struct listings_snapshot_info info;
+        char* copy = NULL;
+        TEST_ASSERT_NULL(view_copy(snapshot, size, &info, &copy));
+        g_free(copy);
+    }
+}
+
+void test_trailing_bytes_are_rejected(void) {
+    char* longer = g_malloc0(snapshot_size + 1);
+    memcpy(longer, snapshot, snapshot_size);
+    struct listings_snapshot_info info;
+    TEST_ASSERT_NULL(view_listings_snapshot(longer, snapshot_size + 1, &info));
+    g_free(longer);
+}
+
+void test_other_versions_are_rejected(void) {
+    char* copy = g_memdup2(snapshot, snapshot_size);
+    // the version follows the four bytes of magic
+    copy[4] ^= 1;
+    struct listings_snapshot_info info;
+    TEST_ASSERT_NULL(view_listings_snapshot(copy, snapshot_size, &info));
+    g_free(copy);
+}
+
+void test_fuzzed_snapshots_are_rejected_or_stay_in_bounds(void) {
+    GRand* rand = g_rand_new_with_seed(FUZZ_SEED);
+    size_t accepted = 0;
+    for (size_t run = 0; run < FUZZ_RUNS; run++) {
+        char* mutated = g_memdup2(snapshot, snapshot_size);
+        size_t size = snapshot_size;
+        // a few random bytes overwritten, sometimes cut short as well
+        guint32 mutations = (guint32)g_rand_int_range(rand, 1, 5);
+        for (guint32 m = 0; m < mutations; m++) {
+            mutated[g_rand_int_range(rand, 0, (gint32)snapshot_size)] = (char)g_rand_int_range(rand, 0, 256);
+        }
+        if (g_rand_boolean(rand))
+            size = (size_t)g_rand_int_range(rand, 0, (gint32)snapshot_size + 1);
+        struct listings_snapshot_info info;
+        char* copy = NULL;
+        struct listings* view = view_copy(mutated, size, &info, &copy);
+        if (view) {
+            accepted++;
+            touch_strings(view, &info);
+            free_listings(view);
+        }
+        g_free(copy);
+        g_free(mutated);
+    }
+    g_rand_free(rand);
+    // flips inside the strings themselves go unnoticed, that's fine as long as nothing is read out of bounds
+    TEST_ASSERT_TRUE(accepted > 0);
+    TEST_ASSERT_TRUE(accepted < FUZZ_RUNS);
+}
+
+void test_random_bytes_are_rejected_or_stay_in_bounds(void) {
+    GRand* rand = g_rand_new_with_seed(FUZZ_SEED);
+    for (size_t run = 0; run < FUZZ_RUNS; run++) {
+        size_t size = (size_t)g_rand_int_range(rand, 0, 512);
+        char* data = g_malloc(size > 0 ? size : 1);
+        for (size_t i = 0; i < size; i++) {
+            data[i] = (char)g_rand_int_range(rand, 0, 256);
+        }
+        // valid headers make it past the first checks more often
+        if (size >= 4 && g_rand_boolean(rand))
+            memcpy(data, snapshot, MIN(size, 24));
+        struct listings_snapshot_info info;
+        struct listings* view = view_listings_snapshot(data, size, &info);
+        if (view) {
+            touch_strings(view, &info);
+            free_listings(view);
+        }
+        g_free(data);
+    }
+    g_rand_free(rand);
+}
+
+int main(void) {
+    UNITY_BEGIN();
+    RUN_TEST(test_round_trip);
+    RUN_TEST(test_strings_point_into_the_snapshot);
+    RUN_TEST(test_empty_listings);
+    RUN_TEST(test_every_truncation_is_rejected);
+    RUN_TEST(test_trailing_bytes_are_rejected);
+    RUN_TEST(test_other_versions_are_rejected);
+    RUN_TEST(test_fuzzed_snapshots_are_rejected_or_stay_in_bounds);
+    RUN_TEST(test_random_bytes_are_rejected_or_stay_in_bounds);
+    return UNITY_END();
+}
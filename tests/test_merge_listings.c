@@ -0,0 +1,131 @@
+#include "memory.h"
+#include "reddit.h"
+#include "unity.h"
+#include <glib.h>
+#include <stdlib.h>
+
+static struct listings* new_listings(const char* subreddit, const uint32_t* ups, size_t count) {
+    struct arena* arena = new_arena();
+    struct listing* items = LOG_ERR_MALLOC(struct listing, count);
+    for (size_t i = 0; i < count; i++) {
+        items[i] = (struct listing){.subreddit = arena_strdup(arena, subreddit),
+                                    .title = arena_printf(arena, "%s %zu", subreddit, i),
+                                    .selftext = NULL,
+                                    .url = NULL,
+                                    .ups = ups[i]};
+    }
+    struct listings* listings = LOG_ERR_MALLOC(struct listings, 1);
+    listings->items = items;
+    listings->count = count;
+    listings->arena = arena;
+    struct listings_cursor* cursor = arena_alloc(arena, sizeof(*cursor));
+    *cursor = (struct listings_cursor){.subreddit = arena_strdup(arena, subreddit),
+                                       .after = arena_printf(arena, "t3_%s%zu", subreddit, count)};
+    listings->cursors = cursor;
+    listings->cursor_count = 1;
+    return listings;
+}
+
+void setUp(void) {
+}
+
+void tearDown(void) {
+}
+
+void test_hot_order_interleaves_by_rank(void) {
+    struct listings* parts[] = {
+        new_listings("linux", (uint32_t[]){5, 4, 3}, 3),
+        NULL,
+        new_listings("cpp", (uint32_t[]){50}, 1),
+    };
+    struct listings* merged = merge_listings(parts, 3, LISTINGS_MERGE_HOT);
+    TEST_ASSERT_EQUAL_size_t(4, merged->count);
+    TEST_ASSERT_EQUAL_STRING("linux 0", merged->items[0].title);
+    TEST_ASSERT_EQUAL_STRING("cpp 0", merged->items[1].title);
+    TEST_ASSERT_EQUAL_STRING("linux 1", merged->items[2].title);
+    TEST_ASSERT_EQUAL_STRING("linux 2", merged->items[3].title);
+    TEST_ASSERT_EQUAL_size_t(2, merged->cursor_count);
+    TEST_ASSERT_EQUAL_STRING("linux", merged->cursors[0].subreddit);
+    TEST_ASSERT_EQUAL_STRING("t3_cpp1", merged->cursors[1].after);
+    free_listings(merged);
+}
+
+void test_ups_order(void) {
+    struct listings* parts[] = {
+        new_listings("linux", (uint32_t[]){5, 40}, 2),
+        new_listings("cpp", (uint32_t[]){50, 1}, 2),
+    };
+    struct listings* merged = merge_listings(parts, 2, LISTINGS_MERGE_UPS);
+    TEST_ASSERT_EQUAL_size_t(4, merged->count);
+    TEST_ASSERT_EQUAL_UINT32(50, merged->items[0].ups);
+    TEST_ASSERT_EQUAL_UINT32(40, merged->items[1].ups);
+    TEST_ASSERT_EQUAL_UINT32(5, merged->items[2].ups);
+    TEST_ASSERT_EQUAL_UINT32(1, merged->items[3].ups);
+    TEST_ASSERT_EQUAL_STRING("cpp", merged->items[0].subreddit);
+    free_listings(merged);
+}
+
+void test_append_page(void) {
+    struct listings* listings = new_listings("linux", (uint32_t[]){5, 4}, 2);
+    struct listings* page = new_listings("linux", (uint32_t[]){3, 2, 1}, 3);
+    append_listings(listings, page, (const char*[]){"linux", NULL});
+    TEST_ASSERT_EQUAL_size_t(5, listings->count);
+    TEST_ASSERT_EQUAL_STRING("linux 1", listings->items[1].title);
+    TEST_ASSERT_EQUAL_STRING("linux 0", listings->items[2].title);
+    TEST_ASSERT_EQUAL_UINT32(1, listings->items[4].ups);
+    TEST_ASSERT_EQUAL_STRING("t3_linux3", listings->cursors[0].after);
+    TEST_ASSERT_TRUE(has_more_listings(listings));
+
+    struct listings* last_page = new_listings("linux", (uint32_t[]){0}, 1);
+    last_page->cursor_count = 0;
+    append_listings(listings, last_page, (const char*[]){"linux", NULL});
+    TEST_ASSERT_EQUAL_size_t(6, listings->count);
+    TEST_ASSERT_FALSE(has_more_listings(listings));
+    free_listings(listings);
+}
+
+void test_append_page_of_some_subreddits(void) {
+    struct listings* parts[] = {
+        new_listings("linux", (uint32_t[]){5}, 1),
+        new_listings("cpp", (uint32_t[]){4}, 1),
+        new_listings("rust", (uint32_t[]){3}, 1),
+    };
+    struct listings* listings = merge_listings(parts, 3, LISTINGS_MERGE_HOT);
+    // cpp's page failed, rust's was its last
+    struct listings* page_parts[] = {
+        new_listings("linux", (uint32_t[]){2, 1}, 2),
+        new_listings("rust", (uint32_t[]){0}, 1),
+    };
+    page_parts[1]->cursor_count = 0;
+    struct listings* page = merge_listings(page_parts, 2, LISTINGS_MERGE_HOT);
+    append_listings(listings, page, (const char*[]){"linux", "rust", NULL});
+    TEST_ASSERT_EQUAL_size_t(6, listings->count);
+    TEST_ASSERT_EQUAL_size_t(2, listings->cursor_count);
+    TEST_ASSERT_EQUAL_STRING("linux", listings->cursors[0].subreddit);
+    TEST_ASSERT_EQUAL_STRING("t3_linux2", listings->cursors[0].after);
+    TEST_ASSERT_EQUAL_STRING("cpp", listings->cursors[1].subreddit);
+    TEST_ASSERT_EQUAL_STRING("t3_cpp1", listings->cursors[1].after);
+    TEST_ASSERT_TRUE(has_more_listings(listings));
+    free_listings(listings);
+}
+
+void test_split_subreddit_query(void) {
+    size_t count = 0;
+    char** subreddits = split_subreddit_query("linux,,cpp,Linux,rust,", &count);
+    TEST_ASSERT_EQUAL_size_t(3, count);
+    TEST_ASSERT_EQUAL_STRING("linux", subreddits[0]);
+    TEST_ASSERT_EQUAL_STRING("cpp", subreddits[1]);
+    TEST_ASSERT_EQUAL_STRING("rust", subreddits[2]);
+    TEST_ASSERT_NULL(subreddits[3]);
+    g_strfreev(subreddits);
+}
+
+int main(void) {
+    UNITY_BEGIN();
+    RUN_TEST(test_hot_order_interleaves_by_rank);
+    RUN_TEST(test_ups_order);
+    RUN_TEST(test_append_page);
+    RUN_TEST(test_append_page_of_some_subreddits);
+    RUN_TEST(test_split_subreddit_query);
+    return UNITY_END();
+}
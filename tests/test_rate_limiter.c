@@ -0,0 +1,78 @@
+#include "rate_limiter.h"
+#include "unity.h"
+#include <stdlib.h>
+#include <time.h>
+
+static struct rate_limiter* limiter;
+static const time_t NOW = 1700000000;
+
+void setUp(void) {
+    limiter = new_rate_limiter();
+}
+
+void tearDown(void) {
+    free_rate_limiter(limiter);
+}
+
+void test_unknown_budget_allows_everything(void) {
+    TEST_ASSERT_EQUAL_INT64(0, rate_limiter_acquire(limiter, REQUEST_PRIORITY_BACKGROUND, 1000, NOW));
+    // responses without the headers don't change that
+    rate_limiter_update(limiter, -1, -1, -1, false, NOW);
+    TEST_ASSERT_EQUAL_INT64(0, rate_limiter_acquire(limiter, REQUEST_PRIORITY_BACKGROUND, 1000, NOW));
+}
+
+void test_background_requests_leave_a_share_to_the_user(void) {
+    rate_limiter_update(limiter, 70, 30, 300, false, NOW);
+    // 20 of the window of 100 are kept for the user
+    TEST_ASSERT_EQUAL_INT64(300, rate_limiter_acquire(limiter, REQUEST_PRIORITY_BACKGROUND, 11, NOW));
+    TEST_ASSERT_EQUAL_INT64(0, rate_limiter_acquire(limiter, REQUEST_PRIORITY_BACKGROUND, 10, NOW));
+    TEST_ASSERT_EQUAL_INT64(290, rate_limiter_acquire(limiter, REQUEST_PRIORITY_BACKGROUND, 1, NOW + 10));
+    TEST_ASSERT_EQUAL_INT64(0, rate_limiter_acquire(limiter, REQUEST_PRIORITY_USER, 20, NOW + 10));
+    TEST_ASSERT_EQUAL_INT64(290, rate_limiter_acquire(limiter, REQUEST_PRIORITY_USER, 1, NOW + 10));
+}
+
+void test_requests_are_deducted_until_reddit_answers(void) {
+    rate_limiter_update(limiter, 0, 3, 60, false, NOW);
+    TEST_ASSERT_EQUAL_INT64(0, rate_limiter_acquire(limiter, REQUEST_PRIORITY_USER, 2, NOW));
+    TEST_ASSERT_EQUAL_INT64(60, rate_limiter_acquire(limiter, REQUEST_PRIORITY_USER, 2, NOW));
+    TEST_ASSERT_EQUAL_INT64(0, rate_limiter_acquire(limiter, REQUEST_PRIORITY_USER, 1, NOW));
+}
+
+void test_late_responses_dont_give_back_requests(void) {
+    rate_limiter_update(limiter, 8, 2, 60, false, NOW);
+    // answered before the one that said 2 were left
+    rate_limiter_update(limiter, 7, 3, 61, false, NOW);
+    TEST_ASSERT_EQUAL_INT64(0, rate_limiter_acquire(limiter, REQUEST_PRIORITY_USER, 2, NOW));
+    TEST_ASSERT_TRUE(rate_limiter_acquire(limiter, REQUEST_PRIORITY_USER, 1, NOW) > 0);
+}
+
+void test_budget_renews_when_the_window_ends(void) {
+    rate_limiter_update(limiter, 100, 0, 60, false, NOW);
+    TEST_ASSERT_EQUAL_INT64(1, rate_limiter_acquire(limiter, REQUEST_PRIORITY_USER, 1, NOW + 59));
+    TEST_ASSERT_EQUAL_INT64(0, rate_limiter_acquire(limiter, REQUEST_PRIORITY_BACKGROUND, 50, NOW + 60));
+}
+
+void test_too_many_requests_without_headers_back_off(void) {
+    rate_limiter_update(limiter, -1, -1, -1, true, NOW);
+    TEST_ASSERT_EQUAL_INT64(60, rate_limiter_acquire(limiter, REQUEST_PRIORITY_USER, 1, NOW));
+    TEST_ASSERT_EQUAL_INT64(0, rate_limiter_acquire(limiter, REQUEST_PRIORITY_USER, 1, NOW + 60));
+}
+
+void test_too_many_requests_use_up_the_window(void) {
+    // a 429 despite what the last response said, e.g. because another client shares the app's budget
+    rate_limiter_update(limiter, 50, 50, 200, false, NOW);
+    rate_limiter_update(limiter, 100, 5, 120, true, NOW);
+    TEST_ASSERT_EQUAL_INT64(120, rate_limiter_acquire(limiter, REQUEST_PRIORITY_USER, 1, NOW));
+}
+
+int main(void) {
+    UNITY_BEGIN();
+    RUN_TEST(test_unknown_budget_allows_everything);
+    RUN_TEST(test_background_requests_leave_a_share_to_the_user);
+    RUN_TEST(test_requests_are_deducted_until_reddit_answers);
+    RUN_TEST(test_late_responses_dont_give_back_requests);
+    RUN_TEST(test_budget_renews_when_the_window_ends);
+    RUN_TEST(test_too_many_requests_without_headers_back_off);
+    RUN_TEST(test_too_many_requests_use_up_the_window);
+    return UNITY_END();
+}
@@ -0,0 +1,135 @@
+#include "request_timing.h"
+#include "unity.h"
+#include <glib.h>
+#include <jansson.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static char* dir;
+static char* log_path;
+static char* histogram_path;
+
+void setUp(void) {
+    dir = g_dir_make_tmp("rofi-reddit-test-XXXXXX", NULL);
+    log_path = g_build_filename(dir, "timings.jsonl", NULL);
+    histogram_path = g_build_filename(dir, "timings.json", NULL);
+}
+
+void tearDown(void) {
+    remove(log_path);
+    remove(histogram_path);
+    remove(dir);
+    g_free(log_path);
+    g_free(histogram_path);
+    g_free(dir);
+}
+
+static struct request_timing timing_of(int64_t total_us) {
+    return (struct request_timing){.dns_us = total_us / 10,
+                                   .connect_us = total_us / 10,
+                                   .tls_us = total_us / 5,
+                                   .first_byte_us = total_us / 2,
+                                   .transfer_us = total_us - total_us / 10 * 2 - total_us / 5 - total_us / 2,
+                                   .total_us = total_us,
+                                   .deserialize_us = total_us / 20,
+                                   .bytes = 1000};
+}
+
+// Within the quarter doubling a histogram bucket spans.
+static void assert_close(int64_t expected, int64_t actual) {
+    TEST_ASSERT_TRUE(actual >= expected * 3 / 4 && actual <= expected * 5 / 4);
+}
+
+void test_no_summary_before_the_first_listings(void) {
+    struct timing_log* log = new_timing_log(NULL, NULL);
+    TEST_ASSERT_NULL(timing_log_summary(log));
+    TEST_ASSERT_TRUE(timing_log_percentile(log, TIMED_REQUEST_LISTINGS, TIMING_PHASE_TOTAL, 0.5) < 0);
+    struct request_timing timing = timing_of(100000);
+    timing_log_record(log, TIMED_REQUEST_ACCESS_TOKEN, NULL, HTTP_OK, &timing);
+    TEST_ASSERT_NULL(timing_log_summary(log));
+    free_timing_log(log);
+}
+
+void test_percentiles(void) {
+    struct timing_log* log = new_timing_log(NULL, NULL);
+    // 90 fast requests and 10 slow ones
+    for (int i = 0; i < 100; i++) {
+        struct request_timing timing = timing_of(i < 90 ? 200000 : 2000000);
+        timing_log_record(log, TIMED_REQUEST_LISTINGS, "linux", HTTP_OK, &timing);
+    }
+    assert_close(200000, timing_log_percentile(log, TIMED_REQUEST_LISTINGS, TIMING_PHASE_TOTAL, 0.5));
+    assert_close(2000000, timing_log_percentile(log, TIMED_REQUEST_LISTINGS, TIMING_PHASE_TOTAL, 0.95));
+    assert_close(100000, timing_log_percentile(log, TIMED_REQUEST_LISTINGS, TIMING_PHASE_FIRST_BYTE, 0.5));
+    TEST_ASSERT_TRUE(timing_log_percentile(log, TIMED_REQUEST_ACCESS_TOKEN, TIMING_PHASE_TOTAL, 0.5) < 0);
+
+    char* summary = timing_log_summary(log);
+    TEST_ASSERT_NOT_NULL(summary);
+    TEST_ASSERT_TRUE(g_str_has_prefix(summary, "r/linux took 2000 ms: DNS 200, connect 200, TLS 400, waiting 1000"));
+    g_free(summary);
+    free_timing_log(log);
+}
+
+void test_histograms_carry_over_sessions(void) {
+    struct timing_log* log = new_timing_log(NULL, histogram_path);
+    struct request_timing timing = timing_of(300000);
+    timing_log_record(log, TIMED_REQUEST_LISTINGS, "linux", HTTP_OK, &timing);
+    free_timing_log(log);
+
+    log = new_timing_log(NULL, histogram_path);
+    assert_close(300000, timing_log_percentile(log, TIMED_REQUEST_LISTINGS, TIMING_PHASE_TOTAL, 0.5));
+    free_timing_log(log);
+}
+
+void test_old_requests_fade(void) {
+    struct timing_log* log = new_timing_log(NULL, NULL);
+    struct request_timing slow = timing_of(4000000);
+    struct request_timing fast = timing_of(100000);
+    for (int i = 0; i < 1000; i++) {
+        timing_log_record(log, TIMED_REQUEST_LISTINGS, "linux", HTTP_OK, &slow);
+    }
+    // fewer than the slow ones, but they came last
+    for (int i = 0; i < 800; i++) {
+        timing_log_record(log, TIMED_REQUEST_LISTINGS, "linux", HTTP_OK, &fast);
+    }
+    assert_close(100000, timing_log_percentile(log, TIMED_REQUEST_LISTINGS, TIMING_PHASE_TOTAL, 0.5));
+    free_timing_log(log);
+}
+
+void test_log_lines(void) {
+    struct timing_log* log = new_timing_log(log_path, NULL);
+    struct request_timing timing = timing_of(100000);
+    timing_log_record(log, TIMED_REQUEST_ACCESS_TOKEN, NULL, HTTP_OK, &timing);
+    timing_log_record(log, TIMED_REQUEST_LISTINGS, "linux", HTTP_FORBIDDEN, &timing);
+    free_timing_log(log);
+
+    char* contents = NULL;
+    TEST_ASSERT_TRUE(g_file_get_contents(log_path, &contents, NULL, NULL));
+    char** lines = g_strsplit(contents, "\n", -1);
+    TEST_ASSERT_EQUAL(3, g_strv_length(lines));
+    TEST_ASSERT_EQUAL_STRING("", lines[2]);
+    json_t* token_line = json_loads(lines[0], 0, NULL);
+    TEST_ASSERT_EQUAL_STRING("access_token", json_string_value(json_object_get(token_line, "request")));
+    TEST_ASSERT_NULL(json_object_get(token_line, "subreddit"));
+    json_t* listings_line = json_loads(lines[1], 0, NULL);
+    TEST_ASSERT_EQUAL_STRING("listings", json_string_value(json_object_get(listings_line, "request")));
+    TEST_ASSERT_EQUAL_STRING("linux", json_string_value(json_object_get(listings_line, "subreddit")));
+    TEST_ASSERT_EQUAL(403, json_integer_value(json_object_get(listings_line, "status")));
+    TEST_ASSERT_EQUAL(50000, json_integer_value(json_object_get(listings_line, "first_byte_us")));
+    TEST_ASSERT_EQUAL(5000, json_integer_value(json_object_get(listings_line, "deserialize_us")));
+    TEST_ASSERT_EQUAL(1000, json_integer_value(json_object_get(listings_line, "bytes")));
+    json_decref(token_line);
+    json_decref(listings_line);
+    g_strfreev(lines);
+    g_free(contents);
+}
+
+int main(void) {
+    UNITY_BEGIN();
+    RUN_TEST(test_no_summary_before_the_first_listings);
+    RUN_TEST(test_percentiles);
+    RUN_TEST(test_histograms_carry_over_sessions);
+    RUN_TEST(test_old_requests_fade);
+    RUN_TEST(test_log_lines);
+    return UNITY_END();
+}
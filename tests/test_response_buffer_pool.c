@@ -0,0 +1,92 @@
+#include "curl_wrappers.h"
+#include "unity.h"
+#include <stdlib.h>
+#include <string.h>
+
+static struct response_buffer_pool* pool;
+
+void setUp(void) {
+    pool = new_response_buffer_pool();
+}
+
+void tearDown(void) {
+    free_response_buffer_pool(pool);
+}
+
+static void write_bytes(struct response_buffer* resp, char byte, size_t size) {
+    char* chunk = malloc(size);
+    memset(chunk, byte, size);
+    TEST_ASSERT_EQUAL(size, write_to_response_buffer(chunk, 1, size, resp));
+    free(chunk);
+}
+
+void test_empty_buffer_is_a_string(void) {
+    struct response_buffer* resp = acquire_response_buffer(pool);
+    TEST_ASSERT_EQUAL(0, resp->size);
+    TEST_ASSERT_EQUAL_STRING("", resp->buffer);
+    release_response_buffer(pool, resp);
+}
+
+void test_capacity_doubles(void) {
+    struct response_buffer* resp = acquire_response_buffer(pool);
+    size_t initial = resp->capacity;
+    write_bytes(resp, 'a', initial);
+    TEST_ASSERT_EQUAL(2 * initial, resp->capacity);
+    // many small chunks only grow it a few more times
+    for (int i = 0; i < 100; i++) {
+        write_bytes(resp, 'b', 100);
+    }
+    TEST_ASSERT_EQUAL(initial + 100 * 100, resp->size);
+    TEST_ASSERT_EQUAL(4 * initial, resp->capacity);
+    TEST_ASSERT_EQUAL('a', resp->buffer[0]);
+    TEST_ASSERT_EQUAL('b', resp->buffer[resp->size - 1]);
+    TEST_ASSERT_EQUAL('\0', resp->buffer[resp->size]);
+    release_response_buffer(pool, resp);
+}
+
+void test_released_buffers_are_reused_with_their_capacity(void) {
+    struct response_buffer* resp = acquire_response_buffer(pool);
+    write_bytes(resp, 'a', 3 * resp->capacity);
+    size_t grown = resp->capacity;
+    release_response_buffer(pool, resp);
+
+    struct response_buffer* reused = acquire_response_buffer(pool);
+    TEST_ASSERT_EQUAL_PTR(resp, reused);
+    TEST_ASSERT_EQUAL(0, reused->size);
+    TEST_ASSERT_EQUAL_STRING("", reused->buffer);
+    TEST_ASSERT_EQUAL(grown, reused->capacity);
+    release_response_buffer(pool, reused);
+
+    struct response_buffer_pool_stats stats = response_buffer_pool_stats(pool);
+    TEST_ASSERT_EQUAL(2, stats.acquired);
+    TEST_ASSERT_EQUAL(1, stats.reused);
+    TEST_ASSERT_EQUAL(grown, stats.high_water_mark);
+}
+
+void test_huge_buffers_are_not_kept(void) {
+    struct response_buffer* resp = acquire_response_buffer(pool);
+    write_bytes(resp, 'a', 4 * 1024 * 1024);
+    release_response_buffer(pool, resp);
+    struct response_buffer* fresh = acquire_response_buffer(pool);
+    TEST_ASSERT_TRUE(fresh->capacity < 4 * 1024 * 1024);
+    TEST_ASSERT_EQUAL(0, response_buffer_pool_stats(pool).reused);
+    TEST_ASSERT_TRUE(response_buffer_pool_stats(pool).high_water_mark > 4 * 1024 * 1024);
+    release_response_buffer(pool, fresh);
+}
+
+void test_without_pool(void) {
+    struct response_buffer* resp = acquire_response_buffer(NULL);
+    write_bytes(resp, 'a', 10);
+    TEST_ASSERT_EQUAL(10, resp->size);
+    release_response_buffer(NULL, resp);
+}
+
+int main(void) {
+    UNITY_BEGIN();
+    RUN_TEST(test_empty_buffer_is_a_string);
+    RUN_TEST(test_capacity_doubles);
+    RUN_TEST(test_released_buffers_are_reused_with_their_capacity);
+    RUN_TEST(test_huge_buffers_are_not_kept);
+    RUN_TEST(test_without_pool);
+    return UNITY_END();
+}
@@ -0,0 +1,253 @@
+#include "reddit.h"
+#include "search_index.h"
+#include "unity.h"
+#include <glib.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// more than the log holds before it is merged in the background
+static const size_t MANY_THREADS = 2500;
+// damaged index files checked, with a fixed seed so that failures reproduce
+static const size_t FUZZ_RUNS = 300;
+static const guint32 FUZZ_SEED = 20240601;
+
+static char* dir;
+static char* index_path;
+static struct search_index* search;
+
+static struct listing thread(char* id, char* title, char* selftext, uint32_t ups) {
+    return (struct listing){.id = id,
+                            .subreddit = "linux",
+                            .title = title,
+                            .selftext = selftext,
+                            .url = "https://www.reddit.com/r/linux/comments/1/",
+                            .ups = ups};
+}
+
+static void add_threads(struct search_index* to) {
+    struct listing items[] = {
+        thread("1", "Kernel 6.9 released", "Lots of new drivers.", 10),
+        thread("2", "Which distro for an old laptop?", "My kernel panics on boot.", 50),
+        thread("3", "Über tiling window managers", NULL, 5),
+        thread("4", "Rust in the kernel", "Drivers written in Rust are merged.", 7),
+    };
+    TEST_ASSERT_TRUE(search_index_add(to, items, 4));
+}
+
+static size_t count_matches(struct search_index* in, const char* query) {
+    struct listings* results = search_index_query(in, query, MANY_THREADS);
+    size_t count = results->count;
+    free_listings(results);
+    return count;
+}
+
+static void remove_dir(void) {
+    GDir* handle = g_dir_open(dir, 0, NULL);
+    const char* name = NULL;
+    while ((name = g_dir_read_name(handle)) != NULL) {
+        char* path = g_build_filename(dir, name, NULL);
+        remove(path);
+        g_free(path);
+    }
+    g_dir_close(handle);
+    remove(dir);
+}
+
+void setUp(void) {
+    dir = g_dir_make_tmp("rofi-reddit-test-XXXXXX", NULL);
+    index_path = g_build_filename(dir, "threads.idx", NULL);
+    search = new_search_index(dir);
+    TEST_ASSERT_NOT_NULL(search);
+}
+
+void tearDown(void) {
+    free_search_index(search);
+    remove_dir();
+    g_free(index_path);
+    g_free(dir);
+}
+
+void test_empty_index_finds_nothing(void) {
+    TEST_ASSERT_EQUAL_size_t(0, count_matches(search, "kernel"));
+    TEST_ASSERT_EQUAL_size_t(0, count_matches(search, ""));
+}
+
+void test_words_match_title_and_selftext_regardless_of_case(void) {
+    add_threads(search);
+    TEST_ASSERT_EQUAL_size_t(3, count_matches(search, "KERNEL "));
+    TEST_ASSERT_EQUAL_size_t(2, count_matches(search, "drivers "));
+    TEST_ASSERT_EQUAL_size_t(1, count_matches(search, "über"));
+    TEST_ASSERT_EQUAL_size_t(1, count_matches(search, "ÜBER"));
+    // punctuation only separates words
+    TEST_ASSERT_EQUAL_size_t(1, count_matches(search, "laptop?"));
+}
+
+void test_every_word_has_to_match(void) {
+    add_threads(search);
+    struct listings* results = search_index_query(search, "rust kernel", 100);
+    TEST_ASSERT_EQUAL_size_t(1, results->count);
+    TEST_ASSERT_EQUAL_STRING("4", results->items[0].id);
+    TEST_ASSERT_EQUAL_STRING("Rust in the kernel", results->items[0].title);
+    TEST_ASSERT_EQUAL_STRING("linux", results->items[0].subreddit);
+    TEST_ASSERT_NOT_NULL(results->items[0].url);
+    TEST_ASSERT_EQUAL_UINT32(7, results->items[0].ups);
+    free_listings(results);
+    TEST_ASSERT_EQUAL_size_t(0, count_matches(search, "rust laptop"));
+}
+
+void test_title_matches_rank_above_selftext_matches(void) {
+    add_threads(search);
+    struct listings* results = search_index_query(search, "kernel ", 100);
+    TEST_ASSERT_EQUAL_size_t(3, results->count);
+    // the thread with more upvotes only mentions it in its text
+    TEST_ASSERT_EQUAL_STRING("2", results->items[2].id);
+    free_listings(results);
+}
+
+void test_last_word_matches_as_prefix_while_typing(void) {
+    add_threads(search);
+    TEST_ASSERT_EQUAL_size_t(3, count_matches(search, "kern"));
+    TEST_ASSERT_EQUAL_size_t(0, count_matches(search, "kern "));
+    TEST_ASSERT_EQUAL_size_t(1, count_matches(search, "rust ker"));
+    // too short to match as a prefix
+    TEST_ASSERT_EQUAL_size_t(0, count_matches(search, "k"));
+}
+
+void test_results_are_capped(void) {
+    add_threads(search);
+    struct listings* results = search_index_query(search, "kernel", 2);
+    TEST_ASSERT_EQUAL_size_t(2, results->count);
+    free_listings(results);
+}
+
+void test_later_version_replaces_earlier(void) {
+    add_threads(search);
+    struct listing edited = thread("1", "Kernel 6.10 released", NULL, 99);
+    TEST_ASSERT_TRUE(search_index_add(search, &edited, 1));
+    TEST_ASSERT_EQUAL_size_t(0, count_matches(search, "drivers lots"));
+    struct listings* results = search_index_query(search, "6 10", 100);
+    TEST_ASSERT_EQUAL_size_t(1, results->count);
+    TEST_ASSERT_EQUAL_UINT32(99, results->items[0].ups);
+    free_listings(results);
+}
+
+void test_threads_without_id_are_skipped(void) {
+    struct listing anonymous = thread(NULL, "Kernel without an id", NULL, 1);
+    TEST_ASSERT_TRUE(search_index_add(search, &anonymous, 1));
+    TEST_ASSERT_EQUAL_size_t(0, count_matches(search, "kernel"));
+}
+
+void test_merging_keeps_every_thread(void) {
+    add_threads(search);
+    TEST_ASSERT_TRUE(search_index_compact(search));
+    TEST_ASSERT_TRUE(g_file_test(index_path, G_FILE_TEST_EXISTS));
+    // nothing left to merge
+    TEST_ASSERT_FALSE(search_index_compact(search));
+    TEST_ASSERT_EQUAL_size_t(3, count_matches(search, "kernel"));
+    TEST_ASSERT_EQUAL_size_t(1, count_matches(search, "rust kernel"));
+
+    struct listing edited = thread("4", "Rust in userspace", NULL, 8);
+    TEST_ASSERT_TRUE(search_index_add(search, &edited, 1));
+    TEST_ASSERT_EQUAL_size_t(0, count_matches(search, "rust kernel"));
+    TEST_ASSERT_TRUE(search_index_compact(search));
+    TEST_ASSERT_EQUAL_size_t(0, count_matches(search, "rust kernel"));
+    TEST_ASSERT_EQUAL_size_t(1, count_matches(search, "rust userspace"));
+    TEST_ASSERT_EQUAL_size_t(2, count_matches(search, "kernel"));
+}
+
+void test_index_survives_a_restart(void) {
+    add_threads(search);
+    TEST_ASSERT_TRUE(search_index_compact(search));
+    struct listing newer = thread("5", "Kernel regressions", NULL, 1);
+    TEST_ASSERT_TRUE(search_index_add(search, &newer, 1));
+    free_search_index(search);
+    search = new_search_index(dir);
+    TEST_ASSERT_EQUAL_size_t(4, count_matches(search, "kernel"));
+}
+
+void test_additions_of_other_processes_are_picked_up(void) {
+    struct search_index* other = new_search_index(dir);
+    TEST_ASSERT_EQUAL_size_t(0, count_matches(search, "kernel"));
+    add_threads(other);
+    TEST_ASSERT_EQUAL_size_t(3, count_matches(search, "kernel"));
+    TEST_ASSERT_TRUE(search_index_compact(other));
+    TEST_ASSERT_EQUAL_size_t(3, count_matches(search, "kernel"));
+    struct listing newer = thread("5", "Kernel regressions", NULL, 1);
+    TEST_ASSERT_TRUE(search_index_add(other, &newer, 1));
+    TEST_ASSERT_EQUAL_size_t(4, count_matches(search, "kernel"));
+    free_search_index(other);
+}
+
+void test_log_is_merged_in_the_background(void) {
+    struct listing* items = g_new(struct listing, MANY_THREADS);
+    char** ids = g_new(char*, MANY_THREADS);
+    for (size_t i = 0; i < MANY_THREADS; i++) {
+        ids[i] = g_strdup_printf("t%zu", i);
+        items[i] = thread(ids[i], i % 2 == 0 ? "Even kernel" : "Odd kernel", NULL, (uint32_t)i);
+    }
+    TEST_ASSERT_TRUE(search_index_add(search, items, MANY_THREADS));
+    // waits for the merge
+    free_search_index(search);
+    TEST_ASSERT_TRUE(g_file_test(index_path, G_FILE_TEST_EXISTS));
+    search = new_search_index(dir);
+    TEST_ASSERT_EQUAL_size_t(MANY_THREADS / 2, count_matches(search, "even kernel"));
+    // equally good matches go by upvotes
+    struct listings* results = search_index_query(search, "odd", 1);
+    TEST_ASSERT_EQUAL_STRING(ids[MANY_THREADS - 1], results->items[0].id);
+    free_listings(results);
+    for (size_t i = 0; i < MANY_THREADS; i++) {
+        g_free(ids[i]);
+    }
+    g_free(ids);
+    g_free(items);
+}
+
+void test_damaged_index_files_are_ignored_or_stay_in_bounds(void) {
+    add_threads(search);
+    TEST_ASSERT_TRUE(search_index_compact(search));
+    char* contents = NULL;
+    gsize size = 0;
+    TEST_ASSERT_TRUE(g_file_get_contents(index_path, &contents, &size, NULL));
+    GRand* rand = g_rand_new_with_seed(FUZZ_SEED);
+    for (size_t run = 0; run < FUZZ_RUNS; run++) {
+        char* damaged = g_memdup2(contents, size);
+        gsize damaged_size = run % 3 == 0 ? (gsize)g_rand_int_range(rand, 0, (gint32)size) : size;
+        guint32 flips = (guint32)g_rand_int_range(rand, 1, 5);
+        for (guint32 flip = 0; flip < flips; flip++) {
+            damaged[g_rand_int_range(rand, 0, (gint32)size)] = (char)g_rand_int_range(rand, 0, 256);
+        }
+        TEST_ASSERT_TRUE(g_file_set_contents(index_path, damaged, (gssize)damaged_size, NULL));
+        struct search_index* reader = new_search_index(dir);
+        const char* queries[] = {"kernel", "rust ker", "drivers", "über", "distro laptop"};
+        for (size_t q = 0; q < G_N_ELEMENTS(queries); q++) {
+            struct listings* results = search_index_query(reader, queries[q], 10);
+            for (size_t i = 0; i < results->count; i++) {
+                TEST_ASSERT_NOT_NULL(results->items[i].title);
+            }
+            free_listings(results);
+        }
+        free_search_index(reader);
+        g_free(damaged);
+    }
+    g_rand_free(rand);
+    g_free(contents);
+}
+
+int main(void) {
+    UNITY_BEGIN();
+    RUN_TEST(test_empty_index_finds_nothing);
+    RUN_TEST(test_words_match_title_and_selftext_regardless_of_case);
+    RUN_TEST(test_every_word_has_to_match);
+    RUN_TEST(test_title_matches_rank_above_selftext_matches);
+    RUN_TEST(test_last_word_matches_as_prefix_while_typing);
+    RUN_TEST(test_results_are_capped);
+    RUN_TEST(test_later_version_replaces_earlier);
+    RUN_TEST(test_threads_without_id_are_skipped);
+    RUN_TEST(test_merging_keeps_every_thread);
+    RUN_TEST(test_index_survives_a_restart);
+    RUN_TEST(test_additions_of_other_processes_are_picked_up);
+    RUN_TEST(test_log_is_merged_in_the_background);
+    RUN_TEST(test_damaged_index_files_are_ignored_or_stay_in_bounds);
+    return UNITY_END();
+}
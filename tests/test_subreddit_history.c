@@ -0,0 +1,154 @@
+#include "subreddit_history.h"
+#include "unity.h"
+#include <glib.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+static const time_t NOW = 1700000000;
+static const time_t DAY = 24 * 60 * 60;
+
+static char* dir;
+static char* history_path;
+
+void setUp(void) {
+    dir = g_dir_make_tmp("rofi-reddit-test-XXXXXX", NULL);
+    history_path = g_build_filename(dir, "history", NULL);
+}
+
+void tearDown(void) {
+    remove(history_path);
+    remove(dir);
+    g_free(history_path);
+    g_free(dir);
+}
+
+static size_t count_lines(void) {
+    char* contents = NULL;
+    TEST_ASSERT_TRUE(g_file_get_contents(history_path, &contents, NULL, NULL));
+    size_t lines = 0;
+    for (const char* c = contents; *c; c++) {
+        lines += *c == '\n';
+    }
+    g_free(contents);
+    return lines;
+}
+
+void test_missing_history_is_empty(void) {
+    struct subreddit_history* history = new_subreddit_history(history_path);
+    TEST_ASSERT_EQUAL_size_t(0, subreddit_history_count(history));
+    TEST_ASSERT_NULL(subreddit_history_name(history, 0));
+    free_subreddit_history(history);
+}
+
+void test_recent_visits_rank_first(void) {
+    struct subreddit_history* history = new_subreddit_history(history_path);
+    TEST_ASSERT_TRUE(subreddit_history_visit(history, "linux", NOW - 2 * DAY));
+    TEST_ASSERT_TRUE(subreddit_history_visit(history, "cpp", NOW - DAY));
+    TEST_ASSERT_TRUE(subreddit_history_visit(history, "rust", NOW));
+    TEST_ASSERT_EQUAL_size_t(3, subreddit_history_count(history));
+    TEST_ASSERT_EQUAL_STRING("rust", subreddit_history_name(history, 0));
+    TEST_ASSERT_EQUAL_STRING("cpp", subreddit_history_name(history, 1));
+    TEST_ASSERT_EQUAL_STRING("linux", subreddit_history_name(history, 2));
+    free_subreddit_history(history);
+}
+
+void test_frequent_visits_outrank_a_recent_one(void) {
+    struct subreddit_history* history = new_subreddit_history(history_path);
+    TEST_ASSERT_TRUE(subreddit_history_visit(history, "rust", NOW));
+    for (int i = 0; i < 5; i++) {
+        TEST_ASSERT_TRUE(subreddit_history_visit(history, "linux", NOW - 3 * DAY + i));
+    }
+    TEST_ASSERT_EQUAL_STRING("linux", subreddit_history_name(history, 0));
+    // but not forever, old visits count less and less
+    TEST_ASSERT_TRUE(subreddit_history_visit(history, "cpp", NOW + 60 * DAY));
+    TEST_ASSERT_EQUAL_STRING("cpp", subreddit_history_name(history, 0));
+    free_subreddit_history(history);
+}
+
+void test_names_are_case_insensitive(void) {
+    struct subreddit_history* history = new_subreddit_history(history_path);
+    TEST_ASSERT_TRUE(subreddit_history_visit(history, "linux", NOW));
+    TEST_ASSERT_TRUE(subreddit_history_visit(history, "Linux", NOW));
+    TEST_ASSERT_TRUE(subreddit_history_visit(history, "linux,cpp", NOW));
+    TEST_ASSERT_EQUAL_size_t(2, subreddit_history_count(history));
+    TEST_ASSERT_EQUAL_STRING("Linux", subreddit_history_name(history, 0));
+    free_subreddit_history(history);
+}
+
+void test_invalid_names_are_not_recorded(void) {
+    struct subreddit_history* history = new_subreddit_history(history_path);
+    TEST_ASSERT_FALSE(subreddit_history_visit(history, "", NOW));
+    TEST_ASSERT_FALSE(subreddit_history_visit(history, "not a name", NOW));
+    TEST_ASSERT_FALSE(subreddit_history_visit(history, "line\nbreak", NOW));
+    TEST_ASSERT_EQUAL_size_t(0, subreddit_history_count(history));
+    free_subreddit_history(history);
+}
+
+void test_reopened_history_keeps_ranks(void) {
+    struct subreddit_history* history = new_subreddit_history(history_path);
+    TEST_ASSERT_TRUE(subreddit_history_visit(history, "linux", NOW - DAY));
+    TEST_ASSERT_TRUE(subreddit_history_visit(history, "linux", NOW - DAY));
+    TEST_ASSERT_TRUE(subreddit_history_visit(history, "rust", NOW));
+    TEST_ASSERT_TRUE(subreddit_history_visit(history, "cpp", NOW - 2 * DAY));
+    free_subreddit_history(history);
+    history = new_subreddit_history(history_path);
+    TEST_ASSERT_EQUAL_size_t(3, subreddit_history_count(history));
+    TEST_ASSERT_EQUAL_STRING("linux", subreddit_history_name(history, 0));
+    TEST_ASSERT_EQUAL_STRING("rust", subreddit_history_name(history, 1));
+    TEST_ASSERT_EQUAL_STRING("cpp", subreddit_history_name(history, 2));
+    free_subreddit_history(history);
+}
+
+void test_file_is_compacted_to_a_line_per_subreddit(void) {
+    struct subreddit_history* history = new_subreddit_history(history_path);
+    for (int i = 0; i < 1000; i++) {
+        TEST_ASSERT_TRUE(subreddit_history_visit(history, i % 3 == 0 ? "linux" : "rust", NOW + i));
+    }
+    TEST_ASSERT_TRUE(count_lines() < 300);
+    free_subreddit_history(history);
+    history = new_subreddit_history(history_path);
+    TEST_ASSERT_EQUAL_size_t(2, subreddit_history_count(history));
+    TEST_ASSERT_EQUAL_STRING("rust", subreddit_history_name(history, 0));
+    free_subreddit_history(history);
+}
+
+void test_least_frecent_are_forgotten(void) {
+    struct subreddit_history* history = new_subreddit_history(history_path);
+    for (int i = 0; i < 500; i++) {
+        char* name = g_strdup_printf("sub%d", i);
+        TEST_ASSERT_TRUE(subreddit_history_visit(history, name, NOW + i));
+        g_free(name);
+    }
+    TEST_ASSERT_TRUE(subreddit_history_count(history) < 500);
+    TEST_ASSERT_EQUAL_STRING("sub499", subreddit_history_name(history, 0));
+    free_subreddit_history(history);
+}
+
+void test_damaged_lines_are_skipped(void) {
+    const char* contents = "1700000000.000\tlinux\n"
+                           "garbage\n"
+                           "1700000000\tnot a name\n"
+                           "nan\trust\n"
+                           "1700000100.5\tcpp\n"
+                           "1700000200\tcut_sh";
+    TEST_ASSERT_TRUE(g_file_set_contents(history_path, contents, -1, NULL));
+    struct subreddit_history* history = new_subreddit_history(history_path);
+    TEST_ASSERT_EQUAL_size_t(2, subreddit_history_count(history));
+    TEST_ASSERT_EQUAL_STRING("cpp", subreddit_history_name(history, 0));
+    TEST_ASSERT_EQUAL_STRING("linux", subreddit_history_name(history, 1));
+    free_subreddit_history(history);
+}
+
+int main(void) {
+    UNITY_BEGIN();
+    RUN_TEST(test_missing_history_is_empty);
+    RUN_TEST(test_recent_visits_rank_first);
+    RUN_TEST(test_frequent_visits_outrank_a_recent_one);
+    RUN_TEST(test_names_are_case_insensitive);
+    RUN_TEST(test_invalid_names_are_not_recorded);
+    RUN_TEST(test_reopened_history_keeps_ranks);
+    RUN_TEST(test_file_is_compacted_to_a_line_per_subreddit);
+    RUN_TEST(test_least_frecent_are_forgotten);
+    RUN_TEST(test_damaged_lines_are_skipped);
+    return UNITY_END();
+}
@@ -0,0 +1,160 @@
+#include "subreddit_index.h"
+#include "unity.h"
+#include <glib.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+static char* dir;
+static char* index_path;
+static char* list_path;
+
+void setUp(void) {
+    dir = g_dir_make_tmp("rofi-reddit-test-XXXXXX", NULL);
+    index_path = g_build_filename(dir, "subreddits.idx", NULL);
+    list_path = g_build_filename(dir, "subreddits.txt", NULL);
+}
+
+void tearDown(void) {
+    remove(index_path);
+    remove(list_path);
+    remove(dir);
+    g_free(index_path);
+    g_free(list_path);
+    g_free(dir);
+}
+
+static struct subreddit_index* new_seeded_index(void) {
+    struct subreddit_index* index = new_subreddit_index(index_path);
+    const char* names[] = {"linux", "cpp", "linux_gaming", "Linux4Noobs", "rust", "LINUX", "not a name", "lisp"};
+    TEST_ASSERT_TRUE(subreddit_index_add(index, names, 8));
+    return index;
+}
+
+void test_missing_index_is_empty(void) {
+    struct subreddit_index* index = new_subreddit_index(index_path);
+    TEST_ASSERT_EQUAL_size_t(0, subreddit_index_count(index));
+    size_t first = 1;
+    size_t last = 1;
+    subreddit_index_find_prefix(index, "li", &first, &last);
+    TEST_ASSERT_EQUAL_size_t(first, last);
+    free_subreddit_index(index);
+}
+
+void test_names_are_sorted_and_deduplicated(void) {
+    struct subreddit_index* index = new_seeded_index();
+    TEST_ASSERT_EQUAL_size_t(6, subreddit_index_count(index));
+    TEST_ASSERT_EQUAL_STRING("cpp", subreddit_index_name(index, 0));
+    TEST_ASSERT_EQUAL_STRING("linux", subreddit_index_name(index, 1));
+    TEST_ASSERT_EQUAL_STRING("Linux4Noobs", subreddit_index_name(index, 2));
+    TEST_ASSERT_EQUAL_STRING("linux_gaming", subreddit_index_name(index, 3));
+    TEST_ASSERT_TRUE(subreddit_index_contains(index, "RUST"));
+    TEST_ASSERT_FALSE(subreddit_index_contains(index, "rus"));
+    free_subreddit_index(index);
+}
+
+void test_prefix_lookup(void) {
+    struct subreddit_index* index = new_seeded_index();
+    size_t first = 0;
+    size_t last = 0;
+    subreddit_index_find_prefix(index, "LIN", &first, &last);
+    TEST_ASSERT_EQUAL_size_t(1, first);
+    TEST_ASSERT_EQUAL_size_t(4, last);
+    subreddit_index_find_prefix(index, "li", &first, &last);
+    TEST_ASSERT_EQUAL_size_t(5, last);
+    subreddit_index_find_prefix(index, "go", &first, &last);
+    TEST_ASSERT_EQUAL_size_t(first, last);
+    subreddit_index_find_prefix(index, "", &first, &last);
+    TEST_ASSERT_EQUAL_size_t(0, first);
+    TEST_ASSERT_EQUAL_size_t(6, last);
+    free_subreddit_index(index);
+}
+
+void test_reopened_index_keeps_names(void) {
+    free_subreddit_index(new_seeded_index());
+    struct subreddit_index* index = new_subreddit_index(index_path);
+    TEST_ASSERT_EQUAL_size_t(6, subreddit_index_count(index));
+    TEST_ASSERT_TRUE(subreddit_index_contains(index, "lisp"));
+    free_subreddit_index(index);
+}
+
+void test_import_list(void) {
+    TEST_ASSERT_TRUE(g_file_set_contents(list_path, "r/linux\n/r/cpp\n  rust,123456\n\nhaskell 42\n", -1, NULL));
+    struct subreddit_index* index = new_subreddit_index(index_path);
+    TEST_ASSERT_TRUE(subreddit_index_import(index, list_path));
+    TEST_ASSERT_EQUAL_size_t(4, subreddit_index_count(index));
+    TEST_ASSERT_TRUE(subreddit_index_contains(index, "haskell"));
+    TEST_ASSERT_TRUE(subreddit_index_contains(index, "rust"));
+    free_subreddit_index(index);
+}
+
+static void on_updated(void* user_data) {
+    (*(int*)user_data)++;
+}
+
+void test_background_update(void) {
+    TEST_ASSERT_TRUE(g_file_set_contents(list_path, "r/linux\nr/cpp\n", -1, NULL));
+    struct subreddit_index* index = new_subreddit_index(index_path);
+    const char* names[] = {"rust", "RUST", "not a name"};
+    int updates = 0;
+    subreddit_index_add_in_background(index, names, 3, list_path, on_updated, &updates);
+    // nothing is swapped in before the main loop runs
+    TEST_ASSERT_EQUAL_size_t(0, subreddit_index_count(index));
+    while (updates == 0) {
+        g_main_context_iteration(NULL, TRUE);
+    }
+    TEST_ASSERT_EQUAL_size_t(3, subreddit_index_count(index));
+    TEST_ASSERT_TRUE(subreddit_index_contains(index, "rust"));
+    // right after a rewrite the next names wait for a later one, freeing the index writes them
+    const char* later[] = {"haskell"};
+    subreddit_index_add_in_background(index, later, 1, NULL, on_updated, &updates);
+    TEST_ASSERT_FALSE(subreddit_index_contains(index, "haskell"));
+    free_subreddit_index(index);
+    TEST_ASSERT_EQUAL(1, updates);
+    index = new_subreddit_index(index_path);
+    TEST_ASSERT_EQUAL_size_t(4, subreddit_index_count(index));
+    TEST_ASSERT_TRUE(subreddit_index_contains(index, "haskell"));
+    free_subreddit_index(index);
+}
+
+void test_damaged_index_is_ignored(void) {
+    free_subreddit_index(new_seeded_index());
+    gchar* contents = NULL;
+    gsize size = 0;
+    TEST_ASSERT_TRUE(g_file_get_contents(index_path, &contents, &size, NULL));
+    // cut off the end of the string heap
+    TEST_ASSERT_TRUE(g_file_set_contents(index_path, contents, (gssize)size - 3, NULL));
+    g_free(contents);
+    struct subreddit_index* index = new_subreddit_index(index_path);
+    TEST_ASSERT_EQUAL_size_t(0, subreddit_index_count(index));
+    free_subreddit_index(index);
+}
+
+void test_many_names(void) {
+    struct subreddit_index* index = new_subreddit_index(index_path);
+    size_t count = 200000;
+    char** names = g_new0(char*, count + 1);
+    for (size_t i = 0; i < count; i++) {
+        names[i] = g_strdup_printf("sub%06zu", i);
+    }
+    TEST_ASSERT_TRUE(subreddit_index_add(index, (const char* const*)names, count));
+    g_strfreev(names);
+    size_t first = 0;
+    size_t last = 0;
+    subreddit_index_find_prefix(index, "sub1234", &first, &last);
+    TEST_ASSERT_EQUAL_size_t(100, last - first);
+    TEST_ASSERT_EQUAL_STRING("sub123400", subreddit_index_name(index, first));
+    free_subreddit_index(index);
+}
+
+int main(void) {
+    UNITY_BEGIN();
+    RUN_TEST(test_missing_index_is_empty);
+    RUN_TEST(test_names_are_sorted_and_deduplicated);
+    RUN_TEST(test_prefix_lookup);
+    RUN_TEST(test_reopened_index_keeps_names);
+    RUN_TEST(test_import_list);
+    RUN_TEST(test_background_update);
+    RUN_TEST(test_damaged_index_is_ignored);
+    RUN_TEST(test_many_names);
+    return UNITY_END();
+}
@@ -0,0 +1,139 @@
+#include "thumbnail_cache.h"
+#include "unity.h"
+#include <glib.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static char* dir;
+static struct thumbnail_cache* cache;
+
+static const char* const FIRST = "https://b.thumbs.redditmedia.com/first.jpg";
+static const char* const SECOND = "https://b.thumbs.redditmedia.com/second.jpg";
+static const char* const THIRD = "https://b.thumbs.redditmedia.com/third.jpg";
+
+static void store(const char* url, const char* data) {
+    TEST_ASSERT_TRUE(thumbnail_cache_store(cache, url, data, strlen(data)));
+}
+
+static void assert_cached(const char* url, const char* data) {
+    char* path = thumbnail_cache_lookup(cache, url);
+    TEST_ASSERT_NOT_NULL(path);
+    char* contents = NULL;
+    TEST_ASSERT_TRUE(g_file_get_contents(path, &contents, NULL, NULL));
+    TEST_ASSERT_EQUAL_STRING(data, contents);
+    g_free(contents);
+    g_free(path);
+}
+
+static size_t files_in_dir(void) {
+    GDir* handle = g_dir_open(dir, 0, NULL);
+    size_t count = 0;
+    while (g_dir_read_name(handle)) {
+        count++;
+    }
+    g_dir_close(handle);
+    return count;
+}
+
+void setUp(void) {
+    dir = g_dir_make_tmp("rofi-reddit-test-XXXXXX", NULL);
+    cache = new_thumbnail_cache(dir, 10);
+    TEST_ASSERT_NOT_NULL(cache);
+}
+
+void tearDown(void) {
+    free_thumbnail_cache(cache);
+    GDir* handle = g_dir_open(dir, 0, NULL);
+    const char* name = NULL;
+    while ((name = g_dir_read_name(handle)) != NULL) {
+        char* path = g_build_filename(dir, name, NULL);
+        remove(path);
+        g_free(path);
+    }
+    g_dir_close(handle);
+    remove(dir);
+    g_free(dir);
+}
+
+void test_miss(void) {
+    TEST_ASSERT_NULL(thumbnail_cache_lookup(cache, FIRST));
+}
+
+void test_store_and_lookup(void) {
+    store(FIRST, "aaaa");
+    assert_cached(FIRST, "aaaa");
+    struct thumbnail_cache_stats stats = thumbnail_cache_stats(cache);
+    TEST_ASSERT_EQUAL_size_t(1, stats.count);
+    TEST_ASSERT_EQUAL_size_t(4, stats.bytes);
+}
+
+void test_file_keeps_the_image_extension(void) {
+    store("https://b.thumbs.redditmedia.com/a.JPG?width=140&s=abc", "a");
+    store("https://b.thumbs.redditmedia.com/image", "b");
+    char* with_extension = thumbnail_cache_lookup(cache, "https://b.thumbs.redditmedia.com/a.JPG?width=140&s=abc");
+    TEST_ASSERT_TRUE(g_str_has_suffix(with_extension, ".jpg"));
+    char* without_extension = thumbnail_cache_lookup(cache, "https://b.thumbs.redditmedia.com/image");
+    TEST_ASSERT_NULL(strchr(strrchr(without_extension, '/'), '.'));
+    g_free(with_extension);
+    g_free(without_extension);
+}
+
+void test_least_recently_used_is_evicted(void) {
+    store(FIRST, "aaaa");
+    store(SECOND, "bbbb");
+    // now used more recently than SECOND
+    g_free(thumbnail_cache_lookup(cache, FIRST));
+    store(THIRD, "cccc");
+    TEST_ASSERT_NULL(thumbnail_cache_lookup(cache, SECOND));
+    assert_cached(FIRST, "aaaa");
+    assert_cached(THIRD, "cccc");
+    struct thumbnail_cache_stats stats = thumbnail_cache_stats(cache);
+    TEST_ASSERT_EQUAL_size_t(2, stats.count);
+    TEST_ASSERT_EQUAL_size_t(8, stats.bytes);
+    TEST_ASSERT_EQUAL_size_t(1, stats.evicted);
+    TEST_ASSERT_EQUAL_size_t(2, files_in_dir());
+}
+
+void test_image_larger_than_the_cache_is_kept_alone(void) {
+    store(FIRST, "aaaa");
+    store(SECOND, "bbbbbbbbbbbbbbbbbbbb");
+    TEST_ASSERT_NULL(thumbnail_cache_lookup(cache, FIRST));
+    assert_cached(SECOND, "bbbbbbbbbbbbbbbbbbbb");
+    TEST_ASSERT_EQUAL_size_t(1, thumbnail_cache_stats(cache).count);
+}
+
+void test_storing_again_replaces_the_image(void) {
+    store(FIRST, "aaaa");
+    store(FIRST, "aa");
+    assert_cached(FIRST, "aa");
+    TEST_ASSERT_EQUAL_size_t(2, thumbnail_cache_stats(cache).bytes);
+}
+
+void test_images_survive_a_restart(void) {
+    store(FIRST, "aaaa");
+    store(SECOND, "bbbb");
+    free_thumbnail_cache(cache);
+    cache = new_thumbnail_cache(dir, 10);
+    assert_cached(FIRST, "aaaa");
+    assert_cached(SECOND, "bbbb");
+    TEST_ASSERT_EQUAL_size_t(8, thumbnail_cache_stats(cache).bytes);
+
+    // a smaller cache is trimmed as soon as it is opened
+    free_thumbnail_cache(cache);
+    cache = new_thumbnail_cache(dir, 5);
+    TEST_ASSERT_EQUAL_size_t(1, thumbnail_cache_stats(cache).count);
+    TEST_ASSERT_EQUAL_size_t(1, files_in_dir());
+}
+
+int main(void) {
+    UNITY_BEGIN();
+    RUN_TEST(test_miss);
+    RUN_TEST(test_store_and_lookup);
+    RUN_TEST(test_file_keeps_the_image_extension);
+    RUN_TEST(test_least_recently_used_is_evicted);
+    RUN_TEST(test_image_larger_than_the_cache_is_kept_alone);
+    RUN_TEST(test_storing_again_replaces_the_image);
+    RUN_TEST(test_images_survive_a_restart);
+    return UNITY_END();
+}
@@ -0,0 +1,134 @@
+#include "mock_reddit_server.h"
+#include "reddit.h"
+#include "thumbnail_cache.h"
+#include "thumbnail_fetcher.h"
+#include "unity.h"
+#include <glib.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static struct mock_reddit_server* server;
+static char* cache_dir;
+static char* thumbnails_dir;
+static struct rofi_reddit_cfg* cfg;
+static struct thumbnail_cache* cache;
+static struct thumbnail_fetcher* fetcher;
+static size_t done;
+static size_t cached;
+
+static void on_done(const char* url, bool was_cached, void* user_data) {
+    done++;
+    if (was_cached)
+        cached++;
+}
+
+static void wait_for(size_t callbacks) {
+    while (done < callbacks) {
+        g_main_context_iteration(NULL, TRUE);
+    }
+}
+
+void setUp(void) {
+    struct mock_reddit_options options = mock_reddit_default_options();
+    server = new_mock_reddit_server(&options);
+    TEST_ASSERT_NOT_NULL(server);
+    cache_dir = g_dir_make_tmp("rofi-reddit-test-XXXXXX", NULL);
+    thumbnails_dir = g_build_filename(cache_dir, "thumbnails", NULL);
+    cfg = new_mock_reddit_cfg(server, cache_dir);
+    cache = new_thumbnail_cache(thumbnails_dir, (size_t)cfg->thumbnails.cache_size_mb * 1024 * 1024);
+    fetcher = new_thumbnail_fetcher(cfg, cache, on_done, NULL);
+    TEST_ASSERT_NOT_NULL(fetcher);
+    done = 0;
+    cached = 0;
+}
+
+void tearDown(void) {
+    free_thumbnail_fetcher(fetcher);
+    free_thumbnail_cache(cache);
+    free_rofi_reddit_cfg(cfg);
+    free_mock_reddit_server(server);
+    remove_files_in(thumbnails_dir);
+    remove(thumbnails_dir);
+    remove_files_in(cache_dir);
+    remove(cache_dir);
+    g_free(thumbnails_dir);
+    g_free(cache_dir);
+}
+
+void test_downloaded_thumbnail_is_cached(void) {
+    char* url = mock_reddit_thumbnail_url(server, "first.jpg");
+    TEST_ASSERT_NULL(thumbnail_cache_lookup(cache, url));
+    thumbnail_fetcher_request(fetcher, url);
+    wait_for(1);
+    TEST_ASSERT_EQUAL_size_t(1, cached);
+
+    char* path = thumbnail_cache_lookup(cache, url);
+    TEST_ASSERT_NOT_NULL(path);
+    char* contents = NULL;
+    size_t size = 0;
+    TEST_ASSERT_TRUE(g_file_get_contents(path, &contents, &size, NULL));
+    char* expected = mock_reddit_thumbnail("first.jpg");
+    TEST_ASSERT_EQUAL_size_t(strlen(expected), size);
+    TEST_ASSERT_EQUAL_MEMORY(expected, contents, size);
+    g_free(expected);
+    g_free(contents);
+    g_free(path);
+    g_free(url);
+}
+
+void test_repeated_requests_download_once(void) {
+    char* url = mock_reddit_thumbnail_url(server, "first.jpg");
+    // rows are redrawn while the image is on its way
+    thumbnail_fetcher_request(fetcher, url);
+    thumbnail_fetcher_request(fetcher, url);
+    thumbnail_fetcher_request(fetcher, url);
+    wait_for(1);
+    // any extra callback would be delivered by now
+    while (g_main_context_iteration(NULL, FALSE)) {
+    }
+    TEST_ASSERT_EQUAL_size_t(1, done);
+    TEST_ASSERT_EQUAL_size_t(1, mock_reddit_server_stats(server).thumbnail_requests);
+    g_free(url);
+}
+
+void test_failed_thumbnail_is_not_retried(void) {
+    char* url = mock_reddit_thumbnail_url(server, "missing.jpg");
+    thumbnail_fetcher_request(fetcher, url);
+    wait_for(1);
+    TEST_ASSERT_EQUAL_size_t(0, cached);
+    TEST_ASSERT_NULL(thumbnail_cache_lookup(cache, url));
+
+    thumbnail_fetcher_request(fetcher, url);
+    while (g_main_context_iteration(NULL, FALSE)) {
+    }
+    TEST_ASSERT_EQUAL_size_t(1, done);
+    TEST_ASSERT_EQUAL_size_t(1, mock_reddit_server_stats(server).thumbnail_requests);
+    g_free(url);
+}
+
+void test_several_thumbnails(void) {
+    const char* names[] = {"a.jpg", "b.png", "c.jpg", "d.jpg", "e.png", "f.jpg"};
+    const size_t count = sizeof(names) / sizeof(names[0]);
+    char* urls[sizeof(names) / sizeof(names[0])];
+    for (size_t i = 0; i < count; i++) {
+        urls[i] = mock_reddit_thumbnail_url(server, names[i]);
+        thumbnail_fetcher_request(fetcher, urls[i]);
+    }
+    wait_for(count);
+    TEST_ASSERT_EQUAL_size_t(count, cached);
+    TEST_ASSERT_EQUAL_size_t(count, thumbnail_cache_stats(cache).count);
+    for (size_t i = 0; i < count; i++) {
+        g_free(urls[i]);
+    }
+}
+
+int main(void) {
+    UNITY_BEGIN();
+    RUN_TEST(test_downloaded_thumbnail_is_cached);
+    RUN_TEST(test_repeated_requests_download_once);
+    RUN_TEST(test_failed_thumbnail_is_not_retried);
+    RUN_TEST(test_several_thumbnails);
+    return UNITY_END();
+}